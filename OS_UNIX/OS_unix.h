@@ -6,11 +6,18 @@
 #define SQLITELIKE_OS_UNIX_H
 
 
+#include <pthread.h>
+#include <vector>
 #include "../tinySQL_VFS.h"
 #include "../tinySQL_def.h"
+#include "../tinySQL_Clock.h"
+#include "../tinySQL_LockProfile.h"
+#include "../tinySQL_ThreadPool.h"
 
 namespace tinySQL {
     class UnixVFS final : public tinySQL_VFS {
+    private:
+        int GetTempName(int nBuf, char *zBuf);
     public:
 
         int xOpen(const char *zName, tinySQL_file **ppFile,
@@ -34,6 +41,8 @@ namespace tinySQL {
 
         int xSleep(int microseconds) override;
 
+        int xSleepNs(uint64_t ns) override;
+
         int xCurrentTime(double *pTime) override;
 
         int xGetLastError(int, char *) override;
@@ -41,18 +50,34 @@ namespace tinySQL {
 
         int xCurrentTimeInt64(unsigned long *pOutTime) override;
 
+        int xWallTimeNs(uint64_t *pNs) override;
+
+        int xMonotonicTime(uint64_t *pNs) override;
+
 
         UnixVFS(int version, int maxPathNameLength, std::string name,
                 void *pAppData = nullptr);
     };
 
+    //a descriptor no UnixFile owns.pending ones were closed while the process
+    //held locks on the file,which closing them would have dropped;cached ones
+    //wait for the next xOpen of the file
+    struct UnixUnusedFd {
+        int fd;
+        int accessMode;             //O_RDONLY or O_RDWR
+        bool bCache;
+    };
+
     struct UnixINode {
     private:
-        std::list<int> unusedFd;
+        std::list<UnixUnusedFd> unusedFd;
+
+        static void Erase(UnixINode *pInode);
+        static void Trim();
     public:
         dev_t dev;
         ino_t ino;
-        pthread_mutex_t lockMutex;
+        ProfiledMutex lockMutex;
         int nShared;
         int nLock;
         unsigned char eFileLock;
@@ -60,23 +85,30 @@ namespace tinySQL {
         int nRef;
 
 
-        void Lock();
+        void Lock(const char *zSite = __builtin_FUNCTION());
         void Unlock();
         void ClosePendingFds();
-        void SetPendingFd(int fd);
         UnixINode(dev_t dev, ino_t ino);
         ~UnixINode();
 
         static UnixINode* UnixINodeFind(dev_t dev,ino_t ino);
-        static void UnixInodeRelease(UnixINode *pInode);
-
+        //fd is given back with the reference,it is kept for reuse when bCache
+        static void UnixInodeRelease(UnixINode *pInode, int fd, int accessMode, bool bCache);
+        //a cached descriptor of the file opened with accessMode and a reference
+        //to its inode in *ppInode,-1 when there is none
+        static int UnixINodeReuse(dev_t dev, ino_t ino, int accessMode, UnixINode **ppInode);
+        //the file was deleted,its cached descriptors are closed
+        static void UnixINodeForget(dev_t dev, ino_t ino);
+        //most descriptors cached over all files,the least recently released go
+        //first.returns the old limit,n < 0 only reads it
+        static int UnusedFdLimit(int n);
     };
 
 
     class UnixFile : public tinySQL_file {
     private:
         static int ProcessFileLockSet(int fd, short l_type, off_t l_start, off_t l_length);
-        static int SeekAndWriteFd(int fd, long offset, const void *pBuffer,long writeCount, int *piErrno);
+        static int PositionalWriteFd(int fd, long offset, const void *pBuffer,long writeCount, int *piErrno);
         static int FcntlSizeHint(UnixFile *pFile, long nByte);
         static void ModeBit(UnixFile *pFile, unsigned char mask, int *pArg);
         static const char *TempFileDir();
@@ -88,6 +120,7 @@ namespace tinySQL {
         unsigned char eFileLock;
         unsigned short ctrlFlags;
         int lastErrno;
+        int accessMode;
         int sectorSize;
         int chunkSize;
 
@@ -115,9 +148,102 @@ namespace tinySQL {
 
         int xDeviceCharacteristics() override;
 
-        UnixFile(std::string pathName, int fd,UnixVFS *pVFS);
+        //pInode is already referenced when given,the file is not looked at then
+        UnixFile(std::string pathName, int fd, UnixVFS *pVFS, int accessMode, UnixINode *pInode = nullptr,
+                 int sectorSize = 0);
+
+
+    };
+
+    //one logical file striped over files in several directories,
+    //stripe i holds logical blocks i,i+N,i+2N... of stripeUnit bytes
+    class StripeVFS final : public tinySQL_VFS {
+    public:
+        tinySQL_VFS *const pBase;
+        const std::vector<std::string> dirs;
+        const long stripeUnit;
+        ThreadPool *pPool;
+
+        std::string StripePath(const char *zName, int iStripe) const;
+
+        int xOpen(const char *zName, tinySQL_file **ppFile,
+                  int flags, int *pOutFlags) override;
+
+        int xDelete(const char *zName) override;
+
+        int xAccess(const char *zName, int flags, int *pResOut) override;
+
+        int xFullPathname(const char *zName, int nOut, char *zOut) override;
+
+        void *xDlOpen(const char *zFilename) override;
+
+        void xDlError(int nByte, char *zErrMsg) override;
+
+        void xDlClose(void *) override;
+
+        int xRandomness(int nByte, char *zOut) override;
+
+        int xSleep(int microseconds) override;
+
+        int xSleepNs(uint64_t ns) override;
+
+        int xCurrentTime(double *pTime) override;
+
+        int xGetLastError(int, char *) override;
+
+        int xCurrentTimeInt64(unsigned long *pOutTime) override;
+
+        int xWallTimeNs(uint64_t *pNs) override;
+
+        int xMonotonicTime(uint64_t *pNs) override;
+
+        //nIOThread == 0 keeps all stripe I/O on the caller's thread
+        StripeVFS(std::string name, tinySQL_VFS *pBase, std::vector<std::string> dirs,
+                  long stripeUnit, int nIOThread);
+        ~StripeVFS();
+    };
+
+    class StripeFile : public tinySQL_file {
+    private:
+        struct Chunk {
+            long stripeOffset;
+            long count;
+            long bufferOffset;
+        };
+
+        std::vector<std::vector<Chunk>> MapRange(long count, long offset) const;
+        long StripeSize(int iStripe, long logicalSize) const;
+        int RunChunks(const std::vector<std::vector<Chunk>> &chunks,
+                      const std::function<int(int, const Chunk &)> &xChunk);
+    public:
+        StripeVFS *const pVFS;
+        std::vector<tinySQL_file *> stripes;
+
+        int xClose() override;
+
+        int xRead(void *pBuff, long readCount, long offset) override;
+
+        int xWrite(const void *pBuff, long writeCount, long offset) override;
 
+        int xTruncate(long size) override;
+
+        int xSync(int flags) override;
+
+        int xFileSize(unsigned long *pSize) override;
+
+        int xLock(int eFileLock) override;
+
+        int xUnlock(int eFileLock) override;
+
+        int xCheckReservedLock(int *pResOut) override;
+
+        int xFileControl(int op, void *pArg) override;
+
+        int xSectorSize() override;
+
+        int xDeviceCharacteristics() override;
 
+        StripeFile(StripeVFS *pVFS, std::vector<tinySQL_file *> stripes);
     };
 
 
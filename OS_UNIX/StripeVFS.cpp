@@ -0,0 +1,314 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include "OS_unix.h"
+
+namespace tinySQL {
+
+    std::string StripeVFS::StripePath(const char *zName, int iStripe) const {
+        const char *zLeaf = strrchr(zName, '/');
+        zLeaf = zLeaf ? zLeaf + 1 : zName;
+        return dirs[iStripe] + "/" + zLeaf + "-stripe" + std::to_string(iStripe);
+    }
+
+    int StripeVFS::xOpen(const char *zName, tinySQL_file **ppFile, int flags, int *pOutFlags) {
+        assert(ppFile);
+        std::vector<tinySQL_file *> stripes;
+        int status = Succeed;
+
+        //without a name every stripe is a temporary file of the base VFS
+        for (int i = 0; i < static_cast<int>(dirs.size()); i++) {
+            tinySQL_file *pStripe = nullptr;
+            std::string path = zName ? StripePath(zName, i) : std::string();
+            status = pBase->xOpen(zName ? path.c_str() : nullptr, &pStripe, flags, i == 0 ? pOutFlags : nullptr);
+            if (status != Succeed)
+                break;
+            stripes.push_back(pStripe);
+        }
+        if (status != Succeed) {
+            for (auto pStripe: stripes)
+                pStripe->xClose();
+            return status;
+        }
+        *ppFile = new StripeFile(this, std::move(stripes));
+        return Succeed;
+    }
+
+    int StripeVFS::xDelete(const char *zName) {
+        int status = Succeed;
+        for (int i = 0; i < static_cast<int>(dirs.size()); i++) {
+            int rc = pBase->xDelete(StripePath(zName, i).c_str());
+            if (i == 0)
+                status = rc;
+        }
+        return status;
+    }
+
+    int StripeVFS::xAccess(const char *zName, int flags, int *pResOut) {
+        return pBase->xAccess(StripePath(zName, 0).c_str(), flags, pResOut);
+    }
+
+    int StripeVFS::xFullPathname(const char *zName, int nOut, char *zOut) {
+        return pBase->xFullPathname(zName, nOut, zOut);
+    }
+
+    void *StripeVFS::xDlOpen(const char *zFilename) {
+        return pBase->xDlOpen(zFilename);
+    }
+
+    void StripeVFS::xDlError(int nByte, char *zErrMsg) {
+        pBase->xDlError(nByte, zErrMsg);
+    }
+
+    void StripeVFS::xDlClose(void *pHandle) {
+        pBase->xDlClose(pHandle);
+    }
+
+    int StripeVFS::xRandomness(int nByte, char *zOut) {
+        return pBase->xRandomness(nByte, zOut);
+    }
+
+    int StripeVFS::xSleep(int microseconds) {
+        return pBase->xSleep(microseconds);
+    }
+
+    int StripeVFS::xSleepNs(uint64_t ns) {
+        return pBase->xSleepNs(ns);
+    }
+
+    int StripeVFS::xCurrentTime(double *pTime) {
+        return pBase->xCurrentTime(pTime);
+    }
+
+    int StripeVFS::xGetLastError(int nByte, char *zErrMsg) {
+        return pBase->xGetLastError(nByte, zErrMsg);
+    }
+
+    int StripeVFS::xCurrentTimeInt64(unsigned long *pOutTime) {
+        return pBase->xCurrentTimeInt64(pOutTime);
+    }
+
+    int StripeVFS::xWallTimeNs(uint64_t *pNs) {
+        return pBase->xWallTimeNs(pNs);
+    }
+
+    int StripeVFS::xMonotonicTime(uint64_t *pNs) {
+        return pBase->xMonotonicTime(pNs);
+    }
+
+    StripeVFS::StripeVFS(std::string name, tinySQL_VFS *pBase, std::vector<std::string> dirs,
+                         long stripeUnit, int nIOThread) :
+            tinySQL_VFS(pBase->iVersion, pBase->mxPathName, std::move(name), nullptr),
+            pBase(pBase), dirs(std::move(dirs)), stripeUnit(stripeUnit), pPool(nullptr) {
+        assert(!this->dirs.empty());
+        assert(stripeUnit > 0);
+        if (nIOThread > 0)
+            pPool = new ThreadPool(nIOThread);
+    }
+
+    StripeVFS::~StripeVFS() {
+        delete pPool;
+    }
+
+
+    std::vector<std::vector<StripeFile::Chunk>> StripeFile::MapRange(long count, long offset) const {
+        auto nStripe = static_cast<long>(stripes.size());
+        long unit = pVFS->stripeUnit;
+        std::vector<std::vector<Chunk>> chunks(nStripe);
+        long done = 0;
+
+        while (done < count) {
+            long block = (offset + done) / unit;
+            long inBlock = (offset + done) % unit;
+            long n = std::min(unit - inBlock, count - done);
+            chunks[block % nStripe].push_back({(block / nStripe) * unit + inBlock, n, done});
+            done += n;
+        }
+        return chunks;
+    }
+
+    long StripeFile::StripeSize(int iStripe, long logicalSize) const {
+        auto nStripe = static_cast<long>(stripes.size());
+        long unit = pVFS->stripeUnit;
+        long nFull = logicalSize / unit;
+        long size = (nFull / nStripe) * unit;
+        if (iStripe < nFull % nStripe)
+            size += unit;
+        else if (iStripe == nFull % nStripe)
+            size += logicalSize % unit;
+        return size;
+    }
+
+    //run every stripe's chunks as one task,stripes proceed concurrently
+    int StripeFile::RunChunks(const std::vector<std::vector<Chunk>> &chunks,
+                              const std::function<int(int, const Chunk &)> &xChunk) {
+        std::vector<int> results(chunks.size(), Succeed);
+        int nBusy = 0;
+        for (auto &list: chunks)
+            if (!list.empty())
+                nBusy++;
+
+        TaskGroup group;
+        for (int i = 0; i < static_cast<int>(chunks.size()); i++) {
+            if (chunks[i].empty())
+                continue;
+            group.Run(nBusy > 1 ? pVFS->pPool : nullptr, [&, i]() {
+                for (auto &chunk: chunks[i]) {
+                    int rc = xChunk(i, chunk);
+                    if (rc == Succeed)
+                        continue;
+                    results[i] = rc;
+                    if (rc != IOError_ReadShort)
+                        break;
+                }
+            });
+        }
+        group.Wait();
+
+        int status = Succeed;
+        for (auto rc: results) {
+            if (rc != Succeed && rc != IOError_ReadShort)
+                return rc;
+            if (rc == IOError_ReadShort)
+                status = rc;
+        }
+        return status;
+    }
+
+    int StripeFile::xClose() {
+        int status = Succeed;
+        for (auto pStripe: stripes) {
+            int rc = pStripe->xClose();
+            if (status == Succeed)
+                status = rc;
+        }
+        delete this;
+        return status;
+    }
+
+    int StripeFile::xRead(void *pBuff, long readCount, long offset) {
+        assert(readCount >= 0);
+        assert(offset >= 0);
+        auto zBuff = static_cast<char *>(pBuff);
+        int status = RunChunks(MapRange(readCount, offset), [&](int i, const Chunk &chunk) {
+            return stripes[i]->xRead(&zBuff[chunk.bufferOffset], chunk.count, chunk.stripeOffset);
+        });
+        //a short stripe may only be a hole inside the logical file
+        if (status == IOError_ReadShort) {
+            unsigned long size;
+            if (xFileSize(&size) == Succeed && offset + readCount <= static_cast<long>(size))
+                status = Succeed;
+        }
+        return status;
+    }
+
+    int StripeFile::xWrite(const void *pBuff, long writeCount, long offset) {
+        assert(writeCount >= 0);
+        assert(offset >= 0);
+        auto zBuff = static_cast<const char *>(pBuff);
+        return RunChunks(MapRange(writeCount, offset), [&](int i, const Chunk &chunk) {
+            return stripes[i]->xWrite(&zBuff[chunk.bufferOffset], chunk.count, chunk.stripeOffset);
+        });
+    }
+
+    int StripeFile::xTruncate(long size) {
+        int status = Succeed;
+        for (int i = 0; i < static_cast<int>(stripes.size()); i++) {
+            int rc = stripes[i]->xTruncate(StripeSize(i, size));
+            if (status == Succeed)
+                status = rc;
+        }
+        return status;
+    }
+
+    int StripeFile::xSync(int flags) {
+        std::vector<std::vector<Chunk>> all(stripes.size(), std::vector<Chunk>(1, Chunk{0, 0, 0}));
+        return RunChunks(all, [&](int i, const Chunk &) {
+            return stripes[i]->xSync(flags);
+        });
+    }
+
+    int StripeFile::xFileSize(unsigned long *pSize) {
+        auto nStripe = static_cast<long>(stripes.size());
+        long unit = pVFS->stripeUnit;
+        unsigned long size = 0;
+        for (long i = 0; i < nStripe; i++) {
+            unsigned long stripeSize;
+            int status = stripes[i]->xFileSize(&stripeSize);
+            if (status != Succeed)
+                return status;
+            if (stripeSize == 0)
+                continue;
+            //logical position just after the last byte held by this stripe
+            long last = static_cast<long>(stripeSize) - 1;
+            unsigned long end = ((last / unit) * nStripe + i) * unit + last % unit + 1;
+            size = std::max(size, end);
+        }
+        *pSize = size;
+        return Succeed;
+    }
+
+    int StripeFile::xLock(int eFileLock) {
+        return stripes[0]->xLock(eFileLock);
+    }
+
+    int StripeFile::xUnlock(int eFileLock) {
+        return stripes[0]->xUnlock(eFileLock);
+    }
+
+    int StripeFile::xCheckReservedLock(int *pResOut) {
+        return stripes[0]->xCheckReservedLock(pResOut);
+    }
+
+    int StripeFile::xFileControl(int op, void *pArg) {
+        switch (op) {
+            case Fcntl_VFSName: {
+                char *pName = new char[pVFS->zName.size() + 1];
+                memcpy(pName, pVFS->zName.c_str(), pVFS->zName.size() + 1);
+                *(char **) pArg = pName;
+                return Succeed;
+            }
+            case Fcntl_SizeHint: {
+                for (int i = 0; i < static_cast<int>(stripes.size()); i++) {
+                    long nByte = StripeSize(i, *(long *) pArg);
+                    int status = stripes[i]->xFileControl(Fcntl_SizeHint, &nByte);
+                    if (status != Succeed)
+                        return status;
+                }
+                return Succeed;
+            }
+            case Fcntl_HaveMoved: {
+                int moved = 0;
+                for (auto pStripe: stripes) {
+                    int rc = 0;
+                    pStripe->xFileControl(Fcntl_HaveMoved, &rc);
+                    moved |= rc;
+                }
+                *(int *) pArg = moved;
+                return Succeed;
+            }
+            case Fcntl_PunchHole:
+            case Fcntl_FileDescriptor:
+            case Fcntl_Prefetch:
+            case Fcntl_SyncRange:
+                //the file is spread over the stripes
+                return NotFound;
+            default:
+                return stripes[0]->xFileControl(op, pArg);
+        }
+    }
+
+    int StripeFile::xSectorSize() {
+        return stripes[0]->xSectorSize();
+    }
+
+    int StripeFile::xDeviceCharacteristics() {
+        return stripes[0]->xDeviceCharacteristics();
+    }
+
+    StripeFile::StripeFile(StripeVFS *pVFS, std::vector<tinySQL_file *> stripes) :
+            pVFS(pVFS), stripes(std::move(stripes)) {
+        assert(!this->stripes.empty());
+    }
+}
@@ -21,24 +21,35 @@ namespace tinySQL {
         }
     }
 
+    //every attempt to take a range is counted under the lock level it is for
     int UnixFile::ProcessFileLockSet(int fd, short l_type, off_t l_start, off_t l_length) {
         struct flock lock{l_type, SEEK_SET, l_start, l_length, 0};
-        return OsSetAdvisoryLock(fd, &lock);
+        if (l_type == F_UNLCK || !LockProfile::Enabled())
+            return OsSetAdvisoryLock(fd, &lock);
+        const char *zLevel = "exclusive";
+        if (l_start == LockZone_PendingByte)
+            zLevel = "pending";
+        else if (l_start == LockZone_ReservedByte)
+            zLevel = "reserved";
+        else if (l_type == F_RDLCK)
+            zLevel = "shared";
+        uint64_t start = Clock::Fast();
+        int ret = OsSetAdvisoryLock(fd, &lock);
+        int err = errno;
+        LockProfile::Fcntl(zLevel, ret && (err == EAGAIN || err == EACCES), Clock::Fast() - start);
+        errno = err;
+        return ret;
     }
 
-    int UnixFile::SeekAndWriteFd(int fd, long offset, const void *pBuffer, long writeCount, int *piErrno) {
+    //pwrite leaves the shared file offset alone,so handles may be used from several threads
+    int UnixFile::PositionalWriteFd(int fd, long offset, const void *pBuffer, long writeCount, int *piErrno) {
         long status;
         assert(fd > 2);
         assert(pBuffer);
         assert(piErrno);
 
         do {
-            long seek = OsLseek(fd, offset, SEEK_SET);
-            if (seek < 0) {
-                status = -1;
-                break;
-            }
-            status = OsWrite(fd, pBuffer, writeCount);
+            status = OsPwrite(fd, pBuffer, writeCount, offset);
         } while (status < 0 && errno == EINTR);
         if (status < 0) *piErrno = errno;
         return status;
@@ -80,11 +91,8 @@ namespace tinySQL {
     int UnixFile::xClose() {
         auto p = static_cast < UnixFile * >(this);
         xUnlock(Lock_None);
-        p->pInode->Lock();
-        if (p->pInode->eFileLock != Lock_None)
-            p->pInode->SetPendingFd(p->iFd);
-        p->pInode->Unlock();
-        UnixINode::UnixInodeRelease(p->pInode);
+        //a file whose name is gone can not be opened again
+        UnixINode::UnixInodeRelease(p->pInode, p->iFd, p->accessMode, !(p->ctrlFlags & UnixFile_Unlinked));
         delete p;
         return Succeed;
     }
@@ -96,10 +104,10 @@ namespace tinySQL {
         assert(readCount >= 0);
         assert(offset >= 0);
 
-        off_t nowOffset = OsLseek(p->iFd, offset, SEEK_SET);
-        if (nowOffset != offset)
-            return IOError_Read;
-        size_t Count = OsRead(p->iFd, buffer, readCount);
+        ssize_t Count;
+        do {
+            Count = OsPread(p->iFd, buffer, readCount, offset);
+        } while (Count < 0 && errno == EINTR);
         p->lastErrno = errno;
         if (Count != readCount) {
             if (Count < 0) {
@@ -128,7 +136,7 @@ namespace tinySQL {
         assert(offset >= 0);
 
 
-        while ((wrote = SeekAndWriteFd(p->iFd, offset, buffer, writeCount, &p->lastErrno)) < writeCount &&
+        while ((wrote = PositionalWriteFd(p->iFd, offset, buffer, writeCount, &p->lastErrno)) < writeCount &&
                wrote > 0) {
             writeCount -= wrote;
             offset += wrote;
@@ -211,7 +219,7 @@ namespace tinySQL {
 
         if (eFileLock == Lock_Shared ||
             (eFileLock == Lock_Exclusive && p->eFileLock < Lock_Pending))
-            if (ProcessFileLockSet(p->iFd, eFileLock == Lock_Shared ? F_RDLCK : F_WRLCK, 1, LockZone_PendingByte)) {
+            if (ProcessFileLockSet(p->iFd, eFileLock == Lock_Shared ? F_RDLCK : F_WRLCK, LockZone_PendingByte, 1)) {
                 tError = errno;
                 status = GetErrorFromPosixError(tError, IOError_Lock);
                 if (status == Busying)
@@ -233,15 +241,14 @@ namespace tinySQL {
                 tError = errno;
                 status = IOError_Unlock;
             }
-            if (status) {
-                if (status != Busying) {
-                    p->lastErrno = errno;
-                    goto end_lock;
-                } else {
-                    p->eFileLock = Lock_Shared;
-                    pInode->nLock++;
-                    pInode->nShared = 1;
-                }
+            if (status != Succeed) {
+                if (status != Busying)
+                    p->lastErrno = tError;
+                goto end_lock;
+            } else {
+                p->eFileLock = Lock_Shared;
+                pInode->nLock++;
+                pInode->nShared = 1;
             }
 
         } else if (eFileLock == Lock_Exclusive && pInode->nShared > 1)
@@ -291,7 +298,7 @@ namespace tinySQL {
                     goto end_lock;
                 }
             }
-            if (ProcessFileLockSet(p->iFd, F_UNLCK, Lock_Pending, 2)) {
+            if (ProcessFileLockSet(p->iFd, F_UNLCK, LockZone_PendingByte, 2)) {
                 status = IOError_Unlock;
                 p->lastErrno = errno;
                 goto end_lock;
@@ -369,8 +376,63 @@ namespace tinySQL {
                 *(int *) pArg = (p->pInode && (OsFstat(p->iFd, &buf) || buf.st_ino != p->pInode->ino));
                 return Succeed;
             }
-            case Fcntl_ExternalReader :
-                throw std::runtime_error("not support");
+            case Fcntl_FileId : {
+                struct stat buf{};
+                if (OsFstat(p->iFd, &buf)) {
+                    p->lastErrno = errno;
+                    return IOError_Fstat;
+                }
+                auto pId = (FileIdentity *) pArg;
+                pId->dev = buf.st_dev;
+                pId->ino = buf.st_ino;
+                pId->mtime = buf.st_mtim.tv_sec * 1000000000L + buf.st_mtim.tv_nsec;
+                return Succeed;
+            }
+            case Fcntl_FileDescriptor :
+                *(int *) pArg = p->iFd;
+                return Succeed;
+            case Fcntl_Prefetch : {
+                auto pRange = (FileRange *) pArg;
+                return OsFadvise(p->iFd, pRange->offset, pRange->length, POSIX_FADV_WILLNEED) ? NotFound : Succeed;
+            }
+            case Fcntl_LockProfile : {
+                auto pReport = (LockReport *) pArg;
+                LockProfile::Hottest(pReport->nMax, &pReport->stats);
+                return Succeed;
+            }
+            case Fcntl_SyncRange : {
+                auto pRange = (FileRange *) pArg;
+                return OsSyncFileRange(p->iFd, pRange->offset, pRange->length, SYNC_FILE_RANGE_WRITE) ? NotFound
+                                                                                                       : Succeed;
+            }
+            case Fcntl_PunchHole : {
+                auto pRange = (FileRange *) pArg;
+                if (OsFallocate(p->iFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pRange->offset, pRange->length)) {
+                    p->lastErrno = errno;
+                    return errno == EOPNOTSUPP ? NotFound : IOError_Write;
+                }
+                return Succeed;
+            }
+            case Fcntl_ExternalReader : {
+                //another connection of this process shares the lock,or another
+                //process holds a read lock on the shared range
+                int bReader = 0;
+                p->pInode->Lock();
+                if (p->pInode->nShared > (p->eFileLock >= Lock_Shared ? 1 : 0))
+                    bReader = 1;
+                else {
+                    struct flock lock{F_WRLCK, SEEK_SET, LockZone_SharedFirst, LockZone_SharedSize, 0};
+                    if (OsGetAdvisoryLock(p->iFd, &lock)) {
+                        p->lastErrno = errno;
+                        p->pInode->Unlock();
+                        return IOError_Lock;
+                    }
+                    bReader = lock.l_type != F_UNLCK;
+                }
+                p->pInode->Unlock();
+                *(int *) pArg = bReader;
+                return Succeed;
+            }
             default :
                 return NotFound;
         }
@@ -385,18 +447,20 @@ namespace tinySQL {
         return 0;
     }
 
-    UnixFile::UnixFile(std::string pathName, int fd,UnixVFS *pVFS) :
-            iFd(fd), pInode(nullptr), pVFS(pVFS), pathName(std::move(pathName)), eFileLock(Lock_None), lastErrno(0),
-            sectorSize(0), chunkSize(0), ctrlFlags(0) {
-
+    UnixFile::UnixFile(std::string pathName, int fd, UnixVFS *pVFS, int accessMode, UnixINode *pInode,
+                       int sectorSize) :
+            iFd(fd), pInode(pInode), pVFS(pVFS), pathName(std::move(pathName)), eFileLock(Lock_None), lastErrno(0),
+            accessMode(accessMode), sectorSize(sectorSize), chunkSize(0), ctrlFlags(0) {
+        if (pInode)
+            return;
         struct stat buf;
         if(fstat(fd,&buf))
             throw std::runtime_error("can not get info about the file");
-        sectorSize = buf.st_blksize;
-        pInode = UnixINode::UnixINodeFind(buf.st_dev,buf.st_ino);
-        pInode->Lock();
-        pInode ->nRef++;
-        pInode ->Unlock();
+        this->sectorSize = buf.st_blksize;
+        this->pInode = UnixINode::UnixINodeFind(buf.st_dev,buf.st_ino);
+        this->pInode->Lock();
+        this->pInode ->nRef++;
+        this->pInode ->Unlock();
 
     }
 
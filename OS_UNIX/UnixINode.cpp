@@ -4,42 +4,42 @@
 #include "OS_unix.h"
 
 namespace tinySQL{
+    static constexpr int DefaultUnusedFdLimit = 64;
+
     struct UnixInodeList{
         std::list<UnixINode> list;
-        pthread_mutex_t mutex;
+        std::list<UnixINode *> lru;     //inodes with cached descriptors,least recently released first
+        int nCached;
+        int maxCached;
+        ProfiledMutex mutex;
 
-        UnixInodeList(): mutex(),list(){
-            pthread_mutex_init(&mutex, nullptr);
-        }
-        ~UnixInodeList() {
-            pthread_mutex_destroy(& mutex);
+        UnixInodeList(): mutex("unix.inodeList"),list(),lru(),nCached(0),maxCached(DefaultUnusedFdLimit){
         }
     };
     static UnixInodeList inodeList;
 
 
     UnixINode::UnixINode(dev_t dev, ino_t ino) : dev(dev), ino(ino),nLock(0),unusedFd(),
-    nShared(0),nRef(0), bProcessLock(0), lockMutex(),eFileLock(Lock_None) {
-        pthread_mutex_init(&lockMutex, nullptr);
+    nShared(0),nRef(0), bProcessLock(0), lockMutex("unix.inode"),eFileLock(Lock_None) {
     }
 
     UnixINode::~UnixINode() {
-        ClosePendingFds();
-        pthread_mutex_unlock(&lockMutex);
-        pthread_mutex_destroy(&lockMutex);
+        for(auto &unused : unusedFd)
+            OsClose(unused.fd);
+        lockMutex.Unlock();
     }
 
-    void UnixINode::Lock() {
-        pthread_mutex_lock(& lockMutex);
+    void UnixINode::Lock(const char *zSite) {
+        lockMutex.Lock(zSite);
     }
 
     void UnixINode::Unlock() {
-        pthread_mutex_unlock(& lockMutex);
+        lockMutex.Unlock();
     }
 
     UnixINode *UnixINode::UnixINodeFind(dev_t dev, ino_t ino) {
         UnixINode * pInode = nullptr;
-        pthread_mutex_lock(&inodeList.mutex);
+        inodeList.mutex.Lock();
         for(auto & it : inodeList.list)
             if(it.ino == ino && it.dev == dev) {
                 pInode = &it;
@@ -49,36 +49,153 @@ namespace tinySQL{
             inodeList.list.emplace_front(dev,ino);
             pInode = &inodeList.list.front();
         }
-        pthread_mutex_unlock(& inodeList.mutex);
+        inodeList.mutex.Unlock();
         return pInode;
     }
 
-    void UnixINode::UnixInodeRelease(UnixINode *pInode) {
+    //the list mutex is held and pInode locked,which the destructor undoes
+    void UnixINode::Erase(UnixINode *pInode) {
+        for(auto it = inodeList.list.begin(); it != inodeList.list.end();it++)
+            if(&(*it) == pInode){
+                inodeList.list.erase(it);
+                return;
+            }
+        throw std::runtime_error("can not find the inode in list");
+    }
+
+    //closes cached descriptors down to the limit,the list mutex is held.
+    //those of a file the process has locks on stay
+    void UnixINode::Trim() {
+        auto it = inodeList.lru.begin();
+        while(inodeList.nCached > inodeList.maxCached && it != inodeList.lru.end()){
+            UnixINode *pInode = *it;
+            pInode->Lock();
+            if(pInode->nLock > 0){
+                pInode->Unlock();
+                it++;
+                continue;
+            }
+            auto fdIt = pInode->unusedFd.end();
+            while(fdIt != pInode->unusedFd.begin() && inodeList.nCached > inodeList.maxCached){
+                fdIt--;
+                if(fdIt->bCache){
+                    OsClose(fdIt->fd);
+                    fdIt = pInode->unusedFd.erase(fdIt);
+                    inodeList.nCached--;
+                }
+            }
+            if(pInode->unusedFd.empty())
+                it = inodeList.lru.erase(it);
+            else
+                it++;
+            if(pInode->nRef == 0 && pInode->unusedFd.empty())
+                Erase(pInode);
+            else
+                pInode->Unlock();
+        }
+    }
+
+    void UnixINode::UnixInodeRelease(UnixINode *pInode, int fd, int accessMode, bool bCache) {
         assert(pInode != nullptr);
 
-        pthread_mutex_lock(&inodeList.mutex);
+        inodeList.mutex.Lock();
         pInode->Lock();
         pInode->nRef--;
-        if(pInode->nRef == 0){
-            for(auto it = inodeList.list.begin(); it != inodeList.list.end();it++)
-                if(&(*it) == pInode){
-                    inodeList.list.erase(it);
-                    pthread_mutex_unlock(&inodeList.mutex);
-                    return;
+        bCache = bCache && inodeList.maxCached > 0;
+        //closing any descriptor of the file drops every lock the process has on it
+        if(bCache || pInode->nLock > 0){
+            pInode->unusedFd.push_front({fd, accessMode, bCache});
+            if(bCache){
+                inodeList.nCached++;
+                inodeList.lru.remove(pInode);
+                inodeList.lru.push_back(pInode);
+            }
+        }else
+            OsClose(fd);
+        if(pInode->nRef == 0 && pInode->unusedFd.empty())
+            Erase(pInode);
+        else
+            pInode->Unlock();
+        Trim();
+        inodeList.mutex.Unlock();
+    }
+
+    int UnixINode::UnixINodeReuse(dev_t dev, ino_t ino, int accessMode, UnixINode **ppInode) {
+        int fd = -1;
+        inodeList.mutex.Lock();
+        for(auto &inode : inodeList.list){
+            if(inode.ino != ino || inode.dev != dev)
+                continue;
+            inode.Lock();
+            bool bCached = false;
+            for(auto it = inode.unusedFd.begin(); it != inode.unusedFd.end();){
+                if(fd < 0 && it->bCache && it->accessMode == accessMode){
+                    fd = it->fd;
+                    it = inode.unusedFd.erase(it);
+                    inodeList.nCached--;
+                    inode.nRef++;
+                    *ppInode = &inode;
+                }else
+                    bCached |= (it++)->bCache;
+            }
+            if(!bCached)
+                inodeList.lru.remove(&inode);
+            inode.Unlock();
+            break;
+        }
+        inodeList.mutex.Unlock();
+        return fd;
+    }
+
+    void UnixINode::UnixINodeForget(dev_t dev, ino_t ino) {
+        inodeList.mutex.Lock();
+        for(auto &inode : inodeList.list){
+            if(inode.ino != ino || inode.dev != dev)
+                continue;
+            inode.Lock();
+            for(auto it = inode.unusedFd.begin(); it != inode.unusedFd.end();){
+                if(!it->bCache)
+                    it++;
+                else{
+                    inodeList.nCached--;
+                    if(inode.nLock > 0){
+                        it->bCache = false;
+                        it++;
+                    }else{
+                        OsClose(it->fd);
+                        it = inode.unusedFd.erase(it);
+                    }
                 }
-            throw std::runtime_error("can not find the inode in list");
+            }
+            inodeList.lru.remove(&inode);
+            if(inode.nRef == 0 && inode.unusedFd.empty())
+                Erase(&inode);
+            else
+                inode.Unlock();
+            break;
         }
-        pInode->Unlock();
+        inodeList.mutex.Unlock();
     }
 
-    void UnixINode::ClosePendingFds() {
-        for(auto value : unusedFd)
-            close(value);
-        unusedFd.clear();
+    int UnixINode::UnusedFdLimit(int n) {
+        inodeList.mutex.Lock();
+        int old = inodeList.maxCached;
+        if(n >= 0){
+            inodeList.maxCached = n;
+            Trim();
+        }
+        inodeList.mutex.Unlock();
+        return old;
     }
 
-    void UnixINode::SetPendingFd(int fd) {
-        unusedFd.emplace_front(fd);
+    void UnixINode::ClosePendingFds() {
+        for(auto it = unusedFd.begin(); it != unusedFd.end();)
+            if(it->bCache)
+                it++;
+            else{
+                OsClose(it->fd);
+                it = unusedFd.erase(it);
+            }
     }
 
 
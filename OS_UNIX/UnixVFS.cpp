@@ -53,9 +53,45 @@ namespace tinySQL {
         return nullptr;
     }
 
+    tinySQL_VFS *tinySQL_VFS::VFSFind(const char *zName) {
+        VFSGet(0);
+        for(auto pVFS : list)
+            if(pVFS->zName == zName)
+                return pVFS;
+        return nullptr;
+    }
+
+
+    static const char *TempFileDirectory(){
+        static const char *azDirs[] = {nullptr, "/var/tmp", "/usr/tmp", "/tmp", "."};
+        struct stat buf{};
+        azDirs[0] = getenv("TMPDIR");
+        for(auto zDir : azDirs){
+            if(zDir == nullptr)
+                continue;
+            if(OsStat(zDir,&buf) == 0 && S_ISDIR(buf.st_mode) && OsAccess(zDir,W_OK | X_OK) == 0)
+                return zDir;
+        }
+        return nullptr;
+    }
+
+    int UnixVFS::GetTempName(int nBuf, char *zBuf) {
+        const char *zDir = TempFileDirectory();
+        if(zDir == nullptr)
+            return IOError_GetTempPath;
+        int tries = 0;
+        do{
+            unsigned long random;
+            tinySQL_Randomness(sizeof(random),&random);
+            snprintf(zBuf,nBuf,"%s/tinySQL_tmp_%016lx",zDir,random);
+            if(tries++ > 10)
+                return IOError_GetTempPath;
+        }while(OsAccess(zBuf,F_OK) == 0);
+        return Succeed;
+    }
 
     int UnixVFS::xOpen(const char *zName, tinySQL_file **ppFile, int flags, int *pOutFlags) {
-        assert(ppFile && zName);
+        assert(ppFile);
         int fd = -1;
         int status = 0;
         int eType = flags & 0xFFF00;
@@ -71,27 +107,54 @@ namespace tinySQL {
         bool isNewJournal = isCreate && ( eType == Open_MainJournal
                 || eType == Open_SuperJournal || eType == Open_MainWAL);
 
-//        if(zName == nullptr){
-//            assert(isDelete && !isNewJournal);
-//            status = x
-//        }
+        if(zName == nullptr){
+            assert(isDelete && !isNewJournal);
+            status = GetTempName(mxPathName + 2, zTempName);
+            if(status != Succeed)
+                return status;
+            zName = zTempName;
+            openFlag |= O_CREAT | O_EXCL | O_RDWR;
+        }
 
         if(isReadOnly) openFlag |= O_RDONLY;
         if(isReadWrite) openFlag |= O_RDWR;
         if(isCreate) openFlag |= O_CREAT;
         if(isExclusive) openFlag |= O_EXCL;
 
-        fd = RobustOpen(zName,openFlag,0);
-        if(fd < 0)
-            return CanNotOpen;
+        int accessMode = openFlag & O_ACCMODE;
+        //a descriptor another handle of the file left behind saves the open and
+        //the fstat,the stat of the name makes sure it is still the same file
+        struct stat buf{};
+        UnixINode *pInode = nullptr;
+        if(!isDelete && !isExclusive && OsStat(zName,&buf) == 0)
+            fd = UnixINode::UnixINodeReuse(buf.st_dev,buf.st_ino,accessMode,&pInode);
+        if(fd < 0){
+            fd = RobustOpen(zName,openFlag,0);
+            if(fd < 0)
+                return CanNotOpen;
+            pInode = nullptr;
+        }
+        //the name goes away at once,the data when the last descriptor closes
+        if(isDelete)
+            OsUnlink(zName);
         if(pOutFlags)
             *pOutFlags = flags;
-        *ppFile = new UnixFile(zName,fd,this);
+        auto pFile = new UnixFile(zName,fd,this,accessMode,pInode,static_cast<int>(buf.st_blksize));
+        if(isDelete)
+            pFile->ctrlFlags |= UnixFile_Unlinked;
+        *ppFile = pFile;
         return status;
     }
 
     int UnixVFS::xDelete(const char *zName) {
-        return OsUnlink(zName)  ? IOError_Delete : Succeed;
+        struct stat buf{};
+        bool bKnown = OsStat(zName,&buf) == 0;
+        if(OsUnlink(zName))
+            return IOError_Delete;
+        //descriptors cached for the file would keep its blocks
+        if(bKnown)
+            UnixINode::UnixINodeForget(buf.st_dev,buf.st_ino);
+        return Succeed;
     }
 
     int UnixVFS::xAccess(const char *zName, int flags, int *pResOut) {
@@ -136,8 +199,18 @@ namespace tinySQL {
 
     int UnixVFS::xRandomness(int nByte, char *pBuf) {
         memset(pBuf,0,nByte);
-        int fd = RobustOpen("/dev/urandom",O_RDONLY,0);
-        if(fd < 0){
+        //getrandom takes no descriptor and only blocks before the kernel pool is seeded
+        long got = 0;
+        while(got < nByte){
+            long n = OsGetrandom(&pBuf[got],nByte - got,0);
+            if(n < 0){
+                if(errno == EINTR)
+                    continue;
+                break;
+            }
+            got += n;
+        }
+        if(got < nByte){
             //just copy time and pid to pBuf
             time_t t = time(nullptr);
             pid_t pid = getpid();
@@ -145,28 +218,23 @@ namespace tinySQL {
             memcpy(pBuf,&t, sizeof(t));
             memcpy(&pBuf[sizeof(t)],&pid, sizeof(pid));
             nByte = sizeof(pid) + sizeof(t);
-        }else{
-            //get random num by read /dev/urandom
-            long got;
-            do{
-                got = OsRead(fd,pBuf,nByte);
-            }while(got < 0 && errno == EINTR);
-            OsClose(fd);
         }
         return nByte;
     }
 
     int UnixVFS::xSleep(int microseconds) {
-        sleep(microseconds / 1000000);
-        usleep(microseconds % 1000000);
+        Clock::Sleep(static_cast<uint64_t>(microseconds) * 1000);
         return microseconds;
     }
 
+    int UnixVFS::xSleepNs(uint64_t ns) {
+        Clock::Sleep(ns);
+        return Succeed;
+    }
+
     int UnixVFS::xCurrentTime(double *pTime) {
-        unsigned long time;
-        int status = xCurrentTimeInt64(&time);
-        *pTime = time;
-        return status;
+        *pTime = static_cast<double>(Clock::Wall()) / 1e9;
+        return Succeed;
     }
 
     int UnixVFS::xGetLastError(int, char *) {
@@ -178,6 +246,16 @@ namespace tinySQL {
         return Succeed;
     }
 
+    int UnixVFS::xWallTimeNs(uint64_t *pNs) {
+        *pNs = Clock::Wall();
+        return Succeed;
+    }
+
+    int UnixVFS::xMonotonicTime(uint64_t *pNs) {
+        *pNs = Clock::Monotonic();
+        return Succeed;
+    }
+
     UnixVFS::UnixVFS(int version, int maxPathNameLength, std::string name, void *pAppData) : tinySQL_VFS(version,
                                                                                                          maxPathNameLength,
                                                                                                          std::move(name),
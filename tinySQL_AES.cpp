@@ -0,0 +1,421 @@
+//
+// Created by user on 26-10-19.
+//
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include "tinySQL_AES.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TINYSQL_AES_X86 1
+#endif
+
+namespace tinySQL {
+
+    //the portable cipher never indexes a table by a secret byte or branches
+    //on one,so the cache and the branch predictor learn nothing of the key
+    //or the data.SubBytes transposes the state into eight words,word i
+    //holding bit i of every byte,and runs the sbox as a boolean circuit on them
+    static unsigned char XTime(unsigned char x) {
+        return static_cast<unsigned char>((x << 1) ^ (0x1b & -(x >> 7)));
+    }
+
+    //8x8 bit matrix,byte r bit c to byte c bit r.its own inverse
+    static uint64_t Transpose8(uint64_t x) {
+        uint64_t t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull;
+        x ^= t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull;
+        x ^= t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull;
+        x ^= t ^ (t << 28);
+        return x;
+    }
+
+    //Boyar and Peralta's 113 gate circuit for the sbox,the field inverse
+    //and the affine map together
+    static void SboxPlanes(uint64_t *q) {
+        uint64_t x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+        uint64_t y14 = x3 ^ x5, y13 = x0 ^ x6, y9 = x0 ^ x3, y8 = x0 ^ x5;
+        uint64_t t0 = x1 ^ x2, y1 = t0 ^ x7, y4 = y1 ^ x3, y12 = y13 ^ y14;
+        uint64_t y2 = y1 ^ x0, y5 = y1 ^ x6, y3 = y5 ^ y8, t1 = x4 ^ y12;
+        uint64_t y15 = t1 ^ x5, y20 = t1 ^ x1, y6 = y15 ^ x7, y10 = y15 ^ t0;
+        uint64_t y11 = y20 ^ y9, y7 = x7 ^ y11, y17 = y10 ^ y11, y19 = y10 ^ y8;
+        uint64_t y16 = t0 ^ y11, y21 = y13 ^ y16, y18 = x0 ^ y16;
+
+        uint64_t t2 = y12 & y15, t3 = y3 & y6, t4 = t3 ^ t2, t5 = y4 & x7;
+        uint64_t t6 = t5 ^ t2, t7 = y13 & y16, t8 = y5 & y1, t9 = t8 ^ t7;
+        uint64_t t10 = y2 & y7, t11 = t10 ^ t7, t12 = y9 & y11, t13 = y14 & y17;
+        uint64_t t14 = t13 ^ t12, t15 = y8 & y10, t16 = t15 ^ t12, t17 = t4 ^ t14;
+        uint64_t t18 = t6 ^ t16, t19 = t9 ^ t14, t20 = t11 ^ t16, t21 = t17 ^ y20;
+        uint64_t t22 = t18 ^ y19, t23 = t19 ^ y21, t24 = t20 ^ y18;
+
+        uint64_t t25 = t21 ^ t22, t26 = t21 & t23, t27 = t24 ^ t26, t28 = t25 & t27;
+        uint64_t t29 = t28 ^ t22, t30 = t23 ^ t24, t31 = t22 ^ t26, t32 = t31 & t30;
+        uint64_t t33 = t32 ^ t24, t34 = t23 ^ t33, t35 = t27 ^ t33, t36 = t24 & t35;
+        uint64_t t37 = t36 ^ t34, t38 = t27 ^ t36, t39 = t29 & t38, t40 = t25 ^ t39;
+
+        uint64_t t41 = t40 ^ t37, t42 = t29 ^ t33, t43 = t29 ^ t40, t44 = t33 ^ t37;
+        uint64_t t45 = t42 ^ t41;
+        uint64_t z0 = t44 & y15, z1 = t37 & y6, z2 = t33 & x7, z3 = t43 & y16;
+        uint64_t z4 = t40 & y1, z5 = t29 & y7, z6 = t42 & y11, z7 = t45 & y17;
+        uint64_t z8 = t41 & y10, z9 = t44 & y12, z10 = t37 & y3, z11 = t33 & y4;
+        uint64_t z12 = t43 & y13, z13 = t40 & y5, z14 = t29 & y2, z15 = t42 & y9;
+        uint64_t z16 = t45 & y14, z17 = t41 & y8;
+
+        uint64_t t46 = z15 ^ z16, t47 = z10 ^ z11, t48 = z5 ^ z13, t49 = z9 ^ z10;
+        uint64_t t50 = z2 ^ z12, t51 = z2 ^ z5, t52 = z7 ^ z8, t53 = z0 ^ z3;
+        uint64_t t54 = z6 ^ z7, t55 = z16 ^ z17, t56 = z12 ^ t48, t57 = t50 ^ t53;
+        uint64_t t58 = z4 ^ t46, t59 = z3 ^ t54, t60 = t46 ^ t57, t61 = z14 ^ t57;
+        uint64_t t62 = t52 ^ t58, t63 = t49 ^ t58, t64 = z4 ^ t59, t65 = t61 ^ t62;
+        uint64_t t66 = z1 ^ t63, t67 = t64 ^ t65;
+        uint64_t s0 = t59 ^ t63, s6 = t56 ^ ~t62, s7 = t48 ^ ~t60, s3 = t53 ^ t66;
+        uint64_t s4 = t51 ^ t66, s5 = t47 ^ t65, s1 = t64 ^ ~s3, s2 = t55 ^ ~t67;
+
+        q[7] = s0, q[6] = s1, q[5] = s2, q[4] = s3, q[3] = s4, q[2] = s5, q[1] = s6, q[0] = s7;
+    }
+
+    //the inverse of the affine map after undoing its constant,rotations by
+    //1,3 and 6 and 0x05.the inverse sbox is this,the sbox and this again
+    static void InvAffinePlanes(uint64_t *q) {
+        uint64_t r[8];
+        for (int i = 0; i < 8; i++)
+            r[i] = q[(i + 7) % 8] ^ q[(i + 5) % 8] ^ q[(i + 2) % 8] ^ ((0x05 >> i & 1) ? ~0ull : 0);
+        memcpy(q, r, sizeof(r));
+    }
+
+    static void SubBytes(unsigned char *s, bool bInverse) {
+        uint64_t w[2], q[8];
+        memcpy(w, s, AES_BlockSize);
+        uint64_t lo = Transpose8(w[0]), hi = Transpose8(w[1]);
+        for (int i = 0; i < 8; i++)
+            q[i] = ((lo >> (8 * i)) & 0xff) | (((hi >> (8 * i)) & 0xff) << 8);
+        if (bInverse)
+            InvAffinePlanes(q);
+        SboxPlanes(q);
+        if (bInverse)
+            InvAffinePlanes(q);
+        lo = 0;
+        hi = 0;
+        for (int i = 0; i < 8; i++) {
+            lo |= (q[i] & 0xff) << (8 * i);
+            hi |= ((q[i] >> 8) & 0xff) << (8 * i);
+        }
+        w[0] = Transpose8(lo);
+        w[1] = Transpose8(hi);
+        memcpy(s, w, AES_BlockSize);
+    }
+
+    static void MixColumn(unsigned char *a) {
+        unsigned char a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+        unsigned char all = a0 ^ a1 ^ a2 ^ a3;
+        a[0] ^= all ^ XTime(a0 ^ a1);
+        a[1] ^= all ^ XTime(a1 ^ a2);
+        a[2] ^= all ^ XTime(a2 ^ a3);
+        a[3] ^= all ^ XTime(a3 ^ a0);
+    }
+
+    //InvMixColumn is MixColumn after multiplying by 4x^2 + 5,as in the aes proposal
+    static void InvMixColumn(unsigned char *a) {
+        unsigned char u = XTime(XTime(a[0] ^ a[2])), v = XTime(XTime(a[1] ^ a[3]));
+        a[0] ^= u;
+        a[1] ^= v;
+        a[2] ^= u;
+        a[3] ^= v;
+        MixColumn(a);
+    }
+
+    AES128::AES128(const unsigned char *pKey) : encKey(), decKey() {
+        auto w = &encKey[0][0];
+        unsigned char rcon = 1;
+        memcpy(w, pKey, AES_BlockSize);
+        for (int i = 4; i < 4 * (AES_Rounds + 1); i++) {
+            unsigned char temp[4];
+            memcpy(temp, &w[(i - 1) * 4], 4);
+            if (i % 4 == 0) {
+                unsigned char word[AES_BlockSize] = {temp[1], temp[2], temp[3], temp[0]};
+                SubBytes(word, false);
+                temp[0] = word[0] ^ rcon;
+                temp[1] = word[1];
+                temp[2] = word[2];
+                temp[3] = word[3];
+                rcon = XTime(rcon);
+            }
+            for (int j = 0; j < 4; j++)
+                w[i * 4 + j] = w[(i - 4) * 4 + j] ^ temp[j];
+        }
+
+        memcpy(decKey[0], encKey[AES_Rounds], AES_BlockSize);
+        memcpy(decKey[AES_Rounds], encKey[0], AES_BlockSize);
+        for (int r = 1; r < AES_Rounds; r++) {
+            memcpy(decKey[r], encKey[AES_Rounds - r], AES_BlockSize);
+            for (int c = 0; c < 4; c++)
+                InvMixColumn(&decKey[r][c * 4]);
+        }
+    }
+
+    void AES128::EncryptBlock(unsigned char *s) const {
+        unsigned char tmp[AES_BlockSize];
+        for (int i = 0; i < AES_BlockSize; i++)
+            s[i] ^= encKey[0][i];
+        for (int round = 1; round <= AES_Rounds; round++) {
+            SubBytes(s, false);
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    tmp[r + 4 * c] = s[r + 4 * ((c + r) % 4)];
+            if (round != AES_Rounds)
+                for (int c = 0; c < 4; c++)
+                    MixColumn(&tmp[c * 4]);
+            for (int i = 0; i < AES_BlockSize; i++)
+                s[i] = tmp[i] ^ encKey[round][i];
+        }
+    }
+
+    void AES128::DecryptBlock(unsigned char *s) const {
+        unsigned char tmp[AES_BlockSize];
+        for (int i = 0; i < AES_BlockSize; i++)
+            s[i] ^= encKey[AES_Rounds][i];
+        for (int round = AES_Rounds - 1; round >= 0; round--) {
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    tmp[r + 4 * ((c + r) % 4)] = s[r + 4 * c];
+            SubBytes(tmp, true);
+            for (int i = 0; i < AES_BlockSize; i++)
+                s[i] = tmp[i] ^ encKey[round][i];
+            if (round != 0)
+                for (int c = 0; c < 4; c++)
+                    InvMixColumn(&s[c * 4]);
+        }
+    }
+
+    //multiply the tweak by the primitive element of GF(2^128),little endian
+    static void MulAlpha(unsigned long &lo, unsigned long &hi) {
+        unsigned long carry = hi >> 63;
+        hi = (hi << 1) | (lo >> 63);
+        lo = (lo << 1) ^ (0x87 & -carry);
+    }
+
+    static void XtsPortable(const AES128 &key, const unsigned char *pTweak, unsigned char *p,
+                            long nBlock, bool bEncrypt) {
+        unsigned long t[2];
+        memcpy(t, pTweak, AES_BlockSize);
+        for (long i = 0; i < nBlock; i++, p += AES_BlockSize) {
+            auto pT = reinterpret_cast<unsigned char *>(t);
+            for (int j = 0; j < AES_BlockSize; j++)
+                p[j] ^= pT[j];
+            if (bEncrypt)
+                key.EncryptBlock(p);
+            else
+                key.DecryptBlock(p);
+            for (int j = 0; j < AES_BlockSize; j++)
+                p[j] ^= pT[j];
+            MulAlpha(t[0], t[1]);
+        }
+    }
+
+#ifdef TINYSQL_AES_X86
+    static constexpr int AesNI_Lanes = 8;
+    static constexpr int VAES_Lanes = 16;
+
+    //n independent blocks keep the aes unit pipeline full,n is a constant in the hot loop
+    template<int n>
+    __attribute__((target("aes,sse2"), always_inline))
+    static inline void XtsAesNIBatch(const __m128i *k, unsigned long &lo, unsigned long &hi,
+                                     unsigned char *p, bool bEncrypt) {
+        __m128i t[n], b[n];
+        for (int i = 0; i < n; i++) {
+            t[i] = _mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo));
+            MulAlpha(lo, hi);
+            b[i] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * AES_BlockSize)),
+                                 _mm_xor_si128(t[i], k[0]));
+        }
+        if (bEncrypt) {
+            for (int r = 1; r < AES_Rounds; r++)
+                for (int i = 0; i < n; i++)
+                    b[i] = _mm_aesenc_si128(b[i], k[r]);
+            for (int i = 0; i < n; i++)
+                b[i] = _mm_aesenclast_si128(b[i], k[AES_Rounds]);
+        } else {
+            for (int r = 1; r < AES_Rounds; r++)
+                for (int i = 0; i < n; i++)
+                    b[i] = _mm_aesdec_si128(b[i], k[r]);
+            for (int i = 0; i < n; i++)
+                b[i] = _mm_aesdeclast_si128(b[i], k[AES_Rounds]);
+        }
+        for (int i = 0; i < n; i++)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i * AES_BlockSize), _mm_xor_si128(b[i], t[i]));
+    }
+
+    //the tweak of a data unit,one block
+    __attribute__((target("aes,sse2")))
+    static void EncryptBlockAesNI(const AES128 &key, unsigned char *p) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i *>(key.encKey[0])));
+        for (int r = 1; r < AES_Rounds; r++)
+            b = _mm_aesenc_si128(b, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key.encKey[r])));
+        b = _mm_aesenclast_si128(b, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key.encKey[AES_Rounds])));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), b);
+    }
+
+    __attribute__((target("aes,sse2")))
+    static void XtsAesNI(const AES128 &key, const unsigned char *pTweak, unsigned char *p,
+                         long nBlock, bool bEncrypt) {
+        const unsigned char(*rk)[AES_BlockSize] = bEncrypt ? key.encKey : key.decKey;
+        __m128i k[AES_Rounds + 1];
+        for (int r = 0; r <= AES_Rounds; r++)
+            k[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rk[r]));
+        unsigned long lo, hi;
+        memcpy(&lo, pTweak, 8);
+        memcpy(&hi, pTweak + 8, 8);
+
+        for (; nBlock >= AesNI_Lanes; nBlock -= AesNI_Lanes, p += AesNI_Lanes * AES_BlockSize)
+            XtsAesNIBatch<AesNI_Lanes>(k, lo, hi, p, bEncrypt);
+        for (; nBlock > 0; nBlock--, p += AES_BlockSize)
+            XtsAesNIBatch<1>(k, lo, hi, p, bEncrypt);
+    }
+
+    __attribute__((target("vaes,avx512f,aes,sse2")))
+    static void XtsVAES(const AES128 &key, const unsigned char *pTweak, unsigned char *p,
+                        long nBlock, bool bEncrypt) {
+        const unsigned char(*rk)[AES_BlockSize] = bEncrypt ? key.encKey : key.decKey;
+        __m512i k[AES_Rounds + 1];
+        alignas(64) unsigned char lanes[4 * AES_BlockSize];
+        for (int r = 0; r <= AES_Rounds; r++) {
+            for (int i = 0; i < 4; i++)
+                memcpy(&lanes[i * AES_BlockSize], rk[r], AES_BlockSize);
+            k[r] = _mm512_load_si512(lanes);
+        }
+        unsigned long lo, hi;
+        memcpy(&lo, pTweak, 8);
+        memcpy(&hi, pTweak + 8, 8);
+
+        alignas(64) unsigned long tweaks[VAES_Lanes * 2];
+        for (; nBlock >= VAES_Lanes; nBlock -= VAES_Lanes, p += VAES_Lanes * AES_BlockSize) {
+            __m512i t[4], b[4];
+            for (int i = 0; i < VAES_Lanes; i++) {
+                tweaks[2 * i] = lo;
+                tweaks[2 * i + 1] = hi;
+                MulAlpha(lo, hi);
+            }
+            for (int i = 0; i < 4; i++) {
+                t[i] = _mm512_load_si512(&tweaks[8 * i]);
+                b[i] = _mm512_xor_si512(_mm512_loadu_si512(p + 64 * i), _mm512_xor_si512(t[i], k[0]));
+            }
+            if (bEncrypt) {
+                for (int r = 1; r < AES_Rounds; r++)
+                    for (int i = 0; i < 4; i++)
+                        b[i] = _mm512_aesenc_epi128(b[i], k[r]);
+                for (int i = 0; i < 4; i++)
+                    b[i] = _mm512_aesenclast_epi128(b[i], k[AES_Rounds]);
+            } else {
+                for (int r = 1; r < AES_Rounds; r++)
+                    for (int i = 0; i < 4; i++)
+                        b[i] = _mm512_aesdec_epi128(b[i], k[r]);
+                for (int i = 0; i < 4; i++)
+                    b[i] = _mm512_aesdeclast_epi128(b[i], k[AES_Rounds]);
+            }
+            for (int i = 0; i < 4; i++)
+                _mm512_storeu_si512(p + 64 * i, _mm512_xor_si512(b[i], t[i]));
+        }
+        if (nBlock > 0) {
+            unsigned char rest[AES_BlockSize];
+            memcpy(rest, &lo, 8);
+            memcpy(rest + 8, &hi, 8);
+            XtsAesNI(key, rest, p, nBlock, bEncrypt);
+        }
+    }
+#endif
+
+    enum XtsImplementation {
+        Xts_Portable,
+        Xts_AesNI,
+        Xts_VAES
+    };
+
+    static XtsImplementation DetectImplementation() {
+#ifdef TINYSQL_AES_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f") &&
+            __builtin_cpu_supports("aes"))
+            return Xts_VAES;
+        if (__builtin_cpu_supports("aes"))
+            return Xts_AesNI;
+#endif
+        return Xts_Portable;
+    }
+
+    static std::atomic<int> &Selected() {
+        static std::atomic<int> impl(DetectImplementation());
+        return impl;
+    }
+
+    static XtsImplementation CurrentImplementation() {
+        return static_cast<XtsImplementation>(Selected().load(std::memory_order_relaxed));
+    }
+
+    static void XtsRun(const AES128 &dataKey, const AES128 &tweakKey, void *pData, long nByte,
+                       unsigned long dataUnit, bool bEncrypt) {
+        assert(nByte % AES_BlockSize == 0);
+        unsigned char tweak[AES_BlockSize] = {0};
+        memcpy(tweak, &dataUnit, sizeof(dataUnit));
+        auto p = static_cast<unsigned char *>(pData);
+        long nBlock = nByte / AES_BlockSize;
+
+        switch (CurrentImplementation()) {
+#ifdef TINYSQL_AES_X86
+            case Xts_VAES:
+                EncryptBlockAesNI(tweakKey, tweak);
+                XtsVAES(dataKey, tweak, p, nBlock, bEncrypt);
+                return;
+            case Xts_AesNI:
+                EncryptBlockAesNI(tweakKey, tweak);
+                XtsAesNI(dataKey, tweak, p, nBlock, bEncrypt);
+                return;
+#endif
+            default:
+                tweakKey.EncryptBlock(tweak);
+                XtsPortable(dataKey, tweak, p, nBlock, bEncrypt);
+        }
+    }
+
+    XTSCipher::XTSCipher(const unsigned char *pKey) : dataKey(pKey), tweakKey(pKey + AES_BlockSize) {
+    }
+
+    void XTSCipher::Encrypt(void *pData, long nByte, unsigned long dataUnit) const {
+        XtsRun(dataKey, tweakKey, pData, nByte, dataUnit, true);
+    }
+
+    void XTSCipher::Decrypt(void *pData, long nByte, unsigned long dataUnit) const {
+        XtsRun(dataKey, tweakKey, pData, nByte, dataUnit, false);
+    }
+
+    bool XTSCipher::SetImplementation(const char *zName) {
+        XtsImplementation best = DetectImplementation();
+        XtsImplementation impl;
+        if (strcmp(zName, "vaes") == 0)
+            impl = Xts_VAES;
+        else if (strcmp(zName, "aesni") == 0)
+            impl = Xts_AesNI;
+        else if (strcmp(zName, "portable") == 0)
+            impl = Xts_Portable;
+        else
+            return false;
+        if (impl > best)
+            return false;
+        Selected().store(impl, std::memory_order_relaxed);
+        return true;
+    }
+
+    const char *XTSCipher::Implementation() {
+        switch (CurrentImplementation()) {
+            case Xts_VAES:
+                return "vaes";
+            case Xts_AesNI:
+                return "aesni";
+            default:
+                return "portable";
+        }
+    }
+}
@@ -0,0 +1,45 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_AES_H
+#define SQLITELIKE_TINYSQL_AES_H
+
+namespace tinySQL {
+
+    static constexpr int AES_BlockSize = 16;
+    static constexpr int AES_Rounds = 10;
+    static constexpr int XTS_KeySize = 32;
+
+    //AES-128 key schedule,the block functions are the portable version and
+    //take the same time whatever the key and the data
+    struct AES128 {
+        unsigned char encKey[AES_Rounds + 1][AES_BlockSize];
+        //round keys of the equivalent inverse cipher,as aesdec expects them
+        unsigned char decKey[AES_Rounds + 1][AES_BlockSize];
+
+        explicit AES128(const unsigned char *pKey);
+
+        void EncryptBlock(unsigned char *pBlock) const;
+        void DecryptBlock(unsigned char *pBlock) const;
+    };
+
+    //XTS-AES-128 (IEEE 1619),the first 16 key bytes encrypt data,the last 16 the tweak.
+    //nByte must be a multiple of AES_BlockSize,each call is one data unit
+    class XTSCipher {
+    private:
+        AES128 dataKey;
+        AES128 tweakKey;
+    public:
+        explicit XTSCipher(const unsigned char *pKey);
+
+        void Encrypt(void *pData, long nByte, unsigned long dataUnit) const;
+        void Decrypt(void *pData, long nByte, unsigned long dataUnit) const;
+
+        //"vaes","aesni" or "portable",chosen once from cpuid
+        static const char *Implementation();
+        //makes every cipher use the named one,false when the cpu lacks it
+        static bool SetImplementation(const char *zName);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_AES_H
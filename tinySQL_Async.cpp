@@ -0,0 +1,355 @@
+//
+// Created by user on 26-10-19.
+//
+#include "tinySQL_Async.h"
+
+#ifdef TINYSQL_ASYNC
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define TINYSQL_URING 1
+#endif
+
+namespace tinySQL {
+
+    //runs the request through the file's own methods
+    static void Perform(AsyncRequest *pRequest) {
+        switch (pRequest->op) {
+            case Async_Read:
+                pRequest->status = pRequest->pFile->xRead(pRequest->pBuff, pRequest->n, pRequest->offset);
+                break;
+            case Async_Write:
+                pRequest->status = pRequest->pFile->xWrite(pRequest->pBuff, pRequest->n, pRequest->offset);
+                break;
+            default:
+                pRequest->status = pRequest->pFile->xSync(0);
+                break;
+        }
+        pRequest->done = pRequest->n;
+    }
+
+    void AsyncOp::await_suspend(std::coroutine_handle<> waiter) {
+        request.waiter = waiter;
+        pExecutor->nPending++;
+        pExecutor->Submit(&request);
+    }
+
+    int AsyncTask::Status() const {
+        if (!handle)
+            return Succeed;
+        if (handle.promise().pException)
+            std::rethrow_exception(handle.promise().pException);
+        return handle.promise().status;
+    }
+
+    AsyncTask::AsyncTask(AsyncTask &&other) noexcept: handle(std::exchange(other.handle, nullptr)) {
+    }
+
+    AsyncTask::~AsyncTask() {
+        if (handle)
+            handle.destroy();
+    }
+
+    int AsyncExecutor::Run(AsyncTask *aTask, int nTask) {
+        for (int i = 0; i < nTask; i++)
+            if (!aTask[i].Done())
+                aTask[i].handle.resume();
+        std::vector<AsyncRequest *> done;
+        while (true) {
+            bool bDone = true;
+            for (int i = 0; i < nTask && bDone; i++)
+                bDone = aTask[i].Done();
+            if (bDone)
+                break;
+            //a task waits on something that is not ours
+            if (nPending == 0)
+                return Misuse;
+            done.clear();
+            int status = Reap(&done);
+            if (status != Succeed)
+                return status;
+            for (AsyncRequest *pRequest: done) {
+                nPending--;
+                pRequest->waiter.resume();
+            }
+        }
+        for (int i = 0; i < nTask; i++) {
+            int status = aTask[i].Status();
+            if (status != Succeed)
+                return status;
+        }
+        return Succeed;
+    }
+
+    int AsyncExecutor::Run(AsyncTask &task) {
+        return Run(&task, 1);
+    }
+
+
+    void PoolExecutor::Submit(AsyncRequest *pRequest) {
+        group.Run(pPool, [this, pRequest]() {
+            Perform(pRequest);
+            pthread_mutex_lock(&mutex);
+            finished.push_back(pRequest);
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
+        });
+    }
+
+    int PoolExecutor::Reap(std::vector<AsyncRequest *> *pDone) {
+        pthread_mutex_lock(&mutex);
+        while (finished.empty())
+            pthread_cond_wait(&cond, &mutex);
+        pDone->insert(pDone->end(), finished.begin(), finished.end());
+        finished.clear();
+        pthread_mutex_unlock(&mutex);
+        return Succeed;
+    }
+
+    const char *PoolExecutor::Name() const {
+        return "pool";
+    }
+
+    PoolExecutor::PoolExecutor(ThreadPool *pPool) : mutex(), cond(), finished(), group(), pPool(pPool) {
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_cond_init(&cond, nullptr);
+    }
+
+    //requests left behind by a Run that failed still point here
+    PoolExecutor::~PoolExecutor() {
+        group.Wait();
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+#ifdef TINYSQL_URING
+    //the rings are shared with the kernel,only the loop thread touches them.
+    //requests queue in backlog and go into the ring in Reap,short reads and
+    //writes go back to the backlog for the rest
+    class UringExecutor : public AsyncExecutor {
+    private:
+        int ringFd;
+        void *pSqRing;
+        size_t sqRingSize;
+        void *pCqRing;
+        size_t cqRingSize;
+        io_uring_sqe *aSqe;
+        size_t sqeSize;
+        unsigned *pSqHead, *pSqTail, *pSqMask, *pSqArray;
+        unsigned sqEntries;
+        unsigned *pCqHead, *pCqTail, *pCqMask;
+        io_uring_cqe *aCqe;
+        unsigned cqEntries;
+        unsigned nInFlight;
+        std::vector<AsyncRequest *> backlog;
+
+        void Complete(AsyncRequest *pRequest, int res, std::vector<AsyncRequest *> *pDone);
+    protected:
+        void Submit(AsyncRequest *pRequest) override;
+        int Reap(std::vector<AsyncRequest *> *pDone) override;
+    public:
+        const char *Name() const override;
+
+        static UringExecutor *Create(unsigned depth);
+        ~UringExecutor() override;
+    private:
+        UringExecutor() : ringFd(-1), pSqRing(nullptr), sqRingSize(0), pCqRing(nullptr), cqRingSize(0),
+                          aSqe(nullptr), sqeSize(0), pSqHead(nullptr), pSqTail(nullptr), pSqMask(nullptr),
+                          pSqArray(nullptr), sqEntries(0), pCqHead(nullptr), pCqTail(nullptr), pCqMask(nullptr),
+                          aCqe(nullptr), cqEntries(0), nInFlight(0), backlog() {
+        }
+    };
+
+    UringExecutor *UringExecutor::Create(unsigned depth) {
+        io_uring_params params{};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+        if (fd < 0)
+            return nullptr;
+        auto p = new UringExecutor();
+        p->ringFd = fd;
+        p->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        p->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool bSingle = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (bSingle)
+            p->sqRingSize = p->cqRingSize = std::max(p->sqRingSize, p->cqRingSize);
+        p->pSqRing = OsMmap(nullptr, p->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQ_RING);
+        if (p->pSqRing == MAP_FAILED) {
+            p->pSqRing = nullptr;
+            delete p;
+            return nullptr;
+        }
+        p->pCqRing = bSingle ? p->pSqRing : OsMmap(nullptr, p->cqRingSize, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        p->sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *pSqes = OsMmap(nullptr, p->sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                             IORING_OFF_SQES);
+        if (p->pCqRing == MAP_FAILED || pSqes == MAP_FAILED) {
+            if (p->pCqRing == MAP_FAILED)
+                p->pCqRing = nullptr;
+            if (pSqes != MAP_FAILED)
+                p->aSqe = static_cast<io_uring_sqe *>(pSqes);
+            delete p;
+            return nullptr;
+        }
+        p->aSqe = static_cast<io_uring_sqe *>(pSqes);
+        auto sq = static_cast<unsigned char *>(p->pSqRing);
+        auto cq = static_cast<unsigned char *>(p->pCqRing);
+        p->pSqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        p->pSqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        p->pSqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        p->pSqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        p->sqEntries = params.sq_entries;
+        p->pCqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        p->pCqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        p->pCqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        p->aCqe = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        p->cqEntries = params.cq_entries;
+        return p;
+    }
+
+    void UringExecutor::Submit(AsyncRequest *pRequest) {
+        backlog.push_back(pRequest);
+    }
+
+    void UringExecutor::Complete(AsyncRequest *pRequest, int res, std::vector<AsyncRequest *> *pDone) {
+        if (res == -EINTR || res == -EAGAIN) {
+            backlog.push_back(pRequest);
+            return;
+        }
+        if (res < 0) {
+            pRequest->status = pRequest->op == Async_Read ? IOError_Read :
+                               pRequest->op == Async_Write ? IOError_Write : IOError_Fsync;
+        } else if (pRequest->op == Async_Sync) {
+            pRequest->status = Succeed;
+        } else if (res == 0) {
+            //past the end of the file a read comes back zero filled as from xRead
+            if (pRequest->op == Async_Read) {
+                memset(static_cast<char *>(pRequest->pBuff) + pRequest->done, 0, pRequest->n - pRequest->done);
+                pRequest->status = IOError_ReadShort;
+            } else
+                pRequest->status = IOError_Write;
+        } else {
+            pRequest->done += res;
+            if (pRequest->done < pRequest->n) {
+                backlog.push_back(pRequest);
+                return;
+            }
+            pRequest->status = Succeed;
+        }
+        pDone->push_back(pRequest);
+    }
+
+    int UringExecutor::Reap(std::vector<AsyncRequest *> *pDone) {
+        size_t nSubmit = 0;
+        size_t nTaken = 0;
+        unsigned tail = *pSqTail;
+        for (; nTaken < backlog.size(); nTaken++) {
+            AsyncRequest *pRequest = backlog[nTaken];
+            if (pRequest->fd < 0) {
+                Perform(pRequest);
+                pDone->push_back(pRequest);
+                continue;
+            }
+            if (tail - __atomic_load_n(pSqHead, __ATOMIC_ACQUIRE) == sqEntries || nInFlight == cqEntries)
+                break;
+            unsigned index = tail & *pSqMask;
+            io_uring_sqe *pSqe = &aSqe[index];
+            memset(pSqe, 0, sizeof(*pSqe));
+            pSqe->fd = pRequest->fd;
+            pSqe->user_data = reinterpret_cast<uintptr_t>(pRequest);
+            if (pRequest->op == Async_Sync) {
+                pSqe->opcode = IORING_OP_FSYNC;
+            } else {
+                pSqe->opcode = pRequest->op == Async_Read ? IORING_OP_READ : IORING_OP_WRITE;
+                pSqe->addr = reinterpret_cast<uintptr_t>(static_cast<char *>(pRequest->pBuff) + pRequest->done);
+                pSqe->len = static_cast<unsigned>(pRequest->n - pRequest->done);
+                pSqe->off = pRequest->offset + pRequest->done;
+            }
+            pSqArray[index] = index;
+            tail++;
+            nSubmit++;
+            nInFlight++;
+        }
+        backlog.erase(backlog.begin(), backlog.begin() + static_cast<long>(nTaken));
+        __atomic_store_n(pSqTail, tail, __ATOMIC_RELEASE);
+
+        //requests done inline are enough to go on with
+        unsigned minComplete = pDone->empty() && nInFlight > 0 ? 1 : 0;
+        while (nSubmit > 0 || minComplete > 0) {
+            long n = syscall(__NR_io_uring_enter, ringFd, nSubmit, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EBUSY)
+                    return IOError;
+            } else
+                nSubmit -= static_cast<size_t>(n);
+            unsigned head = *pCqHead;
+            unsigned cqTail = __atomic_load_n(pCqTail, __ATOMIC_ACQUIRE);
+            for (; head != cqTail; head++) {
+                io_uring_cqe *pCqe = &aCqe[head & *pCqMask];
+                nInFlight--;
+                Complete(reinterpret_cast<AsyncRequest *>(static_cast<uintptr_t>(pCqe->user_data)), pCqe->res, pDone);
+            }
+            __atomic_store_n(pCqHead, head, __ATOMIC_RELEASE);
+            minComplete = pDone->empty() && nInFlight > 0 ? 1 : 0;
+        }
+        return Succeed;
+    }
+
+    const char *UringExecutor::Name() const {
+        return "io_uring";
+    }
+
+    UringExecutor::~UringExecutor() {
+        if (aSqe)
+            OsMunmap(aSqe, sqeSize);
+        if (pCqRing && pCqRing != pSqRing)
+            OsMunmap(pCqRing, cqRingSize);
+        if (pSqRing)
+            OsMunmap(pSqRing, sqRingSize);
+        if (ringFd >= 0)
+            OsClose(ringFd);
+    }
+#endif
+
+    AsyncExecutor *AsyncExecutor::Create(int depth, ThreadPool *pPool) {
+#ifdef TINYSQL_URING
+        if (AsyncExecutor *p = UringExecutor::Create(static_cast<unsigned>(depth)))
+            return p;
+#endif
+        (void) depth;
+        return new PoolExecutor(pPool);
+    }
+
+
+    AsyncOp AsyncFile::Read(void *pBuff, long n, long offset) {
+        return AsyncOp(pExecutor, {Async_Read, pFile, fd, pBuff, n, offset, 0, Succeed, nullptr});
+    }
+
+    AsyncOp AsyncFile::Write(const void *pBuff, long n, long offset) {
+        return AsyncOp(pExecutor, {Async_Write, pFile, fd, const_cast<void *>(pBuff), n, offset, 0, Succeed, nullptr});
+    }
+
+    AsyncOp AsyncFile::Sync() {
+        return AsyncOp(pExecutor, {Async_Sync, pFile, fd, nullptr, 0, 0, 0, Succeed, nullptr});
+    }
+
+    static int FileDescriptor(tinySQL_file *pFile) {
+        int fd = -1;
+        if (pFile->xFileControl(Fcntl_FileDescriptor, &fd) != Succeed)
+            fd = -1;
+        return fd;
+    }
+
+    AsyncFile::AsyncFile(tinySQL_file *pFile, AsyncExecutor *pExecutor) :
+            pFile(pFile), pExecutor(pExecutor), fd(FileDescriptor(pFile)) {
+    }
+}
+#endif
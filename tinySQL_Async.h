@@ -0,0 +1,199 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_ASYNC_H
+#define SQLITELIKE_TINYSQL_ASYNC_H
+
+//coroutines need c++20,the rest of the tree builds without this header
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define TINYSQL_ASYNC 1
+
+#include <pthread.h>
+#include <coroutine>
+#include <exception>
+#include <vector>
+#include "tinySQL_ThreadPool.h"
+#include "tinySQL_def.h"
+#include "tinySQL_file.h"
+
+namespace tinySQL {
+
+    static constexpr int Async_Read = 0;
+    static constexpr int Async_Write = 1;
+    static constexpr int Async_Sync = 2;
+
+    class AsyncExecutor;
+
+    //one operation in flight,kept in the frame of the coroutine that waits on it
+    struct AsyncRequest {
+        int op;
+        tinySQL_file *pFile;
+        int fd;                     //-1 when the file has none
+        void *pBuff;
+        long n;
+        long offset;
+        long done;                  //bytes moved so far
+        int status;
+        std::coroutine_handle<> waiter;
+    };
+
+    //co_await gives the status the tinySQL_file method would have returned
+    class AsyncOp {
+    private:
+        AsyncExecutor *const pExecutor;
+        AsyncRequest request;
+    public:
+        AsyncOp(AsyncExecutor *pExecutor, const AsyncRequest &request) : pExecutor(pExecutor), request(request) {
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> waiter);
+
+        int await_resume() const noexcept {
+            return request.status;
+        }
+    };
+
+    //coroutine returning a status.it starts when it is awaited or handed to
+    //AsyncExecutor::Run and resumes its awaiter when it returns
+    class AsyncTask {
+        friend class AsyncExecutor;
+    public:
+        struct promise_type {
+            int status = Succeed;
+            std::coroutine_handle<> continuation;
+            std::exception_ptr pException;
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    std::coroutine_handle<> next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept {
+                }
+            };
+
+            AsyncTask get_return_object() {
+                return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            FinalAwaiter final_suspend() noexcept {
+                return {};
+            }
+
+            void return_value(int value) {
+                status = value;
+            }
+
+            void unhandled_exception() {
+                pException = std::current_exception();
+            }
+        };
+
+        bool await_ready() const noexcept {
+            return !handle || handle.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            handle.promise().continuation = awaiter;
+            return handle;
+        }
+
+        int await_resume() const {
+            return Status();
+        }
+
+        bool Done() const {
+            return !handle || handle.done();
+        }
+
+        //what the coroutine returned,an exception it let out is thrown again
+        int Status() const;
+
+        AsyncTask(AsyncTask &&other) noexcept;
+        AsyncTask(const AsyncTask &) = delete;
+        AsyncTask &operator=(const AsyncTask &) = delete;
+        ~AsyncTask();
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit AsyncTask(std::coroutine_handle<promise_type> handle) : handle(handle) {
+        }
+    };
+
+    //event loop of one thread.coroutines are resumed on the thread in Run as
+    //their i/o finishes,so everything they touch needs no lock of its own
+    class AsyncExecutor {
+        friend class AsyncOp;
+    protected:
+        int nPending;
+
+        virtual void Submit(AsyncRequest *pRequest) = 0;
+        //waits for at least one request to finish and adds the finished ones to pDone
+        virtual int Reap(std::vector<AsyncRequest *> *pDone) = 0;
+    public:
+        //runs the tasks until all of them return,their i/o is in flight together.
+        //the first status other than Succeed is returned
+        int Run(AsyncTask *aTask, int nTask);
+        int Run(AsyncTask &task);
+        virtual const char *Name() const = 0;
+
+        AsyncExecutor() : nPending(0) {
+        }
+
+        virtual ~AsyncExecutor() = default;
+
+        //io_uring with depth entries where the kernel allows it,a PoolExecutor
+        //on pPool otherwise
+        static AsyncExecutor *Create(int depth, ThreadPool *pPool = ThreadPool::Global());
+    };
+
+    //every request is a task on the pool running the tinySQL_file method
+    class PoolExecutor : public AsyncExecutor {
+    private:
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        std::vector<AsyncRequest *> finished;
+        TaskGroup group;
+    protected:
+        void Submit(AsyncRequest *pRequest) override;
+        int Reap(std::vector<AsyncRequest *> *pDone) override;
+    public:
+        ThreadPool *const pPool;
+
+        const char *Name() const override;
+
+        explicit PoolExecutor(ThreadPool *pPool);
+        ~PoolExecutor() override;
+    };
+
+    //awaitable calls on a tinySQL_file.io_uring reads and writes the
+    //descriptor of a plain unix file,other files go through their methods
+    class AsyncFile {
+    public:
+        tinySQL_file *const pFile;
+        AsyncExecutor *const pExecutor;
+        const int fd;
+
+        AsyncOp Read(void *pBuff, long n, long offset);
+        AsyncOp Write(const void *pBuff, long n, long offset);
+        AsyncOp Sync();
+
+        AsyncFile(tinySQL_file *pFile, AsyncExecutor *pExecutor);
+    };
+}
+#endif
+#endif //SQLITELIKE_TINYSQL_ASYNC_H
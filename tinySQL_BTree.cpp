@@ -0,0 +1,1011 @@
+//
+// Created by user on 26-10-19.
+//
+#include <climits>
+#include <unordered_map>
+#include "tinySQL_BTree.h"
+
+namespace tinySQL {
+
+    static int CompareBytes(const unsigned char *a, int na, const unsigned char *b, int nb) {
+        int c = memcmp(a, b, std::min(na, nb));
+        return c != 0 ? c : na - nb;
+    }
+
+    static int CommonPrefix(const std::string &a, const std::string &b) {
+        size_t n = std::min(a.size(), b.size());
+        size_t i = 0;
+        while (i < n && a[i] == b[i])
+            i++;
+        return static_cast<int>(i);
+    }
+
+    static const unsigned char *Bytes(const std::string &s) {
+        return reinterpret_cast<const unsigned char *>(s.data());
+    }
+
+    long BtPage::FullSize(int type, const BtCell &cell) {
+        long size = BtSlot_Size + 4 + static_cast<long>(cell.key.size());
+        if (type == BtPage_Leaf)
+            size += static_cast<long>(cell.local.size()) + (cell.local.size() < cell.valueSize ? 4 : 0);
+        return size;
+    }
+
+    std::string BtPage::Key(int i) const {
+        std::string key(reinterpret_cast<const char *>(Prefix()), PrefixLength());
+        key.append(reinterpret_cast<const char *>(Suffix(i)), SuffixLength(i));
+        return key;
+    }
+
+    int BtPage::CellSize(int i) const {
+        int suffixLength = SuffixLength(i);
+        if (!IsLeaf())
+            return 4 + suffixLength;
+        unsigned valueSize = Get4(&a[CellOffset(i)]);
+        unsigned local = LocalSize(pageSize, PrefixLength() + suffixLength, valueSize);
+        return 4 + suffixLength + static_cast<int>(local) + (local < valueSize ? 4 : 0);
+    }
+
+    void BtPage::ReadCell(int i, BtCell *pCell) const {
+        const unsigned char *pCellData = &a[CellOffset(i)];
+        int suffixLength = SuffixLength(i);
+        pCell->key = Key(i);
+        if (IsLeaf()) {
+            pCell->child = 0;
+            pCell->valueSize = Get4(pCellData);
+            unsigned local = LocalSize(pageSize, static_cast<int>(pCell->key.size()), pCell->valueSize);
+            pCell->local.assign(reinterpret_cast<const char *>(pCellData + 4 + suffixLength), local);
+            pCell->overflow = local < pCell->valueSize ? Get4(pCellData + 4 + suffixLength + local) : 0;
+        } else {
+            pCell->child = Get4(pCellData);
+            pCell->valueSize = 0;
+            pCell->local.clear();
+            pCell->overflow = 0;
+        }
+    }
+
+    std::vector<BtCell> BtPage::ReadAll() const {
+        int n = CellCount();
+        std::vector<BtCell> cells(n);
+        for (int i = 0; i < n; i++)
+            ReadCell(i, &cells[i]);
+        return cells;
+    }
+
+    //<0 when the key of cell i sorts before pKey
+    int BtPage::Compare(int i, const unsigned char *pKey, int nKey) const {
+        int prefixLength = PrefixLength();
+        int c = memcmp(Prefix(), pKey, std::min(prefixLength, nKey));
+        if (c != 0)
+            return c;
+        if (nKey < prefixLength)
+            return 1;
+        return CompareBytes(Suffix(i), SuffixLength(i), pKey + prefixLength, nKey - prefixLength);
+    }
+
+    //index of the first cell whose key is >= pKey.a key outside the page
+    //prefix is placed by one compare,inside it the 4 byte heads in the slots
+    //decide most steps and the cell itself is only read on equal heads
+    int BtPage::Search(const unsigned char *pKey, int nKey, bool *pExact) const {
+        *pExact = false;
+        int n = CellCount();
+        int prefixLength = PrefixLength();
+        int c = memcmp(pKey, Prefix(), std::min(prefixLength, nKey));
+        if (c < 0 || (c == 0 && nKey < prefixLength))
+            return 0;
+        if (c > 0)
+            return n;
+
+        const unsigned char *pSuffix = pKey + prefixLength;
+        int nSuffix = nKey - prefixLength;
+        uint32_t head = Head(pSuffix, nSuffix);
+        const unsigned char *pSlots = &a[SlotStart()];
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            const unsigned char *pSlot = pSlots + mid * BtSlot_Size;
+            uint32_t slotHead = Get4(pSlot + 4);
+            int cmp;
+            if (slotHead != head)
+                cmp = slotHead < head ? -1 : 1;
+            else
+                cmp = CompareBytes(&a[Get2(pSlot) + 4], static_cast<int>(Get2(pSlot + 2)), pSuffix, nSuffix);
+            if (cmp < 0)
+                lo = mid + 1;
+            else {
+                hi = mid;
+                if (cmp == 0)
+                    *pExact = true;
+            }
+        }
+        return lo;
+    }
+
+    //false when the cell does not share the page prefix or the free gap
+    //between slots and cell content is too small
+    bool BtPage::InsertInPlace(int i, const BtCell &cell) {
+        int prefixLength = PrefixLength();
+        int nKey = static_cast<int>(cell.key.size());
+        if (nKey < prefixLength || memcmp(cell.key.data(), Prefix(), prefixLength) != 0)
+            return false;
+        int n = CellCount();
+        int suffixLength = nKey - prefixLength;
+        int size = 4 + suffixLength;
+        if (IsLeaf())
+            size += static_cast<int>(cell.local.size()) + (cell.local.size() < cell.valueSize ? 4 : 0);
+        int start = ContentStart() - size;
+        if (start < SlotStart() + (n + 1) * BtSlot_Size)
+            return false;
+
+        unsigned char *pCellData = &a[start];
+        const unsigned char *pSuffix = Bytes(cell.key) + prefixLength;
+        Put4(pCellData, IsLeaf() ? cell.valueSize : cell.child);
+        memcpy(pCellData + 4, pSuffix, suffixLength);
+        if (IsLeaf()) {
+            memcpy(pCellData + 4 + suffixLength, cell.local.data(), cell.local.size());
+            if (cell.local.size() < cell.valueSize)
+                Put4(pCellData + 4 + suffixLength + cell.local.size(), cell.overflow);
+        }
+
+        unsigned char *pSlot = &a[SlotStart() + i * BtSlot_Size];
+        memmove(pSlot + BtSlot_Size, pSlot, (n - i) * BtSlot_Size);
+        Put2(pSlot, start);
+        Put2(pSlot + 2, suffixLength);
+        Put4(pSlot + 4, Head(pSuffix, suffixLength));
+        Put2(&a[BtHeader_CellCount], n + 1);
+        Put2(&a[BtHeader_ContentStart], start);
+        return true;
+    }
+
+    //the cell bytes stay behind as a hole until the page is built again
+    void BtPage::Remove(int i) {
+        int n = CellCount();
+        unsigned char *pSlot = &a[SlotStart() + i * BtSlot_Size];
+        memmove(pSlot, pSlot + BtSlot_Size, (n - i - 1) * BtSlot_Size);
+        Put2(&a[BtHeader_CellCount], n - 1);
+    }
+
+    void BtPage::Build(int type, const BtCell *pCells, int nCell, unsigned right, unsigned left) {
+        int prefixLength = nCell >= 2 ? CommonPrefix(pCells[0].key, pCells[nCell - 1].key) : 0;
+        memset(a, 0, pageSize);
+        a[BtHeader_Type] = static_cast<unsigned char>(type);
+        Put2(&a[BtHeader_PrefixLength], prefixLength);
+        Put2(&a[BtHeader_ContentStart], pageSize);
+        SetRight(right);
+        SetLeft(left);
+        if (prefixLength > 0)
+            memcpy(&a[BtHeader_Size], pCells[0].key.data(), prefixLength);
+        for (int i = 0; i < nCell; i++) {
+            bool bInserted = InsertInPlace(i, pCells[i]);
+            assert(bInserted);
+            (void) bInserted;
+        }
+    }
+
+    long BtPage::BuildSize(int type, const BtCell *pCells, int nCell) {
+        int prefixLength = nCell >= 2 ? CommonPrefix(pCells[0].key, pCells[nCell - 1].key) : 0;
+        long size = (BtHeader_Size + prefixLength + 7) & ~7;
+        for (int i = 0; i < nCell; i++)
+            size += FullSize(type, pCells[i]) - prefixLength;
+        return size;
+    }
+
+    //split cells over as few pages as fit,or when bPack is false over the same
+    //number of pages evenly.for interior pages the cell after each range moves
+    //up to the parent as separator
+    static std::vector<std::pair<int, int>> Partition(int type, const std::vector<BtCell> &cells, int pageSize,
+                                                      bool bPack) {
+        int n = static_cast<int>(cells.size());
+        bool bLeaf = type == BtPage_Leaf;
+        std::vector<long> sums(n + 1, 0);
+        for (int i = 0; i < n; i++)
+            sums[i + 1] = sums[i] + BtPage::FullSize(type, cells[i]);
+        auto size = [&](int s, int e) -> long {
+            int prefixLength = e - s >= 2 ? CommonPrefix(cells[s].key, cells[e - 1].key) : 0;
+            return ((BtHeader_Size + prefixLength + 7) & ~7) + sums[e] - sums[s] -
+                   static_cast<long>(e - s) * prefixLength;
+        };
+        auto greedy = [&](long limit) {
+            std::vector<std::pair<int, int>> ranges;
+            int s = 0;
+            for (;;) {
+                int e = s + 1;
+                while (e < n && size(s, e + 1) <= limit)
+                    e++;
+                if (!bLeaf && e == n - 1 && e - s >= 2)
+                    e--;
+                ranges.emplace_back(s, e);
+                if (e >= n)
+                    break;
+                s = bLeaf ? e : e + 1;
+                if (s >= n) {
+                    ranges.emplace_back(n, n);
+                    break;
+                }
+            }
+            return ranges;
+        };
+
+        auto ranges = greedy(pageSize);
+        if (bPack || ranges.size() < 2)
+            return ranges;
+        long target = sums[n] / static_cast<long>(ranges.size()) + sums[n] / n;
+        return greedy(std::min(target, static_cast<long>(pageSize)));
+    }
+
+    int BTree::Create(Pager *pPager, unsigned *pRoot) {
+        int status = pPager->BeginWrite();
+        if (status != Succeed)
+            return status;
+        PgHdr *pPage;
+        status = pPager->Allocate(&pPage);
+        if (status != Succeed)
+            return status;
+        BtPage(pPage->pData, pPager->pageSize).Build(BtPage_Leaf, nullptr, 0, 0, 0);
+        *pRoot = pPage->pgno;
+        pPager->Unref(pPage);
+        return Succeed;
+    }
+
+    void BTree::ReleasePath(std::vector<BtPathEntry> *pPath) {
+        for (auto &entry: *pPath)
+            if (entry.pPage)
+                pPager->Unref(entry.pPage);
+        pPath->clear();
+    }
+
+    int BTree::Descend(const unsigned char *pKey, int nKey, std::vector<BtPathEntry> *pPath, bool *pExact) {
+        unsigned pgno = root;
+        pPath->reserve(8);
+        for (;;) {
+            PgHdr *pPage;
+            int status = pPager->Get(pgno, &pPage);
+            if (status != Succeed) {
+                ReleasePath(pPath);
+                return status;
+            }
+            BtPage page(pPage->pData, pPager->pageSize);
+            bool bExact;
+            int index = page.Search(pKey, nKey, &bExact);
+            pPath->push_back({pPage, index});
+            if (page.IsLeaf()) {
+                *pExact = bExact;
+                return Succeed;
+            }
+            if (page.Type() != BtPage_Interior || pPath->size() > BtMaxDepth) {
+                ReleasePath(pPath);
+                return Corrupt;
+            }
+            pgno = page.Child(index);
+        }
+    }
+
+    //follow the rightmost children only,*pAppend tells whether pKey sorts
+    //after every key of the tree
+    int BTree::DescendRightmost(const unsigned char *pKey, int nKey, std::vector<BtPathEntry> *pPath, bool *pAppend) {
+        unsigned pgno = root;
+        for (;;) {
+            PgHdr *pPage;
+            int status = pPager->Get(pgno, &pPage);
+            if (status != Succeed) {
+                ReleasePath(pPath);
+                return status;
+            }
+            BtPage page(pPage->pData, pPager->pageSize);
+            int n = page.CellCount();
+            pPath->push_back({pPage, n});
+            if (page.IsLeaf()) {
+                *pAppend = n > 0 && page.Compare(n - 1, pKey, nKey) < 0;
+                return Succeed;
+            }
+            if (page.Type() != BtPage_Interior || pPath->size() > BtMaxDepth) {
+                ReleasePath(pPath);
+                return Corrupt;
+            }
+            pgno = page.Right();
+        }
+    }
+
+    int BTree::WriteOverflow(const unsigned char *pData, long nData, unsigned *pFirst) {
+        const long capacity = pPager->pageSize - BtOverflow_Header;
+        PgHdr *pPrev = nullptr;
+        *pFirst = 0;
+        for (long done = 0; done < nData;) {
+            PgHdr *pPage;
+            int status = pPager->Allocate(&pPage);
+            if (status != Succeed) {
+                if (pPrev)
+                    pPager->Unref(pPrev);
+                return status;
+            }
+            long take = std::min(capacity, nData - done);
+            pPage->pData[0] = BtPage_Overflow;
+            memcpy(&pPage->pData[BtOverflow_Header], pData + done, take);
+            if (pPrev) {
+                Put4(&pPrev->pData[BtOverflow_Next], pPage->pgno);
+                pPager->Unref(pPrev);
+            } else
+                *pFirst = pPage->pgno;
+            pPrev = pPage;
+            done += take;
+        }
+        if (pPrev)
+            pPager->Unref(pPrev);
+        return Succeed;
+    }
+
+    int BTree::ReadValue(const BtPage &page, int i, std::string *pValue) {
+        const unsigned char *pCellData = &page.a[page.CellOffset(i)];
+        int suffixLength = page.SuffixLength(i);
+        unsigned valueSize = Get4(pCellData);
+        unsigned local = BtPage::LocalSize(page.pageSize, page.PrefixLength() + suffixLength, valueSize);
+        pValue->assign(reinterpret_cast<const char *>(pCellData + 4 + suffixLength), local);
+        if (local == valueSize)
+            return Succeed;
+
+        pValue->resize(valueSize);
+        const long capacity = page.pageSize - BtOverflow_Header;
+        unsigned next = Get4(pCellData + 4 + suffixLength + local);
+        for (long done = local; done < valueSize;) {
+            PgHdr *pPage;
+            int status = next == 0 ? Corrupt : pPager->Get(next, &pPage);
+            if (status != Succeed)
+                return status;
+            if (pPage->pData[0] != BtPage_Overflow) {
+                pPager->Unref(pPage);
+                return Corrupt;
+            }
+            long take = std::min(capacity, static_cast<long>(valueSize) - done);
+            memcpy(&(*pValue)[done], &pPage->pData[BtOverflow_Header], take);
+            next = Get4(&pPage->pData[BtOverflow_Next]);
+            pPager->Unref(pPage);
+            done += take;
+        }
+        return Succeed;
+    }
+
+    //overflow pages of the value of cell i
+    int BTree::FreeOverflow(const BtPage &page, int i) {
+        const unsigned char *pCellData = &page.a[page.CellOffset(i)];
+        int suffixLength = page.SuffixLength(i);
+        unsigned valueSize = Get4(pCellData);
+        unsigned local = BtPage::LocalSize(page.pageSize, page.PrefixLength() + suffixLength, valueSize);
+        const long capacity = page.pageSize - BtOverflow_Header;
+        unsigned next = local < valueSize ? Get4(pCellData + 4 + suffixLength + local) : 0;
+        for (long done = local; done < valueSize; done += capacity) {
+            PgHdr *pPage;
+            int status = next == 0 ? Corrupt : pPager->Get(next, &pPage);
+            if (status != Succeed)
+                return status;
+            if (pPage->pData[0] != BtPage_Overflow) {
+                pPager->Unref(pPage);
+                return Corrupt;
+            }
+            unsigned pgno = next;
+            next = Get4(&pPage->pData[BtOverflow_Next]);
+            pPager->Unref(pPage);
+            status = pPager->Free(pgno);
+            if (status != Succeed)
+                return status;
+        }
+        return Succeed;
+    }
+
+    int BTree::InsertCell(std::vector<BtPathEntry> &path, int level, int index, const BtCell &cell, bool bPack) {
+        PgHdr *pPage = path[level].pPage;
+        int status = pPager->Write(pPage);
+        if (status != Succeed)
+            return status;
+        BtPage page(pPage->pData, pPager->pageSize);
+        if (page.InsertInPlace(index, cell))
+            return Succeed;
+        auto cells = page.ReadAll();
+        cells.insert(cells.begin() + index, cell);
+        return Store(path, level, cells, page.Right(), bPack);
+    }
+
+    //make the page at path[level] hold cells,splitting it and inserting the
+    //separators into the parent when they do not fit
+    int BTree::Store(std::vector<BtPathEntry> &path, int level, std::vector<BtCell> &cells, unsigned right,
+                     bool bPack) {
+        PgHdr *pPage = path[level].pPage;
+        BtPage page(pPage->pData, pPager->pageSize);
+        int type = page.Type();
+        bool bLeaf = type == BtPage_Leaf;
+        int status = pPager->Write(pPage);
+        if (status != Succeed)
+            return status;
+        if (BtPage::BuildSize(type, cells.data(), static_cast<int>(cells.size())) <= pPager->pageSize) {
+            page.Build(type, cells.data(), static_cast<int>(cells.size()), right, page.Left());
+            return Succeed;
+        }
+
+        auto ranges = Partition(type, cells, pPager->pageSize, bPack);
+        int k = static_cast<int>(ranges.size());
+        bool bRoot = level == 0;
+        std::vector<PgHdr *> pages(k, nullptr);
+        if (!bRoot)
+            pages[0] = pPage;
+        for (int j = bRoot ? 0 : 1; j < k; j++) {
+            status = pPager->Allocate(&pages[j]);
+            if (status != Succeed) {
+                for (int i = bRoot ? 0 : 1; i < j; i++)
+                    pPager->Unref(pages[i]);
+                return status;
+            }
+        }
+
+        unsigned oldLeft = bLeaf ? page.Left() : 0;
+        unsigned oldRight = bLeaf ? page.Right() : 0;
+        std::vector<BtCell> separators(k - 1);
+        for (int j = 0; j < k; j++) {
+            int s = ranges[j].first, e = ranges[j].second;
+            unsigned pageRight, pageLeft = 0;
+            if (bLeaf) {
+                pageLeft = j == 0 ? oldLeft : pages[j - 1]->pgno;
+                pageRight = j == k - 1 ? oldRight : pages[j + 1]->pgno;
+            } else
+                pageRight = j == k - 1 ? right : cells[e].child;
+            BtPage(pages[j]->pData, pPager->pageSize).Build(type, &cells[s], e - s, pageRight, pageLeft);
+            if (j < k - 1) {
+                separators[j].key = bLeaf ? cells[e - 1].key : cells[e].key;
+                separators[j].child = pages[j]->pgno;
+            }
+        }
+        unsigned last = pages[k - 1]->pgno;
+        for (int j = bRoot ? 0 : 1; j < k; j++)
+            pPager->Unref(pages[j]);
+
+        if (bLeaf && oldRight != 0) {
+            PgHdr *pNext;
+            status = pPager->Get(oldRight, &pNext);
+            if (status != Succeed)
+                return status;
+            pPager->Write(pNext);
+            BtPage(pNext->pData, pPager->pageSize).SetLeft(last);
+            pPager->Unref(pNext);
+        }
+
+        if (bRoot) {
+            page.Build(BtPage_Interior, nullptr, 0, last, 0);
+            return Store(path, 0, separators, last, bPack);
+        }
+
+        PgHdr *pParent = path[level - 1].pPage;
+        int parentIndex = path[level - 1].index;
+        status = pPager->Write(pParent);
+        if (status != Succeed)
+            return status;
+        BtPage parent(pParent->pData, pPager->pageSize);
+        if (k == 2) {
+            parent.SetChild(parentIndex, last);
+            return InsertCell(path, level - 1, parentIndex, separators[0], bPack);
+        }
+        auto parentCells = parent.ReadAll();
+        unsigned parentRight = parent.Right();
+        if (parentIndex == static_cast<int>(parentCells.size()))
+            parentRight = last;
+        else
+            parentCells[parentIndex].child = last;
+        parentCells.insert(parentCells.begin() + parentIndex, separators.begin(), separators.end());
+        return Store(path, level - 1, parentCells, parentRight, bPack);
+    }
+
+    //cursors remember their key so they can find their place again after the change
+    void BTree::SaveCursors() {
+        for (auto pCursor: cursors) {
+            if (pCursor->eState != Cursor_Valid)
+                continue;
+            PgHdr *pPage;
+            if (pCursor->generation != pPager->generation || pPager->Get(pCursor->pgno, &pPage) != Succeed) {
+                pCursor->eState = Cursor_Invalid;
+                continue;
+            }
+            pCursor->savedKey = BtPage(pPage->pData, pPager->pageSize).Key(pCursor->index);
+            pCursor->eState = Cursor_RequireSeek;
+            pPager->Unref(pPage);
+        }
+    }
+
+    //keys arriving in ascending order go straight down the right edge and
+    //fill the last leaf completely before a new one is started
+    int BTree::Insert(const void *pKey, int nKey, const void *pValue, long nValue) {
+        auto zKey = static_cast<const unsigned char *>(pKey);
+        if (nKey < 0 || nKey > MaxKeySize() || nValue < 0 || nValue > static_cast<long>(UINT_MAX))
+            return TooBig;
+        int status = pPager->BeginWrite();
+        if (status != Succeed)
+            return status;
+        SaveCursors();
+
+        std::vector<BtPathEntry> path;
+        bool bAppend = false, bExact = false;
+        if (bAppendHint) {
+            status = DescendRightmost(zKey, nKey, &path, &bAppend);
+            if (status != Succeed)
+                return status;
+            if (!bAppend)
+                ReleasePath(&path);
+        }
+        if (!bAppend) {
+            status = Descend(zKey, nKey, &path, &bExact);
+            if (status != Succeed)
+                return status;
+        }
+
+        BtPathEntry &leafEntry = path.back();
+        BtPage leaf(leafEntry.pPage->pData, pPager->pageSize);
+        bAppendHint = leaf.Right() == 0 && leafEntry.index == leaf.CellCount();
+        status = pPager->Write(leafEntry.pPage);
+        if (status == Succeed && bExact && (status = FreeOverflow(leaf, leafEntry.index)) == Succeed)
+            leaf.Remove(leafEntry.index);
+
+        BtCell cell{std::string(reinterpret_cast<const char *>(pKey), nKey), 0, static_cast<unsigned>(nValue), {}, 0};
+        unsigned local = BtPage::LocalSize(pPager->pageSize, nKey, cell.valueSize);
+        cell.local.assign(static_cast<const char *>(pValue), local);
+        if (status == Succeed && local < cell.valueSize)
+            status = WriteOverflow(static_cast<const unsigned char *>(pValue) + local, nValue - local, &cell.overflow);
+        if (status == Succeed)
+            status = InsertCell(path, static_cast<int>(path.size()) - 1, leafEntry.index, cell, bAppend);
+        ReleasePath(&path);
+        return status;
+    }
+
+    int BTree::Delete(const void *pKey, int nKey) {
+        int status = pPager->BeginWrite();
+        if (status != Succeed)
+            return status;
+        std::vector<BtPathEntry> path;
+        bool bExact;
+        status = Descend(static_cast<const unsigned char *>(pKey), nKey, &path, &bExact);
+        if (status != Succeed)
+            return status;
+        if (!bExact) {
+            ReleasePath(&path);
+            return NotFound;
+        }
+        SaveCursors();
+        BtPage leaf(path.back().pPage->pData, pPager->pageSize);
+        status = pPager->Write(path.back().pPage);
+        if (status == Succeed)
+            status = FreeOverflow(leaf, path.back().index);
+        if (status == Succeed) {
+            leaf.Remove(path.back().index);
+            if (leaf.CellCount() == 0 && path.size() > 1)
+                status = Prune(path, static_cast<int>(path.size()) - 1);
+        }
+        ReleasePath(&path);
+        return status;
+    }
+
+    //the page at path[level] has no cells or children left:it leaves the tree
+    //and its parent loses the pointer to it,a parent left without children
+    //follows.the root stays,as an empty leaf
+    int BTree::Prune(std::vector<BtPathEntry> &path, int level) {
+        PgHdr *pPage = path[level].pPage;
+        BtPage page(pPage->pData, pPager->pageSize);
+        int status = pPager->Write(pPage);
+        if (status != Succeed)
+            return status;
+        if (level == 0) {
+            page.Build(BtPage_Leaf, nullptr, 0, 0, 0);
+            return Succeed;
+        }
+        if (page.IsLeaf()) {
+            PgHdr *pSibling;
+            if (page.Left() != 0 && (status = pPager->Get(page.Left(), &pSibling)) == Succeed) {
+                pPager->Write(pSibling);
+                BtPage(pSibling->pData, pPager->pageSize).SetRight(page.Right());
+                pPager->Unref(pSibling);
+            }
+            if (status == Succeed && page.Right() != 0 && (status = pPager->Get(page.Right(), &pSibling)) == Succeed) {
+                pPager->Write(pSibling);
+                BtPage(pSibling->pData, pPager->pageSize).SetLeft(page.Left());
+                pPager->Unref(pSibling);
+            }
+            if (status != Succeed)
+                return status;
+        }
+
+        PgHdr *pParent = path[level - 1].pPage;
+        int index = path[level - 1].index;
+        BtPage parent(pParent->pData, pPager->pageSize);
+        status = pPager->Write(pParent);
+        if (status != Succeed)
+            return status;
+        int n = parent.CellCount();
+        if (index < n)
+            parent.Remove(index);
+        else if (n > 0) {
+            parent.SetRight(parent.Child(n - 1));
+            parent.Remove(n - 1);
+        }
+        unsigned pgno = pPage->pgno;
+        pPager->Unref(pPage);
+        path[level].pPage = nullptr;
+        status = pPager->Free(pgno);
+        if (status == Succeed && n == 0)
+            status = Prune(path, level - 1);
+        return status;
+    }
+
+    struct BtReference {
+        unsigned from;
+        int offset;
+    };
+
+    using BtReferences = std::unordered_map<unsigned, std::vector<BtReference>>;
+
+    static void AddReference(unsigned pgno, unsigned from, int offset, unsigned limit, BtReferences *pRefs) {
+        if (pgno > limit)
+            (*pRefs)[pgno].push_back({from, offset});
+    }
+
+    //where the pages past limit of the subtree under pgno are pointed to from
+    static int CollectReferences(Pager *pPager, unsigned pgno, unsigned limit, int depth, BtReferences *pRefs) {
+        if (depth > BtMaxDepth)
+            return Corrupt;
+        PgHdr *pPage;
+        int status = pPager->Get(pgno, &pPage);
+        if (status != Succeed)
+            return status;
+        BtPage page(pPage->pData, pPager->pageSize);
+        int n = page.CellCount();
+        std::vector<unsigned> children;
+        if (page.Type() == BtPage_Interior) {
+            for (int i = 0; i <= n; i++) {
+                children.push_back(page.Child(i));
+                AddReference(page.Child(i), pgno, i == n ? BtHeader_Right : page.CellOffset(i), limit, pRefs);
+            }
+        } else if (page.IsLeaf()) {
+            AddReference(page.Right(), pgno, BtHeader_Right, limit, pRefs);
+            AddReference(page.Left(), pgno, BtHeader_Left, limit, pRefs);
+            const long capacity = pPager->pageSize - BtOverflow_Header;
+            for (int i = 0; i < n && status == Succeed; i++) {
+                int offset = page.CellOffset(i);
+                unsigned valueSize = Get4(&page.a[offset]);
+                int suffixLength = page.SuffixLength(i);
+                unsigned local = BtPage::LocalSize(pPager->pageSize, page.PrefixLength() + suffixLength, valueSize);
+                unsigned from = pgno;
+                offset += 4 + suffixLength + static_cast<int>(local);
+                unsigned next = local < valueSize ? Get4(&page.a[offset]) : 0;
+                for (long done = local; done < valueSize; done += capacity) {
+                    AddReference(next, from, offset, limit, pRefs);
+                    PgHdr *pOverflow;
+                    if (done + capacity >= valueSize)
+                        break;
+                    status = next == 0 ? Corrupt : pPager->Get(next, &pOverflow);
+                    if (status != Succeed)
+                        break;
+                    from = next;
+                    offset = BtOverflow_Next;
+                    next = Get4(&pOverflow->pData[BtOverflow_Next]);
+                    pPager->Unref(pOverflow);
+                }
+            }
+        } else
+            status = Corrupt;
+        pPager->Unref(pPage);
+        for (size_t i = 0; i < children.size() && status == Succeed; i++)
+            status = CollectReferences(pPager, children[i], limit, depth + 1, pRefs);
+        return status;
+    }
+
+    //pages are moved from the end down,each to the first free page,and the
+    //pages pointing to it are patched where they are by then
+    int BTree::Vacuum(Pager *pPager, const unsigned *pRoot, int nRoot, unsigned nMax) {
+        int status = pPager->BeginWrite();
+        unsigned nFree = 0;
+        if (status == Succeed)
+            status = pPager->FreeCount(&nFree);
+        if (status != Succeed || nFree == 0)
+            return status;
+        unsigned limit = pPager->nPage - std::min(nMax, nFree);
+        for (int i = 0; i < nRoot; i++)
+            limit = std::max(limit, pRoot[i]);
+        BtReferences refs;
+        for (int i = 0; i < nRoot && status == Succeed; i++)
+            status = CollectReferences(pPager, pRoot[i], limit, 0, &refs);
+        int state = Page_Used;
+        for (unsigned pgno = pPager->nPage; pgno > limit && status == Succeed; pgno--) {
+            status = pPager->PageState(pgno, &state);
+            if (status == Succeed && state == Page_Used && refs.count(pgno) == 0)
+                limit = pgno;
+        }
+
+        std::unordered_map<unsigned, unsigned> moved;
+        for (unsigned pgno = pPager->nPage; pgno > limit && status == Succeed; pgno--) {
+            status = pPager->PageState(pgno, &state);
+            //a page freed into a run without a bitmap turns into one,and moves again
+            while (status == Succeed && state != Page_Free) {
+                unsigned to;
+                status = pPager->Relocate(pgno, &to);
+                if (status != Succeed)
+                    break;
+                if (state == Page_Used) {
+                    moved[pgno] = to;
+                    for (auto &ref: refs[pgno]) {
+                        auto it = moved.find(ref.from);
+                        PgHdr *pPage;
+                        status = pPager->Get(it == moved.end() ? ref.from : it->second, &pPage);
+                        if (status != Succeed)
+                            break;
+                        pPager->Write(pPage);
+                        Put4(&pPage->pData[ref.offset], to);
+                        pPager->Unref(pPage);
+                    }
+                }
+                if (status == Succeed && to > limit)
+                    status = SpaceFull;
+                if (status == Succeed)
+                    status = pPager->PageState(pgno, &state);
+            }
+        }
+        //the free pages before limit ran out,bitmaps took some of them
+        if (status == SpaceFull)
+            status = Succeed;
+        if (status == Succeed)
+            status = pPager->TruncateFree();
+        return status;
+    }
+
+    int BTree::Find(const void *pKey, int nKey, std::string *pValue) {
+        std::vector<BtPathEntry> path;
+        bool bExact;
+        int status = Descend(static_cast<const unsigned char *>(pKey), nKey, &path, &bExact);
+        if (status != Succeed)
+            return status;
+        if (bExact)
+            status = ReadValue(BtPage(path.back().pPage->pData, pPager->pageSize), path.back().index, pValue);
+        else
+            status = NotFound;
+        ReleasePath(&path);
+        return status;
+    }
+
+    int BTree::MaxKeySize() const {
+        return BtPage::MaxKey(pPager->pageSize);
+    }
+
+    BTree::BTree(Pager *pPager, unsigned root) : cursors(), bAppendHint(true), pPager(pPager), root(root) {
+    }
+
+
+    int BtCursor::Restore() {
+        if (eState == Cursor_Valid && generation != pTree->pPager->generation)
+            eState = Cursor_Invalid;
+        if (eState != Cursor_RequireSeek)
+            return Succeed;
+        std::string key = std::move(savedKey);
+        int result;
+        int status = Seek(key.data(), static_cast<int>(key.size()), &result);
+        if (status == Succeed && result > 0)
+            bSkipNext = true;
+        return status;
+    }
+
+    //move to the first cell at or after index,crossing into later leaves
+    int BtCursor::SettleForward() {
+        Pager *pPager = pTree->pPager;
+        for (;;) {
+            PgHdr *pPage;
+            int status = pPager->Get(pgno, &pPage);
+            if (status != Succeed) {
+                eState = Cursor_Invalid;
+                return status;
+            }
+            BtPage page(pPage->pData, pPager->pageSize);
+            unsigned next = page.Right();
+            bool bHere = index < page.CellCount();
+            if (!bHere && next != 0)
+                Prefetch(page, next);
+            pPager->Unref(pPage);
+            if (bHere)
+                return Succeed;
+            if (next == 0) {
+                eState = Cursor_Invalid;
+                return Succeed;
+            }
+            pgno = next;
+            index = 0;
+        }
+    }
+
+    int BtCursor::SettleBackward() {
+        Pager *pPager = pTree->pPager;
+        while (index < 0) {
+            PgHdr *pPage;
+            int status = pPager->Get(pgno, &pPage);
+            if (status != Succeed) {
+                eState = Cursor_Invalid;
+                return status;
+            }
+            unsigned prev = BtPage(pPage->pData, pPager->pageSize).Left();
+            pPager->Unref(pPage);
+            if (prev == 0) {
+                eState = Cursor_Invalid;
+                return Succeed;
+            }
+            status = pPager->Get(prev, &pPage);
+            if (status != Succeed) {
+                eState = Cursor_Invalid;
+                return status;
+            }
+            index = BtPage(pPage->pData, pPager->pageSize).CellCount() - 1;
+            pPager->Unref(pPage);
+            pgno = prev;
+            prefetch.Access(prev);
+        }
+        return Succeed;
+    }
+
+    //the cursor leaves leaf for next.when the stride says nothing the parent
+    //of leaf names the leaves after next
+    void BtCursor::Prefetch(const BtPage &leaf, unsigned next) {
+        prefetch.Access(next);
+        int n = leaf.CellCount();
+        if (!prefetch.NeedHint() || n == 0 || pTree->pPager->prefetchLimit <= 0)
+            return;
+        std::string key = leaf.Key(n - 1);
+        std::vector<BtPathEntry> path;
+        bool bExact;
+        if (pTree->Descend(reinterpret_cast<const unsigned char *>(key.data()), static_cast<int>(key.size()), &path,
+                           &bExact) != Succeed)
+            return;
+        if (path.size() >= 2) {
+            BtPathEntry &parent = path[path.size() - 2];
+            BtPage page(parent.pPage->pData, pTree->pPager->pageSize);
+            int nChild = page.CellCount();
+            if (parent.index < nChild && page.Child(parent.index + 1) == next) {
+                std::vector<unsigned> children;
+                for (int i = parent.index + 2; i <= nChild; i++)
+                    children.push_back(page.Child(i));
+                if (!children.empty())
+                    prefetch.Hint(children.data(), static_cast<int>(children.size()));
+            }
+        }
+        pTree->ReleasePath(&path);
+    }
+
+    int BtCursor::Edge(bool bLast) {
+        Pager *pPager = pTree->pPager;
+        bSkipNext = false;
+        eState = Cursor_Invalid;
+        unsigned current = pTree->root;
+        for (int depth = 0;; depth++) {
+            PgHdr *pPage;
+            int status = pPager->Get(current, &pPage);
+            if (status != Succeed)
+                return status;
+            BtPage page(pPage->pData, pPager->pageSize);
+            int type = page.Type();
+            unsigned child = type == BtPage_Interior ? (bLast ? page.Right() : page.Child(0)) : 0;
+            int n = page.CellCount();
+            pPager->Unref(pPage);
+            if (type == BtPage_Leaf) {
+                pgno = current;
+                index = bLast ? n - 1 : 0;
+                break;
+            }
+            if (type != BtPage_Interior || depth > BtMaxDepth)
+                return Corrupt;
+            current = child;
+        }
+        eState = Cursor_Valid;
+        generation = pPager->generation;
+        return bLast ? SettleBackward() : SettleForward();
+    }
+
+    int BtCursor::Seek(const void *pKey, int nKey, int *pResult) {
+        bSkipNext = false;
+        eState = Cursor_Invalid;
+        *pResult = -1;
+        std::vector<BtPathEntry> path;
+        bool bExact;
+        int status = pTree->Descend(static_cast<const unsigned char *>(pKey), nKey, &path, &bExact);
+        if (status != Succeed)
+            return status;
+        pgno = path.back().pPage->pgno;
+        index = path.back().index;
+        pTree->ReleasePath(&path);
+        eState = Cursor_Valid;
+        generation = pTree->pPager->generation;
+        if (bExact) {
+            *pResult = 0;
+            return Succeed;
+        }
+        status = SettleForward();
+        if (eState == Cursor_Valid)
+            *pResult = 1;
+        return status;
+    }
+
+    int BtCursor::First() {
+        return Edge(false);
+    }
+
+    int BtCursor::Last() {
+        return Edge(true);
+    }
+
+    int BtCursor::Next() {
+        int status = Restore();
+        if (status != Succeed || eState != Cursor_Valid)
+            return status;
+        if (bSkipNext) {
+            bSkipNext = false;
+            return Succeed;
+        }
+        index++;
+        return SettleForward();
+    }
+
+    int BtCursor::Prev() {
+        int status = Restore();
+        bSkipNext = false;
+        if (status != Succeed || eState != Cursor_Valid)
+            return status;
+        index--;
+        return SettleBackward();
+    }
+
+    bool BtCursor::Eof() {
+        Restore();
+        return eState != Cursor_Valid;
+    }
+
+    int BtCursor::Key(std::string *pKey) {
+        int status = Restore();
+        if (status != Succeed)
+            return status;
+        if (eState != Cursor_Valid)
+            return NotFound;
+        PgHdr *pPage;
+        status = pTree->pPager->Get(pgno, &pPage);
+        if (status != Succeed)
+            return status;
+        *pKey = BtPage(pPage->pData, pTree->pPager->pageSize).Key(index);
+        pTree->pPager->Unref(pPage);
+        return Succeed;
+    }
+
+    int BtCursor::Value(std::string *pValue) {
+        int status = Restore();
+        if (status != Succeed)
+            return status;
+        if (eState != Cursor_Valid)
+            return NotFound;
+        PgHdr *pPage;
+        status = pTree->pPager->Get(pgno, &pPage);
+        if (status != Succeed)
+            return status;
+        status = pTree->ReadValue(BtPage(pPage->pData, pTree->pPager->pageSize), index, pValue);
+        pTree->pPager->Unref(pPage);
+        return status;
+    }
+
+    int BtCursor::ValueSize(unsigned *pSize) {
+        int status = Restore();
+        if (status != Succeed)
+            return status;
+        if (eState != Cursor_Valid)
+            return NotFound;
+        PgHdr *pPage;
+        status = pTree->pPager->Get(pgno, &pPage);
+        if (status != Succeed)
+            return status;
+        BtPage page(pPage->pData, pTree->pPager->pageSize);
+        *pSize = Get4(&page.a[page.CellOffset(index)]);
+        pTree->pPager->Unref(pPage);
+        return Succeed;
+    }
+
+    BtCursor::BtCursor(BTree *pTree) : pgno(0), index(0), eState(Cursor_Invalid), bSkipNext(false), generation(0),
+                                       savedKey(), prefetch(pTree->pPager), pTree(pTree) {
+        pTree->cursors.push_back(this);
+    }
+
+    BtCursor::~BtCursor() {
+        pTree->cursors.remove(this);
+    }
+}
@@ -0,0 +1,271 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_BTREE_H
+#define SQLITELIKE_TINYSQL_BTREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+#include "tinySQL_Pager.h"
+#include "tinySQL_Prefetch.h"
+
+namespace tinySQL {
+
+    static constexpr int BtPage_Leaf = 1;
+    static constexpr int BtPage_Interior = 2;
+    static constexpr int BtPage_Overflow = 3;
+
+    //deeper paths than this mean a cycle in a corrupt file
+    static constexpr int BtMaxDepth = 40;
+
+    //page header,followed by the key prefix every cell of the page shares and
+    //then by the slot array aligned to 8 bytes
+    static constexpr int BtHeader_Type = 0;
+    static constexpr int BtHeader_CellCount = 2;
+    static constexpr int BtHeader_ContentStart = 4;
+    static constexpr int BtHeader_PrefixLength = 6;
+    static constexpr int BtHeader_Right = 8;         //interior: rightmost child,leaf: next leaf
+    static constexpr int BtHeader_Left = 12;         //leaf: previous leaf
+    static constexpr int BtHeader_Size = 16;
+
+    //slot: u16 cell offset,u16 suffix length,u32 first 4 suffix bytes.eight
+    //slots share a cache line and most search steps never leave the slot array
+    static constexpr int BtSlot_Size = 8;
+
+    //overflow page: u8 type,3 unused bytes,u32 next page,data
+    static constexpr int BtOverflow_Next = 4;
+    static constexpr int BtOverflow_Header = 8;
+
+    //a cell with its full key,used when cells move between pages.
+    //leaf cell on the page: u32 value size,key suffix,local value[,u32 overflow]
+    //interior cell on the page: u32 left child,key suffix
+    struct BtCell {
+        std::string key;
+        unsigned child;
+        unsigned valueSize;
+        std::string local;
+        unsigned overflow;
+    };
+
+    class BtPage {
+    public:
+        unsigned char *const a;
+        const int pageSize;
+
+        BtPage(unsigned char *a, int pageSize) : a(a), pageSize(pageSize) {
+        }
+
+        //largest cell a page takes,chosen so that any four cells fit one page
+        static int MaxLocal(int pageSize) {
+            return (pageSize - 24) / 4 - 8;
+        }
+
+        static int MaxKey(int pageSize) {
+            return MaxLocal(pageSize) - 8;
+        }
+
+        //how much of a value stays on the leaf page
+        static unsigned LocalSize(int pageSize, int nKey, unsigned valueSize) {
+            long maxLocal = MaxLocal(pageSize);
+            if (4 + nKey + static_cast<long>(valueSize) <= maxLocal)
+                return valueSize;
+            return static_cast<unsigned>(std::max(0L, maxLocal - 8 - nKey));
+        }
+
+        static uint32_t Head(const unsigned char *pSuffix, int nSuffix) {
+            unsigned char b[4] = {0, 0, 0, 0};
+            memcpy(b, pSuffix, std::min(nSuffix, 4));
+            return Get4(b);
+        }
+
+        int Type() const {
+            return a[BtHeader_Type];
+        }
+
+        bool IsLeaf() const {
+            return a[BtHeader_Type] == BtPage_Leaf;
+        }
+
+        int CellCount() const {
+            return static_cast<int>(Get2(&a[BtHeader_CellCount]));
+        }
+
+        int ContentStart() const {
+            return static_cast<int>(Get2(&a[BtHeader_ContentStart]));
+        }
+
+        int PrefixLength() const {
+            return static_cast<int>(Get2(&a[BtHeader_PrefixLength]));
+        }
+
+        const unsigned char *Prefix() const {
+            return &a[BtHeader_Size];
+        }
+
+        unsigned Right() const {
+            return Get4(&a[BtHeader_Right]);
+        }
+
+        void SetRight(unsigned pgno) {
+            Put4(&a[BtHeader_Right], pgno);
+        }
+
+        unsigned Left() const {
+            return Get4(&a[BtHeader_Left]);
+        }
+
+        void SetLeft(unsigned pgno) {
+            Put4(&a[BtHeader_Left], pgno);
+        }
+
+        int SlotStart() const {
+            return (BtHeader_Size + PrefixLength() + 7) & ~7;
+        }
+
+        const unsigned char *Slot(int i) const {
+            return &a[SlotStart() + i * BtSlot_Size];
+        }
+
+        int CellOffset(int i) const {
+            return static_cast<int>(Get2(Slot(i)));
+        }
+
+        int SuffixLength(int i) const {
+            return static_cast<int>(Get2(Slot(i) + 2));
+        }
+
+        const unsigned char *Suffix(int i) const {
+            return &a[CellOffset(i) + 4];
+        }
+
+        //interior pages: child left of cell i,or the rightmost child for i == CellCount()
+        unsigned Child(int i) const {
+            return i == CellCount() ? Right() : Get4(&a[CellOffset(i)]);
+        }
+
+        void SetChild(int i, unsigned pgno) {
+            if (i == CellCount())
+                SetRight(pgno);
+            else
+                Put4(&a[CellOffset(i)], pgno);
+        }
+
+        std::string Key(int i) const;
+        int CellSize(int i) const;
+        void ReadCell(int i, BtCell *pCell) const;
+        std::vector<BtCell> ReadAll() const;
+        int Compare(int i, const unsigned char *pKey, int nKey) const;
+        int Search(const unsigned char *pKey, int nKey, bool *pExact) const;
+        bool InsertInPlace(int i, const BtCell &cell);
+        void Remove(int i);
+        void Build(int type, const BtCell *pCells, int nCell, unsigned right, unsigned left);
+
+        //size of a cell without any prefix taken off,slot included
+        static long FullSize(int type, const BtCell &cell);
+
+        //bytes nCell cells take once built into one page,slots included
+        static long BuildSize(int type, const BtCell *pCells, int nCell);
+    };
+
+    struct BtPathEntry {
+        PgHdr *pPage;
+        int index;
+    };
+
+    class BtCursor;
+    class BtBlob;
+    class ColumnScan;
+
+    //B+tree keyed by byte strings in memcmp order.the root page number never
+    //changes,a root split moves the old root contents into new children.
+    //Insert and Delete open a write transaction on the pager when none is open
+    //and leave it to the caller to Commit.a replaced or deleted value frees its
+    //overflow pages and a leaf that loses its last cell is freed,pages are
+    //not merged otherwise
+    class BTree {
+        friend class BtCursor;
+        friend class BtBlob;
+        friend class ColumnScan;
+    private:
+        std::list<BtCursor *> cursors;
+        bool bAppendHint;
+
+        int Descend(const unsigned char *pKey, int nKey, std::vector<BtPathEntry> *pPath, bool *pExact);
+        int DescendRightmost(const unsigned char *pKey, int nKey, std::vector<BtPathEntry> *pPath, bool *pAppend);
+        void ReleasePath(std::vector<BtPathEntry> *pPath);
+        int InsertCell(std::vector<BtPathEntry> &path, int level, int index, const BtCell &cell, bool bPack);
+        int Store(std::vector<BtPathEntry> &path, int level, std::vector<BtCell> &cells, unsigned right, bool bPack);
+        int WriteOverflow(const unsigned char *pData, long nData, unsigned *pFirst);
+        int FreeOverflow(const BtPage &page, int i);
+        int Prune(std::vector<BtPathEntry> &path, int level);
+        int ReadValue(const BtPage &page, int i, std::string *pValue);
+        void SaveCursors();
+    public:
+        Pager *const pPager;
+        const unsigned root;
+
+        static int Create(Pager *pPager, unsigned *pRoot);
+
+        //shrinks the file by up to nMax pages in a write transaction the caller
+        //commits.pages past the new end move to free pages before it and the
+        //pointers to them are found by walking the trees of pRoot,which must
+        //be all the trees in the file.roots never move,nor do pages of no
+        //tree,the file stops short of them
+        static int Vacuum(Pager *pPager, const unsigned *pRoot, int nRoot, unsigned nMax);
+
+        int Insert(const void *pKey, int nKey, const void *pValue, long nValue);
+        int Delete(const void *pKey, int nKey);
+        int Find(const void *pKey, int nKey, std::string *pValue);
+        int MaxKeySize() const;
+
+        BTree(Pager *pPager, unsigned root);
+    };
+
+    static constexpr int Cursor_Invalid = 0;
+    static constexpr int Cursor_Valid = 1;
+    static constexpr int Cursor_RequireSeek = 2;     //the tree changed under the cursor,savedKey marks its place
+
+    //position in a BTree.a cursor is good for the transaction it was positioned in
+    class BtCursor {
+        friend class BTree;
+        friend class ColumnScan;
+    private:
+        unsigned pgno;
+        int index;
+        int eState;
+        bool bSkipNext;
+        unsigned long generation;
+        std::string savedKey;
+        Prefetcher prefetch;
+
+        int Restore();
+        int SettleForward();
+        int SettleBackward();
+        int Edge(bool bLast);
+        void Prefetch(const BtPage &leaf, unsigned next);
+    public:
+        BTree *const pTree;
+
+        //*pResult is 0 on an exact match,1 when the cursor stopped at the next greater key
+        //and -1 when no key is greater or equal (the cursor is then at Eof)
+        int Seek(const void *pKey, int nKey, int *pResult);
+        int First();
+        int Last();
+        int Next();
+        int Prev();
+        bool Eof();
+
+        int Key(std::string *pKey);
+        int Value(std::string *pValue);
+        int ValueSize(unsigned *pSize);
+
+        explicit BtCursor(BTree *pTree);
+        ~BtCursor();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_BTREE_H
@@ -0,0 +1,368 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include "tinySQL_Blob.h"
+
+namespace tinySQL {
+
+    //an output that is not ready is waited for,Export may be given a
+    //non-blocking socket
+    static bool WaitWritable(int fd) {
+        if (errno != EAGAIN)
+            return false;
+        struct pollfd pfd{fd, POLLOUT, 0};
+        return OsPoll(&pfd, 1, -1) >= 0 || errno == EINTR;
+    }
+
+    static int WriteAll(int fd, const unsigned char *p, long n) {
+        while (n > 0) {
+            ssize_t m = OsWrite(fd, p, n);
+            if (m < 0) {
+                if (errno == EINTR || WaitWritable(fd))
+                    continue;
+                return IOError_Write;
+            }
+            p += m;
+            n -= m;
+        }
+        return Succeed;
+    }
+
+    BtBlob::BtBlob(BTree *pTree, std::string key) :
+            key(std::move(key)), valueSize(0), local(0), first(0), generation(0), chain(), next(0), pTree(pTree),
+            nPageSent(0), nPageCopied(0) {
+    }
+
+    int BtBlob::Open(BTree *pTree, const void *pKey, int nKey, BtBlob **ppBlob) {
+        *ppBlob = nullptr;
+        auto pBlob = new BtBlob(pTree, std::string(static_cast<const char *>(pKey), nKey));
+        std::vector<BtPathEntry> path;
+        int status = pBlob->Locate(&path);
+        if (status != Succeed) {
+            delete pBlob;
+            return status;
+        }
+        pTree->ReleasePath(&path);
+        *ppBlob = pBlob;
+        return Succeed;
+    }
+
+    int BtBlob::Close() {
+        delete this;
+        return Succeed;
+    }
+
+    //descends to the cell of the key,the index is kept while the value has
+    //the size and first page it had and the pager kept its pages
+    int BtBlob::Locate(std::vector<BtPathEntry> *pPath) {
+        Pager *pPager = pTree->pPager;
+        bool bExact;
+        int status = pTree->Descend(reinterpret_cast<const unsigned char *>(key.data()), static_cast<int>(key.size()),
+                                    pPath, &bExact);
+        if (status != Succeed)
+            return status;
+        if (!bExact) {
+            pTree->ReleasePath(pPath);
+            return NotFound;
+        }
+        BtPage leaf(pPath->back().pPage->pData, pPager->pageSize);
+        int i = pPath->back().index;
+        const unsigned char *pCell = &leaf.a[leaf.CellOffset(i)];
+        int suffixLength = leaf.SuffixLength(i);
+        unsigned size = Get4(pCell);
+        unsigned nLocal = BtPage::LocalSize(pPager->pageSize, leaf.PrefixLength() + suffixLength, size);
+        unsigned firstPage = nLocal < size ? Get4(pCell + 4 + suffixLength + nLocal) : 0;
+        if (size != valueSize || firstPage != first || generation != pPager->generation)
+            chain.clear();
+        valueSize = size;
+        local = nLocal;
+        first = firstPage;
+        generation = pPager->generation;
+        return Succeed;
+    }
+
+    unsigned char *BtBlob::LocalData(const std::vector<BtPathEntry> &path) const {
+        BtPage leaf(path.back().pPage->pData, pTree->pPager->pageSize);
+        int i = path.back().index;
+        return &leaf.a[leaf.CellOffset(i) + 4 + leaf.SuffixLength(i)];
+    }
+
+    //the index grows to overflow page iPage,only the header of each page
+    //added is read
+    int BtBlob::Walk(long iPage) {
+        const long capacity = pTree->pPager->pageSize - BtOverflow_Header;
+        if (iPage >= (static_cast<long>(valueSize) - local + capacity - 1) / capacity)
+            return Corrupt;
+        while (static_cast<long>(chain.size()) <= iPage) {
+            unsigned pgno = chain.empty() ? first : next;
+            unsigned char header[BtOverflow_Header];
+            int status = pgno == 0 ? Corrupt : pTree->pPager->Peek(pgno, header, sizeof(header));
+            if (status == Succeed && header[0] != BtPage_Overflow)
+                status = Corrupt;
+            if (status != Succeed)
+                return status;
+            chain.push_back(pgno);
+            next = Get4(&header[BtOverflow_Next]);
+        }
+        return Succeed;
+    }
+
+    int BtBlob::Size(unsigned *pSize) {
+        std::vector<BtPathEntry> path;
+        int status = Locate(&path);
+        if (status != Succeed)
+            return status;
+        pTree->ReleasePath(&path);
+        *pSize = valueSize;
+        return Succeed;
+    }
+
+    int BtBlob::Read(void *pData, long nData, long offset) {
+        if (nData < 0 || offset < 0)
+            return Misuse;
+        Pager *pPager = pTree->pPager;
+        std::vector<BtPathEntry> path;
+        int status = Locate(&path);
+        if (status != Succeed)
+            return status;
+        auto p = static_cast<unsigned char *>(pData);
+        const long capacity = pPager->pageSize - BtOverflow_Header;
+        const long end = std::min(offset + nData, static_cast<long>(valueSize));
+        long pos = offset;
+        if (pos < end && pos < local) {
+            long take = std::min(end, static_cast<long>(local)) - pos;
+            memcpy(p, LocalData(path) + pos, take);
+            pos += take;
+        }
+        pTree->ReleasePath(&path);
+        while (pos < end && status == Succeed) {
+            long iPage = (pos - local) / capacity, within = (pos - local) % capacity;
+            long take = std::min(capacity - within, end - pos);
+            PgHdr *pPage;
+            status = Walk(iPage);
+            if (status == Succeed)
+                status = pPager->Get(chain[iPage], &pPage);
+            if (status == Succeed) {
+                memcpy(p + pos - offset, &pPage->pData[BtOverflow_Header + within], take);
+                pPager->Unref(pPage);
+            }
+            pos += take;
+        }
+        if (status != Succeed)
+            return status;
+        if (end < offset + nData) {
+            long from = std::max(end, offset) - offset;
+            memset(p + from, 0, nData - from);
+            return IOError_ReadShort;
+        }
+        return Succeed;
+    }
+
+    int BtBlob::Write(const void *pData, long nData, long offset) {
+        if (nData < 0 || offset < 0)
+            return Misuse;
+        Pager *pPager = pTree->pPager;
+        int status = pPager->BeginWrite();
+        if (status != Succeed)
+            return status;
+        std::vector<BtPathEntry> path;
+        status = Locate(&path);
+        if (status != Succeed)
+            return status;
+        if (offset > static_cast<long>(valueSize)) {
+            pTree->ReleasePath(&path);
+            return Misuse;
+        }
+        auto p = static_cast<const unsigned char *>(pData);
+        const long capacity = pPager->pageSize - BtOverflow_Header;
+        const long end = std::min(offset + nData, static_cast<long>(valueSize));
+        long pos = offset;
+        if (pos < end && pos < local && (status = pPager->Write(path.back().pPage)) == Succeed) {
+            long take = std::min(end, static_cast<long>(local)) - pos;
+            memcpy(LocalData(path) + pos, p, take);
+            pos += take;
+        }
+        pTree->ReleasePath(&path);
+        while (pos < end && status == Succeed) {
+            long iPage = (pos - local) / capacity, within = (pos - local) % capacity;
+            long take = std::min(capacity - within, end - pos);
+            PgHdr *pPage;
+            status = Walk(iPage);
+            if (status == Succeed)
+                status = pPager->Get(chain[iPage], &pPage);
+            if (status == Succeed) {
+                status = pPager->Write(pPage);
+                if (status == Succeed)
+                    memcpy(&pPage->pData[BtOverflow_Header + within], p + pos - offset, take);
+                pPager->Unref(pPage);
+            }
+            pos += take;
+        }
+        if (status == Succeed && end < offset + nData)
+            status = Append(p + end - offset, offset + nData - end);
+        return status;
+    }
+
+    int BtBlob::Append(const void *pData, long nData) {
+        if (nData < 0)
+            return Misuse;
+        Pager *pPager = pTree->pPager;
+        int status = pPager->BeginWrite();
+        if (status != Succeed)
+            return status;
+        std::vector<BtPathEntry> path;
+        status = Locate(&path);
+        if (status != Succeed)
+            return status;
+        if (static_cast<long>(valueSize) + nData > static_cast<long>(UINT_MAX)) {
+            pTree->ReleasePath(&path);
+            return TooBig;
+        }
+        auto p = static_cast<const unsigned char *>(pData);
+        const long capacity = pPager->pageSize - BtOverflow_Header;
+
+        //the cell is rewritten with up to a page of the data,more than a leaf keeps
+        if (local == valueSize && nData > 0) {
+            long take = std::min(nData, capacity);
+            std::string value(reinterpret_cast<const char *>(LocalData(path)), local);
+            value.append(reinterpret_cast<const char *>(p), take);
+            pTree->ReleasePath(&path);
+            status = pTree->Insert(key.data(), static_cast<int>(key.size()), value.data(),
+                                   static_cast<long>(value.size()));
+            if (status == Succeed)
+                status = Locate(&path);
+            if (status != Succeed)
+                return status;
+            p += take;
+            nData -= take;
+        }
+        if (nData == 0) {
+            pTree->ReleasePath(&path);
+            return Succeed;
+        }
+
+        const long nOverflow = static_cast<long>(valueSize) - local;
+        const long last = (nOverflow - 1) / capacity;
+        const long used = nOverflow - last * capacity;
+        PgHdr *pTail = nullptr;
+        status = Walk(last);
+        if (status == Succeed)
+            status = pPager->Get(chain[last], &pTail);
+        if (status == Succeed)
+            status = pPager->Write(pTail);
+        long done = 0;
+        if (status == Succeed) {
+            done = std::min(capacity - used, nData);
+            memcpy(&pTail->pData[BtOverflow_Header + used], p, done);
+        }
+        while (status == Succeed && done < nData) {
+            PgHdr *pPage;
+            status = pPager->Allocate(&pPage);
+            if (status != Succeed)
+                break;
+            long take = std::min(capacity, nData - done);
+            pPage->pData[0] = BtPage_Overflow;
+            Put4(&pPage->pData[BtOverflow_Next], 0);
+            memcpy(&pPage->pData[BtOverflow_Header], p + done, take);
+            Put4(&pTail->pData[BtOverflow_Next], pPage->pgno);
+            pPager->Unref(pTail);
+            pTail = pPage;
+            chain.push_back(pPage->pgno);
+            next = 0;
+            done += take;
+        }
+        if (pTail)
+            pPager->Unref(pTail);
+        if (status == Succeed)
+            status = pPager->Write(path.back().pPage);
+        if (status == Succeed) {
+            BtPage leaf(path.back().pPage->pData, pPager->pageSize);
+            valueSize += static_cast<unsigned>(nData);
+            Put4(&leaf.a[leaf.CellOffset(path.back().index)], valueSize);
+        } else
+            chain.clear();
+        pTree->ReleasePath(&path);
+        return status;
+    }
+
+    //a page that is not in the file as this transaction sees it,or an output
+    //sendfile refuses,is written from the cache.*pCopy stays set for the
+    //rest of the export once sendfile was refused
+    int BtBlob::SendPage(int fd, unsigned pgno, long from, long n, bool *pCopy) {
+        Pager *pPager = pTree->pPager;
+        int fdIn;
+        if (!*pCopy && pPager->PageDescriptor(pgno, &fdIn) == Succeed) {
+            off_t at = static_cast<off_t>(pgno - 1) * pPager->pageSize + BtOverflow_Header + from;
+            long left = n;
+            while (left > 0) {
+                ssize_t m = OsSendfile(fd, fdIn, &at, left);
+                if (m < 0 && (errno == EINVAL || errno == ENOSYS) && left == n) {
+                    *pCopy = true;
+                    break;
+                }
+                if (m < 0) {
+                    if (errno == EINTR || WaitWritable(fd))
+                        continue;
+                    return IOError_Write;
+                }
+                if (m == 0)
+                    return IOError_ReadShort;
+                left -= m;
+            }
+            if (!*pCopy) {
+                nPageSent++;
+                return Succeed;
+            }
+        }
+        PgHdr *pPage;
+        int status = pPager->Get(pgno, &pPage);
+        if (status != Succeed)
+            return status;
+        status = WriteAll(fd, &pPage->pData[BtOverflow_Header + from], n);
+        pPager->Unref(pPage);
+        nPageCopied++;
+        return status;
+    }
+
+    //the index is walked over the whole range first,then each run of pages
+    //in a row is read ahead before its first page is sent
+    int BtBlob::Export(int fd, long nData, long offset) {
+        if (nData < 0 || offset < 0)
+            return Misuse;
+        Pager *pPager = pTree->pPager;
+        std::vector<BtPathEntry> path;
+        int status = Locate(&path);
+        if (status != Succeed)
+            return status;
+        const long capacity = pPager->pageSize - BtOverflow_Header;
+        const long end = std::min(offset + nData, static_cast<long>(valueSize));
+        long pos = offset;
+        if (pos < end && pos < local) {
+            long take = std::min(end, static_cast<long>(local)) - pos;
+            status = WriteAll(fd, LocalData(path) + pos, take);
+            pos += take;
+        }
+        pTree->ReleasePath(&path);
+        if (status == Succeed && pos < end)
+            status = Walk((end - 1 - local) / capacity);
+        bool bCopy = false;
+        while (pos < end && status == Succeed) {
+            long iPage = (pos - local) / capacity, within = (pos - local) % capacity;
+            long take = std::min(capacity - within, end - pos);
+            if (pos == offset || iPage == 0 || (within == 0 && chain[iPage] != chain[iPage - 1] + 1)) {
+                long iEnd = iPage + 1, iLast = (end - 1 - local) / capacity;
+                while (iEnd <= iLast && chain[iEnd] == chain[iEnd - 1] + 1)
+                    iEnd++;
+                pPager->Advise(chain[iPage], static_cast<unsigned>(iEnd - iPage));
+            }
+            status = SendPage(fd, chain[iPage], within, take, &bCopy);
+            pos += take;
+        }
+        if (status == Succeed && end < offset + nData)
+            status = IOError_ReadShort;
+        return status;
+    }
+}
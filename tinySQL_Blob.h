@@ -0,0 +1,63 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_BLOB_H
+#define SQLITELIKE_TINYSQL_BLOB_H
+
+#include <string>
+#include <vector>
+#include "tinySQL_BTree.h"
+
+namespace tinySQL {
+
+    //one value of a BTree read and written by byte ranges,never held in
+    //memory whole.the overflow pages of the value are indexed in chain order
+    //as far as they were walked,so a range past the leaf is found without
+    //following the chain again.every call finds the cell anew,a value that
+    //changed size or first page,or pages thrown away by the pager,start the
+    //index over.
+    //Write and Append open a write transaction when none is open and leave
+    //it to the caller to Commit like Insert does,after an error it should be
+    //rolled back
+    class BtBlob {
+    private:
+        const std::string key;
+        unsigned valueSize;
+        unsigned local;             //bytes of the value on the leaf
+        unsigned first;             //first overflow page
+        unsigned long generation;
+        std::vector<unsigned> chain;
+        unsigned next;              //page after chain.back()
+
+        BtBlob(BTree *pTree, std::string key);
+        int Locate(std::vector<BtPathEntry> *pPath);
+        unsigned char *LocalData(const std::vector<BtPathEntry> &path) const;
+        int Walk(long iPage);
+        int SendPage(int fd, unsigned pgno, long from, long n, bool *pCopy);
+    public:
+        BTree *const pTree;
+        long nPageSent;             //overflow pages Export sent from the database file
+        long nPageCopied;           //and those it sent from memory
+
+        //NotFound when the key is not in the tree
+        static int Open(BTree *pTree, const void *pKey, int nKey, BtBlob **ppBlob);
+        int Close();
+
+        int Size(unsigned *pSize);
+        //bytes past the end of the value read as zeros and give IOError_ReadShort
+        int Read(void *pData, long nData, long offset);
+        //offset no further than the end,the bytes past it are appended
+        int Write(const void *pData, long nData, long offset);
+        //the last overflow page is filled and new ones are linked after it,
+        //the pages before are not touched.a value still on its leaf moves to
+        //overflow pages first
+        int Append(const void *pData, long nData);
+        //writes a range of the value to fd,a socket,pipe or file at its
+        //position.overflow pages whose newest image is in the database file
+        //go with sendfile,runs of them in a row are read ahead as one.bytes
+        //past the end of the value are not sent and give IOError_ReadShort
+        int Export(int fd, long nData, long offset);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_BLOB_H
@@ -0,0 +1,243 @@
+//
+// Created by user on 26-10-19.
+//
+#include <numeric>
+#include "tinySQL_BulkLoad.h"
+
+namespace tinySQL {
+
+    static int CommonPrefix(const std::string &a, const std::string &b) {
+        size_t n = std::min(a.size(), b.size());
+        size_t i = 0;
+        while (i < n && a[i] == b[i])
+            i++;
+        return static_cast<int>(i);
+    }
+
+    //bytes the level's cells,and pExtra after them,take as one page
+    long BulkLoader::PageBytes(int type, const Level &level, const BtCell *pExtra) const {
+        long n = static_cast<long>(level.cells.size()) + (pExtra ? 1 : 0);
+        if (n == 0)
+            return BtHeader_Size;
+        const BtCell &first = level.cells.empty() ? *pExtra : level.cells.front();
+        const BtCell &last = pExtra ? *pExtra : level.cells.back();
+        int prefixLength = n >= 2 ? CommonPrefix(first.key, last.key) : 0;
+        long bytes = level.cellBytes + (pExtra ? BtPage::FullSize(type, *pExtra) : 0);
+        return ((BtHeader_Size + prefixLength + 7) & ~7) + bytes - n * prefixLength;
+    }
+
+    int BulkLoader::Emit(unsigned pgno, const unsigned char *pData) {
+        batch.insert(batch.end(), pData, pData + pPager->pageSize);
+        batchPgno.push_back(pgno);
+        if (static_cast<int>(batchPgno.size()) >= batchPages)
+            return Flush();
+        return Succeed;
+    }
+
+    //pages mostly arrive in number order,so a batch is usually one write
+    int BulkLoader::Flush() {
+        const int pageSize = pPager->pageSize;
+        size_t n = batchPgno.size();
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return batchPgno[a] < batchPgno[b]; });
+
+        std::vector<unsigned char> run;
+        size_t i = 0;
+        while (i < n) {
+            size_t j = i + 1;
+            bool bInPlace = true;
+            while (j < n && batchPgno[order[j]] == batchPgno[order[j - 1]] + 1) {
+                bInPlace = bInPlace && order[j] == order[j - 1] + 1;
+                j++;
+            }
+            const unsigned char *pData = &batch[order[i] * pageSize];
+            if (!bInPlace) {
+                run.resize((j - i) * pageSize);
+                for (size_t k = i; k < j; k++)
+                    memcpy(&run[(k - i) * pageSize], &batch[order[k] * pageSize], pageSize);
+                pData = run.data();
+            }
+            int status = pPager->WritePages(batchPgno[order[i]], pData, static_cast<unsigned>(j - i));
+            if (status != Succeed)
+                return status;
+            i = j;
+        }
+        nPageWritten += static_cast<long>(n);
+        batch.clear();
+        batchPgno.clear();
+        return Succeed;
+    }
+
+    int BulkLoader::WriteOverflow(const unsigned char *pData, long nData, unsigned *pFirst) {
+        const long capacity = pPager->pageSize - BtOverflow_Header;
+        long count = (nData + capacity - 1) / capacity;
+        unsigned pgno = 0;
+        for (long i = 0; i < count; i++) {
+            int status = pPager->Reserve(&pgno);
+            if (status != Succeed)
+                return status;
+            if (i == 0)
+                *pFirst = pgno;
+        }
+        pgno = *pFirst;
+        for (long i = 0; i < count; i++, pgno++) {
+            long take = std::min(capacity, nData - i * capacity);
+            std::fill(page.begin(), page.end(), 0);
+            page[0] = BtPage_Overflow;
+            Put4(&page[BtOverflow_Next], i + 1 < count ? pgno + 1 : 0);
+            memcpy(&page[BtOverflow_Header], pData + i * capacity, take);
+            int status = Emit(pgno, page.data());
+            if (status != Succeed)
+                return status;
+        }
+        return Succeed;
+    }
+
+    int BulkLoader::FinishLeaf(unsigned right) {
+        Level &leaf = levels[0];
+        BtPage(page.data(), pPager->pageSize).Build(BtPage_Leaf, leaf.cells.data(),
+                                                    static_cast<int>(leaf.cells.size()), right, leaf.prevPgno);
+        leaf.nPageDone++;
+        leaf.prevPgno = leaf.pgno;
+        leaf.cells.clear();
+        leaf.cellBytes = 0;
+        return Emit(leaf.pgno, page.data());
+    }
+
+    //interior pages hold their children but the last one as cells,the last
+    //child becomes the right pointer and its key the separator one level up
+    int BulkLoader::AddChild(int iLevel, const std::string &key, unsigned child) {
+        if (static_cast<int>(levels.size()) <= iLevel)
+            levels.resize(iLevel + 1, Level{{}, 0, 0, 0, 0});
+        if (!levels[iLevel].cells.empty() && PageBytes(BtPage_Interior, levels[iLevel], nullptr) > fillLimit) {
+            int status = FinishInterior(iLevel);
+            if (status != Succeed)
+                return status;
+        }
+        BtCell cell{key, child, 0, {}, 0};
+        levels[iLevel].cellBytes += BtPage::FullSize(BtPage_Interior, cell);
+        levels[iLevel].cells.push_back(std::move(cell));
+        return Succeed;
+    }
+
+    int BulkLoader::FinishInterior(int iLevel) {
+        unsigned pgno;
+        int status = pPager->Reserve(&pgno);
+        if (status != Succeed)
+            return status;
+        Level &level = levels[iLevel];
+        int n = static_cast<int>(level.cells.size());
+        BtPage(page.data(), pPager->pageSize).Build(BtPage_Interior, level.cells.data(), n - 1,
+                                                    level.cells[n - 1].child, 0);
+        std::string key = std::move(level.cells[n - 1].key);
+        level.cells.clear();
+        level.cellBytes = 0;
+        level.nPageDone++;
+        status = Emit(pgno, page.data());
+        if (status != Succeed)
+            return status;
+        return AddChild(iLevel + 1, key, pgno);
+    }
+
+    int BulkLoader::AddSorted(const void *pKey, int nKey, const void *pValue, long nValue) {
+        if (nKey < 0 || nKey > BtPage::MaxKey(pPager->pageSize) || nValue < 0 ||
+            nValue > static_cast<long>(UINT32_MAX))
+            return TooBig;
+        if (!bStarted) {
+            int status = pPager->BeginWrite();
+            if (status != Succeed)
+                return status;
+            levels.assign(1, Level{{}, 0, 0, 0, 0});
+            bStarted = true;
+        }
+        auto zKey = static_cast<const char *>(pKey);
+        if (nRow > 0 && lastKey.compare(0, std::string::npos, zKey, nKey) >= 0)
+            return Misuse;
+
+        BtCell cell{std::string(zKey, nKey), 0, static_cast<unsigned>(nValue), {}, 0};
+        unsigned local = BtPage::LocalSize(pPager->pageSize, nKey, cell.valueSize);
+        cell.local.assign(static_cast<const char *>(pValue), local);
+        int status = Succeed;
+        if (local < cell.valueSize)
+            status = WriteOverflow(static_cast<const unsigned char *>(pValue) + local, nValue - local, &cell.overflow);
+
+        if (status == Succeed && !levels[0].cells.empty() &&
+            PageBytes(BtPage_Leaf, levels[0], &cell) > fillLimit) {
+            unsigned next;
+            status = pPager->Reserve(&next);
+            if (status == Succeed)
+                status = FinishLeaf(next);
+            if (status == Succeed)
+                status = AddChild(1, lastKey, levels[0].prevPgno);
+            levels[0].pgno = next;
+        }
+        if (status != Succeed)
+            return status;
+        if (levels[0].pgno == 0) {
+            status = pPager->Reserve(&levels[0].pgno);
+            if (status != Succeed)
+                return status;
+        }
+        levels[0].cellBytes += BtPage::FullSize(BtPage_Leaf, cell);
+        levels[0].cells.push_back(std::move(cell));
+        lastKey.assign(zKey, nKey);
+        nRow++;
+        return Succeed;
+    }
+
+    int BulkLoader::Add(const void *pKey, int nKey, const void *pValue, long nValue) {
+        if (bSorted)
+            return AddSorted(pKey, nKey, pValue, nValue);
+        return pSorter->Add(pKey, nKey, pValue, nValue);
+    }
+
+    int BulkLoader::Finish(unsigned *pRoot) {
+        int status;
+        if (!bSorted) {
+            status = pSorter->Finish([this](const void *pKey, int nKey, const void *pValue, long nValue) {
+                return AddSorted(pKey, nKey, pValue, nValue);
+            });
+            if (status != Succeed)
+                return status;
+        }
+        if (!bStarted) {
+            status = pPager->BeginWrite();
+            if (status != Succeed)
+                return status;
+            levels.assign(1, Level{{}, 0, 0, 0, 0});
+            bStarted = true;
+        }
+        if (levels[0].pgno == 0) {
+            status = pPager->Reserve(&levels[0].pgno);
+            if (status != Succeed)
+                return status;
+        }
+
+        unsigned root = levels[0].pgno;
+        status = FinishLeaf(0);
+        if (status == Succeed && levels.size() > 1)
+            status = AddChild(1, lastKey, root);
+        for (int i = 1; status == Succeed && i < static_cast<int>(levels.size()); i++) {
+            if (levels[i].nPageDone == 0 && levels[i].cells.size() == 1) {
+                root = levels[i].cells[0].child;
+                break;
+            }
+            status = FinishInterior(i);
+        }
+        if (status == Succeed)
+            status = Flush();
+        if (status != Succeed)
+            return status;
+        *pRoot = root;
+        return Succeed;
+    }
+
+    BulkLoader::BulkLoader(Pager *pPager, bool bSorted, int fillPercent, int batchPages, long sortMemory) :
+            levels(), pSorter(bSorted ? nullptr : new Sorter(pPager->pVFS, sortMemory)), batch(), batchPgno(),
+            page(pPager->pageSize), lastKey(), bStarted(false),
+            fillLimit(static_cast<long>(pPager->pageSize) * std::max(10, std::min(fillPercent, 100)) / 100),
+            pPager(pPager), bSorted(bSorted), fillPercent(fillPercent), batchPages(std::max(batchPages, 1)),
+            nRow(0), nPageWritten(0) {
+    }
+}
@@ -0,0 +1,66 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_BULKLOAD_H
+#define SQLITELIKE_TINYSQL_BULKLOAD_H
+
+#include <memory>
+#include "tinySQL_BTree.h"
+#include "tinySQL_Sorter.h"
+
+namespace tinySQL {
+
+    static constexpr int DefaultFillPercent = 90;
+    static constexpr int DefaultLoadBatchPages = 256;
+    static constexpr long DefaultSortMemory = 64L << 20;
+
+    //builds a new tree bottom-up.pages are filled to fillPercent,numbered in
+    //the order they are finished and written batchPages at a time straight to
+    //the file past its committed end,or to the log in wal mode.with bSorted keys must arrive strictly
+    //ascending,otherwise they go through a Sorter spilling to temporary files
+    //and equal keys keep the last value.Finish hands back the root,which the
+    //caller makes reachable (SetMeta) before Commit
+    class BulkLoader {
+    private:
+        struct Level {
+            std::vector<BtCell> cells;
+            long cellBytes;     //sum of BtPage::FullSize over cells
+            unsigned pgno;      //leaf level: number reserved for the page being filled
+            unsigned prevPgno;  //leaf level: previous leaf
+            long nPageDone;
+        };
+
+        std::vector<Level> levels;
+        std::unique_ptr<Sorter> pSorter;
+        std::vector<unsigned char> batch;
+        std::vector<unsigned> batchPgno;
+        std::vector<unsigned char> page;
+        std::string lastKey;
+        bool bStarted;
+        const long fillLimit;
+
+        long PageBytes(int type, const Level &level, const BtCell *pExtra) const;
+        int Emit(unsigned pgno, const unsigned char *pData);
+        int Flush();
+        int WriteOverflow(const unsigned char *pData, long nData, unsigned *pFirst);
+        int FinishLeaf(unsigned right);
+        int AddChild(int iLevel, const std::string &key, unsigned child);
+        int FinishInterior(int iLevel);
+        int AddSorted(const void *pKey, int nKey, const void *pValue, long nValue);
+    public:
+        Pager *const pPager;
+        const bool bSorted;
+        const int fillPercent;
+        const int batchPages;
+        long nRow;
+        long nPageWritten;
+
+        int Add(const void *pKey, int nKey, const void *pValue, long nValue);
+        int Finish(unsigned *pRoot);
+
+        BulkLoader(Pager *pPager, bool bSorted, int fillPercent = DefaultFillPercent,
+                   int batchPages = DefaultLoadBatchPages, long sortMemory = DefaultSortMemory);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_BULKLOAD_H
@@ -0,0 +1,228 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TINYSQL_TSC 1
+#endif
+#include "tinySQL_Clock.h"
+
+namespace tinySQL {
+
+    uint64_t Clock::Monotonic() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    uint64_t Clock::Wall() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    //the tsc and the monotonic clock are read together once,the first Fast
+    //after Clock_CalibrateNs fixes the nanoseconds per tick in 32.32 fixed
+    //point from the two runs since
+    struct TscBase {
+        bool bInvariant;
+        uint64_t tsc;
+        uint64_t ns;
+        std::atomic<uint64_t> mult;
+
+        TscBase() : bInvariant(false), tsc(0), ns(0), mult(0) {
+#ifdef TINYSQL_TSC
+            unsigned a, b, c, d;
+            bInvariant = __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+            tsc = __rdtsc();
+#endif
+            ns = Clock::Monotonic();
+        }
+    };
+
+    static TscBase &Tsc() {
+        static TscBase base;
+        return base;
+    }
+
+    bool Clock::HasFastPath() {
+        return Tsc().bInvariant;
+    }
+
+    uint64_t Clock::Fast() {
+#ifdef TINYSQL_TSC
+        TscBase &base = Tsc();
+        if (base.bInvariant) {
+            uint64_t mult = base.mult.load(std::memory_order_relaxed);
+            uint64_t tsc = __rdtsc();
+            if (mult)
+                return base.ns + static_cast<uint64_t>((static_cast<unsigned __int128>(tsc - base.tsc) * mult) >> 32);
+            uint64_t ns = Monotonic();
+            if (ns - base.ns >= Clock_CalibrateNs && tsc > base.tsc) {
+                mult = static_cast<uint64_t>((static_cast<unsigned __int128>(ns - base.ns) << 32) / (tsc - base.tsc));
+                uint64_t expected = 0;
+                base.mult.compare_exchange_strong(expected, mult, std::memory_order_relaxed);
+            }
+            return ns;
+        }
+#endif
+        return Monotonic();
+    }
+
+    void Clock::SleepUntil(uint64_t deadlineNs) {
+        struct timespec ts{static_cast<time_t>(deadlineNs / 1000000000ull), static_cast<long>(deadlineNs % 1000000000ull)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+    }
+
+    void Clock::Sleep(uint64_t ns) {
+        SleepUntil(Monotonic() + ns);
+    }
+
+    TimerWheel::TimerWheel(uint64_t tickNs, unsigned nSlot) :
+            slots(nSlot), tick(Clock::Monotonic() / tickNs), nextId(1), nTimer(0), mutex(), cond(), thread(),
+            bThread(false), bStop(false), tickNs(tickNs), nFired(0), nWakeup(0) {
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    TimerWheel::~TimerWheel() {
+        pthread_mutex_lock(&mutex);
+        bStop = true;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+        if (bThread)
+            pthread_join(thread, nullptr);
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    uint64_t TimerWheel::Add(uint64_t deadlineNs, std::function<void()> fn) {
+        pthread_mutex_lock(&mutex);
+        uint64_t id = nextId++;
+        uint64_t due = std::max(deadlineNs / tickNs, tick);
+        slots[due % slots.size()].push_back(Timer{id, deadlineNs, std::move(fn)});
+        nTimer++;
+        if (!bThread) {
+            if (pthread_create(&thread, nullptr, Run, this) != 0)
+                throw std::bad_alloc();
+            bThread = true;
+        }
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+        return id;
+    }
+
+    bool TimerWheel::Cancel(uint64_t id) {
+        pthread_mutex_lock(&mutex);
+        for (auto &slot : slots)
+            for (auto it = slot.begin(); it != slot.end(); it++)
+                if (it->id == id) {
+                    slot.erase(it);
+                    nTimer--;
+                    pthread_mutex_unlock(&mutex);
+                    return true;
+                }
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    //the waiter is on the caller's stack,it is woken under the wheel's mutex
+    void TimerWheel::SleepUntil(uint64_t deadlineNs) {
+        struct Waiter {
+            pthread_cond_t cond;
+            bool bDone;
+        } waiter{};
+        pthread_cond_init(&waiter.cond, nullptr);
+        Add(deadlineNs, [&waiter] {
+            waiter.bDone = true;
+            pthread_cond_signal(&waiter.cond);
+        });
+        pthread_mutex_lock(&mutex);
+        while (!waiter.bDone)
+            pthread_cond_wait(&waiter.cond, &mutex);
+        pthread_mutex_unlock(&mutex);
+        pthread_cond_destroy(&waiter.cond);
+    }
+
+    void *TimerWheel::Run(void *pArg) {
+        static_cast<TimerWheel *>(pArg)->Loop();
+        return nullptr;
+    }
+
+    //the first tick from tick on that has a timer,timers a turn or more away
+    //make their slot look due early and are skipped when it comes
+    uint64_t TimerWheel::NextDue() const {
+        for (uint64_t t = tick; t < tick + slots.size(); t++)
+            if (!slots[t % slots.size()].empty())
+                return t;
+        return tick + slots.size();
+    }
+
+    //a tick is handled once it is over,so everything due in it has passed.
+    //timers are fired under the mutex,they are short and must not call back
+    //into the wheel
+    void TimerWheel::Loop() {
+        pthread_mutex_lock(&mutex);
+        while (!bStop) {
+            if (nTimer == 0) {
+                pthread_cond_wait(&cond, &mutex);
+                continue;
+            }
+            uint64_t wake = (NextDue() + 1) * tickNs;
+            uint64_t now = Clock::Monotonic();
+            if (now < wake) {
+                struct timespec ts{static_cast<time_t>(wake / 1000000000ull), static_cast<long>(wake % 1000000000ull)};
+                pthread_cond_timedwait(&cond, &mutex, &ts);
+                continue;
+            }
+            nWakeup++;
+            uint64_t last = now / tickNs - 1;
+            uint64_t end = std::min<uint64_t>(last, tick + slots.size() - 1);
+            for (uint64_t t = tick; t <= end; t++) {
+                auto &slot = slots[t % slots.size()];
+                for (auto it = slot.begin(); it != slot.end();) {
+                    if (it->deadline > now) {
+                        it++;
+                        continue;
+                    }
+                    it->fn();
+                    it = slot.erase(it);
+                    nTimer--;
+                    nFired++;
+                }
+            }
+            tick = last + 1;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    static pthread_mutex_t globalMutex = PTHREAD_MUTEX_INITIALIZER;
+    static TimerWheel *pGlobal = nullptr;
+
+    static void GlobalAfterFork() {
+        pthread_mutex_init(&globalMutex, nullptr);
+        pGlobal = nullptr;
+    }
+
+    TimerWheel *TimerWheel::Global() {
+        pthread_mutex_lock(&globalMutex);
+        if (pGlobal == nullptr) {
+            static bool bAtFork = pthread_atfork(nullptr, nullptr, GlobalAfterFork) == 0;
+            (void) bAtFork;
+            pGlobal = new TimerWheel();
+        }
+        TimerWheel *pWheel = pGlobal;
+        pthread_mutex_unlock(&globalMutex);
+        return pWheel;
+    }
+}
@@ -0,0 +1,83 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_CLOCK_H
+#define SQLITELIKE_TINYSQL_CLOCK_H
+
+#include <pthread.h>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <vector>
+
+namespace tinySQL {
+
+    static constexpr uint64_t Clock_CalibrateNs = 20000000;     //run of the tsc against the monotonic clock
+    static constexpr uint64_t DefaultTimerTickNs = 100000;
+    static constexpr unsigned DefaultTimerSlots = 512;
+
+    class Clock {
+    public:
+        //nanoseconds from an arbitrary point,never going back
+        static uint64_t Monotonic();
+        //nanoseconds since the epoch
+        static uint64_t Wall();
+        //the monotonic clock read from the tsc when it runs at a constant
+        //rate,for timing short intervals.until the tsc is calibrated,and on
+        //machines without one,it is Monotonic
+        static uint64_t Fast();
+        static bool HasFastPath();
+        //retried when a signal cuts the sleep short
+        static void SleepUntil(uint64_t deadlineNs);
+        static void Sleep(uint64_t ns);
+    };
+
+    //timeouts hashed by due time onto slots of tickNs each.a thread of the
+    //wheel's own wakes once per tick that has something due and fires all of
+    //it together,so the many connections backing off on a lock share one
+    //wakeup instead of each running a timer of its own
+    class TimerWheel {
+    private:
+        struct Timer {
+            uint64_t id;
+            uint64_t deadline;
+            std::function<void()> fn;
+        };
+
+        std::vector<std::list<Timer>> slots;
+        uint64_t tick;              //slots before this one have fired
+        uint64_t nextId;
+        long nTimer;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;        //on the monotonic clock
+        pthread_t thread;
+        bool bThread;
+        bool bStop;
+
+        static void *Run(void *pArg);
+        void Loop();
+        uint64_t NextDue() const;
+    public:
+        const uint64_t tickNs;
+        long nFired;
+        long nWakeup;
+
+        //fn runs on the wheel's thread once deadlineNs,on Clock::Monotonic,has
+        //passed.returns an id for Cancel
+        uint64_t Add(uint64_t deadlineNs, std::function<void()> fn);
+        //false when the timer fired or was never there
+        bool Cancel(uint64_t id);
+        //blocks until deadlineNs has passed,woken by the tick it falls in
+        void SleepUntil(uint64_t deadlineNs);
+
+        //a child after fork gets a wheel of its own,the parent's thread is not there
+        static TimerWheel *Global();
+
+        explicit TimerWheel(uint64_t tickNs = DefaultTimerTickNs, unsigned nSlot = DefaultTimerSlots);
+        TimerWheel(const TimerWheel &) = delete;
+        TimerWheel &operator=(const TimerWheel &) = delete;
+        ~TimerWheel();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_CLOCK_H
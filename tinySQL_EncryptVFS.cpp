@@ -0,0 +1,120 @@
+//
+// Created by user on 26-10-19.
+//
+#include <vector>
+#include "tinySQL_EncryptVFS.h"
+
+namespace tinySQL {
+
+    static bool IsZeroPage(const unsigned char *p, int pageSize) {
+        return p[0] == 0 && memcmp(p, p + 1, pageSize - 1) == 0;
+    }
+
+    int EncryptVFS::xOpen(const char *zName, tinySQL_file **ppFile, int flags, int *pOutFlags) {
+        tinySQL_file *pReal = nullptr;
+        int status = pBase->xOpen(zName, &pReal, flags, pOutFlags);
+        if (status != Succeed)
+            return status;
+        *ppFile = new EncryptFile(this, pReal);
+        return Succeed;
+    }
+
+    EncryptVFS::EncryptVFS(std::string name, tinySQL_VFS *pBase, const unsigned char *pKey, int pageSize) :
+            ShimVFS(std::move(name), pBase), cipher(pKey), pageSize(pageSize) {
+        assert(pageSize > 0 && pageSize % AES_BlockSize == 0);
+    }
+
+
+    //read whole pages and decrypt them in place,holes stay zero
+    int EncryptFile::ReadPages(unsigned char *pBuff, long nPage, long firstPage) {
+        int status = pReal->xRead(pBuff, nPage * pageSize, firstPage * pageSize);
+        if (status != Succeed && status != IOError_ReadShort)
+            return status;
+        for (long i = 0; i < nPage; i++) {
+            unsigned char *pPage = &pBuff[i * pageSize];
+            if (!IsZeroPage(pPage, pageSize))
+                cipher.Decrypt(pPage, pageSize, firstPage + i);
+        }
+        return status;
+    }
+
+    int EncryptFile::xRead(void *pBuff, long readCount, long offset) {
+        assert(readCount >= 0);
+        assert(offset >= 0);
+        if (readCount == 0)
+            return Succeed;
+        long firstPage = offset / pageSize;
+        long nPage = (offset + readCount - 1) / pageSize - firstPage + 1;
+        if (offset % pageSize == 0 && readCount % pageSize == 0)
+            return ReadPages(static_cast<unsigned char *>(pBuff), nPage, firstPage);
+
+        //files only ever grow by whole pages,so the page range is short
+        //exactly when the requested range is
+        std::vector<unsigned char> pages(nPage * pageSize);
+        int status = ReadPages(pages.data(), nPage, firstPage);
+        if (status != Succeed && status != IOError_ReadShort)
+            return status;
+        memcpy(pBuff, &pages[offset % pageSize], readCount);
+        return status;
+    }
+
+    int EncryptFile::xWrite(const void *pBuff, long writeCount, long offset) {
+        assert(writeCount >= 0);
+        assert(offset >= 0);
+        if (writeCount == 0)
+            return Succeed;
+        long firstPage = offset / pageSize;
+        long lastPage = (offset + writeCount - 1) / pageSize;
+        long nPage = lastPage - firstPage + 1;
+        std::vector<unsigned char> pages(nPage * pageSize);
+        int status;
+
+        //partial pages at either end are read back and merged first
+        if (offset % pageSize != 0) {
+            status = ReadPages(pages.data(), 1, firstPage);
+            if (status != Succeed && status != IOError_ReadShort)
+                return status;
+        }
+        if ((offset + writeCount) % pageSize != 0 && (lastPage != firstPage || offset % pageSize == 0)) {
+            status = ReadPages(&pages[(nPage - 1) * pageSize], 1, lastPage);
+            if (status != Succeed && status != IOError_ReadShort)
+                return status;
+        }
+        memcpy(&pages[offset % pageSize], pBuff, writeCount);
+        for (long i = 0; i < nPage; i++)
+            cipher.Encrypt(&pages[i * pageSize], pageSize, firstPage + i);
+        return pReal->xWrite(pages.data(), nPage * pageSize, firstPage * pageSize);
+    }
+
+    int EncryptFile::xTruncate(long size) {
+        assert(size >= 0);
+        if (size % pageSize != 0) {
+            long lastPage = size / pageSize;
+            std::vector<unsigned char> page(pageSize);
+            int status = ReadPages(page.data(), 1, lastPage);
+            if (status != Succeed && status != IOError_ReadShort)
+                return status;
+            if (status == Succeed) {
+                memset(&page[size % pageSize], 0, pageSize - size % pageSize);
+                cipher.Encrypt(page.data(), pageSize, lastPage);
+                status = pReal->xWrite(page.data(), pageSize, lastPage * pageSize);
+                if (status != Succeed)
+                    return status;
+            }
+            size = (lastPage + 1) * pageSize;
+        }
+        return pReal->xTruncate(size);
+    }
+
+    //the file's identity keys caches that hold plaintext pages outside the
+    //process,an encrypted file has none
+    int EncryptFile::xFileControl(int op, void *pArg) {
+        if (op == Fcntl_FileId)
+            return NotFound;
+        return ShimFile::xFileControl(op, pArg);
+    }
+
+    EncryptFile::EncryptFile(EncryptVFS *pVFS, tinySQL_file *pReal) :
+            ShimFile(pVFS, pReal), cipher(pVFS->cipher), pageSize(pVFS->pageSize) {
+    }
+}
@@ -0,0 +1,45 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_ENCRYPTVFS_H
+#define SQLITELIKE_TINYSQL_ENCRYPTVFS_H
+
+#include "tinySQL_Shim.h"
+#include "tinySQL_AES.h"
+
+namespace tinySQL {
+
+    //encrypts every page of every file opened through it with XTS-AES,
+    //the page number is the tweak.pages that are all zero on disk are holes
+    //and read back as zero
+    class EncryptVFS final : public ShimVFS {
+    public:
+        const XTSCipher cipher;
+        const int pageSize;
+
+        int xOpen(const char *zName, tinySQL_file **ppFile,
+                  int flags, int *pOutFlags) override;
+
+        EncryptVFS(std::string name, tinySQL_VFS *pBase, const unsigned char *pKey, int pageSize = 4096);
+    };
+
+    class EncryptFile : public ShimFile {
+    private:
+        int ReadPages(unsigned char *pBuff, long nPage, long firstPage);
+    public:
+        const XTSCipher &cipher;
+        const int pageSize;
+
+        int xRead(void *pBuff, long readCount, long offset) override;
+
+        int xWrite(const void *pBuff, long writeCount, long offset) override;
+
+        int xTruncate(long size) override;
+
+        int xFileControl(int op, void *pArg) override;
+
+        EncryptFile(EncryptVFS *pVFS, tinySQL_file *pReal);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_ENCRYPTVFS_H
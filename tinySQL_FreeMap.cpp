@@ -0,0 +1,146 @@
+//
+// Created by user on 26-10-19.
+//
+#include <cassert>
+#include <cstring>
+#include "tinySQL_FreeMap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TINYSQL_BITMAP_X86 1
+#endif
+
+namespace tinySQL {
+
+    //bit i of the map is bit i % 64 of word i / 64
+    static inline uint64_t Word(const unsigned char *pMap, long w) {
+        uint64_t x;
+        memcpy(&x, pMap + 8 * w, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        x = __builtin_bswap64(x);
+#endif
+        return x;
+    }
+
+    //first word at or after w that is not equal to skip,nWord when none is
+    static long SkipScalar(const unsigned char *pMap, long nWord, long w, uint64_t skip) {
+        while (w < nWord && Word(pMap, w) == skip)
+            w++;
+        return w;
+    }
+
+    static long CountScalar(const unsigned char *pMap, long nWord) {
+        long n = 0;
+        for (long w = 0; w < nWord; w++)
+            n += __builtin_popcountll(Word(pMap, w));
+        return n;
+    }
+
+#ifdef TINYSQL_BITMAP_X86
+    __attribute__((target("avx2")))
+    static long SkipAVX2(const unsigned char *pMap, long nWord, long w, uint64_t skip) {
+        while (w < nWord && (w & 3) != 0) {
+            if (Word(pMap, w) != skip)
+                return w;
+            w++;
+        }
+        const __m256i pattern = _mm256_set1_epi64x(static_cast<long long>(skip));
+        for (; w + 4 <= nWord; w += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pMap + 8 * w));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, pattern)) != -1)
+                break;
+        }
+        return SkipScalar(pMap, nWord, w, skip);
+    }
+
+    __attribute__((target("popcnt")))
+    static long CountPopcnt(const unsigned char *pMap, long nWord) {
+        long n = 0;
+        for (long w = 0; w < nWord; w++)
+            n += __builtin_popcountll(Word(pMap, w));
+        return n;
+    }
+#endif
+
+    struct BitmapKernels {
+        const char *zName;
+        long (*skip)(const unsigned char *, long, long, uint64_t);
+        long (*count)(const unsigned char *, long);
+    };
+
+    static const BitmapKernels scalarKernels = {"scalar", SkipScalar, CountScalar};
+#ifdef TINYSQL_BITMAP_X86
+    static const BitmapKernels avx2Kernels = {"avx2", SkipAVX2, CountPopcnt};
+#endif
+
+    static const BitmapKernels *DetectKernels() {
+#ifdef TINYSQL_BITMAP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+            return &avx2Kernels;
+#endif
+        return &scalarKernels;
+    }
+
+    static const BitmapKernels &Kernels() {
+        static const BitmapKernels *pKernels = DetectKernels();
+        return *pKernels;
+    }
+
+    //first bit at or after i that equals bit,nBit when there is none
+    static long NextBit(const unsigned char *pMap, long nBit, long i, bool bit) {
+        if (i >= nBit)
+            return nBit;
+        long nWord = nBit / 64;
+        uint64_t skip = bit ? 0 : ~0ULL;
+        long w = i / 64;
+        uint64_t x = (Word(pMap, w) ^ skip) & (~0ULL << (i % 64));
+        if (x == 0) {
+            w = Kernels().skip(pMap, nWord, w + 1, skip);
+            if (w == nWord)
+                return nBit;
+            x = Word(pMap, w) ^ skip;
+        }
+        return w * 64 + __builtin_ctzll(x);
+    }
+
+    long BitmapFindRun(const unsigned char *pMap, long nBit, long from, long nRun, long *pLength) {
+        assert(nBit % 64 == 0 && from >= 0 && nRun > 0);
+        long i = from;
+        while (i < nBit) {
+            i = NextBit(pMap, nBit, i, true);
+            if (i == nBit)
+                break;
+            long j = NextBit(pMap, nBit, i, false);
+            if (j - i >= nRun) {
+                *pLength = j - i;
+                return i;
+            }
+            i = j;
+        }
+        *pLength = 0;
+        return -1;
+    }
+
+    long BitmapCount(const unsigned char *pMap, long nBit) {
+        assert(nBit % 64 == 0);
+        return Kernels().count(pMap, nBit / 64);
+    }
+
+    long BitmapRunBefore(const unsigned char *pMap, long end) {
+        long i = end;
+        while (i % 64 != 0 && BitmapTest(pMap, i - 1))
+            i--;
+        if (i % 64 != 0)
+            return end - i;
+        while (i > 0 && Word(pMap, i / 64 - 1) == ~0ULL)
+            i -= 64;
+        if (i > 0)
+            i -= __builtin_clzll(~Word(pMap, i / 64 - 1));
+        return end - i;
+    }
+
+    const char *BitmapImplementation() {
+        return Kernels().zName;
+    }
+}
@@ -0,0 +1,41 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_FREEMAP_H
+#define SQLITELIKE_TINYSQL_FREEMAP_H
+
+#include <cstdint>
+
+namespace tinySQL {
+
+    //bitmaps of free pages,bit i is bit i % 8 of byte i / 8.the scans read
+    //8 bytes at a time and,where the cpu has avx2,step over 32 bytes that are
+    //all clear (or all set) at once.nBit is a multiple of 64
+
+    inline bool BitmapTest(const unsigned char *pMap, long i) {
+        return (pMap[i >> 3] >> (i & 7)) & 1;
+    }
+
+    inline void BitmapSet(unsigned char *pMap, long i) {
+        pMap[i >> 3] |= static_cast<unsigned char>(1 << (i & 7));
+    }
+
+    inline void BitmapClear(unsigned char *pMap, long i) {
+        pMap[i >> 3] &= static_cast<unsigned char>(~(1 << (i & 7)));
+    }
+
+    //start of the first run of at least nRun set bits at or after from,-1
+    //when there is none.*pLength is the whole length of that run
+    long BitmapFindRun(const unsigned char *pMap, long nBit, long from, long nRun, long *pLength);
+
+    //set bits in [0,nBit)
+    long BitmapCount(const unsigned char *pMap, long nBit);
+
+    //length of the run of set bits that ends right before bit end
+    long BitmapRunBefore(const unsigned char *pMap, long end);
+
+    //"avx2" or "scalar",chosen once from cpuid
+    const char *BitmapImplementation();
+}
+#endif //SQLITELIKE_TINYSQL_FREEMAP_H
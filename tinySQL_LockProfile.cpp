@@ -0,0 +1,149 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <cstring>
+#include "tinySQL_Clock.h"
+#include "tinySQL_LockProfile.h"
+
+namespace tinySQL {
+
+    static LockSite sites[LockProfile_Sites];
+    static std::atomic<bool> bProfile(true);
+
+    static void StoreMax(std::atomic<uint64_t> &max, uint64_t v) {
+        uint64_t old = max.load(std::memory_order_relaxed);
+        while (v > old && !max.compare_exchange_weak(old, v, std::memory_order_relaxed));
+    }
+
+    bool LockProfile::Enabled() {
+        return bProfile.load(std::memory_order_relaxed);
+    }
+
+    void LockProfile::Enable(bool bEnable) {
+        bProfile.store(bEnable, std::memory_order_relaxed);
+    }
+
+    //open addressing on the two name addresses,a slot is claimed once and never freed
+    LockSite *LockProfile::Site(const char *zLock, const char *zSite) {
+        if (!Enabled())
+            return nullptr;
+        auto h = reinterpret_cast<uintptr_t>(zLock) * 31 + reinterpret_cast<uintptr_t>(zSite);
+        h ^= h >> 17;
+        for (int i = 0; i < LockProfile_Sites; i++) {
+            LockSite &site = sites[(h + i) % LockProfile_Sites];
+            int state = site.state.load(std::memory_order_acquire);
+            if (state == 0 && site.state.compare_exchange_strong(state, 1, std::memory_order_acquire)) {
+                site.zLock = zLock;
+                site.zSite = zSite;
+                site.state.store(2, std::memory_order_release);
+                return &site;
+            }
+            while (state == 1)
+                state = site.state.load(std::memory_order_acquire);
+            if (site.zLock == zLock && site.zSite == zSite)
+                return &site;
+        }
+        return nullptr;
+    }
+
+    void LockProfile::Wait(LockSite *pSite, uint64_t ns, int nContender) {
+        pSite->nContended.fetch_add(1, std::memory_order_relaxed);
+        pSite->nsWait.fetch_add(ns, std::memory_order_relaxed);
+        StoreMax(pSite->nsWaitMax, ns);
+        int old = pSite->maxContenders.load(std::memory_order_relaxed);
+        while (nContender > old &&
+               !pSite->maxContenders.compare_exchange_weak(old, nContender, std::memory_order_relaxed));
+    }
+
+    void LockProfile::Fcntl(const char *zLevel, bool bBusy, uint64_t ns) {
+        LockSite *pSite = Site("fcntl", zLevel);
+        if (!pSite)
+            return;
+        pSite->nAcquire.fetch_add(1, std::memory_order_relaxed);
+        pSite->nsWait.fetch_add(ns, std::memory_order_relaxed);
+        StoreMax(pSite->nsWaitMax, ns);
+        if (bBusy)
+            pSite->nContended.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void LockProfile::Hottest(int nMax, std::vector<LockStat> *pStats) {
+        pStats->clear();
+        for (auto &site : sites) {
+            if (site.state.load(std::memory_order_acquire) != 2)
+                continue;
+            uint64_t nAcquire = site.nAcquire.load(std::memory_order_relaxed);
+            uint64_t nSample = site.nHoldSample.load(std::memory_order_relaxed);
+            uint64_t nsHold = nSample ? static_cast<uint64_t>(
+                    static_cast<double>(site.nsHoldSampled.load(std::memory_order_relaxed)) * nAcquire / nSample) : 0;
+            auto it = std::find_if(pStats->begin(), pStats->end(), [&site](const LockStat &stat) {
+                return strcmp(stat.zLock, site.zLock) == 0 && strcmp(stat.zSite, site.zSite) == 0;
+            });
+            if (it == pStats->end())
+                it = pStats->insert(pStats->end(), LockStat{site.zLock, site.zSite, 0, 0, 0, 0, 0, 0});
+            it->nAcquire += nAcquire;
+            it->nContended += site.nContended.load(std::memory_order_relaxed);
+            it->nsWait += site.nsWait.load(std::memory_order_relaxed);
+            it->nsWaitMax = std::max(it->nsWaitMax, site.nsWaitMax.load(std::memory_order_relaxed));
+            it->nsHold += nsHold;
+            it->maxContenders = std::max(it->maxContenders, site.maxContenders.load(std::memory_order_relaxed));
+        }
+        std::sort(pStats->begin(), pStats->end(), [](const LockStat &a, const LockStat &b) {
+            return a.nsWait != b.nsWait ? a.nsWait > b.nsWait : a.nContended > b.nContended;
+        });
+        if (nMax >= 0 && pStats->size() > static_cast<size_t>(nMax))
+            pStats->resize(nMax);
+    }
+
+    //the sites stay claimed,their counts start over
+    void LockProfile::Reset() {
+        for (auto &site : sites) {
+            site.nAcquire.store(0, std::memory_order_relaxed);
+            site.nContended.store(0, std::memory_order_relaxed);
+            site.nsWait.store(0, std::memory_order_relaxed);
+            site.nsWaitMax.store(0, std::memory_order_relaxed);
+            site.nsHoldSampled.store(0, std::memory_order_relaxed);
+            site.nHoldSample.store(0, std::memory_order_relaxed);
+            site.maxContenders.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ProfiledMutex::ProfiledMutex(const char *zName) : mutex(), nWaiting(0), pHeld(nullptr), acquired(0),
+                                                      zName(zName) {
+        pthread_mutex_init(&mutex, nullptr);
+    }
+
+    ProfiledMutex::~ProfiledMutex() {
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void ProfiledMutex::Lock(const char *zSite) {
+        LockSite *pSite = LockProfile::Site(zName, zSite);
+        if (!pSite) {
+            pthread_mutex_lock(&mutex);
+            pHeld = nullptr;
+            return;
+        }
+        if (pthread_mutex_trylock(&mutex) != 0) {
+            int nContender = nWaiting.fetch_add(1, std::memory_order_relaxed) + 1;
+            uint64_t start = Clock::Fast();
+            pthread_mutex_lock(&mutex);
+            nWaiting.fetch_sub(1, std::memory_order_relaxed);
+            LockProfile::Wait(pSite, Clock::Fast() - start, nContender);
+        }
+        pHeld = nullptr;
+        if (pSite->nAcquire.fetch_add(1, std::memory_order_relaxed) % LockProfile_HoldSample == 0) {
+            pHeld = pSite;
+            acquired = Clock::Fast();
+        }
+    }
+
+    void ProfiledMutex::Unlock() {
+        if (pHeld) {
+            pHeld->nsHoldSampled.fetch_add(Clock::Fast() - acquired, std::memory_order_relaxed);
+            pHeld->nHoldSample.fetch_add(1, std::memory_order_relaxed);
+            pHeld = nullptr;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+}
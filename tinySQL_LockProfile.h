@@ -0,0 +1,89 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_LOCKPROFILE_H
+#define SQLITELIKE_TINYSQL_LOCKPROFILE_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace tinySQL {
+
+    static constexpr int LockProfile_Sites = 256;
+    static constexpr uint64_t LockProfile_HoldSample = 64;     //one acquisition in this many is timed while held
+
+    //what one call site saw of one lock.for an fcntl lock the site is the
+    //level asked for and contended counts the Busying answers
+    struct LockStat {
+        const char *zLock;
+        const char *zSite;
+        uint64_t nAcquire;
+        uint64_t nContended;
+        uint64_t nsWait;
+        uint64_t nsWaitMax;
+        uint64_t nsHold;            //estimated from the sampled acquisitions
+        int maxContenders;          //threads waiting at once,counting the one that waited
+    };
+
+    //passed to xFileControl(Fcntl_LockProfile),stats is filled with the nMax
+    //sites of the process that waited longest
+    struct LockReport {
+        int nMax;
+        std::vector<LockStat> stats;
+    };
+
+    struct LockSite {
+        std::atomic<int> state;     //0 free,1 being claimed,2 in use
+        const char *zLock;
+        const char *zSite;
+        std::atomic<uint64_t> nAcquire;
+        std::atomic<uint64_t> nContended;
+        std::atomic<uint64_t> nsWait;
+        std::atomic<uint64_t> nsWaitMax;
+        std::atomic<uint64_t> nsHoldSampled;
+        std::atomic<uint64_t> nHoldSample;
+        std::atomic<int> maxContenders;
+    };
+
+    //process wide table of lock sites,sites past LockProfile_Sites are not counted.
+    //sites are told apart by the addresses of their names,Hottest adds up
+    //those with equal names
+    class LockProfile {
+    public:
+        static bool Enabled();
+        static void Enable(bool bEnable);
+        //nullptr when off or when the table is full
+        static LockSite *Site(const char *zLock, const char *zSite);
+        static void Wait(LockSite *pSite, uint64_t ns, int nContender);
+        //one fcntl lock call,bBusy when another process held the range
+        static void Fcntl(const char *zLevel, bool bBusy, uint64_t ns);
+        static void Hottest(int nMax, std::vector<LockStat> *pStats);
+        static void Reset();
+    };
+
+    //pthread mutex that counts its acquisitions for the site taking it.an
+    //uncontended Lock costs a trylock and a counter,a wait is timed on
+    //Clock::Fast,and the hold time is sampled on one acquisition in
+    //LockProfile_HoldSample
+    class ProfiledMutex {
+    private:
+        pthread_mutex_t mutex;
+        std::atomic<int> nWaiting;
+        LockSite *pHeld;            //site whose hold is being timed
+        uint64_t acquired;
+    public:
+        const char *const zName;
+
+        void Lock(const char *zSite = __builtin_FUNCTION());
+        void Unlock();
+
+        explicit ProfiledMutex(const char *zName);
+        ProfiledMutex(const ProfiledMutex &) = delete;
+        ProfiledMutex &operator=(const ProfiledMutex &) = delete;
+        ~ProfiledMutex();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_LOCKPROFILE_H
@@ -0,0 +1,1345 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include "tinySQL_Clock.h"
+#include "tinySQL_Lsm.h"
+#include "tinySQL_Pager.h"
+
+namespace tinySQL {
+
+    static constexpr unsigned Lsm_RunMagic = 0x4c534d52;
+    static constexpr unsigned Lsm_ManifestMagic = 0x4c534d4d;
+    static constexpr unsigned Lsm_Tombstone = 0x80000000u;  //top bit of nValue
+    static constexpr long Lsm_RecordHeader = 16;            //nKey,nValue,seq
+    static constexpr long Lsm_LogHeader = 4 + Lsm_RecordHeader;
+    static constexpr long Lsm_FooterSize = 36;
+    static constexpr int SkipMaxHeight = 12;
+    static constexpr size_t ArenaBlock = 256 << 10;
+    static constexpr size_t LogBatch = 64 << 10;            //log bytes gathered into one xWrite
+    static constexpr size_t MaxFrozen = 2;                  //memtables waiting for a flush before writers stall
+    static constexpr size_t StallRuns = 3;                  //level 0 runs,in level0Runs,before writers stall
+    static constexpr uint64_t OrphanProbe = 64;             //run numbers past the manifest's looked at on open
+
+    static uint64_t Get8(const unsigned char *p) {
+        return (static_cast<uint64_t>(Get4(p)) << 32) | Get4(&p[4]);
+    }
+
+    static void Put8(unsigned char *p, uint64_t v) {
+        Put4(p, static_cast<unsigned>(v >> 32));
+        Put4(&p[4], static_cast<unsigned>(v));
+    }
+
+    static uint64_t Hash64(const unsigned char *p, size_t n) {
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ n;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            memcpy(&w, &p[i], 8);
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        for (; i < n; i++)
+            h = (h ^ p[i]) * 0x100000001b3ull;
+        h ^= h >> 29;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 32);
+    }
+
+    static unsigned Checksum(const unsigned char *p, size_t n) {
+        uint64_t h = Hash64(p, n);
+        return static_cast<unsigned>(h ^ (h >> 32));
+    }
+
+    static int CompareBytes(const unsigned char *a, size_t na, const unsigned char *b, size_t nb) {
+        size_t n = std::min(na, nb);
+        int c = n ? memcmp(a, b, n) : 0;
+        return c != 0 ? c : (na < nb ? -1 : na > nb);
+    }
+
+    static int CompareKey(const std::string &a, const unsigned char *b, size_t nb) {
+        return CompareBytes(reinterpret_cast<const unsigned char *>(a.data()), a.size(), b, nb);
+    }
+
+    static const unsigned char *Bytes(const std::string &s) {
+        return reinterpret_cast<const unsigned char *>(s.data());
+    }
+
+    struct LsmRecord {
+        const unsigned char *pKey;
+        unsigned nKey;
+        const unsigned char *pValue;
+        unsigned nValue;
+        uint64_t seq;
+        bool bDelete;
+    };
+
+    //false when the record at *pOffset runs past n
+    static bool ParseRecord(const unsigned char *p, size_t n, size_t *pOffset, LsmRecord *pRecord) {
+        size_t offset = *pOffset;
+        if (n - offset < Lsm_RecordHeader)
+            return false;
+        unsigned nValue = Get4(&p[offset + 4]);
+        *pRecord = {&p[offset + Lsm_RecordHeader], Get4(&p[offset]), nullptr, nValue & ~Lsm_Tombstone,
+                    Get8(&p[offset + 8]), (nValue & Lsm_Tombstone) != 0};
+        if (n - offset - Lsm_RecordHeader < static_cast<size_t>(pRecord->nKey) + pRecord->nValue)
+            return false;
+        pRecord->pValue = pRecord->pKey + pRecord->nKey;
+        *pOffset = offset + Lsm_RecordHeader + pRecord->nKey + pRecord->nValue;
+        return true;
+    }
+
+    static void PutRecord(unsigned char *p, const unsigned char *pKey, unsigned nKey, const unsigned char *pValue,
+                          unsigned nValue, uint64_t seq, bool bDelete) {
+        Put4(p, nKey);
+        Put4(&p[4], nValue | (bDelete ? Lsm_Tombstone : 0));
+        Put8(&p[8], seq);
+        if (nKey)
+            memcpy(&p[Lsm_RecordHeader], pKey, nKey);
+        if (nValue)
+            memcpy(&p[Lsm_RecordHeader + nKey], pValue, nValue);
+    }
+
+    //filter bit positions come from one hash by double hashing
+    static void BloomAdd(unsigned char *pBloom, uint64_t nBit, unsigned nHash, uint64_t h) {
+        uint64_t delta = (h >> 33) | (h << 31);
+        for (unsigned i = 0; i < nHash; i++, h += delta)
+            pBloom[(h % nBit) >> 3] |= static_cast<unsigned char>(1 << ((h % nBit) & 7));
+    }
+
+    static bool BloomTest(const unsigned char *pBloom, uint64_t nBit, unsigned nHash, uint64_t h) {
+        uint64_t delta = (h >> 33) | (h << 31);
+        for (unsigned i = 0; i < nHash; i++, h += delta)
+            if (!((pBloom[(h % nBit) >> 3] >> ((h % nBit) & 7)) & 1))
+                return false;
+        return true;
+    }
+
+
+    //skiplist in keys ascending and then seq descending order.one writer at a
+    //time links nodes in with release stores,readers take no lock
+    struct LsmTree::MemTable {
+        struct Node {
+            uint64_t seq;
+            unsigned nKey;
+            unsigned nValue;        //with Lsm_Tombstone for a delete
+            int height;
+
+            std::atomic<Node *> *Next(int level) {
+                return reinterpret_cast<std::atomic<Node *> *>(this + 1) + level;
+            }
+
+            const unsigned char *Key() {
+                return reinterpret_cast<const unsigned char *>(Next(height));
+            }
+
+            const unsigned char *Value() {
+                return Key() + nKey;
+            }
+        };
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *pFree;
+        size_t nFree;
+        Node *pHead;
+        std::atomic<int> height;
+        std::atomic<long> size;
+        unsigned random;
+        const uint64_t firstLog;    //the entries came from this log and the ones up to the next memtable's
+
+        explicit MemTable(uint64_t firstLog) : blocks(), pFree(nullptr), nFree(0), pHead(nullptr), height(1), size(0),
+                                               random(0x2545f491), firstLog(firstLog) {
+            pHead = NewNode(SkipMaxHeight, 0);
+        }
+
+        Node *NewNode(int h, size_t nData) {
+            size_t n = (sizeof(Node) + h * sizeof(std::atomic<Node *>) + nData + 7) & ~static_cast<size_t>(7);
+            char *p;
+            if (n > ArenaBlock / 4) {
+                blocks.emplace_back(new char[n]);
+                p = blocks.back().get();
+            } else {
+                if (n > nFree) {
+                    blocks.emplace_back(new char[ArenaBlock]);
+                    pFree = blocks.back().get();
+                    nFree = ArenaBlock;
+                }
+                p = pFree;
+                pFree += n;
+                nFree -= n;
+            }
+            size.fetch_add(static_cast<long>(n), std::memory_order_relaxed);
+            auto pNode = reinterpret_cast<Node *>(p);
+            pNode->height = h;
+            for (int i = 0; i < h; i++)
+                new(pNode->Next(i)) std::atomic<Node *>(nullptr);
+            return pNode;
+        }
+
+        static bool Before(Node *pNode, const unsigned char *pKey, size_t nKey, uint64_t seq) {
+            int c = CompareBytes(pNode->Key(), pNode->nKey, pKey, nKey);
+            return c < 0 || (c == 0 && pNode->seq > seq);
+        }
+
+        //first node at or after (key,seq),prev gets the last node before it on every level
+        Node *Seek(const unsigned char *pKey, size_t nKey, uint64_t seq, Node **prev) {
+            Node *x = pHead;
+            for (int level = height.load(std::memory_order_acquire) - 1; level >= 0; level--) {
+                Node *pNext = x->Next(level)->load(std::memory_order_acquire);
+                while (pNext && Before(pNext, pKey, nKey, seq)) {
+                    x = pNext;
+                    pNext = x->Next(level)->load(std::memory_order_acquire);
+                }
+                if (prev)
+                    prev[level] = x;
+            }
+            return x->Next(0)->load(std::memory_order_acquire);
+        }
+
+        void Add(uint64_t seq, const unsigned char *pKey, unsigned nKey, const unsigned char *pValue,
+                 unsigned nValue, bool bDelete) {
+            int h = 1;
+            while (h < SkipMaxHeight) {
+                random ^= random << 13;
+                random ^= random >> 17;
+                random ^= random << 5;
+                if ((random & 3) != 0)
+                    break;
+                h++;
+            }
+            Node *prev[SkipMaxHeight];
+            for (int i = height.load(std::memory_order_relaxed); i < SkipMaxHeight; i++)
+                prev[i] = pHead;
+            Seek(pKey, nKey, seq, prev);
+
+            Node *pNode = NewNode(h, static_cast<size_t>(nKey) + nValue);
+            pNode->seq = seq;
+            pNode->nKey = nKey;
+            pNode->nValue = nValue | (bDelete ? Lsm_Tombstone : 0);
+            if (nKey)
+                memcpy(const_cast<unsigned char *>(pNode->Key()), pKey, nKey);
+            if (nValue)
+                memcpy(const_cast<unsigned char *>(pNode->Value()), pValue, nValue);
+            if (h > height.load(std::memory_order_relaxed))
+                height.store(h, std::memory_order_release);
+            for (int i = 0; i < h; i++) {
+                pNode->Next(i)->store(prev[i]->Next(i)->load(std::memory_order_relaxed), std::memory_order_relaxed);
+                prev[i]->Next(i)->store(pNode, std::memory_order_release);
+            }
+        }
+
+        bool Empty() {
+            return pHead->Next(0)->load(std::memory_order_acquire) == nullptr;
+        }
+    };
+
+    //a run file is data blocks of records,each nKey,nValue (the top bit marks
+    //a tombstone),seq,key and value,then the index: the smallest key,the block
+    //count and for every block its last key,offset,size and checksum.the bloom
+    //filter follows and a footer ends the file: index offset and size,filter
+    //size,record count,hash count,checksum of index and filter,magic.a run
+    //holds one entry per key and integers are big-endian
+    struct LsmTree::Run {
+        struct Block {
+            std::string lastKey;
+            long offset;
+            unsigned size;
+            unsigned checksum;
+        };
+
+        tinySQL_VFS *const pVFS;
+        const std::string name;
+        const uint64_t number;
+        tinySQL_file *pFile;
+        long fileSize;
+        long nRecord;
+        std::string smallest;
+        std::string largest;
+        std::vector<Block> blocks;
+        std::vector<unsigned char> bloom;
+        unsigned nHash;
+        std::atomic<bool> bObsolete;        //the file goes with the last version that has it
+
+        Run(tinySQL_VFS *pVFS, std::string name, uint64_t number) :
+                pVFS(pVFS), name(std::move(name)), number(number), pFile(nullptr), fileSize(0), nRecord(0),
+                smallest(), largest(), blocks(), bloom(), nHash(0), bObsolete(false) {
+        }
+
+        ~Run() {
+            if (pFile)
+                pFile->xClose();
+            if (bObsolete.load())
+                pVFS->xDelete(name.c_str());
+        }
+
+        bool Overlaps(const std::string &lo, const std::string &hi) const {
+            return !(largest < lo || hi < smallest);
+        }
+
+        bool MayContain(uint64_t h) const {
+            return bloom.empty() || BloomTest(bloom.data(), bloom.size() * 8, nHash, h);
+        }
+
+        int ReadBlock(size_t i, std::vector<unsigned char> *pBuffer) const {
+            pBuffer->resize(blocks[i].size);
+            int status = pFile->xRead(pBuffer->data(), blocks[i].size, blocks[i].offset);
+            if (status != Succeed)
+                return status;
+            return Checksum(pBuffer->data(), pBuffer->size()) == blocks[i].checksum ? Succeed : Corrupt;
+        }
+
+        //first block whose last key is not below the key,blocks.size() when none is
+        size_t FindBlock(const unsigned char *pKey, size_t nKey) const {
+            size_t lo = 0, hi = blocks.size();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (CompareKey(blocks[mid].lastKey, pKey, nKey) < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        int Find(const unsigned char *pKey, size_t nKey, bool *pFound, bool *pDelete, std::string *pValue) const {
+            *pFound = false;
+            size_t i = FindBlock(pKey, nKey);
+            if (i == blocks.size())
+                return Succeed;
+            std::vector<unsigned char> buffer;
+            int status = ReadBlock(i, &buffer);
+            if (status != Succeed)
+                return status;
+            size_t offset = 0;
+            while (offset < buffer.size()) {
+                LsmRecord r;
+                if (!ParseRecord(buffer.data(), buffer.size(), &offset, &r))
+                    return Corrupt;
+                int c = CompareBytes(r.pKey, r.nKey, pKey, nKey);
+                if (c > 0)
+                    break;
+                if (c == 0) {
+                    *pFound = true;
+                    *pDelete = r.bDelete;
+                    if (!r.bDelete && pValue)
+                        pValue->assign(reinterpret_cast<const char *>(r.pValue), r.nValue);
+                    break;
+                }
+            }
+            return Succeed;
+        }
+    };
+
+    struct LsmTree::Version {
+        std::vector<std::shared_ptr<Run>> levels[LsmMaxLevel];  //level 0 and tiered levels newest first,
+                                                                //leveled ones by smallest key
+    };
+
+    //entries in keys ascending and then seq descending order,the current one is copied out
+    struct LsmTree::Source {
+        std::string key;
+        std::string value;
+        uint64_t seq = 0;
+        bool bDelete = false;
+        bool bEof = true;
+
+        //to the first entry whose key is not below pKey
+        virtual int Seek(const unsigned char *pKey, size_t nKey) = 0;
+        virtual int Next() = 0;
+        virtual ~Source() = default;
+    };
+
+    //entries newer than snapshot are passed over
+    struct LsmTree::MemSource : Source {
+        std::shared_ptr<MemTable> pMem;
+        uint64_t snapshot;
+        MemTable::Node *pNode;
+
+        MemSource(std::shared_ptr<MemTable> pMem, uint64_t snapshot) :
+                pMem(std::move(pMem)), snapshot(snapshot), pNode(nullptr) {
+        }
+
+        int Load(MemTable::Node *p) {
+            while (p && p->seq > snapshot)
+                p = p->Next(0)->load(std::memory_order_acquire);
+            pNode = p;
+            bEof = p == nullptr;
+            if (p) {
+                key.assign(reinterpret_cast<const char *>(p->Key()), p->nKey);
+                value.assign(reinterpret_cast<const char *>(p->Value()), p->nValue & ~Lsm_Tombstone);
+                seq = p->seq;
+                bDelete = (p->nValue & Lsm_Tombstone) != 0;
+            }
+            return Succeed;
+        }
+
+        int Seek(const unsigned char *pKey, size_t nKey) override {
+            return Load(pMem->Seek(pKey, nKey, UINT64_MAX, nullptr));
+        }
+
+        int Next() override {
+            return Load(pNode->Next(0)->load(std::memory_order_acquire));
+        }
+    };
+
+    struct LsmTree::RunSource : Source {
+        std::shared_ptr<Run> pRun;
+        size_t iBlock;
+        std::vector<unsigned char> buffer;
+        size_t offset;
+
+        explicit RunSource(std::shared_ptr<Run> pRun) : pRun(std::move(pRun)), iBlock(0), buffer(), offset(0) {
+        }
+
+        //the record at offset,going on to the next block at the end of one
+        int Load() {
+            while (offset == buffer.size()) {
+                if (++iBlock >= pRun->blocks.size()) {
+                    bEof = true;
+                    return Succeed;
+                }
+                offset = 0;
+                int status = pRun->ReadBlock(iBlock, &buffer);
+                if (status != Succeed) {
+                    bEof = true;
+                    return status;
+                }
+            }
+            LsmRecord r;
+            if (!ParseRecord(buffer.data(), buffer.size(), &offset, &r)) {
+                bEof = true;
+                return Corrupt;
+            }
+            key.assign(reinterpret_cast<const char *>(r.pKey), r.nKey);
+            value.assign(reinterpret_cast<const char *>(r.pValue), r.nValue);
+            seq = r.seq;
+            bDelete = r.bDelete;
+            bEof = false;
+            return Succeed;
+        }
+
+        int Seek(const unsigned char *pKey, size_t nKey) override {
+            iBlock = pRun->FindBlock(pKey, nKey);
+            buffer.clear();
+            offset = 0;
+            if (iBlock == pRun->blocks.size()) {
+                bEof = true;
+                return Succeed;
+            }
+            int status = pRun->ReadBlock(iBlock, &buffer);
+            if (status != Succeed) {
+                bEof = true;
+                return status;
+            }
+            do
+                status = Load();
+            while (status == Succeed && !bEof && CompareKey(key, pKey, nKey) < 0);
+            return status;
+        }
+
+        int Next() override {
+            return Load();
+        }
+    };
+
+    //the newest entry of every key in the children,tombstones included
+    struct LsmTree::MergeSource : Source {
+        std::vector<std::unique_ptr<Source>> children;
+
+        int Settle() {
+            Source *pBest = nullptr;
+            for (auto &pChild: children) {
+                if (pChild->bEof)
+                    continue;
+                int c = pBest ? pChild->key.compare(pBest->key) : -1;
+                if (c < 0 || (c == 0 && pChild->seq > pBest->seq))
+                    pBest = pChild.get();
+            }
+            bEof = pBest == nullptr;
+            if (pBest) {
+                key = pBest->key;
+                value = pBest->value;
+                seq = pBest->seq;
+                bDelete = pBest->bDelete;
+            }
+            return Succeed;
+        }
+
+        int Seek(const unsigned char *pKey, size_t nKey) override {
+            for (auto &pChild: children) {
+                int status = pChild->Seek(pKey, nKey);
+                if (status != Succeed)
+                    return status;
+            }
+            return Settle();
+        }
+
+        int Next() override {
+            for (auto &pChild: children)
+                while (!pChild->bEof && pChild->key == key) {
+                    int status = pChild->Next();
+                    if (status != Succeed)
+                        return status;
+                }
+            return Settle();
+        }
+    };
+
+    struct LsmTree::Compaction {
+        int outputLevel;
+        std::vector<std::shared_ptr<Run>> inputs;
+        bool bDropDeletes;
+    };
+
+    //builds one run file front to back
+    struct RunBuilder {
+        tinySQL_file *const pFile;
+        const long blockSize;
+        std::vector<unsigned char> block;
+        std::vector<unsigned char> index;       //block entries,the smallest key and count go in front at Finish
+        std::vector<uint64_t> hashes;
+        std::string smallest;
+        std::string lastKey;
+        long offset;
+        unsigned nBlock;
+
+        RunBuilder(tinySQL_file *pFile, long blockSize) :
+                pFile(pFile), blockSize(blockSize), block(), index(), hashes(), smallest(), lastKey(), offset(0),
+                nBlock(0) {
+        }
+
+        int EndBlock() {
+            if (block.empty())
+                return Succeed;
+            int status = pFile->xWrite(block.data(), static_cast<long>(block.size()), offset);
+            if (status != Succeed)
+                return status;
+            size_t at = index.size();
+            index.resize(at + 4 + lastKey.size() + 16);
+            unsigned char *p = &index[at];
+            Put4(p, static_cast<unsigned>(lastKey.size()));
+            memcpy(&p[4], lastKey.data(), lastKey.size());
+            p += 4 + lastKey.size();
+            Put8(p, offset);
+            Put4(&p[8], static_cast<unsigned>(block.size()));
+            Put4(&p[12], Checksum(block.data(), block.size()));
+            offset += static_cast<long>(block.size());
+            nBlock++;
+            block.clear();
+            return Succeed;
+        }
+
+        int Add(const std::string &key, const std::string &value, uint64_t seq, bool bDelete) {
+            if (hashes.empty())
+                smallest = key;
+            lastKey = key;
+            hashes.push_back(Hash64(Bytes(key), key.size()));
+            size_t at = block.size();
+            block.resize(at + Lsm_RecordHeader + key.size() + value.size());
+            PutRecord(&block[at], Bytes(key), static_cast<unsigned>(key.size()), Bytes(value),
+                      static_cast<unsigned>(value.size()), seq, bDelete);
+            return static_cast<long>(block.size()) >= blockSize ? EndBlock() : Succeed;
+        }
+
+        //size of the data written so far
+        long Size() const {
+            return offset + static_cast<long>(block.size());
+        }
+
+        int Finish(int bloomBits) {
+            int status = EndBlock();
+            if (status != Succeed)
+                return status;
+            std::vector<unsigned char> tail(8 + smallest.size());
+            Put4(tail.data(), static_cast<unsigned>(smallest.size()));
+            memcpy(&tail[4], smallest.data(), smallest.size());
+            Put4(&tail[4 + smallest.size()], nBlock);
+            tail.insert(tail.end(), index.begin(), index.end());
+            long indexSize = static_cast<long>(tail.size());
+
+            unsigned nHash = 0;
+            if (bloomBits > 0) {
+                uint64_t nBit = (hashes.size() * bloomBits + 63) & ~static_cast<uint64_t>(63);
+                nHash = std::max(1u, std::min(30u, static_cast<unsigned>(bloomBits * 69 / 100)));
+                size_t at = tail.size();
+                tail.resize(at + nBit / 8);
+                for (uint64_t h: hashes)
+                    BloomAdd(&tail[at], nBit, nHash, h);
+            }
+            long bloomSize = static_cast<long>(tail.size()) - indexSize;
+            unsigned checksum = Checksum(tail.data(), tail.size());
+            size_t at = tail.size();
+            tail.resize(at + Lsm_FooterSize);
+            unsigned char *p = &tail[at];
+            Put8(p, offset);
+            Put4(&p[8], static_cast<unsigned>(indexSize));
+            Put4(&p[12], static_cast<unsigned>(bloomSize));
+            Put8(&p[16], hashes.size());
+            Put4(&p[24], nHash);
+            Put4(&p[28], checksum);
+            Put4(&p[32], Lsm_RunMagic);
+            status = pFile->xWrite(tail.data(), static_cast<long>(tail.size()), offset);
+            if (status != Succeed)
+                return status;
+            return pFile->xSync(0);
+        }
+    };
+
+
+    std::string LsmTree::LogName(uint64_t number) const {
+        return path + "-log-" + std::to_string(number);
+    }
+
+    std::string LsmTree::RunName(uint64_t number) const {
+        return path + "-" + std::to_string(number) + ".run";
+    }
+
+    std::string LsmTree::ManifestName(int slot) const {
+        return path + "-manifest-" + std::to_string(slot);
+    }
+
+    int LsmTree::OpenRun(uint64_t number, std::shared_ptr<Run> *ppRun) {
+        auto pRun = std::make_shared<Run>(pVFS, RunName(number), number);
+        int status = pVFS->xOpen(pRun->name.c_str(), &pRun->pFile, Open_ReadOnly, nullptr);
+        if (status != Succeed) {
+            pRun->pFile = nullptr;
+            return status;
+        }
+        unsigned long size;
+        status = pRun->pFile->xFileSize(&size);
+        if (status != Succeed)
+            return status;
+        if (size < static_cast<unsigned long>(Lsm_FooterSize))
+            return Corrupt;
+        unsigned char footer[Lsm_FooterSize];
+        status = pRun->pFile->xRead(footer, Lsm_FooterSize, static_cast<long>(size) - Lsm_FooterSize);
+        if (status != Succeed)
+            return status;
+        uint64_t indexOffset = Get8(footer);
+        unsigned indexSize = Get4(&footer[8]), bloomSize = Get4(&footer[12]);
+        if (Get4(&footer[32]) != Lsm_RunMagic || indexSize < 8 ||
+            indexOffset + indexSize + bloomSize + Lsm_FooterSize != size)
+            return Corrupt;
+        std::vector<unsigned char> tail(indexSize + bloomSize);
+        status = pRun->pFile->xRead(tail.data(), static_cast<long>(tail.size()), static_cast<long>(indexOffset));
+        if (status != Succeed)
+            return status;
+        if (Checksum(tail.data(), tail.size()) != Get4(&footer[28]))
+            return Corrupt;
+
+        const unsigned char *p = tail.data(), *pEnd = p + indexSize;
+        unsigned n = Get4(p);
+        if (static_cast<size_t>(pEnd - p) < 8ul + n)
+            return Corrupt;
+        pRun->smallest.assign(reinterpret_cast<const char *>(&p[4]), n);
+        unsigned nBlock = Get4(&p[4 + n]);
+        p += 8 + n;
+        for (unsigned i = 0; i < nBlock; i++) {
+            if (pEnd - p < 4 || static_cast<size_t>(pEnd - p) < 20ul + Get4(p))
+                return Corrupt;
+            n = Get4(p);
+            p += 4 + n;
+            pRun->blocks.push_back({std::string(reinterpret_cast<const char *>(p - n), n),
+                                    static_cast<long>(Get8(p)), Get4(&p[8]), Get4(&p[12])});
+            p += 16;
+        }
+        if (nBlock == 0)
+            return Corrupt;
+        pRun->largest = pRun->blocks.back().lastKey;
+        pRun->bloom.assign(tail.begin() + indexSize, tail.end());
+        pRun->nRecord = static_cast<long>(Get8(&footer[16]));
+        pRun->nHash = Get4(&footer[24]);
+        pRun->fileSize = static_cast<long>(size);
+        *ppRun = pRun;
+        return Succeed;
+    }
+
+    //what pSource has left goes to new runs of about maxBytes each.compaction
+    //writes are spread out so they do not take more than compactionRate
+    int LsmTree::WriteRun(Source *pSource, long maxBytes, bool bDropDeletes, bool bThrottle,
+                          std::vector<std::shared_ptr<Run>> *pRuns) {
+        uint64_t start = Clock::Monotonic();
+        long written = 0;
+        int status = Succeed;
+        while (status == Succeed) {
+            while (status == Succeed && !pSource->bEof && pSource->bDelete && bDropDeletes)
+                status = pSource->Next();
+            if (status != Succeed || pSource->bEof)
+                break;
+
+            pthread_mutex_lock(&mutex);
+            uint64_t number = nextRun++;
+            pthread_mutex_unlock(&mutex);
+            std::string name = RunName(number);
+            tinySQL_file *pFile = nullptr;
+            status = pVFS->xOpen(name.c_str(), &pFile, Open_Create | Open_ReadWrite, nullptr);
+            if (status != Succeed)
+                break;
+            status = pFile->xTruncate(0);
+
+            RunBuilder builder(pFile, config.blockSize);
+            long checked = 0;
+            while (status == Succeed && !pSource->bEof && builder.Size() < maxBytes) {
+                if (!(pSource->bDelete && bDropDeletes))
+                    status = builder.Add(pSource->key, pSource->value, pSource->seq, pSource->bDelete);
+                if (status == Succeed)
+                    status = pSource->Next();
+                if (bThrottle && config.compactionRate > 0 && builder.offset != checked) {
+                    checked = builder.offset;
+                    uint64_t due = start + static_cast<uint64_t>(
+                            static_cast<double>(written + checked) * 1e9 / static_cast<double>(config.compactionRate));
+                    uint64_t now = Clock::Monotonic();
+                    if (due > now + 1000000)
+                        pVFS->xSleep(static_cast<int>(std::min<uint64_t>((due - now) / 1000, 1000000)));
+                }
+            }
+            if (status == Succeed)
+                status = builder.Finish(config.bloomBits);
+            written += builder.offset;
+            pFile->xClose();
+            std::shared_ptr<Run> pRun;
+            if (status == Succeed)
+                status = OpenRun(number, &pRun);
+            if (status != Succeed) {
+                pVFS->xDelete(name.c_str());
+                break;
+            }
+            pRuns->push_back(pRun);
+        }
+        if (status != Succeed) {
+            for (auto &pRun: *pRuns)
+                pRun->bObsolete = true;
+            pRuns->clear();
+        }
+        return status;
+    }
+
+    //manifest: magic,seq,first live log,next run number,last seq,run count,
+    //then level and number of every run,checksum.two slots are written in
+    //turn so one of them is whole after a crash
+    int LsmTree::WriteManifest(const Version &version, uint64_t logNumber) {
+        std::vector<unsigned char> data(44);
+        Put4(data.data(), Lsm_ManifestMagic);
+        Put8(&data[4], manifestSeq + 1);
+        Put8(&data[12], logNumber);
+        Put8(&data[20], nextRun);
+        Put8(&data[28], lastSeq);
+        unsigned nRun = 0;
+        for (int level = 0; level < LsmMaxLevel; level++)
+            for (auto &pRun: version.levels[level]) {
+                size_t at = data.size();
+                data.resize(at + 12);
+                Put4(&data[at], level);
+                Put8(&data[at + 4], pRun->number);
+                nRun++;
+            }
+        Put4(&data[36], nRun);
+        Put4(&data[40], static_cast<unsigned>(data.size()) + 4);
+        data.resize(data.size() + 4);
+        Put4(&data[data.size() - 4], Checksum(data.data(), data.size() - 4));
+
+        tinySQL_file *pFile = nullptr;
+        std::string name = ManifestName(static_cast<int>((manifestSeq + 1) % 2));
+        int status = pVFS->xOpen(name.c_str(), &pFile, Open_Create | Open_ReadWrite, nullptr);
+        if (status != Succeed)
+            return status;
+        status = pFile->xWrite(data.data(), static_cast<long>(data.size()), 0);
+        if (status == Succeed)
+            status = pFile->xTruncate(static_cast<long>(data.size()));
+        if (status == Succeed)
+            status = pFile->xSync(0);
+        pFile->xClose();
+        if (status == Succeed)
+            manifestSeq++;
+        return status;
+    }
+
+    //pData is left empty when the slot is missing or not whole
+    int LsmTree::ReadManifest(int slot, std::vector<unsigned char> *pData) {
+        pData->clear();
+        std::string name = ManifestName(slot);
+        int exists = 0;
+        int status = pVFS->xAccess(name.c_str(), Access_Exists, &exists);
+        if (status != Succeed || !exists)
+            return status;
+        tinySQL_file *pFile = nullptr;
+        status = pVFS->xOpen(name.c_str(), &pFile, Open_ReadOnly, nullptr);
+        if (status != Succeed)
+            return status;
+        unsigned long size;
+        status = pFile->xFileSize(&size);
+        std::vector<unsigned char> data(size);
+        if (status == Succeed && size > 0)
+            status = pFile->xRead(data.data(), static_cast<long>(size), 0);
+        pFile->xClose();
+        if (status != Succeed)
+            return status;
+        if (size >= 48 && Get4(data.data()) == Lsm_ManifestMagic && Get4(&data[40]) == size &&
+            size == 48 + 12ul * Get4(&data[36]) && Checksum(data.data(), size - 4) == Get4(&data[size - 4]))
+            pData->swap(data);
+        return Succeed;
+    }
+
+    int LsmTree::ReplayLog(uint64_t number) {
+        tinySQL_file *pFile = nullptr;
+        std::string name = LogName(number);
+        int status = pVFS->xOpen(name.c_str(), &pFile, Open_ReadOnly, nullptr);
+        if (status != Succeed)
+            return status;
+        unsigned long size;
+        status = pFile->xFileSize(&size);
+        std::vector<unsigned char> data(size);
+        if (status == Succeed && size > 0)
+            status = pFile->xRead(data.data(), static_cast<long>(size), 0);
+        pFile->xClose();
+        if (status != Succeed)
+            return status;
+        //a torn tail ends the log
+        size_t offset = 0;
+        while (size - offset >= static_cast<size_t>(Lsm_LogHeader)) {
+            size_t next = offset + 4;
+            LsmRecord r;
+            if (!ParseRecord(data.data(), size, &next, &r) ||
+                Checksum(&data[offset + 4], next - offset - 4) != Get4(&data[offset]))
+                break;
+            pMem->Add(r.seq, r.pKey, r.nKey, r.pValue, r.nValue, r.bDelete);
+            lastSeq = std::max(lastSeq, r.seq);
+            offset = next;
+        }
+        return Succeed;
+    }
+
+    int LsmTree::OpenLog() {
+        tinySQL_file *pFile = nullptr;
+        int status = pVFS->xOpen(LogName(nextLog).c_str(), &pFile, Open_Create | Open_ReadWrite, nullptr);
+        if (status != Succeed)
+            return status;
+        status = pFile->xTruncate(0);
+        if (status != Succeed) {
+            pFile->xClose();
+            return status;
+        }
+        pLog = pFile;
+        logOffset = 0;
+        nextLog++;
+        return Succeed;
+    }
+
+    int LsmTree::WriteLog(bool bSync) {
+        if (!logBuffer.empty()) {
+            int status = pLog->xWrite(logBuffer.data(), static_cast<long>(logBuffer.size()), logOffset);
+            if (status != Succeed)
+                return status;
+            logOffset += static_cast<long>(logBuffer.size());
+            logBuffer.clear();
+        }
+        return bSync ? pLog->xSync(0) : Succeed;
+    }
+
+    int LsmTree::Recover() {
+        std::vector<unsigned char> slots[2];
+        for (int slot = 0; slot < 2; slot++) {
+            int status = ReadManifest(slot, &slots[slot]);
+            if (status != Succeed)
+                return status;
+        }
+        int best = -1;
+        for (int slot = 0; slot < 2; slot++)
+            if (!slots[slot].empty() && (best < 0 || Get8(&slots[slot][4]) > Get8(&slots[best][4])))
+                best = slot;
+
+        uint64_t logNumber = 0;
+        auto pNew = std::make_shared<Version>();
+        if (best >= 0) {
+            const unsigned char *p = slots[best].data();
+            manifestSeq = Get8(&p[4]);
+            logNumber = Get8(&p[12]);
+            nextRun = Get8(&p[20]);
+            lastSeq = Get8(&p[28]);
+            unsigned nRun = Get4(&p[36]);
+            for (unsigned i = 0; i < nRun; i++) {
+                unsigned level = Get4(&p[44 + 12 * i]);
+                if (level >= LsmMaxLevel)
+                    return Corrupt;
+                std::shared_ptr<Run> pRun;
+                int status = OpenRun(Get8(&p[48 + 12 * i]), &pRun);
+                if (status != Succeed)
+                    return status;
+                pNew->levels[level].push_back(pRun);
+            }
+        }
+        pVersion = pNew;
+
+        //runs of a flush or compaction that never made it into the manifest
+        std::vector<bool> live(nextRun + OrphanProbe);
+        for (auto &level: pVersion->levels)
+            for (auto &pRun: level)
+                live[pRun->number] = true;
+        for (uint64_t number = 0; number < live.size(); number++) {
+            int exists = 0;
+            if (!live[number] && pVFS->xAccess(RunName(number).c_str(), Access_Exists, &exists) == Succeed && exists)
+                pVFS->xDelete(RunName(number).c_str());
+        }
+        nextRun += OrphanProbe;
+
+        pMem = std::make_shared<MemTable>(logNumber);
+        nextLog = logNumber;
+        while (true) {
+            int exists = 0;
+            int status = pVFS->xAccess(LogName(nextLog).c_str(), Access_Exists, &exists);
+            if (status != Succeed)
+                return status;
+            if (!exists)
+                break;
+            status = ReplayLog(nextLog);
+            if (status != Succeed)
+                return status;
+            nextLog++;
+        }
+        int status = OpenLog();
+        if (status != Succeed)
+            return status;
+        if (pMem->Empty()) {
+            for (uint64_t number = logNumber; number + 1 < nextLog; number++)
+                pVFS->xDelete(LogName(number).c_str());
+            pMem = std::make_shared<MemTable>(nextLog - 1);
+        } else {
+            frozen.push_back(pMem);
+            pMem = std::make_shared<MemTable>(nextLog - 1);
+            pthread_mutex_lock(&mutex);
+            Schedule();
+            pthread_mutex_unlock(&mutex);
+        }
+        return Succeed;
+    }
+
+    int LsmTree::Open(tinySQL_VFS *pVFS, const char *zPath, const LsmConfig &config, LsmTree **ppTree,
+                      ThreadPool *pPool) {
+        assert(pVFS && zPath && ppTree);
+        *ppTree = nullptr;
+        if (config.memtableSize <= 0 || config.runSize <= 0 || config.level0Runs < 1 || config.fanout < 2 ||
+            config.bloomBits < 0 || config.blockSize < 64 || config.compactionRate < 0 ||
+            (config.style != Lsm_Leveled && config.style != Lsm_Tiered))
+            return Misuse;
+        auto pTree = new LsmTree(pVFS, zPath, config, pPool);
+        int status = pTree->Recover();
+        if (status != Succeed) {
+            pTree->Close();
+            return status;
+        }
+        *ppTree = pTree;
+        return Succeed;
+    }
+
+    int LsmTree::Close() {
+        pthread_mutex_lock(&mutex);
+        bClosing = true;
+        pthread_mutex_unlock(&mutex);
+        background.Wait();
+        int status = pLog ? WriteLog(true) : Succeed;
+        delete this;
+        return status;
+    }
+
+    //oldest log a memtable still needs
+    uint64_t LsmTree::LiveLog() const {
+        return frozen.empty() ? pMem->firstLog : frozen.front()->firstLog;
+    }
+
+    //called with the mutex held.the memtable is frozen behind a synced log so
+    //the logs stay in order of their entries
+    int LsmTree::Freeze() {
+        int status = WriteLog(true);
+        if (status != Succeed)
+            return status;
+        tinySQL_file *pOld = pLog;
+        status = OpenLog();
+        if (status != Succeed)
+            return status;
+        pOld->xClose();
+        frozen.push_back(pMem);
+        pMem = std::make_shared<MemTable>(nextLog - 1);
+        Schedule();
+        return Succeed;
+    }
+
+    //called with the mutex held
+    int LsmTree::MakeRoom() {
+        bool bStalled = false;
+        while (backgroundStatus == Succeed && pMem->size.load(std::memory_order_relaxed) >= config.memtableSize) {
+            if (frozen.size() < MaxFrozen && pVersion->levels[0].size() < StallRuns * static_cast<size_t>(config.level0Runs))
+                return Freeze();
+            if (!bStalled)
+                stats.nStall++;
+            bStalled = true;
+            Schedule();
+            pthread_cond_wait(&cond, &mutex);
+        }
+        return backgroundStatus;
+    }
+
+    int LsmTree::Put(const void *pKey, int nKey, const void *pValue, long nValue, bool bDelete) {
+        if (nKey < 0 || nValue < 0 || static_cast<unsigned long>(nKey) + nValue >= Lsm_Tombstone)
+            return TooBig;
+        auto p = static_cast<const unsigned char *>(pKey);
+        auto pData = static_cast<const unsigned char *>(pValue);
+        pthread_mutex_lock(&mutex);
+        int status = MakeRoom();
+        if (status == Succeed) {
+            uint64_t seq = ++lastSeq;
+            size_t at = logBuffer.size();
+            logBuffer.resize(at + Lsm_LogHeader + nKey + nValue);
+            PutRecord(&logBuffer[at + 4], p, nKey, pData, nValue, seq, bDelete);
+            Put4(&logBuffer[at], Checksum(&logBuffer[at + 4], logBuffer.size() - at - 4));
+            pMem->Add(seq, p, nKey, pData, nValue, bDelete);
+            if (logBuffer.size() >= LogBatch)
+                status = WriteLog(false);
+        }
+        pthread_mutex_unlock(&mutex);
+        return status;
+    }
+
+    int LsmTree::Insert(const void *pKey, int nKey, const void *pValue, long nValue) {
+        return Put(pKey, nKey, pValue, nValue, false);
+    }
+
+    int LsmTree::Delete(const void *pKey, int nKey) {
+        return Put(pKey, nKey, nullptr, 0, true);
+    }
+
+    int LsmTree::Find(const void *pKey, int nKey, std::string *pValue) {
+        auto p = static_cast<const unsigned char *>(pKey);
+        pthread_mutex_lock(&mutex);
+        std::vector<std::shared_ptr<MemTable>> mems(frozen.rbegin(), frozen.rend());
+        mems.insert(mems.begin(), pMem);
+        std::shared_ptr<Version> pCurrent = pVersion;
+        pthread_mutex_unlock(&mutex);
+
+        for (auto &pTable: mems) {
+            MemTable::Node *pNode = pTable->Seek(p, nKey, UINT64_MAX, nullptr);
+            if (pNode && CompareBytes(pNode->Key(), pNode->nKey, p, nKey) == 0) {
+                if (pNode->nValue & Lsm_Tombstone)
+                    return NotFound;
+                if (pValue)
+                    pValue->assign(reinterpret_cast<const char *>(pNode->Value()), pNode->nValue);
+                return Succeed;
+            }
+        }
+        uint64_t h = Hash64(p, nKey);
+        for (auto &level: pCurrent->levels)
+            for (auto &pRun: level) {
+                if (CompareKey(pRun->smallest, p, nKey) > 0 || CompareKey(pRun->largest, p, nKey) < 0)
+                    continue;
+                if (!pRun->MayContain(h)) {
+                    nBloomSkip.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                bool bFound, bDelete;
+                int status = pRun->Find(p, nKey, &bFound, &bDelete, pValue);
+                if (status != Succeed)
+                    return status;
+                if (bFound)
+                    return bDelete ? NotFound : Succeed;
+            }
+        return NotFound;
+    }
+
+    int LsmTree::Commit() {
+        pthread_mutex_lock(&mutex);
+        int status = WriteLog(true);
+        pthread_mutex_unlock(&mutex);
+        return status;
+    }
+
+    int LsmTree::Flush() {
+        pthread_mutex_lock(&mutex);
+        int status = backgroundStatus;
+        if (status == Succeed && !pMem->Empty())
+            status = Freeze();
+        Schedule();
+        while (bWorking)
+            pthread_cond_wait(&cond, &mutex);
+        if (status == Succeed)
+            status = backgroundStatus;
+        pthread_mutex_unlock(&mutex);
+        return status;
+    }
+
+    void LsmTree::Stats(LsmStats *pStats) {
+        pthread_mutex_lock(&mutex);
+        *pStats = stats;
+        for (int level = 0; level < LsmMaxLevel; level++) {
+            pStats->runs[level] = static_cast<int>(pVersion->levels[level].size());
+            pStats->levelBytes[level] = 0;
+            for (auto &pRun: pVersion->levels[level])
+                pStats->levelBytes[level] += pRun->fileSize;
+        }
+        pthread_mutex_unlock(&mutex);
+        pStats->nBloomSkip = nBloomSkip.load(std::memory_order_relaxed);
+    }
+
+    //called with the mutex held.Work looks for something to do itself
+    void LsmTree::Schedule() {
+        if (bWorking || bClosing || backgroundStatus != Succeed)
+            return;
+        bWorking = true;
+        background.Run(pPool, [this]() { Work(); });
+    }
+
+    //flushes come before compactions,one step at a time
+    void LsmTree::Work() {
+        pthread_mutex_lock(&mutex);
+        while (!bClosing && backgroundStatus == Succeed) {
+            int status;
+            Compaction compaction;
+            if (!frozen.empty()) {
+                pthread_mutex_unlock(&mutex);
+                status = FlushFrozen();
+                pthread_mutex_lock(&mutex);
+            } else if (PickCompaction(&compaction)) {
+                pthread_mutex_unlock(&mutex);
+                status = RunCompaction(&compaction);
+                pthread_mutex_lock(&mutex);
+            } else
+                break;
+            backgroundStatus = status;
+            pthread_cond_broadcast(&cond);
+        }
+        bWorking = false;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    int LsmTree::FlushFrozen() {
+        pthread_mutex_lock(&mutex);
+        std::shared_ptr<MemTable> pTable = frozen.front();
+        pthread_mutex_unlock(&mutex);
+
+        MergeSource source;
+        source.children.emplace_back(new MemSource(pTable, UINT64_MAX));
+        std::vector<std::shared_ptr<Run>> runs;
+        int status = source.Seek(nullptr, 0);
+        if (status == Succeed)
+            status = WriteRun(&source, LONG_MAX, false, false, &runs);
+        if (status != Succeed)
+            return status;
+
+        pthread_mutex_lock(&mutex);
+        auto pNew = std::make_shared<Version>(*pVersion);
+        pNew->levels[0].insert(pNew->levels[0].begin(), runs.begin(), runs.end());
+        uint64_t liveLog = frozen.size() > 1 ? frozen[1]->firstLog : pMem->firstLog;
+        status = WriteManifest(*pNew, liveLog);
+        if (status == Succeed) {
+            pVersion = pNew;
+            frozen.erase(frozen.begin());
+            stats.nFlush++;
+            for (auto &pRun: runs)
+                stats.bytesFlushed += pRun->fileSize;
+        } else {
+            for (auto &pRun: runs)
+                pRun->bObsolete = true;
+        }
+        pthread_mutex_unlock(&mutex);
+        if (status == Succeed)
+            for (uint64_t number = pTable->firstLog; number < liveLog; number++)
+                pVFS->xDelete(LogName(number).c_str());
+        return status;
+    }
+
+    //called with the mutex held.leveled: all of level 0 once it has
+    //level0Runs runs,else one run of the first level past runSize*fanout^level,
+    //each with the runs of the next level they overlap.tiered: all runs of
+    //the first level that has level0Runs (level 0) or fanout of them
+    bool LsmTree::PickCompaction(Compaction *pCompaction) {
+        const Version &version = *pVersion;
+        std::vector<std::shared_ptr<Run>> &inputs = pCompaction->inputs;
+        inputs.clear();
+        int level = -1;
+        if (config.style == Lsm_Tiered) {
+            for (int i = 0; i < LsmMaxLevel - 1 && level < 0; i++)
+                if (version.levels[i].size() >= static_cast<size_t>(i == 0 ? config.level0Runs : config.fanout))
+                    level = i;
+            if (level < 0)
+                return false;
+            inputs = version.levels[level];
+        } else {
+            if (version.levels[0].size() >= static_cast<size_t>(config.level0Runs)) {
+                level = 0;
+                inputs = version.levels[0];
+            } else {
+                double limit = static_cast<double>(config.runSize);
+                for (int i = 1; i < LsmMaxLevel - 1 && level < 0; i++) {
+                    limit *= config.fanout;
+                    long bytes = 0;
+                    for (auto &pRun: version.levels[i])
+                        bytes += pRun->fileSize;
+                    if (static_cast<double>(bytes) > limit)
+                        level = i;
+                }
+                if (level < 0)
+                    return false;
+                //the runs of a level take turns so all of its keys move down
+                const auto &runs = version.levels[level];
+                auto it = std::find_if(runs.begin(), runs.end(), [&](const std::shared_ptr<Run> &pRun) {
+                    return pRun->smallest > compactKey[level];
+                });
+                if (it == runs.end())
+                    it = runs.begin();
+                compactKey[level] = (*it)->largest;
+                inputs.push_back(*it);
+            }
+            std::string lo = inputs[0]->smallest, hi = inputs[0]->largest;
+            for (auto &pRun: inputs) {
+                lo = std::min(lo, pRun->smallest);
+                hi = std::max(hi, pRun->largest);
+            }
+            for (auto &pRun: version.levels[level + 1])
+                if (pRun->Overlaps(lo, hi))
+                    inputs.push_back(pRun);
+        }
+        pCompaction->outputLevel = level + 1;
+
+        //a tombstone can go once nothing older than the inputs may hold its key
+        std::string lo = inputs[0]->smallest, hi = inputs[0]->largest;
+        for (auto &pRun: inputs) {
+            lo = std::min(lo, pRun->smallest);
+            hi = std::max(hi, pRun->largest);
+        }
+        pCompaction->bDropDeletes = true;
+        for (int i = level + 1; i < LsmMaxLevel; i++)
+            for (auto &pRun: version.levels[i])
+                if (pRun->Overlaps(lo, hi) && std::find(inputs.begin(), inputs.end(), pRun) == inputs.end())
+                    pCompaction->bDropDeletes = false;
+        return true;
+    }
+
+    int LsmTree::RunCompaction(Compaction *pCompaction) {
+        MergeSource source;
+        for (auto &pRun: pCompaction->inputs)
+            source.children.emplace_back(new RunSource(pRun));
+        std::vector<std::shared_ptr<Run>> runs;
+        int status = source.Seek(nullptr, 0);
+        //a tiered level gets one run per compaction
+        if (status == Succeed)
+            status = WriteRun(&source, config.style == Lsm_Tiered ? LONG_MAX : config.runSize,
+                              pCompaction->bDropDeletes, true, &runs);
+        if (status != Succeed)
+            return status;
+
+        pthread_mutex_lock(&mutex);
+        auto pNew = std::make_shared<Version>(*pVersion);
+        for (auto &level: pNew->levels)
+            level.erase(std::remove_if(level.begin(), level.end(), [&](const std::shared_ptr<Run> &pRun) {
+                return std::find(pCompaction->inputs.begin(), pCompaction->inputs.end(), pRun) !=
+                       pCompaction->inputs.end();
+            }), level.end());
+        auto &output = pNew->levels[pCompaction->outputLevel];
+        if (config.style == Lsm_Leveled) {
+            output.insert(output.end(), runs.begin(), runs.end());
+            std::sort(output.begin(), output.end(), [](const std::shared_ptr<Run> &a, const std::shared_ptr<Run> &b) {
+                return a->smallest < b->smallest;
+            });
+        } else
+            output.insert(output.begin(), runs.begin(), runs.end());
+        status = WriteManifest(*pNew, LiveLog());
+        if (status == Succeed) {
+            pVersion = pNew;
+            for (auto &pRun: pCompaction->inputs)
+                pRun->bObsolete = true;
+            stats.nCompaction++;
+            for (auto &pRun: runs)
+                stats.bytesCompacted += pRun->fileSize;
+        } else {
+            for (auto &pRun: runs)
+                pRun->bObsolete = true;
+        }
+        pthread_mutex_unlock(&mutex);
+        return status;
+    }
+
+    LsmTree::LsmTree(tinySQL_VFS *pVFS, std::string path, const LsmConfig &config, ThreadPool *pPool) :
+            mutex(), cond(), pMem(), frozen(), pVersion(), pLog(nullptr), logBuffer(), logOffset(0), lastSeq(0),
+            nextRun(0), nextLog(0), manifestSeq(0), compactKey(), background(), bWorking(false), bClosing(false),
+            backgroundStatus(Succeed), stats(), nBloomSkip(0), pVFS(pVFS), pPool(pPool), path(std::move(path)),
+            config(config) {
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_cond_init(&cond, nullptr);
+    }
+
+    LsmTree::~LsmTree() {
+        background.Wait();
+        if (pLog)
+            pLog->xClose();
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+
+    int LsmCursor::Start(const void *pKey, int nKey) {
+        pSource.reset(new LsmTree::MergeSource());
+        pthread_mutex_lock(&pTree->mutex);
+        uint64_t snapshot = pTree->lastSeq;
+        pSource->children.emplace_back(new LsmTree::MemSource(pTree->pMem, snapshot));
+        for (auto &pTable: pTree->frozen)
+            pSource->children.emplace_back(new LsmTree::MemSource(pTable, snapshot));
+        for (auto &level: pTree->pVersion->levels)
+            for (auto &pRun: level)
+                pSource->children.emplace_back(new LsmTree::RunSource(pRun));
+        pthread_mutex_unlock(&pTree->mutex);
+
+        int status = pSource->Seek(static_cast<const unsigned char *>(pKey), nKey);
+        while (status == Succeed && !pSource->bEof && pSource->bDelete)
+            status = pSource->Next();
+        return status;
+    }
+
+    int LsmCursor::Seek(const void *pKey, int nKey, int *pResult) {
+        *pResult = -1;
+        int status = Start(pKey, nKey);
+        if (status == Succeed && !pSource->bEof)
+            *pResult = CompareKey(pSource->key, static_cast<const unsigned char *>(pKey), nKey) == 0 ? 0 : 1;
+        return status;
+    }
+
+    int LsmCursor::First() {
+        return Start(nullptr, 0);
+    }
+
+    int LsmCursor::Next() {
+        if (Eof())
+            return Succeed;
+        int status;
+        do
+            status = pSource->Next();
+        while (status == Succeed && !pSource->bEof && pSource->bDelete);
+        return status;
+    }
+
+    bool LsmCursor::Eof() const {
+        return pSource == nullptr || pSource->bEof;
+    }
+
+    int LsmCursor::Key(std::string *pKey) {
+        if (Eof())
+            return NotFound;
+        *pKey = pSource->key;
+        return Succeed;
+    }
+
+    int LsmCursor::Value(std::string *pValue) {
+        if (Eof())
+            return NotFound;
+        *pValue = pSource->value;
+        return Succeed;
+    }
+
+    LsmCursor::LsmCursor(LsmTree *pTree) : pSource(), pTree(pTree) {
+    }
+
+    LsmCursor::~LsmCursor() = default;
+}
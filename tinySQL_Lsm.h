@@ -0,0 +1,166 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_LSM_H
+#define SQLITELIKE_TINYSQL_LSM_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tinySQL_ThreadPool.h"
+#include "tinySQL_VFS.h"
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    static constexpr int LsmMaxLevel = 7;
+
+    static constexpr int Lsm_Leveled = 0;   //levels past 0 hold runs of disjoint keys,each fanout times the last
+    static constexpr int Lsm_Tiered = 1;    //a level of fanout runs is merged into one run of the next
+
+    struct LsmConfig {
+        long memtableSize;          //bytes a memtable takes before it is frozen and flushed
+        long runSize;               //compaction starts a new run past this
+        int level0Runs;             //runs in level 0 that start a compaction
+        int fanout;
+        int bloomBits;              //filter bits per key
+        int blockSize;              //of the data blocks a fence pointer leads to
+        long compactionRate;        //bytes per second compaction writes,0 is unlimited
+        int style;
+    };
+
+    static constexpr LsmConfig DefaultLsmConfig = {8L << 20, 8L << 20, 4, 10, 10, 4096, 0, Lsm_Leveled};
+
+    struct LsmStats {
+        long nFlush;
+        long nCompaction;
+        long bytesFlushed;
+        long bytesCompacted;
+        long nStall;                //writes that waited for the background to catch up
+        long nBloomSkip;            //run lookups the filter answered
+        int runs[LsmMaxLevel];
+        long levelBytes[LsmMaxLevel];
+    };
+
+    class LsmCursor;
+
+    //log-structured merge tree for tables that are mostly appended to.writes
+    //go to a memtable,a skiplist that readers walk without locks,and to a log
+    //"<path>-log-<n>" that Commit syncs.a full memtable is frozen and written
+    //out by the pool as a sorted run "<path>-<n>.run":data blocks,an index
+    //of the last key of every block and a bloom filter.runs move down the
+    //levels by compaction on the pool,throttled to compactionRate,and writers
+    //stall while flushes fall behind.a lookup asks the memtables,then the
+    //runs newest first,each after its filter;the run list is kept in
+    //"<path>-manifest-0" and "-1" written in turn.BTree and LsmTree take the
+    //same calls,a table picks either one
+    class LsmTree {
+        friend class LsmCursor;
+    private:
+        struct MemTable;
+        struct Run;
+        struct Version;
+        struct Source;
+        struct MemSource;
+        struct RunSource;
+        struct MergeSource;
+        struct Compaction;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        std::shared_ptr<MemTable> pMem;
+        std::vector<std::shared_ptr<MemTable>> frozen;      //oldest first
+        std::shared_ptr<Version> pVersion;
+        tinySQL_file *pLog;
+        std::vector<unsigned char> logBuffer;
+        long logOffset;
+        uint64_t lastSeq;
+        uint64_t nextRun;
+        uint64_t nextLog;
+        uint64_t manifestSeq;
+        std::string compactKey[LsmMaxLevel];                //where the next leveled compaction of a level starts
+        TaskGroup background;
+        bool bWorking;
+        bool bClosing;
+        int backgroundStatus;
+        LsmStats stats;
+        std::atomic<long> nBloomSkip;
+
+        LsmTree(tinySQL_VFS *pVFS, std::string path, const LsmConfig &config, ThreadPool *pPool);
+        std::string LogName(uint64_t number) const;
+        std::string RunName(uint64_t number) const;
+        std::string ManifestName(int slot) const;
+        int Recover();
+        int ReplayLog(uint64_t number);
+        int OpenLog();
+        int WriteLog(bool bSync);
+        int Put(const void *pKey, int nKey, const void *pValue, long nValue, bool bDelete);
+        int Freeze();
+        int MakeRoom();
+        uint64_t LiveLog() const;
+        void Schedule();
+        void Work();
+        int FlushFrozen();
+        bool PickCompaction(Compaction *pCompaction);
+        int RunCompaction(Compaction *pCompaction);
+        int WriteRun(Source *pSource, long maxBytes, bool bDropDeletes, bool bThrottle,
+                     std::vector<std::shared_ptr<Run>> *pRuns);
+        int OpenRun(uint64_t number, std::shared_ptr<Run> *ppRun);
+        int WriteManifest(const Version &version, uint64_t logNumber);
+        int ReadManifest(int slot, std::vector<unsigned char> *pData);
+    public:
+        tinySQL_VFS *const pVFS;
+        ThreadPool *const pPool;
+        const std::string path;
+        const LsmConfig config;
+
+        //flushes and compactions run on pPool,writers may wait for them and so
+        //must not be workers of pPool themselves
+        static int Open(tinySQL_VFS *pVFS, const char *zPath, const LsmConfig &config, LsmTree **ppTree,
+                        ThreadPool *pPool = ThreadPool::Global());
+        //waits for the background,the memtable stays in its log
+        int Close();
+
+        int Insert(const void *pKey, int nKey, const void *pValue, long nValue);
+        //a delete is written as a tombstone,NotFound is never returned
+        int Delete(const void *pKey, int nKey);
+        int Find(const void *pKey, int nKey, std::string *pValue);
+
+        //the writes so far are durable once it returns
+        int Commit();
+        //writes the memtable out and waits until no flush or compaction is due
+        int Flush();
+        void Stats(LsmStats *pStats);
+
+        ~LsmTree();
+    };
+
+    //walks the keys of an LsmTree as they were when the cursor was positioned.
+    //the runs it reads stay on disk until it moves on or goes away
+    class LsmCursor {
+    private:
+        std::unique_ptr<LsmTree::MergeSource> pSource;
+
+        int Start(const void *pKey, int nKey);
+    public:
+        LsmTree *const pTree;
+
+        //*pResult is 0 on an exact match,1 when the cursor stopped at the next greater key
+        //and -1 when no key is greater or equal (the cursor is then at Eof)
+        int Seek(const void *pKey, int nKey, int *pResult);
+        int First();
+        int Next();
+        bool Eof() const;
+
+        int Key(std::string *pKey);
+        int Value(std::string *pValue);
+
+        explicit LsmCursor(LsmTree *pTree);
+        ~LsmCursor();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_LSM_H
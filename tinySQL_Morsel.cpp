@@ -0,0 +1,338 @@
+//
+// Created by user on 26-10-19.
+//
+#include <sched.h>
+#include <algorithm>
+#include <stdexcept>
+#include "tinySQL_Morsel.h"
+#include "tinySQL_PageAlloc.h"
+
+namespace tinySQL {
+
+    void *MorselScheduler::WorkerMain(void *pArg) {
+        auto pWorker = static_cast<Worker *>(pArg);
+        MorselScheduler *pScheduler = pWorker->pScheduler;
+        pthread_mutex_lock(&pScheduler->mutex);
+        while (true) {
+            while (!pScheduler->bShutdown && pScheduler->epoch == pWorker->seen)
+                pthread_cond_wait(&pScheduler->workCond, &pScheduler->mutex);
+            if (pScheduler->bShutdown)
+                break;
+            pWorker->seen = pScheduler->epoch;
+            pthread_mutex_unlock(&pScheduler->mutex);
+            pScheduler->Drain(pWorker);
+            pthread_mutex_lock(&pScheduler->mutex);
+        }
+        pthread_mutex_unlock(&pScheduler->mutex);
+        return nullptr;
+    }
+
+    //own queue from the front,other queues from the back
+    bool MorselScheduler::Take(Worker *pWorker, Morsel *pMorsel) {
+        pthread_mutex_lock(&pWorker->mutex);
+        bool bFound = !pWorker->queue.empty();
+        if (bFound) {
+            *pMorsel = pWorker->queue.front();
+            pWorker->queue.pop_front();
+        }
+        pthread_mutex_unlock(&pWorker->mutex);
+        for (size_t i = 0; !bFound && i < pWorker->victims.size(); i++) {
+            Worker *pVictim = workers[pWorker->victims[i]].get();
+            pthread_mutex_lock(&pVictim->mutex);
+            bFound = !pVictim->queue.empty();
+            if (bFound) {
+                *pMorsel = pVictim->queue.back();
+                pVictim->queue.pop_back();
+            }
+            pthread_mutex_unlock(&pVictim->mutex);
+            if (bFound) {
+                pthread_mutex_lock(&mutex);
+                nStolen++;
+                pthread_mutex_unlock(&mutex);
+            }
+        }
+        return bFound;
+    }
+
+    //a worker may still be here when the next Run deals out its morsels,so
+    //the task is looked up again for every morsel
+    void MorselScheduler::Drain(Worker *pWorker) {
+        Morsel morsel{0, 0};
+        while (Take(pWorker, &morsel)) {
+            pthread_mutex_lock(&mutex);
+            const MorselTask *pCurrent = status == Succeed ? pTask : nullptr;
+            pthread_mutex_unlock(&mutex);
+            int rc = pCurrent ? (*pCurrent)(pWorker->id, morsel) : Succeed;
+            pthread_mutex_lock(&mutex);
+            if (rc != Succeed && status == Succeed)
+                status = rc;
+            if (--nRemaining == 0)
+                pthread_cond_broadcast(&doneCond);
+            pthread_mutex_unlock(&mutex);
+        }
+    }
+
+    int MorselScheduler::Run(const std::vector<Morsel> &morsels, const MorselTask &task) {
+        if (morsels.empty())
+            return Succeed;
+        pthread_mutex_lock(&runMutex);
+        pthread_mutex_lock(&mutex);
+        pTask = &task;
+        nRemaining = static_cast<long>(morsels.size());
+        status = Succeed;
+        const long n = static_cast<long>(morsels.size());
+        const long nWorker = static_cast<long>(workers.size());
+        for (long i = 0; i < nWorker; i++) {
+            Worker *pWorker = workers[i].get();
+            pthread_mutex_lock(&pWorker->mutex);
+            pWorker->queue.assign(morsels.begin() + n * i / nWorker, morsels.begin() + n * (i + 1) / nWorker);
+            pthread_mutex_unlock(&pWorker->mutex);
+        }
+        epoch++;
+        pthread_cond_broadcast(&workCond);
+        while (nRemaining > 0)
+            pthread_cond_wait(&doneCond, &mutex);
+        int rc = status;
+        pTask = nullptr;
+        pthread_mutex_unlock(&mutex);
+        pthread_mutex_unlock(&runMutex);
+        return rc;
+    }
+
+    int MorselScheduler::WorkerCount() const {
+        return static_cast<int>(workers.size());
+    }
+
+    int MorselScheduler::NodeCount() const {
+        return nNode;
+    }
+
+    int MorselScheduler::NodeOf(int iWorker) const {
+        return workers[iWorker]->node;
+    }
+
+    MorselScheduler::MorselScheduler(int nWorker) : workers(), mutex(), workCond(), doneCond(), runMutex(),
+                                                    pTask(nullptr), epoch(0), nRemaining(0), status(Succeed),
+                                                    bShutdown(false), nNode(1), nStolen(0) {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        std::vector<int> cpus;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+        }
+        std::vector<int> nodeOfCpu;
+        nNode = NumaNodeMap(&nodeOfCpu);
+        auto NodeOfCpu = [&nodeOfCpu](int cpu) {
+            return cpu >= 0 && cpu < static_cast<int>(nodeOfCpu.size()) ? nodeOfCpu[cpu] : 0;
+        };
+        std::stable_sort(cpus.begin(), cpus.end(), [&NodeOfCpu](int a, int b) {
+            return NodeOfCpu(a) < NodeOfCpu(b);
+        });
+        if (nWorker <= 0)
+            nWorker = std::max(1, static_cast<int>(cpus.size()));
+
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_cond_init(&workCond, nullptr);
+        pthread_cond_init(&doneCond, nullptr);
+        pthread_mutex_init(&runMutex, nullptr);
+        for (int i = 0; i < nWorker; i++) {
+            std::unique_ptr<Worker> pWorker(new Worker{this, i, -1, 0, pthread_t(), pthread_mutex_t(), {}, {}, 0});
+            if (!cpus.empty()) {
+                pWorker->cpu = cpus[i % cpus.size()];
+                pWorker->node = NodeOfCpu(pWorker->cpu);
+            }
+            pthread_mutex_init(&pWorker->mutex, nullptr);
+            workers.push_back(std::move(pWorker));
+        }
+        for (auto &pWorker: workers) {
+            for (auto &pOther: workers)
+                if (pOther != pWorker && pOther->node == pWorker->node)
+                    pWorker->victims.push_back(pOther->id);
+            for (auto &pOther: workers)
+                if (pOther->node != pWorker->node)
+                    pWorker->victims.push_back(pOther->id);
+        }
+
+        //pinned from the start,so what a worker allocates and touches first
+        //comes from its own node
+        for (auto &pWorker: workers) {
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            if (pWorker->cpu >= 0 && nWorker <= static_cast<int>(cpus.size())) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(pWorker->cpu, &set);
+                pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+            }
+            int rc = pthread_create(&pWorker->thread, &attr, WorkerMain, pWorker.get());
+            pthread_attr_destroy(&attr);
+            if (rc)
+                throw std::runtime_error("can not create worker thread");
+        }
+    }
+
+    MorselScheduler::~MorselScheduler() {
+        pthread_mutex_lock(&mutex);
+        bShutdown = true;
+        pthread_cond_broadcast(&workCond);
+        pthread_mutex_unlock(&mutex);
+        for (auto &pWorker: workers) {
+            pthread_join(pWorker->thread, nullptr);
+            pthread_mutex_destroy(&pWorker->mutex);
+        }
+        pthread_mutex_destroy(&runMutex);
+        pthread_cond_destroy(&doneCond);
+        pthread_cond_destroy(&workCond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    MorselScheduler *MorselScheduler::Global() {
+        static MorselScheduler scheduler;
+        return &scheduler;
+    }
+
+
+    //interior pages level by level on the caller's thread,they are a small
+    //part of the tree and mostly cached
+    int ParallelScan::CollectLeaves() {
+        Pager *pPager = pTree->pPager;
+        leaves.clear();
+        std::vector<unsigned> level{pTree->root};
+        for (int depth = 0; !level.empty(); depth++) {
+            std::vector<unsigned> next;
+            for (unsigned pgno: level) {
+                PgHdr *pPage;
+                int status = pPager->Get(pgno, &pPage);
+                if (status != Succeed)
+                    return status;
+                BtPage page(pPage->pData, pPager->pageSize);
+                int type = page.Type();
+                if (type == BtPage_Interior && depth <= BtMaxDepth) {
+                    for (int i = 0; i <= page.CellCount(); i++)
+                        next.push_back(page.Child(i));
+                } else if (type == BtPage_Leaf)
+                    leaves.push_back(pgno);
+                else {
+                    pPager->Unref(pPage);
+                    return Corrupt;
+                }
+                pPager->Unref(pPage);
+            }
+            level.swap(next);
+        }
+        std::sort(leaves.begin(), leaves.end());
+        return Succeed;
+    }
+
+    int ParallelScan::ReadValue(WorkerState &state, const BtPage &page, int index, const unsigned char **ppValue,
+                                unsigned *pSize) {
+        const int pageSize = page.pageSize;
+        const unsigned char *pCell = &page.a[page.CellOffset(index)];
+        const int suffixLength = page.SuffixLength(index);
+        const unsigned valueSize = Get4(pCell);
+        const unsigned local = BtPage::LocalSize(pageSize, page.PrefixLength() + suffixLength, valueSize);
+        *ppValue = pCell + 4 + suffixLength;
+        *pSize = valueSize;
+        if (local == valueSize)
+            return Succeed;
+
+        state.value.assign(reinterpret_cast<const char *>(*ppValue), local);
+        state.value.resize(valueSize);
+        state.overflow.resize(pageSize);
+        const long capacity = pageSize - BtOverflow_Header;
+        unsigned next = Get4(*ppValue + local);
+        for (long done = local; done < valueSize;) {
+            int status = next == 0 ? Corrupt : pTree->pPager->ReadPages(next, state.overflow.data(), 1);
+            if (status == Succeed && state.overflow[0] != BtPage_Overflow)
+                status = Corrupt;
+            if (status != Succeed)
+                return status;
+            long take = std::min(capacity, static_cast<long>(valueSize) - done);
+            memcpy(&state.value[done], &state.overflow[BtOverflow_Header], take);
+            next = Get4(&state.overflow[BtOverflow_Next]);
+            done += take;
+        }
+        *ppValue = reinterpret_cast<const unsigned char *>(state.value.data());
+        return Succeed;
+    }
+
+    //runs of consecutive page numbers in the morsel are read with one call
+    int ParallelScan::RunMorsel(int iWorker, const Morsel &morsel, const ScanSink &sink) {
+        const int pageSize = pTree->pPager->pageSize;
+        if (!states[iWorker]) {
+            states[iWorker].reset(new WorkerState{{}, {}, {}, {0, {}}, 0});
+            states[iWorker]->pages.resize(static_cast<size_t>(morselPages) * pageSize);
+            states[iWorker]->batch.columns.resize(columns.size());
+        }
+        WorkerState &state = *states[iWorker];
+        ColumnBatch &batch = state.batch;
+        batch.nRow = 0;
+
+        for (long i = morsel.begin; i < morsel.end;) {
+            long j = i + 1;
+            while (j < morsel.end && leaves[j] == leaves[j - 1] + 1)
+                j++;
+            int status = pTree->pPager->ReadPages(leaves[i], state.pages.data(), static_cast<unsigned>(j - i));
+            if (status != Succeed)
+                return status;
+            for (long k = 0; k < j - i; k++) {
+                BtPage page(&state.pages[k * pageSize], pageSize);
+                if (!page.IsLeaf())
+                    return Corrupt;
+                for (int index = 0; index < page.CellCount(); index++) {
+                    const unsigned char *pValue;
+                    unsigned valueSize;
+                    status = ReadValue(state, page, index, &pValue, &valueSize);
+                    if (status != Succeed)
+                        return status;
+                    DecodeRow(pValue, valueSize, columns, batch.nRow++, &batch);
+                    if (batch.nRow == VectorSize) {
+                        state.nRow += batch.nRow;
+                        status = sink(iWorker, batch);
+                        batch.nRow = 0;
+                        if (status != Succeed)
+                            return status;
+                    }
+                }
+            }
+            i = j;
+        }
+        if (batch.nRow == 0)
+            return Succeed;
+        state.nRow += batch.nRow;
+        int status = sink(iWorker, batch);
+        batch.nRow = 0;
+        return status;
+    }
+
+    int ParallelScan::Run(const ScanSink &sink) {
+        Pager *pPager = pTree->pPager;
+        if (pPager->State() == Pager_Writer)
+            return Misuse;
+        int status = CollectLeaves();
+        if (status != Succeed)
+            return status;
+
+        std::vector<Morsel> morsels;
+        for (long i = 0; i < static_cast<long>(leaves.size()); i += morselPages)
+            morsels.push_back({i, std::min(static_cast<long>(leaves.size()), i + morselPages)});
+        states.clear();
+        states.resize(pScheduler->WorkerCount());
+        status = pScheduler->Run(morsels, [this, &sink](int iWorker, const Morsel &morsel) {
+            return RunMorsel(iWorker, morsel, sink);
+        });
+        nPage = static_cast<long>(leaves.size());
+        nRow = 0;
+        for (auto &pState: states)
+            if (pState)
+                nRow += pState->nRow;
+        return status;
+    }
+
+    ParallelScan::ParallelScan(BTree *pTree, std::vector<int> columns, MorselScheduler *pScheduler, int morselPages)
+            : leaves(), states(), pTree(pTree), columns(std::move(columns)), pScheduler(pScheduler),
+              morselPages(std::max(1, morselPages)), nRow(0), nPage(0) {
+    }
+}
@@ -0,0 +1,118 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_MORSEL_H
+#define SQLITELIKE_TINYSQL_MORSEL_H
+
+#include <pthread.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "tinySQL_Vector.h"
+
+namespace tinySQL {
+
+    static constexpr int DefaultMorselPages = 64;
+
+    //a slice [begin,end) of a work list,the unit a worker takes at once
+    struct Morsel {
+        long begin;
+        long end;
+    };
+
+    typedef std::function<int(int iWorker, const Morsel &morsel)> MorselTask;
+
+    //fixed set of workers,by default one per cpu the process may run on,each
+    //pinned to its cpu and sorted by numa node.Run deals the morsels out in
+    //contiguous blocks,one per worker,and a worker that runs dry steals from
+    //the back of other queues,those of its own node first.Run blocks the
+    //caller until every morsel ran,after a failed task the rest are skipped.
+    //it must not be called from a worker
+    class MorselScheduler {
+    private:
+        struct Worker {
+            MorselScheduler *pScheduler;
+            int id;
+            int cpu;
+            int node;
+            pthread_t thread;
+            pthread_mutex_t mutex;
+            std::deque<Morsel> queue;
+            std::vector<int> victims;   //same node first
+            unsigned long seen;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        pthread_mutex_t mutex;
+        pthread_cond_t workCond;
+        pthread_cond_t doneCond;
+        pthread_mutex_t runMutex;
+        const MorselTask *pTask;
+        unsigned long epoch;
+        long nRemaining;
+        int status;
+        bool bShutdown;
+        int nNode;
+
+        static void *WorkerMain(void *pArg);
+        bool Take(Worker *pWorker, Morsel *pMorsel);
+        void Drain(Worker *pWorker);
+    public:
+        long nStolen;
+
+        int Run(const std::vector<Morsel> &morsels, const MorselTask &task);
+        int WorkerCount() const;
+        int NodeCount() const;
+        int NodeOf(int iWorker) const;
+
+        //nWorker 0 takes one worker per allowed cpu
+        explicit MorselScheduler(int nWorker = 0);
+        ~MorselScheduler();
+
+        static MorselScheduler *Global();
+    };
+
+    //called on the workers with the rows of the morsels each one runs,batches
+    //of one worker never overlap so per-worker state needs no lock
+    typedef std::function<int(int iWorker, ColumnBatch &batch)> ScanSink;
+
+    //full scan of a BTree split into morsels of morselPages leaf pages.the
+    //leaves are found from the interior pages,sorted by page number and read
+    //by the workers with positional reads on the pager's file,bypassing the
+    //cache.rows come out in no particular order.the scan runs inside the
+    //caller's read transaction,it is refused while a write transaction may
+    //hold pages that are not in the file yet
+    class ParallelScan {
+    private:
+        struct WorkerState {
+            std::vector<unsigned char> pages;
+            std::vector<unsigned char> overflow;
+            std::string value;
+            ColumnBatch batch;
+            long nRow;
+        };
+
+        std::vector<unsigned> leaves;
+        std::vector<std::unique_ptr<WorkerState>> states;
+
+        int CollectLeaves();
+        int ReadValue(WorkerState &state, const BtPage &page, int index, const unsigned char **ppValue,
+                      unsigned *pSize);
+        int RunMorsel(int iWorker, const Morsel &morsel, const ScanSink &sink);
+    public:
+        BTree *const pTree;
+        const std::vector<int> columns;
+        MorselScheduler *const pScheduler;
+        const int morselPages;
+        long nRow;
+        long nPage;
+
+        int Run(const ScanSink &sink);
+
+        ParallelScan(BTree *pTree, std::vector<int> columns, MorselScheduler *pScheduler = MorselScheduler::Global(),
+                     int morselPages = DefaultMorselPages);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_MORSEL_H
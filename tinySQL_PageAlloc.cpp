@@ -0,0 +1,233 @@
+//
+// Created by user on 26-10-19.
+//
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "tinySQL_PageAlloc.h"
+
+namespace tinySQL {
+
+    static constexpr int NumFrameClass = 13;    //MinFrameSize << 12 == MaxFrameSize
+    static constexpr size_t ThreadBatch = 64;   //frames moved between a thread's list and its node's
+    static constexpr int MemPolicyPreferred = 1;
+
+    static void ParseCpuList(const char *z, std::vector<int> *pCpus) {
+        while (*z) {
+            char *zEnd;
+            long first = strtol(z, &zEnd, 10);
+            if (zEnd == z)
+                return;
+            long last = first;
+            z = zEnd;
+            if (*z == '-') {
+                last = strtol(z + 1, &zEnd, 10);
+                z = zEnd;
+            }
+            for (long cpu = first; cpu <= last; cpu++)
+                pCpus->push_back(static_cast<int>(cpu));
+            if (*z != ',')
+                return;
+            z++;
+        }
+    }
+
+    int NumaNodeMap(std::vector<int> *pNodeOfCpu) {
+        int nNode = 1;
+        DIR *pDir = opendir("/sys/devices/system/node");
+        if (pDir == nullptr)
+            return nNode;
+        while (dirent *pEntry = readdir(pDir)) {
+            int node;
+            char zTail;
+            if (sscanf(pEntry->d_name, "node%d%c", &node, &zTail) != 1)
+                continue;
+            char zPath[64];
+            snprintf(zPath, sizeof(zPath), "/sys/devices/system/node/node%d/cpulist", node);
+            int fd = OsOpen(zPath, O_RDONLY);
+            if (fd < 0)
+                continue;
+            char zList[1024];
+            ssize_t n = OsRead(fd, zList, sizeof(zList) - 1);
+            OsClose(fd);
+            if (n <= 0)
+                continue;
+            zList[n] = 0;
+            std::vector<int> cpus;
+            ParseCpuList(zList, &cpus);
+            for (int cpu: cpus) {
+                if (static_cast<int>(pNodeOfCpu->size()) <= cpu)
+                    pNodeOfCpu->resize(cpu + 1, 0);
+                (*pNodeOfCpu)[cpu] = node;
+            }
+            nNode = std::max(nNode, node + 1);
+        }
+        closedir(pDir);
+        return nNode;
+    }
+
+    //kept in the first frame of every region,which is aligned to its size
+    struct PageAllocator::Region {
+        int node;
+    };
+
+    struct PageThreadCache {
+        std::vector<void *> lists[NumFrameClass];
+
+        ~PageThreadCache() {
+            for (int i = 0; i < NumFrameClass; i++)
+                if (!lists[i].empty())
+                    PageAllocator::Get(MinFrameSize << i)->Release(&lists[i], lists[i].size());
+        }
+    };
+
+    static thread_local PageThreadCache threadCache;
+
+    PageAllocator::Region *PageAllocator::RegionOf(void *pFrame) {
+        return reinterpret_cast<Region *>(reinterpret_cast<uintptr_t>(pFrame) & ~(PageRegionSize - 1));
+    }
+
+    int PageAllocator::CurrentNode() const {
+        int cpu = sched_getcpu();
+        if (cpu < 0 || cpu >= static_cast<int>(nodeOfCpu.size()))
+            return 0;
+        return nodeOfCpu[cpu];
+    }
+
+    //twice the size is mapped so an aligned region can be cut out of it
+    bool PageAllocator::NewRegion(int node, Partition *pPart) {
+        bool bHuge = true;
+        void *pMap = OsMmap(nullptr, 2 * PageRegionSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pMap == MAP_FAILED) {
+            bHuge = false;
+            pMap = OsMmap(nullptr, 2 * PageRegionSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (pMap == MAP_FAILED)
+                return false;
+        }
+        auto pStart = static_cast<unsigned char *>(pMap);
+        auto pBase = reinterpret_cast<unsigned char *>(
+                (reinterpret_cast<uintptr_t>(pStart) + PageRegionSize - 1) & ~(PageRegionSize - 1));
+        if (pBase > pStart)
+            OsMunmap(pStart, pBase - pStart);
+        if (pStart + 2 * PageRegionSize > pBase + PageRegionSize)
+            OsMunmap(pBase + PageRegionSize, pStart + 2 * PageRegionSize - (pBase + PageRegionSize));
+        if (!bHuge)
+            madvise(pBase, PageRegionSize, MADV_HUGEPAGE);
+        if (partitions.size() > 1) {
+            unsigned long mask = 1UL << node;
+            syscall(SYS_mbind, pBase, PageRegionSize, MemPolicyPreferred, &mask, sizeof(mask) * 8, 0);
+        }
+
+        reinterpret_cast<Region *>(pBase)->node = node;
+        pPart->pCarve = pBase + frameSize;
+        pPart->pCarveEnd = pBase + PageRegionSize;
+        pPart->nRegion++;
+        if (bHuge)
+            pPart->nHugeRegion++;
+        return true;
+    }
+
+    //frames are carved only when none were freed,and a region is only mapped
+    //when nothing else is left
+    bool PageAllocator::Refill(int node, std::vector<void *> *pList) {
+        Partition *pPart = partitions[node].get();
+        pthread_mutex_lock(&pPart->mutex);
+        size_t n = std::min(ThreadBatch, pPart->free.size());
+        pList->insert(pList->end(), pPart->free.end() - n, pPart->free.end());
+        pPart->free.resize(pPart->free.size() - n);
+        bool bCarve = n == 0;
+        while (bCarve && n < ThreadBatch) {
+            if (pPart->pCarve == pPart->pCarveEnd && (n > 0 || !NewRegion(node, pPart)))
+                break;
+            pList->push_back(pPart->pCarve);
+            pPart->pCarve += frameSize;
+            pPart->nFrame++;
+            n++;
+        }
+        pthread_mutex_unlock(&pPart->mutex);
+        return n > 0;
+    }
+
+    //the last n frames of the list go back to their nodes
+    void PageAllocator::Release(std::vector<void *> *pList, size_t n) {
+        assert(n <= pList->size());
+        for (size_t i = pList->size() - n; i < pList->size(); i++) {
+            Partition *pPart = partitions[RegionOf((*pList)[i])->node].get();
+            pthread_mutex_lock(&pPart->mutex);
+            pPart->free.push_back((*pList)[i]);
+            pthread_mutex_unlock(&pPart->mutex);
+        }
+        pList->resize(pList->size() - n);
+    }
+
+    void *PageAllocator::Allocate() {
+        std::vector<void *> &list = threadCache.lists[iClass];
+        if (list.empty() && !Refill(CurrentNode(), &list))
+            return nullptr;
+        void *pFrame = list.back();
+        list.pop_back();
+        partitions[RegionOf(pFrame)->node]->nInUse.fetch_add(1, std::memory_order_relaxed);
+        return pFrame;
+    }
+
+    void PageAllocator::Free(void *pFrame) {
+        if (pFrame == nullptr)
+            return;
+        std::vector<void *> &list = threadCache.lists[iClass];
+        int node = RegionOf(pFrame)->node;
+        partitions[node]->nInUse.fetch_sub(1, std::memory_order_relaxed);
+        list.push_back(pFrame);
+        if (node != CurrentNode())
+            Release(&list, 1);
+        else if (list.size() >= 2 * ThreadBatch)
+            Release(&list, ThreadBatch);
+    }
+
+    void PageAllocator::Stats(PageAllocStats *pStats) {
+        *pStats = PageAllocStats{frameSize, 0, 0, 0, 0, {}};
+        for (auto &pPart: partitions) {
+            pthread_mutex_lock(&pPart->mutex);
+            pStats->nRegion += pPart->nRegion;
+            pStats->nHugeRegion += pPart->nHugeRegion;
+            pStats->nFrame += pPart->nFrame;
+            pthread_mutex_unlock(&pPart->mutex);
+            long nInUse = pPart->nInUse.load(std::memory_order_relaxed);
+            pStats->nInUse += nInUse;
+            pStats->inUseByNode.push_back(nInUse);
+        }
+    }
+
+    PageAllocator::PageAllocator(size_t frameSize, int iClass) :
+            partitions(), nodeOfCpu(), iClass(iClass), frameSize(frameSize) {
+        int nNode = NumaNodeMap(&nodeOfCpu);
+        for (int i = 0; i < nNode; i++) {
+            auto pPart = new Partition{PTHREAD_MUTEX_INITIALIZER, {}, nullptr, nullptr, {0}, 0, 0, 0};
+            partitions.emplace_back(pPart);
+        }
+    }
+
+    //allocators are never destroyed,threads may hand frames back at any time
+    PageAllocator *PageAllocator::Get(size_t frameSize) {
+        static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        static std::atomic<PageAllocator *> allocators[NumFrameClass];
+        if (frameSize < MinFrameSize || frameSize > MaxFrameSize || (frameSize & (frameSize - 1)) != 0)
+            return nullptr;
+        int iClass = __builtin_ctzl(frameSize / MinFrameSize);
+        PageAllocator *pAllocator = allocators[iClass].load(std::memory_order_acquire);
+        if (pAllocator)
+            return pAllocator;
+        pthread_mutex_lock(&mutex);
+        pAllocator = allocators[iClass].load(std::memory_order_relaxed);
+        if (pAllocator == nullptr) {
+            pAllocator = new PageAllocator(frameSize, iClass);
+            allocators[iClass].store(pAllocator, std::memory_order_release);
+        }
+        pthread_mutex_unlock(&mutex);
+        return pAllocator;
+    }
+}
@@ -0,0 +1,81 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_PAGEALLOC_H
+#define SQLITELIKE_TINYSQL_PAGEALLOC_H
+
+#include <pthread.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    static constexpr size_t HugePageSize = 2 << 20;
+    static constexpr size_t PageRegionSize = 32 << 20;
+    static constexpr size_t MinFrameSize = 512;
+    static constexpr size_t MaxFrameSize = HugePageSize;
+
+    //numa node of every cpu from sysfs,all cpus are on node 0 without it.
+    //returns the node count
+    int NumaNodeMap(std::vector<int> *pNodeOfCpu);
+
+    //filled by PageAllocator::Stats
+    struct PageAllocStats {
+        size_t frameSize;
+        long nRegion;
+        long nHugeRegion;               //backed by hugetlb pages rather than transparent ones
+        long nFrame;                    //handed out of the regions so far
+        long nInUse;
+        std::vector<long> inUseByNode;
+    };
+
+    //frames of one power of two size for pages and i/o buffers.memory comes in
+    //regions of PageRegionSize,hugetlb pages when the system has them reserved
+    //and transparent huge pages otherwise,each region bound to the numa node
+    //of the thread that needed it.a thread allocates from and frees to its own
+    //list,which trades frames with its node's list a batch at a time.frames
+    //freed on another node go back to the node they came from.regions are kept
+    //for the life of the process
+    class PageAllocator {
+    private:
+        struct Region;
+        struct Partition {
+            pthread_mutex_t mutex;
+            std::vector<void *> free;
+            unsigned char *pCarve;      //the rest of the newest region
+            unsigned char *pCarveEnd;
+            std::atomic<long> nInUse;
+            long nRegion;
+            long nHugeRegion;
+            long nFrame;
+        };
+
+        std::vector<std::unique_ptr<Partition>> partitions;    //one per node
+        std::vector<int> nodeOfCpu;
+        const int iClass;
+
+        PageAllocator(size_t frameSize, int iClass);
+        static Region *RegionOf(void *pFrame);
+        int CurrentNode() const;
+        bool NewRegion(int node, Partition *pPart);
+        bool Refill(int node, std::vector<void *> *pList);
+        void Release(std::vector<void *> *pList, size_t n);
+
+        friend struct PageThreadCache;
+    public:
+        const size_t frameSize;
+
+        //nullptr when no memory is left.frames are not zeroed
+        void *Allocate();
+        void Free(void *pFrame);
+        void Stats(PageAllocStats *pStats);
+
+        //the process wide allocator for frameSize,a power of two between
+        //MinFrameSize and MaxFrameSize,nullptr for any other size
+        static PageAllocator *Get(size_t frameSize);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_PAGEALLOC_H
@@ -0,0 +1,1392 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <new>
+#include "tinySQL_Clock.h"
+#include "tinySQL_FreeMap.h"
+#include "tinySQL_Pager.h"
+
+namespace tinySQL {
+
+    static constexpr int MaxWriteRun = 64;      //pages gathered into one xWrite by Commit
+    static constexpr long DefaultPrefetchLimit = 256;
+
+    static bool ValidPageSize(int pageSize) {
+        return pageSize >= MinPageSize && pageSize <= MaxPageSize && (pageSize & (pageSize - 1)) == 0;
+    }
+
+    int Pager::Open(tinySQL_VFS *pVFS, const char *zPath, int pageSize, Pager **ppPager) {
+        assert(pVFS && ppPager);
+        *ppPager = nullptr;
+        tinySQL_file *pFile = nullptr;
+        int status = pVFS->xOpen(zPath, &pFile, Open_Create | Open_ReadWrite, nullptr);
+        if (status != Succeed)
+            return status;
+
+        //an existing database keeps the page size it was created with
+        unsigned char header[Header_Meta];
+        status = pFile->xRead(header, sizeof(header), 0);
+        if (status == Succeed) {
+            if (memcmp(header, Header_MagicString, sizeof(Header_MagicString)) != 0) {
+                pFile->xClose();
+                return Corrupt;
+            }
+            pageSize = static_cast<int>(Get4(&header[Header_PageSize]));
+        } else if (status != IOError_ReadShort) {
+            pFile->xClose();
+            return status;
+        }
+        if (!ValidPageSize(pageSize)) {
+            pFile->xClose();
+            return Corrupt;
+        }
+        auto pPager = new Pager(pVFS, pFile, zPath, pageSize);
+        if (status == Succeed && Get4(&header[Header_JournalMode]) == Journal_Wal) {
+            status = pPager->OpenWal();
+            if (status != Succeed) {
+                delete pPager;
+                return status;
+            }
+        }
+        *ppPager = pPager;
+        return Succeed;
+    }
+
+    int Pager::Close() {
+        if (eState == Pager_Writer)
+            Rollback();
+        else
+            EndRead();
+        delete this;
+        return Succeed;
+    }
+
+    //retries wait on the global timer wheel,connections backing off together
+    //are woken by the same tick
+    int Pager::LockWait(tinySQL_file *pLockFile, int eLock) {
+        uint64_t deadline = 0;
+        uint64_t backoff = LockBackoffMinNs;
+        for (;;) {
+            int status = pLockFile->xLock(eLock);
+            if (status != Busying || busyTimeoutMs <= 0)
+                return status;
+            uint64_t now = Clock::Monotonic();
+            if (deadline == 0)
+                deadline = now + static_cast<uint64_t>(busyTimeoutMs) * 1000000;
+            else if (now >= deadline)
+                return status;
+            TimerWheel::Global()->SleepUntil(std::min(deadline, now + backoff));
+            backoff = std::min(backoff * 2, LockBackoffMaxNs);
+        }
+    }
+
+    int Pager::Unlock() {
+        DropPrefetched();
+        int status = pFile->xUnlock(Lock_None);
+        if (pWal) {
+            int walStatus = pWal->pFile->xUnlock(Lock_None);
+            if (status == Succeed)
+                status = walStatus;
+        }
+        return status;
+    }
+
+    int Pager::OpenWal() {
+        return Wal::Open(pVFS, path + "-wal", pageSize, &pWal);
+    }
+
+    void Pager::CloseWal() {
+        pWal->Close();
+        pWal = nullptr;
+        ResetCache();
+    }
+
+    //pages other connections committed to the log since the last snapshot are
+    //dropped from the cache,all of them when the log was started over
+    int Pager::RefreshWal(std::vector<unsigned> *pChanged) {
+        bool bReset;
+        std::vector<unsigned> changed;
+        int status = pWal->Refresh(&bReset, &changed);
+        if (status != Succeed)
+            return status;
+        if (bReset) {
+            ResetCache();
+            return pChanged ? Busying : Succeed;
+        }
+        for (auto pgno: changed) {
+            auto it = cache.find(pgno);
+            if (it == cache.end() || it->second->nRef != 0 || it->second->bDirty)
+                continue;
+            if (it->second->bInLru)
+                LruRemove(it->second);
+            FreePage(it->second);
+            cache.erase(it);
+        }
+        if (!changed.empty())
+            generation++;
+        if (pChanged)
+            pChanged->swap(changed);
+        return Succeed;
+    }
+
+    //the change counter tells whether another connection committed since the
+    //cache was filled.in wal mode page 1 may be in the log,and the refresh of
+    //the snapshot already dropped the pages that changed
+    int Pager::ReadHeader() {
+        unsigned long size;
+        int status = pFile->xFileSize(&size);
+        if (status != Succeed)
+            return status;
+        nPageFile = static_cast<unsigned>(size / pageSize);
+        if (pShared) {
+            FileIdentity id{};
+            status = pFile->xFileControl(Fcntl_FileId, &id);
+            if (status != Succeed)
+                return status;
+            fileMtime = id.mtime;
+        }
+        unsigned char header[Header_Meta];
+        unsigned frame = pWal ? pWal->Find(1) : 0;
+        if (frame)
+            status = pWal->ReadFrame(frame, header, sizeof(header));
+        else if (nPageFile == 0) {
+            if (changeCounter != 0 || !cache.empty())
+                ResetCache();
+            nPage = 0;
+            nPageCommitted = 0;
+            changeCounter = 0;
+            journalMode = pWal ? Journal_Wal : Journal_Direct;
+            return Succeed;
+        } else
+            status = pFile->xRead(header, sizeof(header), 0);
+        if (status != Succeed)
+            return status;
+        if (memcmp(header, Header_MagicString, sizeof(Header_MagicString)) != 0 ||
+            static_cast<int>(Get4(&header[Header_PageSize])) != pageSize)
+            return Corrupt;
+        unsigned counter = Get4(&header[Header_ChangeCounter]);
+        if (counter != changeCounter) {
+            if (!pWal)
+                ResetCache();
+            changeCounter = counter;
+        }
+        journalMode = Get4(&header[Header_JournalMode]);
+        nPage = Get4(&header[Header_PageCount]);
+        nPageCommitted = nPage;
+        return Succeed;
+    }
+
+    int Pager::BeginRead() {
+        if (eState != Pager_Open)
+            return Succeed;
+        if (!pWal) {
+            int status = LockWait(pFile, Lock_Shared);
+            if (status != Succeed)
+                return status;
+            status = ReadHeader();
+            if (status == Succeed && journalMode == Journal_Wal) {
+                //another connection switched the database to wal mode
+                status = OpenWal();
+                pFile->xUnlock(Lock_None);
+                return status == Succeed ? BeginRead() : status;
+            }
+            if (status != Succeed) {
+                pFile->xUnlock(Lock_None);
+                return status;
+            }
+            eState = Pager_Reader;
+            return Succeed;
+        }
+
+        //the shared lock on the log keeps checkpoints from starting it over
+        //under the snapshot
+        int status = LockWait(pWal->pFile, Lock_Shared);
+        if (status != Succeed)
+            return status;
+        status = RefreshWal();
+        if (status == Succeed)
+            status = ReadHeader();
+        if (status == Succeed && journalMode != Journal_Wal) {
+            //another connection left wal mode
+            pWal->pFile->xUnlock(Lock_None);
+            CloseWal();
+            return BeginRead();
+        }
+        if (status != Succeed) {
+            pWal->pFile->xUnlock(Lock_None);
+            return status;
+        }
+        eState = Pager_Reader;
+        return Succeed;
+    }
+
+    int Pager::EndRead() {
+        if (eState == Pager_Open)
+            return Succeed;
+        if (eState == Pager_Writer)
+            return Rollback();
+        eState = Pager_Open;
+        return Unlock();
+    }
+
+    //in wal mode the reserved lock on the database is the writer's mutex.a
+    //write transaction must start from the newest commit,so a read transaction
+    //whose snapshot is behind cannot be upgraded and gets Busying
+    int Pager::BeginWrite() {
+        if (eState == Pager_Writer)
+            return Succeed;
+        bool bFresh = eState == Pager_Open;
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        if (pWal) {
+            status = LockWait(pFile, Lock_Shared);
+            if (status == Succeed)
+                status = LockWait(pFile, Lock_Reserved);
+            if (status == Succeed) {
+                bool bNewer;
+                status = pWal->HasNewer(&bNewer);
+                if (status == Succeed && bNewer) {
+                    if (bFresh)
+                        status = RefreshWal();
+                    else
+                        status = Busying;
+                    if (status == Succeed)
+                        status = ReadHeader();
+                    if (status == Succeed && journalMode != Journal_Wal)
+                        status = Busying;
+                }
+            }
+            if (status != Succeed) {
+                pFile->xUnlock(Lock_None);
+                if (bFresh)
+                    EndRead();
+                return status;
+            }
+        } else {
+            status = LockWait(pFile, Lock_Reserved);
+            if (status != Succeed)
+                return status;
+        }
+        eState = Pager_Writer;
+        allocHint = 0;
+
+        if (nPage == 0) {
+            nPage = 1;
+            PgHdr *pPage = NewPage(1);
+            memcpy(pPage->pData, Header_MagicString, sizeof(Header_MagicString));
+            Put4(&pPage->pData[Header_PageSize], pageSize);
+            pPage->bDirty = true;
+            dirty.push_back(pPage);
+            Unref(pPage);
+        }
+        return Succeed;
+    }
+
+    //contiguous dirty pages go out in one call
+    int Pager::WriteDirty() {
+        std::sort(dirty.begin(), dirty.end(), [](PgHdr *a, PgHdr *b) { return a->pgno < b->pgno; });
+        std::vector<unsigned char> run;
+        size_t i = 0;
+        while (i < dirty.size()) {
+            size_t j = i + 1;
+            while (j < dirty.size() && j - i < MaxWriteRun && dirty[j]->pgno == dirty[j - 1]->pgno + 1)
+                j++;
+            const unsigned char *pData = dirty[i]->pData;
+            if (j - i > 1) {
+                run.resize((j - i) * pageSize);
+                for (size_t k = i; k < j; k++)
+                    memcpy(&run[(k - i) * pageSize], dirty[k]->pData, pageSize);
+                pData = run.data();
+            }
+            int status = pFile->xWrite(pData, static_cast<long>((j - i) * pageSize),
+                                       static_cast<long>(dirty[i]->pgno - 1) * pageSize);
+            if (status != Succeed)
+                return status;
+            i = j;
+        }
+        return Succeed;
+    }
+
+    int Pager::WriteWal() {
+        std::sort(dirty.begin(), dirty.end(), [](PgHdr *a, PgHdr *b) { return a->pgno < b->pgno; });
+        std::vector<unsigned> pgnos(dirty.size());
+        std::vector<const unsigned char *> pages(dirty.size());
+        for (size_t i = 0; i < dirty.size(); i++) {
+            pgnos[i] = dirty[i]->pgno;
+            pages[i] = dirty[i]->pData;
+        }
+        return pWal->Append(pgnos.data(), pages.data(), static_cast<int>(dirty.size()), nPage);
+    }
+
+    int Pager::BeginConcurrent() {
+        if (!pWal || eState != Pager_Open)
+            return Misuse;
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        PgHdr *pFirst;
+        status = Get(1, &pFirst);
+        if (status != Succeed) {
+            EndRead();
+            return status;
+        }
+        metaSnapshot.assign(&pFirst->pData[Header_Meta], &pFirst->pData[pageSize]);
+        Unref(pFirst);
+        nPageSnapshot = nPage;
+        readSet.clear();
+        bConcurrent = true;
+        allocHint = 0;
+        eState = Pager_Writer;
+        return Succeed;
+    }
+
+    //runs under the writer lock.the snapshot is moved up to the newest commit,
+    //which drops the pages others changed from the cache unless they are dirty.
+    //page 1 changes with every commit,only its part past the header counts
+    int Pager::Validate() {
+        unsigned nPageOwn = nPage;
+        std::vector<unsigned> changed;
+        int status = RefreshWal(&changed);
+        if (status != Succeed)
+            return status;
+        bool bFirst = false;
+        for (auto pgno: changed) {
+            if (pgno == 1)
+                bFirst = true;
+            else if (readSet.count(pgno))
+                return Busying;
+        }
+        if (bFirst) {
+            std::vector<unsigned char> first(pageSize);
+            status = pWal->ReadFrame(pWal->Find(1), first.data(), pageSize);
+            if (status != Succeed)
+                return status;
+            if (memcmp(&first[Header_Meta], metaSnapshot.data(), metaSnapshot.size()) != 0)
+                return Busying;
+        }
+        status = ReadHeader();
+        if (status != Succeed)
+            return status;
+        if (nPageOwn != nPageSnapshot) {
+            if (nPage != nPageSnapshot)
+                return Busying;
+            nPage = nPageOwn;
+        }
+        return Succeed;
+    }
+
+    int Pager::Commit() {
+        if (eState != Pager_Writer)
+            return EndRead();
+        if (dirty.empty() && nPage == nPageCommitted) {
+            eState = Pager_Reader;
+            bConcurrent = false;
+            return EndRead();
+        }
+        //pages are about to be written under the reads
+        DropPrefetched();
+        int status;
+        if (!pWal && (status = LockWait(pFile, Lock_Exclusive)) != Succeed)
+            return status;
+        if (bConcurrent) {
+            status = LockWait(pFile, Lock_Shared);
+            if (status == Succeed)
+                status = LockWait(pFile, Lock_Reserved);
+            if (status != Succeed)
+                return status;
+            status = Validate();
+            if (status != Succeed) {
+                Rollback();
+                return status;
+            }
+            bConcurrent = false;
+            readSet.clear();
+        }
+
+        PgHdr *pFirst;
+        status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        Write(pFirst);
+        Put4(&pFirst->pData[Header_PageCount], nPage);
+        Put4(&pFirst->pData[Header_ChangeCounter], changeCounter + 1);
+        Unref(pFirst);
+
+        if (pWal)
+            status = WriteWal();
+        else {
+            status = WriteDirty();
+            if (status == Succeed)
+                status = pFile->xSync(0);
+        }
+        if (status != Succeed)
+            return status;
+
+        changeCounter++;
+        if (!pWal) {
+            //pages TruncateFree cut off,the file just stays longer when that fails
+            if (nPage < nPageFile && pFile->xTruncate(static_cast<long>(nPage) * pageSize) == Succeed)
+                nPageFile = nPage;
+            nPageFile = std::max(nPageFile, nPage);
+        }
+        nPageCommitted = nPage;
+        if (pShared)
+            PublishDirty();
+        for (auto pPage: dirty) {
+            pPage->bDirty = false;
+            if (pPage->nRef == 0)
+                LruAdd(pPage);
+        }
+        dirty.clear();
+        EvictClean();
+        eState = Pager_Open;
+        //a checkpoint that finds readers is left to a later commit
+        if (pWal && autoCheckpoint > 0 && pWal->mxFrame >= autoCheckpoint)
+            WalCheckpoint(false, checkpointSliceMs > 0 ? checkpointSliceMs * 1000000L : -1);
+        return Unlock();
+    }
+
+    //readers that start during the copy pin the same commit as the copy,so
+    //only readers from before it hold pages back.starting the log over needs
+    //the log to itself,while a reader keeps it only pages committed since are
+    //copied next time.a copy cut short by budgetNs goes on from where it was
+    int Pager::WalCheckpoint(bool bLeave, long budgetNs) {
+        int bReader = 0;
+        int status = pWal->pFile->xFileControl(Fcntl_ExternalReader, &bReader);
+        if (status != Succeed)
+            return status;
+        if (bReader)
+            return Busying;
+        status = RefreshWal();
+        bool bDone = false;
+        if (status == Succeed)
+            status = pWal->Backfill(pFile, budgetNs, checkpointWriters, ThreadPool::Global(), &bDone);
+        unsigned long size;
+        if (status == Succeed && (status = pFile->xFileSize(&size)) == Succeed)
+            nPageFile = static_cast<unsigned>(size / pageSize);
+        if (status == Succeed && !bDone)
+            return Succeed;
+        if (status == Succeed)
+            status = pWal->pFile->xFileControl(Fcntl_ExternalReader, &bReader);
+        if (status != Succeed)
+            return status;
+        if (bReader)
+            return Busying;
+        bool bPinned = false;
+        if ((status = ShipPinned(&bPinned)) != Succeed)
+            return status;
+        if (bPinned)
+            return Busying;
+        status = pWal->pFile->xLock(Lock_Exclusive);
+        if (status == Succeed)
+            status = pWal->Restart();
+
+        if (status == Succeed && bLeave) {
+            //page 1 goes to the file by hand and the log is emptied before any
+            //other connection may look at either
+            PgHdr *pFirst;
+            status = Get(1, &pFirst);
+            if (status == Succeed) {
+                std::vector<unsigned char> first(pFirst->pData, pFirst->pData + pageSize);
+                Unref(pFirst);
+                Put4(&first[Header_JournalMode], Journal_Direct);
+                Put4(&first[Header_ChangeCounter], changeCounter + 1);
+                status = pFile->xWrite(first.data(), pageSize, 0);
+                if (status == Succeed)
+                    status = pFile->xSync(0);
+                if (status == Succeed)
+                    status = pWal->pFile->xTruncate(0);
+                if (status == Succeed)
+                    changeCounter++;
+            }
+        }
+        pWal->pFile->xUnlock(Lock_Shared);
+        return status;
+    }
+
+    int Pager::Checkpoint() {
+        if (!pWal)
+            return Succeed;
+        if (eState != Pager_Open)
+            return Misuse;
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        status = LockWait(pFile, Lock_Shared);
+        if (status == Succeed)
+            status = LockWait(pFile, Lock_Reserved);
+        if (status == Succeed)
+            status = WalCheckpoint(false, -1);
+        int endStatus = EndRead();
+        return status == Succeed ? endStatus : status;
+    }
+
+    //a log shipper leaves the mark of what its follower acknowledged next to
+    //the database,the log is not started over before the follower has all of it
+    int Pager::ShipPinned(bool *pPinned) {
+        *pPinned = false;
+        if (pWal->mxFrame == 0)
+            return Succeed;
+        std::string name = path + Wal_ShipSuffix;
+        int bExists = 0;
+        int status = pVFS->xAccess(name.c_str(), Access_Exists, &bExists);
+        if (status != Succeed || !bExists)
+            return status;
+        tinySQL_file *pShip = nullptr;
+        if ((status = pVFS->xOpen(name.c_str(), &pShip, Open_ReadOnly, nullptr)) != Succeed)
+            return status == CanNotOpen ? Succeed : status;
+        unsigned char mark[Wal_ShipMarkSize] = {};
+        status = pShip->xRead(mark, Wal_ShipMarkSize, 0);
+        pShip->xClose();
+        if (status == IOError_ReadShort)
+            status = Succeed;
+        if (status != Succeed)
+            return status;
+        uint64_t salts = (static_cast<uint64_t>(Get4(&mark[4])) << 32) | Get4(&mark[8]);
+        *pPinned = Get4(&mark[0]) != Wal_ShipMagic || salts != pWal->Salts() || Get4(&mark[12]) < pWal->mxFrame;
+        return Succeed;
+    }
+
+    void Pager::CheckpointProgress(CheckpointStats *pStats) const {
+        *pStats = CheckpointStats{};
+        if (pWal)
+            pWal->Stats(pStats);
+    }
+
+    int Pager::SetWalMode(bool bWal) {
+        if (eState != Pager_Open)
+            return Misuse;
+        if (bWal == (pWal != nullptr))
+            return Succeed;
+        int status;
+        if (bWal) {
+            status = BeginWrite();
+            if (status != Succeed) {
+                EndRead();
+                return status;
+            }
+            PgHdr *pFirst;
+            status = Get(1, &pFirst);
+            if (status == Succeed) {
+                Write(pFirst);
+                Put4(&pFirst->pData[Header_JournalMode], Journal_Wal);
+                Unref(pFirst);
+                status = Commit();
+            }
+            if (status != Succeed) {
+                Rollback();
+                return status;
+            }
+            return OpenWal();
+        }
+
+        status = BeginRead();
+        if (status != Succeed)
+            return status;
+        status = LockWait(pFile, Lock_Shared);
+        if (status == Succeed)
+            status = LockWait(pFile, Lock_Reserved);
+        if (status == Succeed)
+            status = WalCheckpoint(true, -1);
+        int endStatus = EndRead();
+        if (status != Succeed)
+            return status;
+        CloseWal();
+        return endStatus;
+    }
+
+    bool Pager::WalMode() const {
+        return pWal != nullptr;
+    }
+
+    //pages changed by the transaction are thrown away and read again when needed
+    int Pager::Rollback() {
+        if (eState != Pager_Writer)
+            return EndRead();
+        for (auto pPage: dirty) {
+            assert(pPage->nRef == 0);
+            cache.erase(pPage->pgno);
+            FreePage(pPage);
+        }
+        dirty.clear();
+        for (auto it = cache.begin(); it != cache.end();) {
+            if (it->first > nPageCommitted) {
+                assert(it->second->nRef == 0);
+                if (it->second->bInLru)
+                    LruRemove(it->second);
+                FreePage(it->second);
+                it = cache.erase(it);
+            } else
+                it++;
+        }
+        generation++;
+        if (pWal)
+            pWal->Discard();
+        bConcurrent = false;
+        readSet.clear();
+        eState = Pager_Open;
+        return Unlock();
+    }
+
+    //a page's contents are fixed by where it was read from:a log frame until
+    //the log starts over,the file until the next commit in direct mode or the
+    //next checkpoint in wal mode,both of which move the file's mtime.the change
+    //counter and the salts cover writes that land within the mtime granularity
+    void Pager::PageTag(unsigned frame, SharedTag *pTag) const {
+        if (frame)
+            *pTag = {Tag_WalFrame, pWal->Salts(), frame};
+        else if (pWal)
+            *pTag = {Tag_WalFile, static_cast<uint64_t>(fileMtime), pWal->Salts()};
+        else
+            *pTag = {Tag_Direct, static_cast<uint64_t>(fileMtime), changeCounter};
+    }
+
+    //called once the commit is durable,the file was just written so direct
+    //mode needs its new mtime
+    void Pager::PublishDirty() {
+        if (!pWal) {
+            FileIdentity id{};
+            if (pFile->xFileControl(Fcntl_FileId, &id) != Succeed)
+                return;
+            fileMtime = id.mtime;
+        }
+        SharedTag tag{};
+        for (auto pPage: dirty) {
+            PageTag(pWal ? pWal->Find(pPage->pgno) : 0, &tag);
+            pShared->Publish(pPage->pgno, tag, pPage->pData);
+        }
+    }
+
+    int Pager::UseSharedCache(long nSlot) {
+        if (pShared)
+            return Succeed;
+        FileIdentity id{};
+        int status = pFile->xFileControl(Fcntl_FileId, &id);
+        if (status != Succeed)
+            return status;
+        status = SharedCache::Open(id, pageSize, nSlot, &pShared);
+        if (status == Succeed)
+            ResetCache();
+        return status;
+    }
+
+    SharedCache *Pager::Shared() const {
+        return pShared;
+    }
+
+    int Pager::State() const {
+        return eState;
+    }
+
+    void Pager::ResetCache() {
+        DropPrefetched();
+        for (auto it = cache.begin(); it != cache.end();) {
+            if (it->second->nRef == 0 && !it->second->bDirty) {
+                if (it->second->bInLru)
+                    LruRemove(it->second);
+                FreePage(it->second);
+                it = cache.erase(it);
+            } else
+                it++;
+        }
+        generation++;
+    }
+
+    void Pager::EvictClean() {
+        while (static_cast<long>(cache.size()) > cacheSize && pLruFirst) {
+            PgHdr *pPage = pLruFirst;
+            LruRemove(pPage);
+            cache.erase(pPage->pgno);
+            FreePage(pPage);
+        }
+    }
+
+    void Pager::LruAdd(PgHdr *pPage) {
+        pPage->pLruPrev = pLruLast;
+        pPage->pLruNext = nullptr;
+        if (pLruLast)
+            pLruLast->pLruNext = pPage;
+        else
+            pLruFirst = pPage;
+        pLruLast = pPage;
+        pPage->bInLru = true;
+    }
+
+    void Pager::LruRemove(PgHdr *pPage) {
+        if (pPage->pLruPrev)
+            pPage->pLruPrev->pLruNext = pPage->pLruNext;
+        else
+            pLruFirst = pPage->pLruNext;
+        if (pPage->pLruNext)
+            pPage->pLruNext->pLruPrev = pPage->pLruPrev;
+        else
+            pLruLast = pPage->pLruPrev;
+        pPage->bInLru = false;
+    }
+
+    PgHdr *Pager::NewPage(unsigned pgno) {
+        //out of memory is what new would have thrown
+        auto pData = static_cast<unsigned char *>(pAlloc->Allocate());
+        if (pData == nullptr)
+            throw std::bad_alloc();
+        memset(pData, 0, pageSize);
+        auto pPage = new PgHdr{pgno, pData, 1, false, false, nullptr, nullptr, this};
+        cache[pgno] = pPage;
+        return pPage;
+    }
+
+    void Pager::FreePage(PgHdr *pPage) {
+        pAlloc->Free(pPage->pData);
+        delete pPage;
+    }
+
+    //throws away the cached copy of a page whose contents no longer matter,
+    //unless somebody still holds it
+    void Pager::Drop(unsigned pgno) {
+        auto it = cache.find(pgno);
+        if (it == cache.end() || it->second->nRef != 0)
+            return;
+        PgHdr *pPage = it->second;
+        if (pPage->bInLru)
+            LruRemove(pPage);
+        if (pPage->bDirty)
+            dirty.erase(std::find(dirty.begin(), dirty.end(), pPage));
+        cache.erase(it);
+        FreePage(pPage);
+    }
+
+    //a zeroed dirty page in place of whatever was cached,pages allocated past
+    //the end may be left behind by a transaction that rolled back
+    PgHdr *Pager::Fresh(unsigned pgno) {
+        Drop(pgno);
+        assert(cache.find(pgno) == cache.end());
+        PgHdr *pPage = NewPage(pgno);
+        Write(pPage);
+        return pPage;
+    }
+
+    int Pager::Get(unsigned pgno, PgHdr **ppPage) {
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        if (pgno == 0 || pgno > nPage)
+            return Corrupt;
+        if (bConcurrent)
+            readSet.insert(pgno);
+
+        auto it = cache.find(pgno);
+        if (it != cache.end()) {
+            PgHdr *pPage = it->second;
+            if (pPage->bInLru)
+                LruRemove(pPage);
+            pPage->nRef++;
+            *ppPage = pPage;
+            return Succeed;
+        }
+
+        PgHdr *pPage = NewPage(pgno);
+        unsigned frame = pWal ? pWal->Find(pgno) : 0;
+        //pages past the last commit may be written around the cache
+        bool bShare = pShared && pgno <= nPageCommitted && (frame || pgno <= nPageFile);
+        SharedTag tag{};
+        if (bShare) {
+            PageTag(frame, &tag);
+            if (pShared->Lookup(pgno, tag, pPage->pData)) {
+                EvictClean();
+                *ppPage = pPage;
+                return Succeed;
+            }
+        }
+        if (frame) {
+            status = pWal->ReadFrame(frame, pPage->pData, pageSize);
+            if (status != Succeed) {
+                cache.erase(pgno);
+                FreePage(pPage);
+                return status;
+            }
+        } else if (TakePrefetched(pPage)) {
+            nPrefetchHit++;
+        } else if (pgno <= nPageFile) {
+            status = pFile->xRead(pPage->pData, pageSize, static_cast<long>(pgno - 1) * pageSize);
+            if (status != Succeed && status != IOError_ReadShort) {
+                cache.erase(pgno);
+                FreePage(pPage);
+                return status;
+            }
+        }
+        if (bShare && status == Succeed)
+            pShared->Publish(pgno, tag, pPage->pData);
+        EvictClean();
+        *ppPage = pPage;
+        return Succeed;
+    }
+
+    bool Pager::CanPrefetch(unsigned pgno) const {
+        return pgno >= 1 && pgno <= nPageFile && pgno <= nPageCommitted && cache.find(pgno) == cache.end() &&
+               prefetched.find(pgno) == prefetched.end() && !(pWal && pWal->Find(pgno));
+    }
+
+    //a run of pages in a row is one xRead.when the buffer is full the oldest
+    //pages read are thrown away,not ones still being read
+    int Pager::Prefetch(const unsigned *aPgno, int n) {
+        if (eState == Pager_Open || prefetchLimit <= 0)
+            return Succeed;
+        int i = 0;
+        while (i < n) {
+            std::vector<PrefetchSlot *> slots;
+            unsigned first = aPgno[i];
+            for (; i < n && aPgno[i] == first + slots.size() && CanPrefetch(aPgno[i]); i++) {
+                while (static_cast<long>(prefetched.size()) >= prefetchLimit && !prefetchOrder.empty()) {
+                    auto it = prefetched.find(prefetchOrder.front());
+                    if (it != prefetched.end()) {
+                        pthread_mutex_lock(&prefetchMutex);
+                        bool bDone = it->second->bDone;
+                        pthread_mutex_unlock(&prefetchMutex);
+                        if (!bDone)
+                            break;
+                        pAlloc->Free(it->second->pData);
+                        delete it->second;
+                        prefetched.erase(it);
+                    }
+                    prefetchOrder.pop_front();
+                }
+                if (static_cast<long>(prefetched.size()) >= prefetchLimit)
+                    break;
+                auto pData = static_cast<unsigned char *>(pAlloc->Allocate());
+                if (pData == nullptr)
+                    break;
+                auto pSlot = new PrefetchSlot{pData, Succeed, false};
+                prefetched[aPgno[i]] = pSlot;
+                prefetchOrder.push_back(aPgno[i]);
+                slots.push_back(pSlot);
+            }
+            if (slots.empty()) {
+                if (static_cast<long>(prefetched.size()) >= prefetchLimit)
+                    break;
+                i++;
+                continue;
+            }
+            prefetchGroup.Run(ThreadPool::Global(), [this, slots, first]() {
+                std::vector<unsigned char> buffer(slots.size() * pageSize);
+                int status = pFile->xRead(buffer.data(), static_cast<long>(buffer.size()),
+                                          static_cast<long>(first - 1) * pageSize);
+                for (size_t k = 0; k < slots.size(); k++)
+                    memcpy(slots[k]->pData, &buffer[k * pageSize], pageSize);
+                pthread_mutex_lock(&prefetchMutex);
+                for (auto pSlot: slots) {
+                    pSlot->status = status;
+                    pSlot->bDone = true;
+                }
+                pthread_cond_broadcast(&prefetchCond);
+                pthread_mutex_unlock(&prefetchMutex);
+            });
+        }
+        return Succeed;
+    }
+
+    void Pager::Advise(unsigned pgno, unsigned count) {
+        if (pgno == 0 || pgno > nPageFile)
+            return;
+        count = std::min(count, nPageFile - pgno + 1);
+        FileRange range{static_cast<long>(pgno - 1) * pageSize, static_cast<long>(count) * pageSize};
+        pFile->xFileControl(Fcntl_Prefetch, &range);
+    }
+
+    //the page read ahead goes into pPage,waiting for it if it is still being read
+    bool Pager::TakePrefetched(PgHdr *pPage) {
+        auto it = prefetched.find(pPage->pgno);
+        if (it == prefetched.end())
+            return false;
+        PrefetchSlot *pSlot = it->second;
+        prefetched.erase(it);
+        pthread_mutex_lock(&prefetchMutex);
+        while (!pSlot->bDone)
+            pthread_cond_wait(&prefetchCond, &prefetchMutex);
+        pthread_mutex_unlock(&prefetchMutex);
+        bool bRead = pSlot->status == Succeed;
+        if (bRead)
+            std::swap(pPage->pData, pSlot->pData);
+        pAlloc->Free(pSlot->pData);
+        delete pSlot;
+        return bRead;
+    }
+
+    void Pager::DropPrefetched() {
+        if (prefetched.empty() && prefetchOrder.empty())
+            return;
+        prefetchGroup.Wait();
+        for (auto &it: prefetched) {
+            pAlloc->Free(it.second->pData);
+            delete it.second;
+        }
+        prefetched.clear();
+        prefetchOrder.clear();
+    }
+
+    void Pager::Unref(PgHdr *pPage) {
+        assert(pPage->nRef > 0);
+        if (--pPage->nRef == 0 && !pPage->bDirty)
+            LruAdd(pPage);
+    }
+
+    int Pager::Write(PgHdr *pPage) {
+        if (eState != Pager_Writer)
+            return PermitError;
+        if (!pPage->bDirty) {
+            pPage->bDirty = true;
+            dirty.push_back(pPage);
+        }
+        return Succeed;
+    }
+
+    int Pager::Allocate(PgHdr **ppPage) {
+        if (eState != Pager_Writer)
+            return PermitError;
+        unsigned pgno = 0;
+        int status = Succeed;
+        if (allocHint > 1 && allocHint <= nPage)
+            status = TakeFree(allocHint, allocHint + 1, 1, &pgno);
+        if (status == Succeed && pgno == 0)
+            status = TakeFree(2, nPage + 1, FreeExtent, &pgno);
+        if (status == Succeed && pgno == 0)
+            status = TakeFree(2, nPage + 1, 1, &pgno);
+        if (status != Succeed)
+            return status;
+        if (pgno == 0)
+            pgno = ++nPage;
+        else
+            allocHint = pgno + 1;
+        *ppPage = Fresh(pgno);
+        return Succeed;
+    }
+
+    long Pager::MapSpan() const {
+        return static_cast<long>(pageSize) * 8;
+    }
+
+    int Pager::MapCount() const {
+        return (pageSize - Header_FreeMaps) / 4;
+    }
+
+    static bool IsMap(const unsigned char *pFirst, int nMap, unsigned pgno) {
+        for (int i = 0; i < nMap; i++)
+            if (Get4(&pFirst[Header_FreeMaps + 4 * i]) == pgno)
+                return true;
+        return false;
+    }
+
+    //*ppMap is nullptr when the run of pgno has no bitmap
+    int Pager::GetMap(PgHdr *pFirst, unsigned pgno, PgHdr **ppMap) {
+        *ppMap = nullptr;
+        long run = (pgno - 1) / MapSpan();
+        if (run >= MapCount())
+            return Succeed;
+        unsigned mapPgno = Get4(&pFirst->pData[Header_FreeMaps + 4 * run]);
+        return mapPgno == 0 ? Succeed : Get(mapPgno, ppMap);
+    }
+
+    int Pager::AddFree(PgHdr *pFirst, int delta) {
+        int status = Write(pFirst);
+        if (status == Succeed)
+            Put4(&pFirst->pData[Header_FreeCount], Get4(&pFirst->pData[Header_FreeCount]) + delta);
+        return status;
+    }
+
+    //takes the first free page in [from,limit) that starts a run of nRun free
+    //pages.*pPgno is 0 when there is none
+    int Pager::TakeFree(unsigned from, unsigned limit, long nRun, unsigned *pPgno) {
+        *pPgno = 0;
+        PgHdr *pFirst;
+        int status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        const long span = MapSpan();
+        long nMap = Get4(&pFirst->pData[Header_FreeCount]) == 0 ? 0 :
+                    std::min(static_cast<long>(MapCount()), (static_cast<long>(limit) - 2) / span + 1);
+        for (long run = (from - 1) / span; run < nMap && *pPgno == 0; run++) {
+            unsigned mapPgno = Get4(&pFirst->pData[Header_FreeMaps + 4 * run]);
+            PgHdr *pMap;
+            if (mapPgno == 0)
+                continue;
+            if ((status = Get(mapPgno, &pMap)) != Succeed)
+                break;
+            long start = std::max(0L, static_cast<long>(from) - 1 - run * span);
+            long length;
+            long bit = BitmapFindRun(pMap->pData, span, start, nRun, &length);
+            if (bit >= 0 && run * span + bit + 1 < limit) {
+                Write(pMap);
+                BitmapClear(pMap->pData, bit);
+                status = AddFree(pFirst, -1);
+                *pPgno = static_cast<unsigned>(run * span + bit + 1);
+            }
+            Unref(pMap);
+        }
+        Unref(pFirst);
+        return status;
+    }
+
+    int Pager::Free(unsigned pgno) {
+        if (eState != Pager_Writer)
+            return PermitError;
+        if (pgno <= 1 || pgno > nPage)
+            return Misuse;
+        PgHdr *pFirst;
+        int status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        long run = (pgno - 1) / MapSpan();
+        if (run >= MapCount()) {
+            Unref(pFirst);
+            return Succeed;
+        }
+        if (IsMap(pFirst->pData, MapCount(), pgno)) {
+            Unref(pFirst);
+            return Misuse;
+        }
+        unsigned char *pSlot = &pFirst->pData[Header_FreeMaps + 4 * run];
+        if (Get4(pSlot) == 0) {
+            //the page turns into the bitmap of its run
+            status = Write(pFirst);
+            if (status == Succeed) {
+                Put4(pSlot, pgno);
+                Unref(Fresh(pgno));
+            }
+            Unref(pFirst);
+            return status;
+        }
+        PgHdr *pMap;
+        status = Get(Get4(pSlot), &pMap);
+        if (status == Succeed) {
+            long bit = static_cast<long>((pgno - 1) % MapSpan());
+            if (BitmapTest(pMap->pData, bit))
+                status = Corrupt;
+            else {
+                Write(pMap);
+                BitmapSet(pMap->pData, bit);
+                status = AddFree(pFirst, 1);
+            }
+            Unref(pMap);
+        }
+        Unref(pFirst);
+        if (status == Succeed)
+            Drop(pgno);
+        return status;
+    }
+
+    int Pager::FreeCount(unsigned *pCount) {
+        *pCount = 0;
+        int status = BeginRead();
+        if (status != Succeed || nPage == 0)
+            return status;
+        PgHdr *pFirst;
+        status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        *pCount = Get4(&pFirst->pData[Header_FreeCount]);
+        Unref(pFirst);
+        return Succeed;
+    }
+
+    int Pager::PageState(unsigned pgno, int *pState) {
+        *pState = Page_Used;
+        if (pgno == 1)
+            return Succeed;
+        PgHdr *pFirst;
+        int status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        if (IsMap(pFirst->pData, MapCount(), pgno)) {
+            *pState = Page_FreeMap;
+            Unref(pFirst);
+            return Succeed;
+        }
+        PgHdr *pMap;
+        status = GetMap(pFirst, pgno, &pMap);
+        Unref(pFirst);
+        if (status != Succeed || pMap == nullptr)
+            return status;
+        if (BitmapTest(pMap->pData, static_cast<long>((pgno - 1) % MapSpan())))
+            *pState = Page_Free;
+        Unref(pMap);
+        return Succeed;
+    }
+
+    int Pager::Relocate(unsigned pgno, unsigned *pNew) {
+        if (eState != Pager_Writer)
+            return PermitError;
+        int state;
+        int status = pgno <= 1 || pgno > nPage ? Misuse : PageState(pgno, &state);
+        if (status == Succeed && state == Page_Free)
+            status = Misuse;
+        unsigned to = 0;
+        if (status == Succeed)
+            status = TakeFree(2, pgno, 1, &to);
+        if (status == Succeed && to == 0)
+            status = SpaceFull;
+        PgHdr *pOld;
+        if (status == Succeed)
+            status = Get(pgno, &pOld);
+        if (status != Succeed)
+            return status;
+        PgHdr *pPage = Fresh(to);
+        memcpy(pPage->pData, pOld->pData, pageSize);
+        Unref(pPage);
+        Unref(pOld);
+
+        if (state == Page_FreeMap) {
+            PgHdr *pFirst;
+            status = Get(1, &pFirst);
+            if (status != Succeed)
+                return status;
+            Write(pFirst);
+            for (int i = 0; i < MapCount(); i++)
+                if (Get4(&pFirst->pData[Header_FreeMaps + 4 * i]) == pgno)
+                    Put4(&pFirst->pData[Header_FreeMaps + 4 * i], to);
+            Unref(pFirst);
+        }
+        status = Free(pgno);
+        if (status == Succeed) {
+            generation++;
+            *pNew = to;
+        }
+        return status;
+    }
+
+    int Pager::TruncateFree() {
+        if (eState != Pager_Writer)
+            return PermitError;
+        PgHdr *pFirst;
+        int status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        const long span = MapSpan();
+        for (bool bMore = true; bMore && status == Succeed;) {
+            bMore = false;
+            while (nPage > 1 && status == Succeed) {
+                PgHdr *pMap;
+                if ((status = GetMap(pFirst, nPage, &pMap)) != Succeed || pMap == nullptr)
+                    break;
+                long end = static_cast<long>((nPage - 1) % span) + 1;
+                long n = BitmapRunBefore(pMap->pData, end);
+                if (n > 0) {
+                    Write(pMap);
+                    for (long bit = end - n; bit < end; bit++) {
+                        BitmapClear(pMap->pData, bit);
+                        Drop(static_cast<unsigned>(nPage - end + bit + 1));
+                    }
+                    status = AddFree(pFirst, -static_cast<int>(n));
+                    nPage -= static_cast<unsigned>(n);
+                }
+                Unref(pMap);
+                if (n < end)
+                    break;
+            }
+
+            //bitmaps of runs wholly past the end are not needed any more
+            for (int run = MapCount() - 1; run >= 0 && status == Succeed; run--) {
+                unsigned char *pSlot = &pFirst->pData[Header_FreeMaps + 4 * run];
+                unsigned mapPgno = Get4(pSlot);
+                if (mapPgno == 0 || run * span + 1 <= static_cast<long>(nPage))
+                    continue;
+                Write(pFirst);
+                Put4(pSlot, 0);
+                status = Free(mapPgno);
+                bMore = true;
+            }
+        }
+        Unref(pFirst);
+        return status;
+    }
+
+    //free pages hold nothing anybody reads.the writer lock keeps them free
+    //meanwhile,and once the log is checkpointed no reader sees them in use
+    int Pager::PunchFree() {
+        if (eState != Pager_Open)
+            return Misuse;
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        status = LockWait(pFile, Lock_Shared);
+        if (status == Succeed)
+            status = LockWait(pFile, Lock_Reserved);
+        if (status == Succeed && pWal)
+            status = WalCheckpoint(false, -1);
+        PgHdr *pFirst = nullptr;
+        if (status == Succeed && nPage > 0)
+            status = Get(1, &pFirst);
+        const long span = MapSpan();
+        bool bSupported = true;
+        for (int run = 0; pFirst && run < MapCount() && bSupported && status == Succeed; run++) {
+            unsigned mapPgno = Get4(&pFirst->pData[Header_FreeMaps + 4 * run]);
+            PgHdr *pMap;
+            if (mapPgno == 0 || (status = Get(mapPgno, &pMap)) != Succeed)
+                continue;
+            long bit = 0, length;
+            while (status == Succeed && (bit = BitmapFindRun(pMap->pData, span, bit, 1, &length)) >= 0) {
+                long first = run * span + bit + 1;
+                long last = std::min(first + length - 1, static_cast<long>(nPageFile));
+                if (first <= last) {
+                    FileRange range{(first - 1) * pageSize, (last - first + 1) * pageSize};
+                    status = pFile->xFileControl(Fcntl_PunchHole, &range);
+                }
+                if (status == NotFound) {
+                    bSupported = false;
+                    status = Succeed;
+                    break;
+                }
+                bit += length;
+            }
+            Unref(pMap);
+        }
+        if (pFirst)
+            Unref(pFirst);
+        int endStatus = EndRead();
+        return status == Succeed ? endStatus : status;
+    }
+
+    int Pager::Reserve(unsigned *pPgno) {
+        if (eState != Pager_Writer || bConcurrent)
+            return PermitError;
+        *pPgno = ++nPage;
+        return Succeed;
+    }
+
+    //in wal mode the pages go to the log as frames of the open transaction,
+    //the database file only gets them from a checkpoint like any other page
+    int Pager::WritePages(unsigned pgno, const unsigned char *pData, unsigned count) {
+        if (eState != Pager_Writer)
+            return PermitError;
+        assert(pgno > nPageCommitted && pgno + count - 1 <= nPage);
+        if (pWal) {
+            std::vector<unsigned> pgnos(count);
+            std::vector<const unsigned char *> pages(count);
+            for (unsigned i = 0; i < count; i++) {
+                pgnos[i] = pgno + i;
+                pages[i] = &pData[static_cast<long>(i) * pageSize];
+            }
+            return pWal->Append(pgnos.data(), pages.data(), static_cast<int>(count), 0);
+        }
+        int status = pFile->xWrite(pData, static_cast<long>(count) * pageSize, static_cast<long>(pgno - 1) * pageSize);
+        if (status == Succeed)
+            nPageFile = std::max(nPageFile, pgno + count - 1);
+        return status;
+    }
+
+    //in wal mode pages of the snapshot that are in the log come from their
+    //frames,the runs between them from the file
+    int Pager::ReadPages(unsigned pgno, unsigned char *pData, unsigned count) {
+        if (pgno == 0 || pgno + count - 1 > nPageCommitted)
+            return Corrupt;
+        if (!pWal)
+            return pFile->xRead(pData, static_cast<long>(count) * pageSize, static_cast<long>(pgno - 1) * pageSize);
+        unsigned i = 0;
+        while (i < count) {
+            int status;
+            unsigned frame = pWal->Find(pgno + i);
+            if (frame) {
+                status = pWal->ReadFrame(frame, &pData[static_cast<long>(i) * pageSize], pageSize);
+                i++;
+            } else {
+                unsigned j = i + 1;
+                while (j < count && pWal->Find(pgno + j) == 0)
+                    j++;
+                status = pFile->xRead(&pData[static_cast<long>(i) * pageSize], static_cast<long>(j - i) * pageSize,
+                                      static_cast<long>(pgno + i - 1) * pageSize);
+                i = j;
+            }
+            if (status != Succeed)
+                return status;
+        }
+        return Succeed;
+    }
+
+    int Pager::Peek(unsigned pgno, void *pData, int n) {
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        if (pgno == 0 || pgno > nPage || n > pageSize)
+            return Corrupt;
+        if (bConcurrent)
+            readSet.insert(pgno);
+        auto it = cache.find(pgno);
+        if (it != cache.end()) {
+            memcpy(pData, it->second->pData, n);
+            return Succeed;
+        }
+        unsigned frame = pWal ? pWal->Find(pgno) : 0;
+        if (frame)
+            return pWal->ReadFrame(frame, pData, n);
+        memset(pData, 0, n);
+        if (pgno > nPageFile)
+            return Succeed;
+        status = pFile->xRead(pData, n, static_cast<long>(pgno - 1) * pageSize);
+        return status == IOError_ReadShort ? Succeed : status;
+    }
+
+    int Pager::PageDescriptor(unsigned pgno, int *pFd) {
+        if (eState == Pager_Open || pgno == 0 || pgno > nPageFile || pgno > nPageCommitted)
+            return NotFound;
+        auto it = cache.find(pgno);
+        if ((it != cache.end() && it->second->bDirty) || (pWal && pWal->Find(pgno)))
+            return NotFound;
+        return pFile->xFileControl(Fcntl_FileDescriptor, pFd) == Succeed ? Succeed : NotFound;
+    }
+
+    int Pager::GetMeta(int index, unsigned *pValue) {
+        assert(index >= 0 && index < Pager_MetaCount);
+        PgHdr *pFirst;
+        int status = BeginRead();
+        if (status != Succeed)
+            return status;
+        if (nPage == 0) {
+            *pValue = 0;
+            return Succeed;
+        }
+        status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        *pValue = Get4(&pFirst->pData[Header_Meta + 4 * index]);
+        Unref(pFirst);
+        return Succeed;
+    }
+
+    int Pager::SetMeta(int index, unsigned value) {
+        assert(index >= 0 && index < Pager_MetaCount);
+        PgHdr *pFirst;
+        int status = Get(1, &pFirst);
+        if (status != Succeed)
+            return status;
+        status = Write(pFirst);
+        if (status == Succeed)
+            Put4(&pFirst->pData[Header_Meta + 4 * index], value);
+        Unref(pFirst);
+        return status;
+    }
+
+    Pager::Pager(tinySQL_VFS *pVFS, tinySQL_file *pFile, std::string path, int pageSize) :
+            pFile(pFile), pWal(nullptr), pShared(nullptr), pAlloc(PageAllocator::Get(pageSize)), path(std::move(path)), cache(), pLruFirst(nullptr), pLruLast(nullptr),
+            dirty(), nPageFile(0), nPageCommitted(0), changeCounter(0), journalMode(Journal_Direct), fileMtime(0),
+            bConcurrent(false), readSet(), metaSnapshot(), nPageSnapshot(0), allocHint(0),
+            prefetched(), prefetchOrder(), prefetchMutex(), prefetchCond(), prefetchGroup(), eState(Pager_Open),
+            pVFS(pVFS), pageSize(pageSize), nPage(0), cacheSize(2000), busyTimeoutMs(5000), generation(0),
+            autoCheckpoint(DefaultAutoCheckpoint), checkpointSliceMs(DefaultCheckpointSliceMs),
+            checkpointWriters(DefaultCheckpointWriters), prefetchLimit(DefaultPrefetchLimit), nPrefetchHit(0) {
+        pthread_mutex_init(&prefetchMutex, nullptr);
+        pthread_cond_init(&prefetchCond, nullptr);
+    }
+
+    Pager::~Pager() {
+        DropPrefetched();
+        pthread_cond_destroy(&prefetchCond);
+        pthread_mutex_destroy(&prefetchMutex);
+        for (auto &it: cache)
+            FreePage(it.second);
+        if (pWal)
+            pWal->Close();
+        if (pShared)
+            pShared->Close();
+        pFile->xClose();
+    }
+}
@@ -0,0 +1,265 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_PAGER_H
+#define SQLITELIKE_TINYSQL_PAGER_H
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "tinySQL_PageAlloc.h"
+#include "tinySQL_SharedCache.h"
+#include "tinySQL_ThreadPool.h"
+#include "tinySQL_VFS.h"
+#include "tinySQL_Wal.h"
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    static constexpr int DefaultPageSize = 4096;
+    static constexpr int MinPageSize = 512;
+    static constexpr int MaxPageSize = 32768;
+    static constexpr int Pager_MetaCount = 16;
+
+    //page 1 holds only the database header
+    static constexpr char Header_MagicString[16] = "tinySQL format1";
+    static constexpr int Header_PageSize = 16;
+    static constexpr int Header_PageCount = 20;
+    static constexpr int Header_ChangeCounter = 24;
+    static constexpr int Header_JournalMode = 28;
+    static constexpr int Header_Meta = 32;
+    static constexpr int Header_FreeCount = 96;
+    static constexpr int Header_FreeMaps = 128;      //to the end of the page,the free page bitmap of each run
+
+    static constexpr int Page_Used = 0;
+    static constexpr int Page_Free = 1;
+    static constexpr int Page_FreeMap = 2;
+
+    //a lock refused with Busying is tried again after waits doubling between these
+    static constexpr uint64_t LockBackoffMinNs = 100000;
+    static constexpr uint64_t LockBackoffMaxNs = 2000000;
+
+    //free pages Allocate looks for in a row before it takes a lone one
+    static constexpr long FreeExtent = 16;
+
+    static constexpr int Pager_Open = 0;
+    static constexpr int Pager_Reader = 1;
+    static constexpr int Pager_Writer = 2;
+
+    static constexpr unsigned Journal_Direct = 0;
+    static constexpr unsigned Journal_Wal = 1;
+
+    inline unsigned Get2(const unsigned char *p) {
+        return (p[0] << 8) | p[1];
+    }
+
+    inline void Put2(unsigned char *p, unsigned v) {
+        p[0] = static_cast<unsigned char>(v >> 8);
+        p[1] = static_cast<unsigned char>(v);
+    }
+
+    inline unsigned Get4(const unsigned char *p) {
+        return (static_cast<unsigned>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    inline void Put4(unsigned char *p, unsigned v) {
+        p[0] = static_cast<unsigned char>(v >> 24);
+        p[1] = static_cast<unsigned char>(v >> 16);
+        p[2] = static_cast<unsigned char>(v >> 8);
+        p[3] = static_cast<unsigned char>(v);
+    }
+
+    class Pager;
+
+    //a page read ahead of Get by a pool task into a frame of its own
+    struct PrefetchSlot {
+        unsigned char *pData;
+        int status;
+        bool bDone;
+    };
+
+    struct PgHdr {
+        unsigned pgno;
+        unsigned char *pData;
+        int nRef;
+        bool bDirty;
+        bool bInLru;
+        PgHdr *pLruPrev;     //clean unreferenced pages,least recently used first
+        PgHdr *pLruNext;
+        Pager *pPager;
+    };
+
+    //page cache over one database file.a transaction is opened by BeginRead or
+    //BeginWrite (Get starts a read transaction on its own) and ended by Commit,
+    //Rollback or EndRead.dirty pages stay in memory until Commit writes them in
+    //place,there is no rollback journal so a crash during Commit can tear pages.
+    //in wal mode Commit appends the pages to the log instead.a read transaction
+    //pins the log up to the last commit and takes no lock on the database,so
+    //readers and the one writer never wait for each other;a checkpoint copies
+    //the log back once no reader holds a snapshot of it
+    class Pager {
+    private:
+        tinySQL_file *pFile;
+        Wal *pWal;
+        SharedCache *pShared;
+        PageAllocator *const pAlloc;
+        const std::string path;
+        std::unordered_map<unsigned, PgHdr *> cache;
+        PgHdr *pLruFirst;
+        PgHdr *pLruLast;
+        std::vector<PgHdr *> dirty;
+        unsigned nPageFile;
+        unsigned nPageCommitted;
+        unsigned changeCounter;
+        unsigned journalMode;
+        long fileMtime;             //of the database file at the start of the transaction,tags shared pages
+        bool bConcurrent;
+        std::unordered_set<unsigned> readSet;           //pages a concurrent transaction looked at
+        std::vector<unsigned char> metaSnapshot;        //page 1 past the header when it began
+        unsigned nPageSnapshot;
+        unsigned allocHint;         //page after the last one Allocate reused
+        std::unordered_map<unsigned, PrefetchSlot *> prefetched;
+        std::deque<unsigned> prefetchOrder;             //oldest first,pages taken since may still be in it
+        pthread_mutex_t prefetchMutex;
+        pthread_cond_t prefetchCond;
+        TaskGroup prefetchGroup;
+        int eState;
+
+        Pager(tinySQL_VFS *pVFS, tinySQL_file *pFile, std::string path, int pageSize);
+        int LockWait(tinySQL_file *pLockFile, int eLock);
+        int Unlock();
+        int ReadHeader();
+        int WriteDirty();
+        int WriteWal();
+        int OpenWal();
+        void CloseWal();
+        int RefreshWal(std::vector<unsigned> *pChanged = nullptr);
+        int WalCheckpoint(bool bLeave, long budgetNs);
+        int ShipPinned(bool *pPinned);
+        int Validate();
+        void PageTag(unsigned frame, SharedTag *pTag) const;
+        void PublishDirty();
+        void ResetCache();
+        void EvictClean();
+        void LruAdd(PgHdr *pPage);
+        void LruRemove(PgHdr *pPage);
+        PgHdr *NewPage(unsigned pgno);
+        void FreePage(PgHdr *pPage);
+        void Drop(unsigned pgno);
+        PgHdr *Fresh(unsigned pgno);
+        long MapSpan() const;
+        int MapCount() const;
+        int GetMap(PgHdr *pFirst, unsigned pgno, PgHdr **ppMap);
+        int TakeFree(unsigned from, unsigned limit, long nRun, unsigned *pPgno);
+        int AddFree(PgHdr *pFirst, int delta);
+        bool CanPrefetch(unsigned pgno) const;
+        bool TakePrefetched(PgHdr *pPage);
+        void DropPrefetched();
+    public:
+        tinySQL_VFS *const pVFS;
+        const int pageSize;
+        unsigned nPage;
+        long cacheSize;             //most clean pages kept
+        int busyTimeoutMs;          //how long lock waits retry on Busying
+        unsigned long generation;   //bumped whenever cached page contents are thrown away
+        unsigned autoCheckpoint;    //log frames that make Commit try a checkpoint,0 never
+        int checkpointSliceMs;      //time a Commit spends copying the log back,0 copies it all at once
+        int checkpointWriters;      //runs of pages written to the file at once by a checkpoint
+        long prefetchLimit;         //most pages read ahead and not taken by Get yet,0 turns it off
+        long nPrefetchHit;          //Get misses served from pages read ahead
+
+        static int Open(tinySQL_VFS *pVFS, const char *zPath, int pageSize, Pager **ppPager);
+        int Close();
+
+        int BeginRead();
+        int EndRead();
+        int BeginWrite();
+        //write transaction in wal mode that holds no lock until Commit.Commit
+        //takes the writer lock only to check that no page the transaction read
+        //was committed by someone else since it began,and to append.on such a
+        //conflict the transaction is rolled back and Commit returns Busying.
+        //two transactions that both grow the file conflict as well,and Reserve
+        //is refused since its pages would bypass the check
+        int BeginConcurrent();
+        int Commit();
+        int Rollback();
+        int State() const;
+
+        //switching needs no transaction open on this connection,leaving wal
+        //mode also needs no other connection reading
+        int SetWalMode(bool bWal);
+        bool WalMode() const;
+        //Busying while another connection reads a snapshot of the log
+        int Checkpoint();
+        //zeros outside wal mode
+        void CheckpointProgress(CheckpointStats *pStats) const;
+
+        //pages read or committed by this connection go to the segment every
+        //process opening the file shares,and misses look there before the
+        //file.NotFound when the vfs will not name the file.the segment goes
+        //away once the last connection using it is closed
+        int UseSharedCache(long nSlot = DefaultSharedSlots);
+        SharedCache *Shared() const;
+
+        int Get(unsigned pgno, PgHdr **ppPage);
+        //reads pages ahead on the pool for Get to take,those cached,in the
+        //log or past the file are left out.what Get has not taken when the
+        //transaction ends is thrown away
+        int Prefetch(const unsigned *aPgno, int n);
+        //asks the os to read count pages from pgno into its cache
+        void Advise(unsigned pgno, unsigned count);
+        void Unref(PgHdr *pPage);
+        int Write(PgHdr *pPage);
+
+        //free pages are kept in bitmaps,one per run of pageSize * 8 pages,
+        //listed on page 1 after the header.a run's bitmap is the first page
+        //freed in it,runs past the end of the list keep their pages.Allocate
+        //takes a free page when there is one,the one after the page it took
+        //last if that is free,else the start of the first run of FreeExtent
+        //free pages,else the first free page,and grows the file otherwise
+        int Allocate(PgHdr **ppPage);
+        //the caller holds no reference to the page and nothing points to it
+        int Free(unsigned pgno);
+        int FreeCount(unsigned *pCount);
+        int PageState(unsigned pgno, int *pState);
+        //copies a page to the first free page before it and frees it,pages
+        //that point to it are left to the caller except for bitmaps.SpaceFull
+        //when no free page comes before it
+        int Relocate(unsigned pgno, unsigned *pNew);
+        //takes the free pages at the end off the page count,the file shrinks
+        //at Commit,in wal mode at the checkpoint after it
+        int TruncateFree();
+        //hands the space of free pages inside the file back to the file
+        //system.needs no transaction open on this connection,in wal mode it
+        //checkpoints first and gets Busying while another connection reads
+        int PunchFree();
+
+        //page numbers past the end for pages that bypass the cache.WritePages
+        //writes such pages straight to the file,in wal mode to the log as
+        //frames of the transaction.readers never look at them before Commit
+        //counts them in the header
+        int Reserve(unsigned *pPgno);
+        int WritePages(unsigned pgno, const unsigned char *pData, unsigned count);
+
+        //positional read of committed pages past the cache,safe from any
+        //thread while the read transaction that counted them stays open
+        int ReadPages(unsigned pgno, unsigned char *pData, unsigned count);
+        //the first n bytes of a page,from the cache when it is there and read
+        //around it otherwise
+        int Peek(unsigned pgno, void *pData, int n);
+        //the descriptor to read the page this transaction sees from,at
+        //(pgno - 1) * pageSize.NotFound when its newest image is in the cache
+        //or the log,or the file has no descriptor
+        int PageDescriptor(unsigned pgno, int *pFd);
+
+        int GetMeta(int index, unsigned *pValue);
+        int SetMeta(int index, unsigned value);
+
+        ~Pager();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_PAGER_H
@@ -0,0 +1,96 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <climits>
+#include "tinySQL_Prefetch.h"
+
+namespace tinySQL {
+
+    void Prefetcher::Issue() {
+        std::vector<unsigned> pages;
+        while (nHintIssued < hinted.size() && nHintIssued < window)
+            pages.push_back(hinted[nHintIssued++]);
+        if (nMatch > 0) {
+            long end = static_cast<long>(last) + static_cast<long>(window) * stride;
+            if (stride > 0)
+                next = std::max(next, static_cast<long>(last) + stride);
+            else
+                next = std::min(next, static_cast<long>(last) + stride);
+            while ((stride > 0 ? next <= end : next >= end) && next >= 1 && next <= pPager->nPage) {
+                pages.push_back(static_cast<unsigned>(next));
+                next += stride;
+            }
+            //one more window of a forward run goes to the os cache only
+            if (stride == 1 && advised < end + static_cast<long>(window)) {
+                long from = std::max(advised, end + 1);
+                pPager->Advise(static_cast<unsigned>(from), static_cast<unsigned>(end + window + 1 - from));
+                advised = end + window + 1;
+            }
+        }
+        if (!pages.empty()) {
+            pPager->Prefetch(pages.data(), static_cast<int>(pages.size()));
+            nIssued += static_cast<long>(pages.size());
+        }
+    }
+
+    void Prefetcher::Access(unsigned pgno) {
+        if (pgno == last)
+            return;
+        nAccess++;
+        bool bExpected = false;
+        auto it = std::find(hinted.begin(), hinted.end(), pgno);
+        if (it != hinted.end()) {
+            size_t passed = it - hinted.begin() + 1;
+            hinted.erase(hinted.begin(), it + 1);
+            nHintIssued -= std::min(nHintIssued, passed);
+            bExpected = true;
+        } else {
+            hinted.clear();
+            nHintIssued = 0;
+        }
+        long delta = last ? static_cast<long>(pgno) - static_cast<long>(last) : 0;
+        if (delta != 0 && delta == stride) {
+            nMatch++;
+            bExpected = true;
+        } else {
+            stride = delta;
+            nMatch = 0;
+            next = stride > 0 ? 0 : LONG_MAX;
+            advised = 0;
+        }
+        last = pgno;
+        if (bExpected) {
+            nExpected++;
+            window = std::min(window * 2, PrefetchMaxWindow);
+        } else
+            window = PrefetchMinWindow;
+        Issue();
+    }
+
+    void Prefetcher::Hint(const unsigned *aPgno, int n) {
+        hinted.assign(aPgno, aPgno + std::min(n, static_cast<int>(PrefetchMaxHint)));
+        nHintIssued = 0;
+        Issue();
+    }
+
+    bool Prefetcher::NeedHint() const {
+        return hinted.empty() && nMatch == 0;
+    }
+
+    void Prefetcher::Reset() {
+        hinted.clear();
+        nHintIssued = 0;
+        last = 0;
+        stride = 0;
+        nMatch = 0;
+        next = 0;
+        advised = 0;
+        window = PrefetchMinWindow;
+    }
+
+    Prefetcher::Prefetcher(Pager *pPager) :
+            hinted(), nHintIssued(0), last(0), stride(0), nMatch(0), next(0), advised(0), window(PrefetchMinWindow),
+            pPager(pPager), nAccess(0), nExpected(0), nIssued(0) {
+    }
+}
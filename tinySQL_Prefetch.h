@@ -0,0 +1,52 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_PREFETCH_H
+#define SQLITELIKE_TINYSQL_PREFETCH_H
+
+#include <deque>
+#include "tinySQL_Pager.h"
+
+namespace tinySQL {
+
+    static constexpr unsigned PrefetchMinWindow = 4;
+    static constexpr unsigned PrefetchMaxWindow = 64;
+    static constexpr unsigned PrefetchMaxHint = 512;
+
+    //watches the leaf pages one cursor moves through and has the pager read
+    //the next ones ahead of it.pages named by Hint,the rest of the children of
+    //the parent the cursor walks,are read first;a run of equal steps between
+    //pages (1 for a tree loaded in key order) is followed on past them and the
+    //os is asked to read further still.the window of pages read ahead doubles
+    //while the guesses come true and falls back on a miss
+    class Prefetcher {
+    private:
+        std::deque<unsigned> hinted;    //not visited yet,in order
+        size_t nHintIssued;             //of hinted,asked for already
+        unsigned last;
+        long stride;
+        int nMatch;                     //steps in a row equal to stride
+        long next;                      //first page of the stride run not asked for
+        long advised;                   //the os was asked for the pages before this one
+        unsigned window;
+
+        void Issue();
+    public:
+        Pager *const pPager;
+        long nAccess;
+        long nExpected;                 //pages that were hinted or on the stride
+        long nIssued;
+
+        //the cursor moved onto pgno
+        void Access(unsigned pgno);
+        //pages the cursor reaches next,in order,replacing earlier hints
+        void Hint(const unsigned *aPgno, int n);
+        //nothing is known about where the cursor goes after this page
+        bool NeedHint() const;
+        void Reset();
+
+        explicit Prefetcher(Pager *pPager);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_PREFETCH_H
@@ -4,15 +4,15 @@
 #include <pthread.h>
 #include <cstring>
 #include <cassert>
+#include "tinySQL_LockProfile.h"
 #include "tinySQL_VFS.h"
 namespace tinySQL{
     struct RandomGenerator{
-        pthread_mutex_t mutex;
+        ProfiledMutex mutex;
         unsigned char i,j;
         unsigned char s[256];
 
-        RandomGenerator(): mutex(),s(),i(0),j(0){
-            pthread_mutex_init(& mutex, nullptr);
+        RandomGenerator(): mutex("random"),s(),i(0),j(0){
             tinySQL_VFS * pVFS = tinySQL_VFS::VFSGet(0);
             char k[256];
             unsigned char t;
@@ -29,9 +29,6 @@ namespace tinySQL{
                 s[i] = t;
             }
         }
-        ~RandomGenerator(){
-            pthread_mutex_destroy(& mutex);
-        }
     };
 
     void tinySQL_Randomness(int nByte,void *pBuf){
@@ -39,7 +36,7 @@ namespace tinySQL{
         assert(nByte > 0 && pBuf);
         auto zBuf = static_cast< unsigned char*>(pBuf);
         unsigned char t;
-        pthread_mutex_lock(&random.mutex);
+        random.mutex.Lock();
         for(;nByte;nByte--){
             random.i++;
             t = random.s[random.i];
@@ -49,7 +46,7 @@ namespace tinySQL{
             t += random.s[random.i];
             *(zBuf++) = random.s[t];
         }
-        pthread_mutex_unlock(&random.mutex);
+        random.mutex.Unlock();
     }
 
 
@@ -0,0 +1,478 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <cerrno>
+#include "tinySQL_Replica.h"
+
+namespace tinySQL {
+
+    //a socket is sent to without SIGPIPE,anything else is written
+    static int SendAll(int fd, const unsigned char *p, long n) {
+        while (n > 0) {
+            ssize_t m = OsSend(fd, p, n, MSG_NOSIGNAL);
+            if (m < 0 && errno == ENOTSOCK)
+                m = OsWrite(fd, p, n);
+            if (m < 0) {
+                if (errno == EINTR)
+                    continue;
+                return IOError_Write;
+            }
+            p += m;
+            n -= m;
+        }
+        return Succeed;
+    }
+
+    static int RecvAll(int fd, unsigned char *p, long n) {
+        while (n > 0) {
+            ssize_t m = OsRead(fd, p, n);
+            if (m < 0 && errno == EINTR)
+                continue;
+            if (m <= 0)
+                return IOError_Read;
+            p += m;
+            n -= m;
+        }
+        return Succeed;
+    }
+
+    static void PutMark(unsigned char *p, const ReplicaMark &mark) {
+        Put4(p, static_cast<unsigned>(mark.salts >> 32));
+        Put4(p + 4, static_cast<unsigned>(mark.salts));
+        Put4(p + 8, mark.frame);
+    }
+
+    static ReplicaMark GetMark(const unsigned char *p) {
+        return ReplicaMark{(static_cast<uint64_t>(Get4(p)) << 32) | Get4(p + 4), Get4(p + 8)};
+    }
+
+    //a mark file holds Wal_ShipMagic and the mark,false when there is none
+    static int ReadMarkFile(tinySQL_VFS *pVFS, const std::string &name, ReplicaMark *pMark, bool *pValid) {
+        *pValid = false;
+        int bExists = 0;
+        int status = pVFS->xAccess(name.c_str(), Access_Exists, &bExists);
+        if (status != Succeed || !bExists)
+            return status;
+        tinySQL_file *pFile = nullptr;
+        if ((status = pVFS->xOpen(name.c_str(), &pFile, Open_ReadOnly, nullptr)) != Succeed)
+            return status;
+        unsigned char buff[Wal_ShipMarkSize];
+        status = pFile->xRead(buff, Wal_ShipMarkSize, 0);
+        pFile->xClose();
+        if (status == IOError_ReadShort)
+            return Succeed;
+        if (status == Succeed && Get4(buff) == Wal_ShipMagic) {
+            *pMark = GetMark(&buff[4]);
+            *pValid = true;
+        }
+        return status;
+    }
+
+    static int ReadPageCount(tinySQL_file *pDb, unsigned *pnPage) {
+        unsigned char header[Header_Meta];
+        int status = pDb->xRead(header, sizeof(header), 0);
+        *pnPage = Get4(&header[Header_PageCount]);
+        return status;
+    }
+
+    static int WriteMarkFile(tinySQL_file *pFile, const ReplicaMark &mark) {
+        unsigned char buff[Wal_ShipMarkSize];
+        Put4(buff, Wal_ShipMagic);
+        PutMark(&buff[4], mark);
+        return pFile->xWrite(buff, Wal_ShipMarkSize, 0);
+    }
+
+    LogShipper::LogShipper(tinySQL_VFS *pVFS, std::string path, int fdIn, int fdOut) :
+            pWal(nullptr), pDb(nullptr), pPin(nullptr), inFlight(), message(), shipped(0), shippedSize(0),
+            bFull(false), pVFS(pVFS), path(std::move(path)), fdIn(fdIn), fdOut(fdOut), window(DefaultReplicaWindow),
+            nBatch(0), nPageShipped(0), nFullCopy(0) {
+    }
+
+    LogShipper::~LogShipper() {
+        if (pWal)
+            pWal->Close();
+        if (pDb)
+            pDb->xClose();
+        if (pPin)
+            pPin->xClose();
+    }
+
+    //a shipper that fails to start leaves "<db>-ship" as it was,the next one
+    //still finds the follower's mark there
+    int LogShipper::Open(tinySQL_VFS *pVFS, const char *zDb, int fdIn, int fdOut, LogShipper **ppShipper) {
+        assert(pVFS && ppShipper);
+        *ppShipper = nullptr;
+        auto pShipper = new LogShipper(pVFS, zDb, fdIn, fdOut);
+        int status = pVFS->xOpen(zDb, &pShipper->pDb, Open_ReadOnly, nullptr);
+        unsigned char header[Header_Meta];
+        if (status == Succeed)
+            status = pShipper->pDb->xRead(header, sizeof(header), 0);
+        if (status == Succeed && (memcmp(header, Header_MagicString, sizeof(Header_MagicString)) != 0 ||
+                                  Get4(&header[Header_JournalMode]) != Journal_Wal))
+            status = Misuse;
+        if (status == IOError_ReadShort)
+            status = Misuse;
+        if (status == Succeed)
+            status = Wal::Open(pVFS, pShipper->path + "-wal", static_cast<int>(Get4(&header[Header_PageSize])),
+                               &pShipper->pWal);
+        if (status == Succeed)
+            status = pVFS->xOpen((pShipper->path + Wal_ShipSuffix).c_str(), &pShipper->pPin,
+                                 Open_Create | Open_ReadWrite, nullptr);
+        if (status == Succeed)
+            status = pShipper->Handshake();
+        if (status != Succeed) {
+            delete pShipper;
+            return status;
+        }
+        *ppShipper = pShipper;
+        return Succeed;
+    }
+
+    int LogShipper::Close(bool bKeepPin) {
+        int status = Succeed;
+        if (!bKeepPin) {
+            pPin->xClose();
+            pPin = nullptr;
+            status = pVFS->xDelete((path + Wal_ShipSuffix).c_str());
+        }
+        delete this;
+        return status;
+    }
+
+    //the follower goes on from its mark when that is in the log,or when it is
+    //the mark kept for the log before,which was started over only once the
+    //follower had all of it.the pin is set to where it goes on from before
+    //the shared lock that keeps the log from starting over is let go
+    int LogShipper::Handshake() {
+        unsigned char hello[Replica_HelloSize];
+        int status = RecvAll(fdIn, hello, Replica_HelloSize);
+        if (status != Succeed)
+            return status;
+        if (Get4(hello) != Replica_Hello)
+            return Corrupt;
+        ReplicaMark theirs = GetMark(&hello[8]);
+        bool bSamePageSize = static_cast<int>(Get4(&hello[4])) == pWal->pageSize;
+
+        int waited = 0;
+        while ((status = pWal->pFile->xLock(Lock_Shared)) == Busying && waited++ < Replica_LockWaitMs)
+            pVFS->xSleep(1000);
+        if (status != Succeed)
+            return status;
+        bool bReset;
+        ReplicaMark pin{};
+        bool bPin = false;
+        status = pWal->Refresh(&bReset, nullptr);
+        if (status == Succeed)
+            status = ReadMarkFile(pVFS, path + Wal_ShipSuffix, &pin, &bPin);
+        if (status == Succeed) {
+            if (bSamePageSize && theirs.salts == pWal->Salts() && theirs.frame <= pWal->mxFrame)
+                shipped = theirs.frame;
+            else if (bSamePageSize && bPin && theirs.salts == pin.salts && theirs.frame == pin.frame)
+                shipped = 0;
+            else {
+                shipped = 0;
+                bFull = true;
+            }
+            if (shipped)
+                status = pWal->CommitSize(shipped, &shippedSize);
+            else if (!bFull)
+                status = ReadPageCount(pDb, &shippedSize);
+        }
+        if (status == Succeed)
+            status = WritePin(ReplicaMark{pWal->Salts(), shipped});
+        pWal->pFile->xUnlock(Lock_None);
+        return status;
+    }
+
+    int LogShipper::WritePin(const ReplicaMark &mark) {
+        return WriteMarkFile(pPin, mark);
+    }
+
+    //pages of the snapshot come from the log,the rest from the database
+    //file.a checkpoint may write pages of a later commit to the file during a
+    //full copy,those are in the log after the snapshot and go in the next batch
+    int LogShipper::SendPages(const std::vector<unsigned> &pages, unsigned nPage, unsigned flags) {
+        const int pageSize = pWal->pageSize;
+        const long entrySize = 4 + pageSize;
+        size_t i = 0;
+        do {
+            unsigned n = static_cast<unsigned>(std::min(pages.size() - i, static_cast<size_t>(Replica_BatchPages)));
+            bool bLast = i + n == pages.size();
+            message.resize(Replica_BatchHeaderSize + n * entrySize);
+            unsigned char *p = message.data();
+            Put4(p, Replica_Batch);
+            Put4(p + 4, flags | (bLast ? Replica_LastPart : 0));
+            Put4(p + 8, static_cast<unsigned>(pageSize));
+            Put4(p + 12, nPage);
+            Put4(p + 16, n);
+            PutMark(p + 20, ReplicaMark{pWal->Salts(), pWal->mxFrame});
+            p += Replica_BatchHeaderSize;
+            for (unsigned k = 0; k < n; k++, p += entrySize) {
+                unsigned pgno = pages[i + k];
+                Put4(p, pgno);
+                unsigned frame = pWal->Find(pgno);
+                int status = frame ? pWal->ReadFrame(frame, p + 4, pageSize)
+                                   : pDb->xRead(p + 4, pageSize, static_cast<long>(pgno - 1) * pageSize);
+                if (status != Succeed && status != IOError_ReadShort)
+                    return status;
+            }
+            int status = SendAll(fdOut, message.data(), static_cast<long>(message.size()));
+            if (status != Succeed)
+                return status;
+            i += n;
+        } while (i < pages.size());
+        inFlight.push_back(ReplicaMark{pWal->Salts(), pWal->mxFrame});
+        nBatch++;
+        nPageShipped += static_cast<long>(pages.size());
+        return Succeed;
+    }
+
+    int LogShipper::Ship() {
+        int status = PollAcks(false);
+        if (status != Succeed)
+            return status;
+        if ((status = pWal->pFile->xLock(Lock_Shared)) != Succeed)
+            return status == Busying ? Succeed : status;
+        bool bReset = false;
+        status = pWal->Refresh(&bReset, nullptr);
+        if (status == Succeed && bReset)
+            shipped = 0;
+        std::vector<unsigned> pages;
+        if (status == Succeed && bFull) {
+            unsigned nPage = pWal->dbSize;
+            if (pWal->mxFrame == 0)
+                status = ReadPageCount(pDb, &nPage);
+            for (unsigned pgno = 1; pgno <= nPage; pgno++)
+                pages.push_back(pgno);
+            if (status == Succeed)
+                status = SendPages(pages, nPage, Replica_FullCopy);
+            if (status == Succeed) {
+                bFull = false;
+                nFullCopy++;
+                shippedSize = nPage;
+            }
+        } else if (status == Succeed && pWal->mxFrame != shipped) {
+            pWal->PagesSince(shipped, &pages);
+            //pages the database grew by that have no frame of their own were
+            //written to the file,they are read from there
+            size_t nLogged = pages.size();
+            for (unsigned pgno = shippedSize + 1; pgno <= pWal->dbSize; pgno++)
+                if (pWal->Find(pgno) <= shipped)
+                    pages.push_back(pgno);
+            if (pages.size() != nLogged)
+                std::sort(pages.begin(), pages.end());
+            status = SendPages(pages, pWal->dbSize, 0);
+            if (status == Succeed)
+                shippedSize = pWal->dbSize;
+        }
+        if (status == Succeed)
+            shipped = pWal->mxFrame;
+        pWal->pFile->xUnlock(Lock_None);
+        while (status == Succeed && static_cast<int>(inFlight.size()) >= window)
+            status = PollAcks(true);
+        return status;
+    }
+
+    int LogShipper::Drain() {
+        int status = Succeed;
+        while (status == Succeed && !inFlight.empty())
+            status = ReadAck();
+        return status;
+    }
+
+    int LogShipper::ReadAck() {
+        unsigned char ack[Replica_AckSize];
+        int status = RecvAll(fdIn, ack, Replica_AckSize);
+        if (status != Succeed)
+            return status;
+        ReplicaMark mark = GetMark(&ack[4]);
+        if (Get4(ack) != Replica_Ack || inFlight.empty() || inFlight.front().salts != mark.salts ||
+            inFlight.front().frame != mark.frame)
+            return Corrupt;
+        inFlight.pop_front();
+        return WritePin(mark);
+    }
+
+    //bWait waits for one ack,the ones that are there already are read either way
+    int LogShipper::PollAcks(bool bWait) {
+        for (;;) {
+            struct pollfd pfd{fdIn, POLLIN, 0};
+            int n = OsPoll(&pfd, 1, bWait ? -1 : 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return IOError_Read;
+            if (n == 0)
+                return Succeed;
+            int status = ReadAck();
+            if (status != Succeed)
+                return status;
+            bWait = false;
+        }
+    }
+
+    LogFollower::LogFollower(tinySQL_VFS *pVFS, std::string path, int fdIn, int fdOut) :
+            pPager(nullptr), pCopy(nullptr), mark{0, 0}, message(), pVFS(pVFS), path(std::move(path)),
+            fdIn(fdIn), fdOut(fdOut), nBatch(0), nPageApplied(0), nFullCopy(0) {
+    }
+
+    LogFollower::~LogFollower() {
+        if (pPager)
+            pPager->Close();
+        if (pCopy)
+            pCopy->xClose();
+    }
+
+    int LogFollower::Open(tinySQL_VFS *pVFS, const char *zPath, int fdIn, int fdOut, LogFollower **ppFollower) {
+        assert(pVFS && ppFollower);
+        *ppFollower = nullptr;
+        auto pFollower = new LogFollower(pVFS, zPath, fdIn, fdOut);
+        int bExists = 0;
+        int status = pVFS->xAccess(zPath, Access_Exists, &bExists);
+        if (status == Succeed && bExists)
+            status = Pager::Open(pVFS, zPath, DefaultPageSize, &pFollower->pPager);
+        if (status == Succeed)
+            status = pFollower->Hello();
+        if (status != Succeed) {
+            delete pFollower;
+            return status;
+        }
+        *ppFollower = pFollower;
+        return Succeed;
+    }
+
+    int LogFollower::Close() {
+        delete this;
+        return Succeed;
+    }
+
+    //a page size of 0 asks for a full copy
+    int LogFollower::Hello() {
+        bool bValid = false;
+        int status = ReadMarkFile(pVFS, path + Replica_MarkSuffix, &mark, &bValid);
+        if (status != Succeed)
+            return status;
+        if (!bValid || !pPager || !pPager->WalMode())
+            mark = ReplicaMark{0, 0};
+        unsigned char hello[Replica_HelloSize];
+        Put4(hello, Replica_Hello);
+        Put4(&hello[4], mark.salts || mark.frame ? static_cast<unsigned>(pPager->pageSize) : 0);
+        PutMark(&hello[8], mark);
+        return SendAll(fdOut, hello, Replica_HelloSize);
+    }
+
+    //the copy is written under nobody,its log and mark are of the database before
+    int LogFollower::BeginCopy() {
+        if (pPager) {
+            pPager->Close();
+            pPager = nullptr;
+        }
+        pVFS->xDelete((path + "-wal").c_str());
+        pVFS->xDelete((path + Replica_MarkSuffix).c_str());
+        nFullCopy++;
+        return pVFS->xOpen(path.c_str(), &pCopy, Open_Create | Open_ReadWrite, nullptr);
+    }
+
+    int LogFollower::EndCopy(unsigned nPage, int pageSize) {
+        int status = pCopy->xTruncate(static_cast<long>(nPage) * pageSize);
+        if (status == Succeed)
+            status = pCopy->xSync(0);
+        pCopy->xClose();
+        pCopy = nullptr;
+        if (status == Succeed)
+            status = Pager::Open(pVFS, path.c_str(), pageSize, &pPager);
+        return status;
+    }
+
+    int LogFollower::WriteMark() {
+        tinySQL_file *pFile = nullptr;
+        int status = pVFS->xOpen((path + Replica_MarkSuffix).c_str(), &pFile, Open_Create | Open_ReadWrite, nullptr);
+        if (status != Succeed)
+            return status;
+        status = WriteMarkFile(pFile, mark);
+        pFile->xClose();
+        return status;
+    }
+
+    //the parts of a batch are applied as they come,the last one commits
+    int LogFollower::Apply() {
+        int status;
+        for (;;) {
+            unsigned char header[Replica_BatchHeaderSize];
+            if ((status = RecvAll(fdIn, header, Replica_BatchHeaderSize)) != Succeed)
+                break;
+            unsigned flags = Get4(&header[4]);
+            int pageSize = static_cast<int>(Get4(&header[8]));
+            unsigned nPage = Get4(&header[12]);
+            unsigned n = Get4(&header[16]);
+            if (Get4(header) != Replica_Batch || n > Replica_BatchPages || pageSize < MinPageSize ||
+                pageSize > MaxPageSize || (!(flags & Replica_FullCopy) && (!pPager || pPager->pageSize != pageSize))) {
+                status = Corrupt;
+                break;
+            }
+            const long entrySize = 4 + pageSize;
+            message.resize(n * entrySize);
+            if ((status = RecvAll(fdIn, message.data(), static_cast<long>(message.size()))) != Succeed)
+                break;
+
+            if (flags & Replica_FullCopy) {
+                if (!pCopy && (status = BeginCopy()) != Succeed)
+                    break;
+            } else if (pPager->State() != Pager_Writer) {
+                if ((status = pPager->BeginWrite()) != Succeed)
+                    break;
+            }
+            if (pPager)
+                pPager->nPage = std::max(pPager->nPage, nPage);
+            const unsigned char *p = message.data();
+            for (unsigned k = 0; k < n && status == Succeed; k++, p += entrySize) {
+                unsigned pgno = Get4(p);
+                if (pgno == 0 || pgno > nPage) {
+                    status = Corrupt;
+                } else if (pCopy) {
+                    status = pCopy->xWrite(p + 4, pageSize, static_cast<long>(pgno - 1) * pageSize);
+                } else {
+                    PgHdr *pPage;
+                    if ((status = pPager->Get(pgno, &pPage)) != Succeed)
+                        break;
+                    if ((status = pPager->Write(pPage)) == Succeed)
+                        memcpy(pPage->pData, p + 4, pageSize);
+                    pPager->Unref(pPage);
+                }
+            }
+            if (status != Succeed)
+                break;
+            nPageApplied += n;
+            if (!(flags & Replica_LastPart))
+                continue;
+
+            if (pCopy)
+                status = EndCopy(nPage, pageSize);
+            else {
+                pPager->nPage = nPage;
+                status = pPager->Commit();
+            }
+            if (status == Succeed) {
+                mark = GetMark(&header[20]);
+                status = WriteMark();
+            }
+            if (status == Succeed) {
+                unsigned char ack[Replica_AckSize];
+                Put4(ack, Replica_Ack);
+                PutMark(&ack[4], mark);
+                status = SendAll(fdOut, ack, Replica_AckSize);
+            }
+            if (status == Succeed)
+                nBatch++;
+            return status;
+        }
+        if (pPager && pPager->State() == Pager_Writer)
+            pPager->Rollback();
+        return status;
+    }
+
+    ReplicaMark LogFollower::Mark() const {
+        return mark;
+    }
+}
@@ -0,0 +1,131 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_REPLICA_H
+#define SQLITELIKE_TINYSQL_REPLICA_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "tinySQL_Pager.h"
+#include "tinySQL_VFS.h"
+#include "tinySQL_Wal.h"
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    static constexpr unsigned Replica_Hello = 0x74735248;
+    static constexpr unsigned Replica_Batch = 0x74735242;
+    static constexpr unsigned Replica_Ack = 0x74735241;
+    static constexpr int Replica_HelloSize = 20;
+    static constexpr int Replica_BatchHeaderSize = 32;
+    static constexpr int Replica_AckSize = 16;
+    static constexpr unsigned Replica_LastPart = 1;     //the follower commits after this message
+    static constexpr unsigned Replica_FullCopy = 2;     //the message is part of a copy of the whole database
+    static constexpr unsigned Replica_BatchPages = 64;  //pages per message,a batch may take several
+    static constexpr int DefaultReplicaWindow = 8;      //batches sent ahead of their acks
+    static constexpr int Replica_LockWaitMs = 5000;
+    static constexpr const char *Replica_MarkSuffix = "-mark";
+
+    //where a follower is in the primary's log,the salts of the log and the last frame it has
+    struct ReplicaMark {
+        uint64_t salts;
+        unsigned frame;
+    };
+
+    //sends what a database in wal mode commits to one follower over a
+    //connected socket or a pair of pipes.every Ship reads the frames committed
+    //since the last one from the log,under a shared lock on it like a reader,
+    //and sends the newest image of each page as one batch the follower
+    //applies in one transaction.batches are sent without waiting for acks
+    //until Window of them are outstanding.
+    //the mark the follower acknowledged last is kept in "<db>-ship",a
+    //checkpoint does not start the log over while it is behind,so a follower
+    //that comes back picks up where it was.one that cannot,or shows up with
+    //a different database,gets a copy of every page first.
+    //writes to a pipe whose reader went away raise SIGPIPE,sockets are sent
+    //to without it
+    class LogShipper {
+    private:
+        Wal *pWal;                  //own view of the primary's log
+        tinySQL_file *pDb;
+        tinySQL_file *pPin;         //"<db>-ship"
+        std::deque<ReplicaMark> inFlight;
+        std::vector<unsigned char> message;
+        unsigned shipped;           //frame of the log sent up to
+        unsigned shippedSize;       //page count the follower has once it applies what was sent
+        bool bFull;                 //the next batch is a copy of the whole database
+
+        LogShipper(tinySQL_VFS *pVFS, std::string path, int fdIn, int fdOut);
+        int Handshake();
+        int SendPages(const std::vector<unsigned> &pages, unsigned nPage, unsigned flags);
+        int ReadAck();
+        int PollAcks(bool bWait);
+        int WritePin(const ReplicaMark &mark);
+    public:
+        tinySQL_VFS *const pVFS;
+        const std::string path;
+        const int fdIn;             //acks come from here
+        const int fdOut;
+        int window;
+        long nBatch;
+        long nPageShipped;
+        long nFullCopy;
+
+        //waits for the follower to say what it has.Misuse when the database
+        //is not in wal mode
+        static int Open(tinySQL_VFS *pVFS, const char *zDb, int fdIn, int fdOut, LogShipper **ppShipper);
+        //bKeepPin leaves the log held for a shipper that takes over later,the
+        //database never starts its log over until one does
+        int Close(bool bKeepPin = false);
+
+        //sends what was committed since the last call,nothing while a
+        //checkpoint starts the log over.it only waits when window batches are
+        //not acknowledged yet
+        int Ship();
+        //waits until the follower acknowledged everything sent
+        int Drain();
+
+        ~LogShipper();
+    };
+
+    //keeps a copy of a primary's database up to date from what its
+    //LogShipper sends.batches are committed to the copy through a Pager in wal
+    //mode,so readers with a Pager of their own on the copy get the snapshot of
+    //a batch the primary committed;a full copy is written to the file
+    //directly and nobody reads it meanwhile.the mark of the last batch is kept
+    //in "<copy>-mark" after it is committed and acknowledged after that
+    class LogFollower {
+    private:
+        Pager *pPager;
+        tinySQL_file *pCopy;        //the file during a full copy
+        ReplicaMark mark;
+        std::vector<unsigned char> message;
+
+        LogFollower(tinySQL_VFS *pVFS, std::string path, int fdIn, int fdOut);
+        int Hello();
+        int BeginCopy();
+        int EndCopy(unsigned nPage, int pageSize);
+        int WriteMark();
+    public:
+        tinySQL_VFS *const pVFS;
+        const std::string path;
+        const int fdIn;
+        const int fdOut;            //acks go here
+        long nBatch;
+        long nPageApplied;
+        long nFullCopy;
+
+        static int Open(tinySQL_VFS *pVFS, const char *zPath, int fdIn, int fdOut, LogFollower **ppFollower);
+        int Close();
+
+        //waits for the next batch and applies it.IOError_Read once the shipper is gone
+        int Apply();
+        ReplicaMark Mark() const;
+
+        ~LogFollower();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_REPLICA_H
@@ -0,0 +1,201 @@
+//
+// Created by user on 26-10-19.
+//
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include "tinySQL_SharedCache.h"
+
+namespace tinySQL {
+
+    static constexpr uint32_t SharedMagic = 0x74735343;
+    static constexpr size_t SharedAlign = 4096;
+
+    struct SharedCache::Header {
+        uint32_t magic;
+        uint32_t pageSize;
+        uint64_t nSlot;
+        std::atomic<uint64_t> clock;
+    };
+
+    struct alignas(64) SharedCache::Entry {
+        std::atomic<uint64_t> version;
+        std::atomic<uint32_t> pgno;     //0 for an empty slot
+        std::atomic<uint32_t> kind;
+        std::atomic<uint64_t> a;
+        std::atomic<uint64_t> b;
+        std::atomic<uint32_t> ref;
+    };
+
+    //the segment is mapped by unrelated processes
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock free");
+
+    size_t SharedCache::SegmentSize(long nSlot, int pageSize) {
+        size_t entries = (SharedAlign + nSlot * sizeof(Entry) + SharedAlign - 1) / SharedAlign * SharedAlign;
+        return entries + static_cast<size_t>(nSlot) * pageSize;
+    }
+
+    //built under a name of its own and linked in complete,Succeed also when
+    //another process linked its segment first
+    int SharedCache::Create(const char *zName, int pageSize, long nSlot) {
+        char zTemp[112];
+        snprintf(zTemp, sizeof(zTemp), "%s-XXXXXX", zName);
+        int fd = OsMkostemp(zTemp, O_CLOEXEC);
+        if (fd < 0)
+            return CanNotOpen;
+        int status = Succeed;
+        size_t size = SegmentSize(nSlot, pageSize);
+        void *pMap = MAP_FAILED;
+        if (OsFtruncate(fd, static_cast<off_t>(size)))
+            status = IOError_Truncate;
+        else if ((pMap = OsMmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+            status = CanNotOpen;
+        else {
+            auto pHeader = static_cast<Header *>(pMap);
+            pHeader->magic = SharedMagic;
+            pHeader->pageSize = pageSize;
+            pHeader->nSlot = nSlot;
+            OsMunmap(pMap, size);
+        }
+        if (status == Succeed && OsLink(zTemp, zName) && errno != EEXIST)
+            status = CanNotOpen;
+        OsUnlink(zTemp);
+        OsClose(fd);
+        return status;
+    }
+
+    //the shared flock is taken before the segment is looked at,one the last
+    //connection removed meanwhile is not under the name any more and the open
+    //starts over
+    int SharedCache::Open(const FileIdentity &id, int pageSize, long nSlot, SharedCache **ppCache) {
+        assert(ppCache && nSlot >= SharedProbe);
+        *ppCache = nullptr;
+        char zName[96];
+        snprintf(zName, sizeof(zName), "/dev/shm/tinySQL-%lx-%lx-%d", id.dev, id.ino, pageSize);
+        int status;
+        int fd;
+        struct stat buf{};
+        for (;;) {
+            if ((fd = OsOpen(zName, O_RDWR | O_CLOEXEC)) < 0) {
+                if (errno != ENOENT)
+                    return CanNotOpen;
+                if ((status = Create(zName, pageSize, nSlot)) != Succeed)
+                    return status;
+                continue;
+            }
+            if (OsFlock(fd, LOCK_SH)) {
+                OsClose(fd);
+                return IOError_Lock;
+            }
+            if (OsFstat(fd, &buf)) {
+                OsClose(fd);
+                return IOError_Fstat;
+            }
+            if (buf.st_nlink > 0)
+                break;
+            OsClose(fd);
+        }
+
+        auto size = static_cast<size_t>(buf.st_size);
+        void *pMap = OsMmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        status = pMap == MAP_FAILED ? CanNotOpen : Succeed;
+        if (status == Succeed) {
+            auto pHeader = static_cast<Header *>(pMap);
+            if (size < SharedAlign || pHeader->magic != SharedMagic ||
+                static_cast<int>(pHeader->pageSize) != pageSize ||
+                SegmentSize(static_cast<long>(pHeader->nSlot), pageSize) != size)
+                status = Corrupt;
+        }
+        if (status != Succeed) {
+            if (pMap != MAP_FAILED)
+                OsMunmap(pMap, size);
+            OsClose(fd);
+            return status;
+        }
+        *ppCache = new SharedCache(pMap, size, fd, zName, pageSize);
+        return Succeed;
+    }
+
+    int SharedCache::Close() {
+        delete this;
+        return Succeed;
+    }
+
+    long SharedCache::Bucket(unsigned pgno) const {
+        return static_cast<long>((pgno * 0x9E3779B97F4A7C15ull) >> 17) % nSlot;
+    }
+
+    bool SharedCache::Lookup(unsigned pgno, const SharedTag &tag, unsigned char *pData) {
+        long slot = Bucket(pgno);
+        for (int i = 0; i < SharedProbe; i++, slot = (slot + 1) % nSlot) {
+            Entry &entry = pEntries[slot];
+            uint64_t version = entry.version.load(std::memory_order_acquire);
+            if ((version & 1) || entry.pgno.load(std::memory_order_relaxed) != pgno ||
+                entry.kind.load(std::memory_order_relaxed) != tag.kind ||
+                entry.a.load(std::memory_order_relaxed) != tag.a || entry.b.load(std::memory_order_relaxed) != tag.b)
+                continue;
+            memcpy(pData, &pFrames[slot * pageSize], pageSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.version.load(std::memory_order_relaxed) != version)
+                break;
+            entry.ref.store(1, std::memory_order_relaxed);
+            nHit++;
+            return true;
+        }
+        nMiss++;
+        return false;
+    }
+
+    void SharedCache::Publish(unsigned pgno, const SharedTag &tag, const unsigned char *pData) {
+        long first = Bucket(pgno);
+        for (int i = 0; i < SharedProbe; i++) {
+            Entry &entry = pEntries[(first + i) % nSlot];
+            if (entry.pgno.load(std::memory_order_relaxed) == pgno &&
+                entry.kind.load(std::memory_order_relaxed) == tag.kind &&
+                entry.a.load(std::memory_order_relaxed) == tag.a && entry.b.load(std::memory_order_relaxed) == tag.b)
+                return;
+        }
+
+        //referenced slots get a second chance as the hand passes them
+        auto hand = static_cast<long>(pHeader->clock.fetch_add(1, std::memory_order_relaxed) % SharedProbe);
+        long victim = -1;
+        for (int i = 0; i < SharedProbe && victim < 0; i++) {
+            long slot = (first + (hand + i) % SharedProbe) % nSlot;
+            if (pEntries[slot].pgno.load(std::memory_order_relaxed) == 0 ||
+                pEntries[slot].ref.exchange(0, std::memory_order_relaxed) == 0)
+                victim = slot;
+        }
+        if (victim < 0)
+            victim = (first + hand) % nSlot;
+
+        Entry &entry = pEntries[victim];
+        uint64_t version = entry.version.load(std::memory_order_relaxed);
+        if ((version & 1) ||
+            !entry.version.compare_exchange_strong(version, version + 1, std::memory_order_acq_rel))
+            return;
+        entry.pgno.store(pgno, std::memory_order_relaxed);
+        entry.kind.store(tag.kind, std::memory_order_relaxed);
+        entry.a.store(tag.a, std::memory_order_relaxed);
+        entry.b.store(tag.b, std::memory_order_relaxed);
+        memcpy(&pFrames[victim * pageSize], pData, pageSize);
+        entry.ref.store(1, std::memory_order_relaxed);
+        entry.version.store(version + 2, std::memory_order_release);
+    }
+
+    SharedCache::SharedCache(void *pMap, size_t mapSize, int fd, std::string name, int pageSize) :
+            pMap(pMap), mapSize(mapSize), fd(fd), name(std::move(name)), pHeader(static_cast<Header *>(pMap)),
+            pEntries(nullptr), pFrames(nullptr), pageSize(pageSize), nSlot(static_cast<long>(pHeader->nSlot)),
+            nHit(0), nMiss(0) {
+        pEntries = reinterpret_cast<Entry *>(static_cast<unsigned char *>(pMap) + SharedAlign);
+        pFrames = static_cast<unsigned char *>(pMap) + (mapSize - static_cast<size_t>(nSlot) * pageSize);
+    }
+
+    //the exclusive lock is only granted when no other connection holds the
+    //shared one
+    SharedCache::~SharedCache() {
+        OsMunmap(pMap, mapSize);
+        if (OsFlock(fd, LOCK_EX | LOCK_NB) == 0)
+            OsUnlink(name.c_str());
+        OsClose(fd);
+    }
+}
@@ -0,0 +1,74 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_SHAREDCACHE_H
+#define SQLITELIKE_TINYSQL_SHAREDCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    static constexpr long DefaultSharedSlots = 8192;
+    static constexpr int SharedProbe = 8;       //slots a page may live in
+
+    static constexpr unsigned Tag_Direct = 1;   //read from the file,{file mtime,change counter}
+    static constexpr unsigned Tag_WalFrame = 2; //read from a log frame,{salts,frame}
+    static constexpr unsigned Tag_WalFile = 3;  //read from the file in wal mode,{file mtime,salts}
+
+    //what a page was read as,equal tags mean equal contents
+    struct SharedTag {
+        unsigned kind;
+        uint64_t a;
+        uint64_t b;
+    };
+
+    //page cache shared by every process that opens the same database file,a
+    //segment in /dev/shm named after the file's device and inode.a slot holds
+    //one page,a page hashes to a window of SharedProbe slots and replacement
+    //in the window follows a clock over reference bits,started at a hand all
+    //processes share.each slot has a version that is odd while it is written:
+    //a lookup copies the page out and takes a changed version as a miss,a
+    //publish that loses the race for a slot skips it.nothing is locked,and a
+    //page is only found under the tag it was read as,so stale ones age out.
+    //every connection attached holds a shared flock on the segment,the one
+    //that detaches last gets it exclusively and removes the segment.one left
+    //by a process that died is reused by the next Open on the file,and can be
+    //removed by hand while nobody has the file open
+    class SharedCache {
+    private:
+        struct Header;
+        struct Entry;
+
+        void *pMap;
+        size_t mapSize;
+        int fd;                     //holds the shared flock while attached
+        std::string name;
+        Header *pHeader;
+        Entry *pEntries;
+        unsigned char *pFrames;
+
+        SharedCache(void *pMap, size_t mapSize, int fd, std::string name, int pageSize);
+        long Bucket(unsigned pgno) const;
+        static size_t SegmentSize(long nSlot, int pageSize);
+        static int Create(const char *zName, int pageSize, long nSlot);
+    public:
+        const int pageSize;
+        long nSlot;
+        long nHit;
+        long nMiss;
+
+        //a segment that exists keeps the size it was created with
+        static int Open(const FileIdentity &id, int pageSize, long nSlot, SharedCache **ppCache);
+        //the segment is removed when no other connection is attached
+        int Close();
+
+        bool Lookup(unsigned pgno, const SharedTag &tag, unsigned char *pData);
+        void Publish(unsigned pgno, const SharedTag &tag, const unsigned char *pData);
+
+        ~SharedCache();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_SHAREDCACHE_H
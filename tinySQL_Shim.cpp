@@ -0,0 +1,138 @@
+//
+// Created by user on 26-10-19.
+//
+#include "tinySQL_Shim.h"
+
+namespace tinySQL {
+
+    ShimVFS::ShimVFS(std::string name, tinySQL_VFS *pBase) :
+            tinySQL_VFS(pBase->iVersion, pBase->mxPathName, std::move(name), nullptr), pBase(pBase) {
+    }
+
+    int ShimVFS::xDelete(const char *zName) {
+        return pBase->xDelete(zName);
+    }
+
+    int ShimVFS::xAccess(const char *zName, int flags, int *pResOut) {
+        return pBase->xAccess(zName, flags, pResOut);
+    }
+
+    int ShimVFS::xFullPathname(const char *zName, int nOut, char *zOut) {
+        return pBase->xFullPathname(zName, nOut, zOut);
+    }
+
+    void *ShimVFS::xDlOpen(const char *zFilename) {
+        return pBase->xDlOpen(zFilename);
+    }
+
+    void ShimVFS::xDlError(int nByte, char *zErrMsg) {
+        pBase->xDlError(nByte, zErrMsg);
+    }
+
+    void ShimVFS::xDlClose(void *pHandle) {
+        pBase->xDlClose(pHandle);
+    }
+
+    int ShimVFS::xRandomness(int nByte, char *zOut) {
+        return pBase->xRandomness(nByte, zOut);
+    }
+
+    int ShimVFS::xSleep(int microseconds) {
+        return pBase->xSleep(microseconds);
+    }
+
+    int ShimVFS::xSleepNs(uint64_t ns) {
+        return pBase->xSleepNs(ns);
+    }
+
+    int ShimVFS::xCurrentTime(double *pTime) {
+        return pBase->xCurrentTime(pTime);
+    }
+
+    int ShimVFS::xGetLastError(int nByte, char *zErrMsg) {
+        return pBase->xGetLastError(nByte, zErrMsg);
+    }
+
+    int ShimVFS::xCurrentTimeInt64(unsigned long *pOutTime) {
+        return pBase->xCurrentTimeInt64(pOutTime);
+    }
+
+    int ShimVFS::xWallTimeNs(uint64_t *pNs) {
+        return pBase->xWallTimeNs(pNs);
+    }
+
+    int ShimVFS::xMonotonicTime(uint64_t *pNs) {
+        return pBase->xMonotonicTime(pNs);
+    }
+
+
+    int ShimFile::xClose() {
+        int status = pReal->xClose();
+        delete this;
+        return status;
+    }
+
+    int ShimFile::xRead(void *pBuff, long readCount, long offset) {
+        return pReal->xRead(pBuff, readCount, offset);
+    }
+
+    int ShimFile::xWrite(const void *pBuff, long writeCount, long offset) {
+        return pReal->xWrite(pBuff, writeCount, offset);
+    }
+
+    int ShimFile::xTruncate(long size) {
+        return pReal->xTruncate(size);
+    }
+
+    int ShimFile::xSync(int flags) {
+        return pReal->xSync(flags);
+    }
+
+    int ShimFile::xFileSize(unsigned long *pSize) {
+        return pReal->xFileSize(pSize);
+    }
+
+    int ShimFile::xLock(int eFileLock) {
+        return pReal->xLock(eFileLock);
+    }
+
+    int ShimFile::xUnlock(int eFileLock) {
+        return pReal->xUnlock(eFileLock);
+    }
+
+    int ShimFile::xCheckReservedLock(int *pResOut) {
+        return pReal->xCheckReservedLock(pResOut);
+    }
+
+    int ShimFile::xFileControl(int op, void *pArg) {
+        if (op == Fcntl_VFSName) {
+            //report the whole stack,e.g. "encryptVFS/unixVFS"
+            char *zBase = nullptr;
+            std::string name(pVFS->zName);
+            if (pReal->xFileControl(Fcntl_VFSName, &zBase) == Succeed && zBase) {
+                name.append("/").append(zBase);
+                delete[] zBase;
+            }
+            char *pName = new char[name.size() + 1];
+            memcpy(pName, name.c_str(), name.size() + 1);
+            *(char **) pArg = pName;
+            return Succeed;
+        }
+        //i/o on the descriptor would go around this layer
+        if (op == Fcntl_FileDescriptor)
+            return NotFound;
+        return pReal->xFileControl(op, pArg);
+    }
+
+    int ShimFile::xSectorSize() {
+        return pReal->xSectorSize();
+    }
+
+    int ShimFile::xDeviceCharacteristics() {
+        return pReal->xDeviceCharacteristics();
+    }
+
+    ShimFile::ShimFile(ShimVFS *pVFS, tinySQL_file *pReal) : pVFS(pVFS), pReal(pReal) {
+        assert(pReal);
+    }
+}
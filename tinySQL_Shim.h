@@ -0,0 +1,82 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_SHIM_H
+#define SQLITELIKE_TINYSQL_SHIM_H
+
+#include "tinySQL_VFS.h"
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    //base of the VFS that wrap another VFS,every method goes to pBase
+    //until a subclass overrides it
+    class ShimVFS : public tinySQL_VFS {
+    protected:
+        ShimVFS(std::string name, tinySQL_VFS *pBase);
+    public:
+        tinySQL_VFS *const pBase;
+
+        int xDelete(const char *zName) override;
+
+        int xAccess(const char *zName, int flags, int *pResOut) override;
+
+        int xFullPathname(const char *zName, int nOut, char *zOut) override;
+
+        void *xDlOpen(const char *zFilename) override;
+
+        void xDlError(int nByte, char *zErrMsg) override;
+
+        void xDlClose(void *) override;
+
+        int xRandomness(int nByte, char *zOut) override;
+
+        int xSleep(int microseconds) override;
+
+        int xSleepNs(uint64_t ns) override;
+
+        int xCurrentTime(double *pTime) override;
+
+        int xGetLastError(int, char *) override;
+
+        int xCurrentTimeInt64(unsigned long *pOutTime) override;
+
+        int xWallTimeNs(uint64_t *pNs) override;
+
+        int xMonotonicTime(uint64_t *pNs) override;
+    };
+
+    class ShimFile : public tinySQL_file {
+    public:
+        ShimVFS *const pVFS;
+        tinySQL_file *const pReal;
+
+        int xClose() override;
+
+        int xRead(void *pBuff, long readCount, long offset) override;
+
+        int xWrite(const void *pBuff, long writeCount, long offset) override;
+
+        int xTruncate(long size) override;
+
+        int xSync(int flags) override;
+
+        int xFileSize(unsigned long *pSize) override;
+
+        int xLock(int eFileLock) override;
+
+        int xUnlock(int eFileLock) override;
+
+        int xCheckReservedLock(int *pResOut) override;
+
+        int xFileControl(int op, void *pArg) override;
+
+        int xSectorSize() override;
+
+        int xDeviceCharacteristics() override;
+
+        ShimFile(ShimVFS *pVFS, tinySQL_file *pReal);
+    };
+}
+#endif //SQLITELIKE_TINYSQL_SHIM_H
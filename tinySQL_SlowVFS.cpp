@@ -0,0 +1,145 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include "tinySQL_Clock.h"
+#include "tinySQL_SlowVFS.h"
+
+namespace tinySQL {
+
+    //transfers queue behind each other as on a single device
+    uint64_t SlowVFS::Transfer(long nByte, long bandwidth) {
+        uint64_t cost = static_cast<uint64_t>(static_cast<double>(nByte) * 1e9 / static_cast<double>(bandwidth));
+        pthread_mutex_lock(&deviceMutex);
+        uint64_t start = std::max(Clock::Monotonic(), deviceBusyUntil);
+        deviceBusyUntil = start + cost;
+        uint64_t end = deviceBusyUntil;
+        pthread_mutex_unlock(&deviceMutex);
+        return end;
+    }
+
+    int SlowVFS::xOpen(const char *zName, tinySQL_file **ppFile, int flags, int *pOutFlags) {
+        tinySQL_file *pReal = nullptr;
+        int status = pBase->xOpen(zName, &pReal, flags, pOutFlags);
+        if (status != Succeed)
+            return status;
+        *ppFile = new SlowFile(this, pReal);
+        return Succeed;
+    }
+
+    SlowVFS::SlowVFS(std::string name, tinySQL_VFS *pBase, const SlowConfig &config) :
+            ShimVFS(std::move(name), pBase), deviceMutex(), deviceBusyUntil(0), defaultConfig(config) {
+        pthread_mutex_init(&deviceMutex, nullptr);
+    }
+
+    SlowVFS::~SlowVFS() {
+        pthread_mutex_destroy(&deviceMutex);
+    }
+
+
+    //xorshift64*,the files do not share one generator so only the threads
+    //of one file contend on it
+    uint64_t SlowFile::NextRandom() {
+        pthread_mutex_lock(&randomMutex);
+        randomState ^= randomState >> 12;
+        randomState ^= randomState << 25;
+        randomState ^= randomState >> 27;
+        uint64_t value = randomState * 2685821657736338717ull;
+        pthread_mutex_unlock(&randomMutex);
+        return value;
+    }
+
+    bool SlowFile::Chance(int permille) {
+        return permille > 0 && static_cast<int>(NextRandom() % 1000) < permille;
+    }
+
+    void SlowFile::Delay(const LatencyDistribution &latency) {
+        double us = static_cast<double>(latency.baseUs);
+        double unit = static_cast<double>(NextRandom() >> 11) / static_cast<double>(1ull << 53);
+        switch (latency.kind) {
+            case Latency_Uniform:
+                us += unit * 2.0 * static_cast<double>(latency.meanUs);
+                break;
+            case Latency_Exponential:
+                us += -std::log(1.0 - unit) * static_cast<double>(latency.meanUs);
+                break;
+            default:
+                break;
+        }
+        if (Chance(latency.tailPermille))
+            us += static_cast<double>(latency.tailUs);
+        if (us >= 1.0)
+            Clock::SleepUntil(Clock::Monotonic() + static_cast<uint64_t>(us * 1000.0));
+    }
+
+    void SlowFile::Throttle(long nByte) {
+        if (config.bandwidth > 0 && nByte > 0)
+            Clock::SleepUntil(pSlowVFS->Transfer(nByte, config.bandwidth));
+    }
+
+    int SlowFile::xRead(void *pBuff, long readCount, long offset) {
+        Delay(config.read);
+        Throttle(readCount);
+        return pReal->xRead(pBuff, readCount, offset);
+    }
+
+    int SlowFile::xWrite(const void *pBuff, long writeCount, long offset) {
+        Delay(config.write);
+        Throttle(writeCount);
+        return pReal->xWrite(pBuff, writeCount, offset);
+    }
+
+    int SlowFile::xSync(int flags) {
+        Delay(config.sync);
+        if (Chance(config.syncStallPermille))
+            Clock::SleepUntil(Clock::Monotonic() + static_cast<uint64_t>(config.syncStallUs) * 1000);
+        return pReal->xSync(flags);
+    }
+
+    //a level already held costs nothing and can not be busy,as with the real lock
+    int SlowFile::xLock(int eFileLock) {
+        if (eFileLock <= eLock)
+            return pReal->xLock(eFileLock);
+        Delay(config.lock);
+        if (Chance(config.busyPermille))
+            return Busying;
+        int status = pReal->xLock(eFileLock);
+        if (status == Succeed)
+            eLock = eFileLock;
+        return status;
+    }
+
+    int SlowFile::xUnlock(int eFileLock) {
+        int status = pReal->xUnlock(eFileLock);
+        if (status == Succeed)
+            eLock = std::min(eLock, eFileLock);
+        return status;
+    }
+
+    int SlowFile::xFileControl(int op, void *pArg) {
+        switch (op) {
+            case Fcntl_SlowSetConfig:
+                config = *(SlowConfig *) pArg;
+                return Succeed;
+            case Fcntl_SlowGetConfig:
+                *(SlowConfig *) pArg = config;
+                return Succeed;
+            default:
+                return ShimFile::xFileControl(op, pArg);
+        }
+    }
+
+    SlowFile::SlowFile(SlowVFS *pVFS, tinySQL_file *pReal) :
+            ShimFile(pVFS, pReal), randomState(0), randomMutex(), eLock(Lock_None), pSlowVFS(pVFS),
+            config(pVFS->defaultConfig) {
+        pthread_mutex_init(&randomMutex, nullptr);
+        while (randomState == 0)
+            tinySQL_Randomness(sizeof(randomState), &randomState);
+    }
+
+    SlowFile::~SlowFile() {
+        pthread_mutex_destroy(&randomMutex);
+    }
+}
@@ -0,0 +1,88 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_SLOWVFS_H
+#define SQLITELIKE_TINYSQL_SLOWVFS_H
+
+#include <cstdint>
+#include <pthread.h>
+#include "tinySQL_Shim.h"
+
+namespace tinySQL {
+
+    static constexpr int Latency_Constant = 0;
+    static constexpr int Latency_Uniform = 1;        //random part uniform in [0,2*meanUs]
+    static constexpr int Latency_Exponential = 2;    //random part exponential with mean meanUs
+
+    //delay added to one kind of call: baseUs + random part,and with
+    //probability tailPermille/1000 a further tailUs
+    struct LatencyDistribution {
+        int kind;
+        long baseUs;
+        long meanUs;
+        int tailPermille;
+        long tailUs;
+    };
+
+    //set with Fcntl_SlowSetConfig and read with Fcntl_SlowGetConfig
+    struct SlowConfig {
+        LatencyDistribution read;
+        LatencyDistribution write;
+        LatencyDistribution sync;
+        LatencyDistribution lock;
+        long bandwidth;             //bytes per second shared by every file of the VFS,0 is unlimited
+        int syncStallPermille;      //chance of an fsync stall on xSync
+        long syncStallUs;
+        int busyPermille;           //chance that xLock fails with Busying without trying the real lock
+    };
+
+    //delays calls of files opened through it to imitate slow or contended storage
+    class SlowVFS final : public ShimVFS {
+    private:
+        pthread_mutex_t deviceMutex;
+        uint64_t deviceBusyUntil;
+    public:
+        SlowConfig defaultConfig;
+
+        //reserve the modelled device for nByte and return when the transfer would end
+        uint64_t Transfer(long nByte, long bandwidth);
+
+        int xOpen(const char *zName, tinySQL_file **ppFile,
+                  int flags, int *pOutFlags) override;
+
+        SlowVFS(std::string name, tinySQL_VFS *pBase, const SlowConfig &config);
+        ~SlowVFS();
+    };
+
+    class SlowFile : public ShimFile {
+    private:
+        uint64_t randomState;
+        pthread_mutex_t randomMutex;    //prefetch reads come from pool threads
+        int eLock;
+
+        uint64_t NextRandom();
+        bool Chance(int permille);
+        void Delay(const LatencyDistribution &latency);
+        void Throttle(long nByte);
+    public:
+        SlowVFS *const pSlowVFS;
+        SlowConfig config;
+
+        int xRead(void *pBuff, long readCount, long offset) override;
+
+        int xWrite(const void *pBuff, long writeCount, long offset) override;
+
+        int xSync(int flags) override;
+
+        int xLock(int eFileLock) override;
+
+        int xUnlock(int eFileLock) override;
+
+        int xFileControl(int op, void *pArg) override;
+
+        SlowFile(SlowVFS *pVFS, tinySQL_file *pReal);
+        ~SlowFile() override;
+    };
+}
+#endif //SQLITELIKE_TINYSQL_SLOWVFS_H
@@ -0,0 +1,514 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <string>
+#include "tinySQL_Sorter.h"
+
+namespace tinySQL {
+
+    static constexpr long SorterIOSize = 1 << 20;
+    static constexpr long MinMergeBuffer = 64 << 10;
+    static constexpr long RadixThreshold = 256;
+    static constexpr long ParallelSortThreshold = 1 << 16;
+
+    struct RunHeader {
+        uint32_t nKey;
+        uint32_t nValue;
+    };
+
+    static uint64_t KeyPrefix(const void *pKey, int nKey) {
+        unsigned char b[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        memcpy(b, pKey, std::min(nKey, 8));
+        uint64_t prefix = 0;
+        for (unsigned char c: b)
+            prefix = (prefix << 8) | c;
+        return prefix;
+    }
+
+    //buffered sequential writer for one run
+    struct RunWriter {
+        tinySQL_file *pFile;
+        std::vector<char> buffer;
+        long used;
+        long offset;
+
+        explicit RunWriter(tinySQL_file *pFile) : pFile(pFile), buffer(SorterIOSize), used(0), offset(0) {
+        }
+
+        int Write(const void *pData, long n) {
+            auto zData = static_cast<const char *>(pData);
+            while (n > 0) {
+                long take = std::min(n, static_cast<long>(buffer.size()) - used);
+                memcpy(&buffer[used], zData, take);
+                used += take;
+                zData += take;
+                n -= take;
+                if (used == static_cast<long>(buffer.size())) {
+                    int status = Flush();
+                    if (status != Succeed)
+                        return status;
+                }
+            }
+            return Succeed;
+        }
+
+        int WriteRecord(const void *pKey, int nKey, const void *pValue, long nValue) {
+            RunHeader header{static_cast<uint32_t>(nKey), static_cast<uint32_t>(nValue)};
+            int status = Write(&header, sizeof(header));
+            if (status == Succeed)
+                status = Write(pKey, nKey);
+            if (status == Succeed)
+                status = Write(pValue, nValue);
+            return status;
+        }
+
+        int Flush() {
+            if (used == 0)
+                return Succeed;
+            int status = pFile->xWrite(buffer.data(), used, offset);
+            offset += used;
+            used = 0;
+            return status;
+        }
+    };
+
+    //reads a run through two buffers,the next block is read on the pool
+    //while the current one is consumed
+    struct RunReader {
+        tinySQL_file *pFile;
+        ThreadPool *pPool;
+        std::vector<char> buffers[2];
+        int current;
+        long size;
+        long fileOffset;
+        long begin;
+        long end;
+        bool bPrefetching;
+        long prefetchLength;
+        int prefetchStatus;
+        TaskGroup prefetch;
+        bool bDone;
+        std::string key;
+        std::string value;
+
+        RunReader(tinySQL_file *pFile, long size, long bufferSize, ThreadPool *pPool) :
+                pFile(pFile), pPool(pPool), buffers{std::vector<char>(bufferSize), std::vector<char>(bufferSize)},
+                current(0), size(size), fileOffset(0), begin(0), end(0), bPrefetching(false), prefetchLength(0),
+                prefetchStatus(Succeed), prefetch(), bDone(false), key(), value() {
+            StartPrefetch();
+        }
+
+        void StartPrefetch() {
+            long n = std::min(static_cast<long>(buffers[0].size()), size - fileOffset);
+            if (n <= 0)
+                return;
+            long offset = fileOffset;
+            char *pBuffer = buffers[1 - current].data();
+            fileOffset += n;
+            prefetchLength = n;
+            bPrefetching = true;
+            prefetch.Run(pPool, [this, pBuffer, n, offset]() {
+                prefetchStatus = pFile->xRead(pBuffer, n, offset);
+            });
+        }
+
+        int Read(void *pOut, long n) {
+            auto zOut = static_cast<char *>(pOut);
+            while (n > 0) {
+                if (begin == end) {
+                    if (!bPrefetching)
+                        return IOError_ReadShort;
+                    prefetch.Wait();
+                    bPrefetching = false;
+                    if (prefetchStatus != Succeed)
+                        return prefetchStatus;
+                    current = 1 - current;
+                    begin = 0;
+                    end = prefetchLength;
+                    StartPrefetch();
+                }
+                long take = std::min(n, end - begin);
+                memcpy(zOut, &buffers[current][begin], take);
+                begin += take;
+                zOut += take;
+                n -= take;
+            }
+            return Succeed;
+        }
+
+        int Next() {
+            if (begin == end && !bPrefetching) {
+                bDone = true;
+                return Succeed;
+            }
+            RunHeader header{};
+            int status = Read(&header, sizeof(header));
+            if (status != Succeed)
+                return status;
+            key.resize(header.nKey);
+            value.resize(header.nValue);
+            status = Read(&key[0], header.nKey);
+            if (status == Succeed)
+                status = Read(&value[0], header.nValue);
+            return status;
+        }
+    };
+
+    //tournament tree of losers over k sources,the root holds the overall
+    //winner and replacing it costs log2(k) compares on one leaf-to-root path.
+    //less(a,b) orders two live sources,an exhausted source loses to all
+    template<typename Less>
+    class LoserTree {
+    private:
+        std::vector<int> tree;
+        const int k;
+        Less less;
+
+        //-1 fills the tree before the first round and beats everything
+        bool Beats(int a, int b) const {
+            return a == -1 || (b != -1 && less(a, b));
+        }
+
+    public:
+        LoserTree(int k, Less less) : tree(k, -1), k(k), less(less) {
+            for (int i = k - 1; i >= 0; i--)
+                Replay(i);
+        }
+
+        int Winner() const {
+            return tree[0];
+        }
+
+        //source s moved on,play its path again
+        void Replay(int s) {
+            for (int t = (s + k) / 2; t > 0; t /= 2)
+                if (Beats(tree[t], s))
+                    std::swap(s, tree[t]);
+            tree[0] = s;
+        }
+    };
+
+    //LSD radix sort on the 8 byte prefixes,passes whose byte is the same for
+    //every record are skipped.records with equal prefixes are then ordered by
+    //the full key,equal keys stay in arrival order (by arena offset)
+    void Sorter::SortRecords(const char *zArena, Record *pBegin, Record *pEnd) {
+        long n = pEnd - pBegin;
+        auto fullLess = [zArena](const Record &a, const Record &b) {
+            if (a.prefix != b.prefix)
+                return a.prefix < b.prefix;
+            int c = memcmp(zArena + a.offset, zArena + b.offset, std::min(a.nKey, b.nKey));
+            if (c != 0)
+                return c < 0;
+            if (a.nKey != b.nKey)
+                return a.nKey < b.nKey;
+            return a.offset < b.offset;
+        };
+        if (n < RadixThreshold) {
+            std::sort(pBegin, pEnd, fullLess);
+            return;
+        }
+
+        std::vector<Record> temp(n);
+        Record *pFrom = pBegin, *pTo = temp.data();
+        for (int shift = 0; shift < 64; shift += 8) {
+            long count[256] = {0};
+            for (long i = 0; i < n; i++)
+                count[(pFrom[i].prefix >> shift) & 0xff]++;
+            if (count[(pFrom[0].prefix >> shift) & 0xff] == n)
+                continue;
+            long position = 0;
+            for (long &c: count) {
+                long next = position + c;
+                c = position;
+                position = next;
+            }
+            for (long i = 0; i < n; i++)
+                pTo[count[(pFrom[i].prefix >> shift) & 0xff]++] = pFrom[i];
+            std::swap(pFrom, pTo);
+        }
+        if (pFrom != pBegin)
+            std::copy(pFrom, pFrom + n, pBegin);
+
+        for (Record *p = pBegin; p < pEnd;) {
+            Record *q = p + 1;
+            while (q < pEnd && q->prefix == p->prefix)
+                q++;
+            if (q - p > 1)
+                std::sort(p, q, fullLess);
+            p = q;
+        }
+    }
+
+    static bool SameKey(const char *zArena, long aOffset, int aKey, long bOffset, int bKey) {
+        return aKey == bKey && memcmp(zArena + aOffset, zArena + bOffset, aKey) == 0;
+    }
+
+    //buffer must be sorted,of equal keys only the last is written
+    int Sorter::WriteRun(const Buffer &buffer, Run *pRun) {
+        tinySQL_file *pFile = nullptr;
+        int status = pVFS->xOpen(nullptr, &pFile, Open_Create | Open_ReadWrite | Open_Exclusive | Open_Delete,
+                                 nullptr);
+        if (status != Succeed)
+            return status;
+
+        RunWriter writer(pFile);
+        const char *zArena = buffer.arena.data();
+        const auto &records = buffer.records;
+        for (size_t i = 0; i < records.size() && status == Succeed; i++) {
+            const Record &r = records[i];
+            if (i + 1 < records.size() &&
+                SameKey(zArena, r.offset, r.nKey, records[i + 1].offset, records[i + 1].nKey))
+                continue;
+            status = writer.WriteRecord(zArena + r.offset, r.nKey, zArena + r.offset + r.nKey, r.nValue);
+        }
+        if (status == Succeed)
+            status = writer.Flush();
+        if (status != Succeed) {
+            pFile->xClose();
+            return status;
+        }
+        *pRun = {pFile, writer.offset};
+        return Succeed;
+    }
+
+    int Sorter::WaitSpills() {
+        spills.Wait();
+        nInFlight = 0;
+        return spillStatus;
+    }
+
+    //the full buffer is sorted and written on the pool,the run keeps its
+    //place in runs so that later records still win over earlier ones
+    int Sorter::StartSpill() {
+        pthread_mutex_lock(&mutex);
+        int status = spillStatus;
+        pthread_mutex_unlock(&mutex);
+        if (status != Succeed)
+            return status;
+        int maxInFlight = pPool ? std::max(1, pPool->ThreadCount()) : 1;
+        if (nInFlight >= maxInFlight) {
+            int status = WaitSpills();
+            if (status != Succeed)
+                return status;
+        }
+        auto pBuffer = std::make_shared<Buffer>();
+        std::swap(*pBuffer, current);
+        pthread_mutex_lock(&mutex);
+        size_t index = runs.size();
+        runs.push_back({nullptr, 0});
+        pthread_mutex_unlock(&mutex);
+        nRun++;
+        nInFlight++;
+        spills.Run(pPool, [this, pBuffer, index]() {
+            SortRecords(pBuffer->arena.data(), pBuffer->records.data(),
+                        pBuffer->records.data() + pBuffer->records.size());
+            Run run{nullptr, 0};
+            int status = WriteRun(*pBuffer, &run);
+            pthread_mutex_lock(&mutex);
+            if (status == Succeed)
+                runs[index] = run;
+            else
+                spillStatus = status;
+            pthread_mutex_unlock(&mutex);
+        });
+        return Succeed;
+    }
+
+    int Sorter::Add(const void *pKey, int nKey, const void *pValue, long nValue) {
+        assert(nKey >= 0 && nValue >= 0 && nValue <= static_cast<long>(UINT32_MAX));
+        long used = static_cast<long>(current.arena.size() + current.records.size() * sizeof(Record));
+        if (!current.records.empty() && used + nKey + nValue + static_cast<long>(sizeof(Record)) > bufferLimit) {
+            int status = StartSpill();
+            if (status != Succeed)
+                return status;
+        }
+        long offset = static_cast<long>(current.arena.size());
+        current.arena.insert(current.arena.end(), static_cast<const char *>(pKey),
+                             static_cast<const char *>(pKey) + nKey);
+        current.arena.insert(current.arena.end(), static_cast<const char *>(pValue),
+                             static_cast<const char *>(pValue) + nValue);
+        current.records.push_back({KeyPrefix(pKey, nKey), offset, nKey, static_cast<uint32_t>(nValue)});
+        nRecord++;
+        return Succeed;
+    }
+
+    int Sorter::MergeRuns(const std::vector<Run> &sources, long ioSize, const SorterSink &sink) {
+        std::vector<std::unique_ptr<RunReader>> readers;
+        readers.reserve(sources.size());
+        for (auto &run: sources)
+            readers.emplace_back(new RunReader(run.pFile, run.size, ioSize, pPool));
+        for (auto &pReader: readers) {
+            int status = pReader->Next();
+            if (status != Succeed)
+                return status;
+        }
+
+        //on equal keys the earlier run comes first,so the later record is the one kept
+        auto less = [&readers](int a, int b) {
+            const RunReader &ra = *readers[a], &rb = *readers[b];
+            if (ra.bDone || rb.bDone)
+                return !ra.bDone;
+            int c = ra.key.compare(rb.key);
+            return c != 0 ? c < 0 : a < b;
+        };
+        LoserTree<decltype(less)> tree(static_cast<int>(readers.size()), less);
+
+        std::string key, value;
+        bool bPending = false;
+        for (;;) {
+            int winner = tree.Winner();
+            RunReader &reader = *readers[winner];
+            if (reader.bDone)
+                break;
+            if (bPending && key != reader.key) {
+                int status = sink(key.data(), static_cast<int>(key.size()), value.data(),
+                                  static_cast<long>(value.size()));
+                if (status != Succeed)
+                    return status;
+            }
+            key.swap(reader.key);
+            value.swap(reader.value);
+            bPending = true;
+            int status = reader.Next();
+            if (status != Succeed)
+                return status;
+            tree.Replay(winner);
+        }
+        if (bPending)
+            return sink(key.data(), static_cast<int>(key.size()), value.data(), static_cast<long>(value.size()));
+        return Succeed;
+    }
+
+    //nothing was spilled: sort slices of the buffer on the pool and merge them
+    int Sorter::SortMemory(const SorterSink &sink) {
+        const char *zArena = current.arena.data();
+        auto &records = current.records;
+        long n = static_cast<long>(records.size());
+        int nSlice = pPool && n >= ParallelSortThreshold ? std::max(1, pPool->ThreadCount()) : 1;
+        std::vector<std::pair<long, long>> slices;
+        {
+            TaskGroup group;
+            for (int i = 0; i < nSlice; i++) {
+                long begin = n * i / nSlice, end = n * (i + 1) / nSlice;
+                slices.emplace_back(begin, end);
+                Record *pRecords = records.data();
+                group.Run(nSlice > 1 ? pPool : nullptr, [zArena, pRecords, begin, end]() {
+                    SortRecords(zArena, pRecords + begin, pRecords + end);
+                });
+            }
+            group.Wait();
+        }
+
+        //slices are in arrival order,so among equal keys the later slice wins
+        auto less = [&](int a, int b) {
+            bool aDone = slices[a].first == slices[a].second, bDone = slices[b].first == slices[b].second;
+            if (aDone || bDone)
+                return !aDone;
+            const Record &ra = records[slices[a].first], &rb = records[slices[b].first];
+            if (ra.prefix != rb.prefix)
+                return ra.prefix < rb.prefix;
+            int c = memcmp(zArena + ra.offset, zArena + rb.offset, std::min(ra.nKey, rb.nKey));
+            if (c != 0)
+                return c < 0;
+            return ra.nKey != rb.nKey ? ra.nKey < rb.nKey : a < b;
+        };
+        LoserTree<decltype(less)> tree(nSlice, less);
+        const Record *pPending = nullptr;
+        for (;;) {
+            int winner = tree.Winner();
+            if (slices[winner].first == slices[winner].second)
+                break;
+            const Record *pRecord = &records[slices[winner].first++];
+            if (pPending && !SameKey(zArena, pPending->offset, pPending->nKey, pRecord->offset, pRecord->nKey)) {
+                int status = sink(zArena + pPending->offset, pPending->nKey, zArena + pPending->offset + pPending->nKey,
+                                  pPending->nValue);
+                if (status != Succeed)
+                    return status;
+            }
+            pPending = pRecord;
+            tree.Replay(winner);
+        }
+        if (pPending)
+            return sink(zArena + pPending->offset, pPending->nKey, zArena + pPending->offset + pPending->nKey,
+                        pPending->nValue);
+        return Succeed;
+    }
+
+    int Sorter::Finish(const SorterSink &sink) {
+        int status = WaitSpills();
+        if (status == Succeed && runs.empty())
+            status = SortMemory(sink);
+        else if (status == Succeed) {
+            if (!current.records.empty())
+                status = StartSpill();
+            if (status == Succeed)
+                status = WaitSpills();
+
+            //every run being merged gets two read buffers of ioSize
+            long fanIn = std::max(2L, memoryLimit / (2 * MinMergeBuffer));
+            while (status == Succeed && static_cast<long>(runs.size()) > fanIn) {
+                std::vector<Run> merged;
+                for (size_t i = 0; i < runs.size() && status == Succeed; i += fanIn) {
+                    std::vector<Run> group(runs.begin() + i, runs.begin() + std::min(runs.size(), i + fanIn));
+                    if (group.size() == 1) {
+                        merged.push_back(group[0]);
+                        runs[i].pFile = nullptr;
+                        continue;
+                    }
+                    tinySQL_file *pFile = nullptr;
+                    status = pVFS->xOpen(nullptr, &pFile, Open_Create | Open_ReadWrite | Open_Exclusive | Open_Delete,
+                                         nullptr);
+                    if (status != Succeed)
+                        break;
+                    RunWriter writer(pFile);
+                    long ioSize = std::max(MinMergeBuffer, std::min(SorterIOSize, memoryLimit / (2 * fanIn)));
+                    status = MergeRuns(group, ioSize, [&writer](const void *pKey, int nKey, const void *pValue,
+                                                                long nValue) {
+                        return writer.WriteRecord(pKey, nKey, pValue, nValue);
+                    });
+                    if (status == Succeed)
+                        status = writer.Flush();
+                    merged.push_back({pFile, writer.offset});
+                    for (size_t j = i; j < i + group.size(); j++) {
+                        runs[j].pFile->xClose();
+                        runs[j].pFile = nullptr;
+                    }
+                }
+                for (auto &run: runs)
+                    if (run.pFile)
+                        merged.push_back(run);
+                runs.swap(merged);
+                nMergePass++;
+            }
+            if (status == Succeed) {
+                long ioSize = std::max(MinMergeBuffer,
+                                       std::min(SorterIOSize, memoryLimit / (2 * static_cast<long>(runs.size()))));
+                status = MergeRuns(runs, ioSize, sink);
+                nMergePass++;
+            }
+        }
+        current.arena.clear();
+        current.records.clear();
+        for (auto &run: runs)
+            if (run.pFile)
+                run.pFile->xClose();
+        runs.clear();
+        return status;
+    }
+
+    Sorter::Sorter(tinySQL_VFS *pVFS, long memoryLimit, ThreadPool *pPool) :
+            current(), runs(), mutex(), spills(), nInFlight(0), spillStatus(Succeed),
+            bufferLimit(memoryLimit / ((pPool ? pPool->ThreadCount() : 0) + 1)),
+            pVFS(pVFS), pPool(pPool), memoryLimit(memoryLimit), nRecord(0), nRun(0), nMergePass(0) {
+        pthread_mutex_init(&mutex, nullptr);
+    }
+
+    Sorter::~Sorter() {
+        spills.Wait();
+        for (auto &run: runs)
+            if (run.pFile)
+                run.pFile->xClose();
+        pthread_mutex_destroy(&mutex);
+    }
+}
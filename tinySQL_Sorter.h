@@ -0,0 +1,76 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_SORTER_H
+#define SQLITELIKE_TINYSQL_SORTER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "tinySQL_ThreadPool.h"
+#include "tinySQL_VFS.h"
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    //called for every record in key order,a status other than Succeed stops the sort
+    typedef std::function<int(const void *pKey, int nKey, const void *pValue, long nValue)> SorterSink;
+
+    //sorts key/value records by key in memcmp order within memoryLimit bytes.
+    //records collect in a buffer of memoryLimit/(threads+1) bytes,a full
+    //buffer is sorted and written out as a run to a temporary file of pVFS on
+    //the pool while the next one fills.Finish merges the runs,in several passes
+    //when there are too many to give each a read buffer.of records with equal
+    //keys only the one added last comes out.the sorter waits on pool tasks,so
+    //it must not itself run on a worker of pPool
+    class Sorter {
+    private:
+        struct Record {
+            uint64_t prefix;    //first 8 key bytes big-endian,zero padded
+            long offset;
+            int nKey;
+            uint32_t nValue;
+        };
+
+        struct Buffer {
+            std::vector<char> arena;
+            std::vector<Record> records;
+        };
+
+        struct Run {
+            tinySQL_file *pFile;
+            long size;
+        };
+
+        Buffer current;
+        std::vector<Run> runs;
+        pthread_mutex_t mutex;
+        TaskGroup spills;
+        int nInFlight;
+        int spillStatus;
+        const long bufferLimit;
+
+        static void SortRecords(const char *zArena, Record *pBegin, Record *pEnd);
+        int WriteRun(const Buffer &buffer, Run *pRun);
+        int StartSpill();
+        int WaitSpills();
+        int MergeRuns(const std::vector<Run> &sources, long ioSize, const SorterSink &sink);
+        int SortMemory(const SorterSink &sink);
+    public:
+        tinySQL_VFS *const pVFS;
+        ThreadPool *const pPool;
+        const long memoryLimit;
+        long nRecord;
+        long nRun;
+        int nMergePass;
+
+        int Add(const void *pKey, int nKey, const void *pValue, long nValue);
+        int Finish(const SorterSink &sink);
+
+        Sorter(tinySQL_VFS *pVFS, long memoryLimit, ThreadPool *pPool = ThreadPool::Global());
+        ~Sorter();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_SORTER_H
@@ -0,0 +1,119 @@
+//
+// Created by user on 26-10-19.
+//
+#include <cassert>
+#include <stdexcept>
+#include <unistd.h>
+#include "tinySQL_ThreadPool.h"
+
+namespace tinySQL {
+
+    void *ThreadPool::WorkerMain(void *pArg) {
+        auto pPool = static_cast<ThreadPool *>(pArg);
+        while (true) {
+            pthread_mutex_lock(&pPool->mutex);
+            while (pPool->tasks.empty() && !pPool->bShutdown)
+                pthread_cond_wait(&pPool->cond, &pPool->mutex);
+            if (pPool->tasks.empty()) {
+                pthread_mutex_unlock(&pPool->mutex);
+                return nullptr;
+            }
+            auto task = std::move(pPool->tasks.front());
+            pPool->tasks.pop_front();
+            pthread_mutex_unlock(&pPool->mutex);
+            task();
+        }
+    }
+
+    ThreadPool::ThreadPool(int nThread) : tasks(), threads(), mutex(), cond(), bShutdown(false) {
+        assert(nThread > 0);
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_cond_init(&cond, nullptr);
+        for (int i = 0; i < nThread; i++) {
+            pthread_t thread;
+            if (pthread_create(&thread, nullptr, WorkerMain, this))
+                throw std::runtime_error("can not create worker thread");
+            threads.push_back(thread);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        pthread_mutex_lock(&mutex);
+        bShutdown = true;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+        for (auto thread: threads)
+            pthread_join(thread, nullptr);
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void ThreadPool::Submit(std::function<void()> task) {
+        pthread_mutex_lock(&mutex);
+        tasks.push_back(std::move(task));
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    int ThreadPool::ThreadCount() const {
+        return static_cast<int>(threads.size());
+    }
+
+    //the workers do not survive a fork,so a child process gets a pool of its
+    //own the first time it asks.the one it inherited is left as it is
+    static pthread_mutex_t globalMutex = PTHREAD_MUTEX_INITIALIZER;
+    static ThreadPool *pGlobal = nullptr;
+
+    static void GlobalAfterFork() {
+        pthread_mutex_init(&globalMutex, nullptr);
+        pGlobal = nullptr;
+    }
+
+    ThreadPool *ThreadPool::Global() {
+        pthread_mutex_lock(&globalMutex);
+        if (pGlobal == nullptr) {
+            static bool bAtFork = pthread_atfork(nullptr, nullptr, GlobalAfterFork) == 0;
+            (void) bAtFork;
+            pGlobal = new ThreadPool(sysconf(_SC_NPROCESSORS_ONLN) > 0 ?
+                                     static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)) : 1);
+        }
+        ThreadPool *pPool = pGlobal;
+        pthread_mutex_unlock(&globalMutex);
+        return pPool;
+    }
+
+    TaskGroup::TaskGroup() : mutex(), cond(), nPending(0) {
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_cond_init(&cond, nullptr);
+    }
+
+    TaskGroup::~TaskGroup() {
+        Wait();
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void TaskGroup::Run(ThreadPool *pPool, std::function<void()> task) {
+        if (pPool == nullptr) {
+            task();
+            return;
+        }
+        pthread_mutex_lock(&mutex);
+        nPending++;
+        pthread_mutex_unlock(&mutex);
+        pPool->Submit([this, task = std::move(task)]() {
+            task();
+            pthread_mutex_lock(&mutex);
+            if (--nPending == 0)
+                pthread_cond_broadcast(&cond);
+            pthread_mutex_unlock(&mutex);
+        });
+    }
+
+    void TaskGroup::Wait() {
+        pthread_mutex_lock(&mutex);
+        while (nPending > 0)
+            pthread_cond_wait(&cond, &mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+}
@@ -0,0 +1,51 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_THREADPOOL_H
+#define SQLITELIKE_TINYSQL_THREADPOOL_H
+
+#include <pthread.h>
+#include <functional>
+#include <list>
+#include <vector>
+
+namespace tinySQL {
+
+    //fixed size pool of pthread workers,tasks run in submit order
+    class ThreadPool {
+    private:
+        std::list<std::function<void()>> tasks;
+        std::vector<pthread_t> threads;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        bool bShutdown;
+
+        static void *WorkerMain(void *pArg);
+    public:
+        explicit ThreadPool(int nThread);
+        ~ThreadPool();
+
+        void Submit(std::function<void()> task);
+        int ThreadCount() const;
+
+        //shared pool sized to the number of online cpus
+        static ThreadPool *Global();
+    };
+
+    //counts tasks of one batch so the submitter can wait for all of them
+    class TaskGroup {
+    private:
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        int nPending;
+    public:
+        TaskGroup();
+        ~TaskGroup();
+
+        //run task on pPool,or inline when pPool is null
+        void Run(ThreadPool *pPool, std::function<void()> task);
+        void Wait();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_THREADPOOL_H
@@ -0,0 +1,350 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <vector>
+#include "tinySQL_TieredVFS.h"
+
+namespace tinySQL {
+
+    int TieredVFS::xOpen(const char *zName, tinySQL_file **ppFile, int flags, int *pOutFlags) {
+        tinySQL_file *pReal = nullptr;
+        int status = pBase->xOpen(zName, &pReal, flags, pOutFlags);
+        if (status != Succeed)
+            return status;
+        *ppFile = new TieredFile(this, pReal);
+        return Succeed;
+    }
+
+    TieredVFS::TieredVFS(std::string name, tinySQL_VFS *pBase, int pageSize, long maxHotPage,
+                         unsigned promoteThreshold) :
+            ShimVFS(std::move(name), pBase), pageSize(pageSize), maxHotPage(maxHotPage),
+            promoteThreshold(promoteThreshold), pPool(ThreadPool::Global()) {
+        assert(pageSize > 0 && maxHotPage > 0);
+        pthread_mutex_init(&inodeMutex, nullptr);
+    }
+
+    TieredVFS::~TieredVFS() {
+        pthread_mutex_destroy(&inodeMutex);
+    }
+
+    std::atomic<unsigned long> *TieredVFS::AcquireWrites(const FileIdentity &id) {
+        pthread_mutex_lock(&inodeMutex);
+        auto &pInode = inodes[{id.dev, id.ino}];
+        if (!pInode)
+            pInode = new InodeWrites{0, {0}};
+        pInode->nRef++;
+        pthread_mutex_unlock(&inodeMutex);
+        return &pInode->nWrite;
+    }
+
+    void TieredVFS::ReleaseWrites(const FileIdentity &id) {
+        pthread_mutex_lock(&inodeMutex);
+        auto it = inodes.find({id.dev, id.ino});
+        if (it != inodes.end() && --it->second->nRef == 0) {
+            delete it->second;
+            inodes.erase(it);
+        }
+        pthread_mutex_unlock(&inodeMutex);
+    }
+
+
+    bool TieredFile::AllHot(long firstPage, long lastPage) {
+        for (long pgno = firstPage; pgno <= lastPage; pgno++) {
+            auto it = pages.find(pgno);
+            if (it == pages.end() || !it->second.pHot)
+                return false;
+        }
+        return true;
+    }
+
+    //a copy taken at gen is still valid if nothing wrote the page or dropped the tier since
+    bool TieredFile::Fresh(const PageStat &stat, unsigned long gen) const {
+        return gen >= dropGen && stat.lastWrite <= gen;
+    }
+
+    void TieredFile::Promote(PageStat &stat, const unsigned char *pData, long nByte) {
+        int pageSize = pTieredVFS->pageSize;
+        stat.pHot.reset(new unsigned char[pageSize]);
+        memcpy(stat.pHot.get(), pData, nByte);
+        memset(stat.pHot.get() + nByte, 0, pageSize - nByte);
+        nHot++;
+        stats.nPromote++;
+    }
+
+    //the read did not cover the whole page,fetch it on a worker
+    void TieredFile::PromoteLater(long pgno) {
+        auto &stat = pages[pgno];
+        if (stat.bPending)
+            return;
+        stat.bPending = true;
+        unsigned long gen = writeGen;
+        background.Run(pTieredVFS->pPool, [this, pgno, gen]() {
+            int pageSize = pTieredVFS->pageSize;
+            std::vector<unsigned char> buffer(pageSize);
+            int status = pReal->xRead(buffer.data(), pageSize, pgno * pageSize);
+            pthread_mutex_lock(&mutex);
+            auto &stat = pages[pgno];
+            stat.bPending = false;
+            if ((status == Succeed || status == IOError_ReadShort) && !stat.pHot && Fresh(stat, gen))
+                Promote(stat, buffer.data(), pageSize);
+            pthread_mutex_unlock(&mutex);
+        });
+    }
+
+    void TieredFile::Touch(long firstPage, long lastPage) {
+        for (long pgno = firstPage; pgno <= lastPage; pgno++)
+            pages[pgno].nAccess++;
+        nAccessSinceSweep += lastPage - firstPage + 1;
+    }
+
+    //called without the mutex,demotion and counter aging run in the background
+    void TieredFile::MaybeSweep() {
+        long maxHotPage = pTieredVFS->maxHotPage;
+        pthread_mutex_lock(&mutex);
+        bool bStart = !bSweeping && (nHot > maxHotPage || nAccessSinceSweep > 4 * maxHotPage);
+        if (bStart)
+            bSweeping = true;
+        pthread_mutex_unlock(&mutex);
+        if (bStart)
+            background.Run(pTieredVFS->pPool, [this]() { Sweep(); });
+    }
+
+    void TieredFile::Sweep() {
+        long lowWater = pTieredVFS->maxHotPage * 9 / 10;
+        pthread_mutex_lock(&mutex);
+        for (auto it = pages.begin(); it != pages.end();) {
+            it->second.nAccess >>= 1;
+            if (it->second.nAccess == 0 && !it->second.pHot && !it->second.bPending)
+                it = pages.erase(it);
+            else
+                it++;
+        }
+        if (nHot > lowWater) {
+            std::vector<std::pair<unsigned, long>> hot;
+            for (auto &it: pages)
+                if (it.second.pHot)
+                    hot.emplace_back(it.second.nAccess, it.first);
+            long nDemote = nHot - lowWater;
+            std::nth_element(hot.begin(), hot.begin() + nDemote - 1, hot.end());
+            for (long i = 0; i < nDemote; i++)
+                pages[hot[i].second].pHot.reset();
+            nHot -= nDemote;
+            stats.nDemote += nDemote;
+        }
+        nAccessSinceSweep = 0;
+        bSweeping = false;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void TieredFile::DropAll() {
+        for (auto &it: pages)
+            it.second.pHot.reset();
+        nHot = 0;
+        dropGen = ++writeGen;
+    }
+
+    //mtime is -1 when the base vfs has no file id,the size and the counter
+    //are all there is to compare then
+    int TieredFile::Stamp(FileStamp *pStamp) {
+        FileIdentity now{};
+        int status = pReal->xFileControl(Fcntl_FileId, &now);
+        if (status == NotFound)
+            now.mtime = -1;
+        else if (status != Succeed)
+            return status;
+        unsigned long size;
+        status = pReal->xFileSize(&size);
+        if (status != Succeed)
+            return status;
+        pStamp->mtime = now.mtime;
+        pStamp->size = static_cast<long>(size);
+        pStamp->nWrite = pWrites ? pWrites->load() : 0;
+        return Succeed;
+    }
+
+    int TieredFile::xClose() {
+        background.Wait();
+        if (pWrites)
+            pTieredVFS->ReleaseWrites(id);
+        return ShimFile::xClose();
+    }
+
+    int TieredFile::xRead(void *pBuff, long readCount, long offset) {
+        assert(readCount >= 0);
+        assert(offset >= 0);
+        if (readCount == 0)
+            return Succeed;
+        int pageSize = pTieredVFS->pageSize;
+        long firstPage = offset / pageSize;
+        long lastPage = (offset + readCount - 1) / pageSize;
+        auto zBuff = static_cast<unsigned char *>(pBuff);
+
+        pthread_mutex_lock(&mutex);
+        Touch(firstPage, lastPage);
+        if (AllHot(firstPage, lastPage)) {
+            for (long pgno = firstPage; pgno <= lastPage; pgno++) {
+                long from = std::max(offset, pgno * pageSize);
+                long to = std::min(offset + readCount, (pgno + 1) * pageSize);
+                memcpy(&zBuff[from - offset], &pages[pgno].pHot[from - pgno * pageSize], to - from);
+            }
+            stats.nHit++;
+            int status = offset + readCount > fileSize ? IOError_ReadShort : Succeed;
+            pthread_mutex_unlock(&mutex);
+            MaybeSweep();
+            return status;
+        }
+        stats.nMiss++;
+        unsigned long gen = writeGen;
+        pthread_mutex_unlock(&mutex);
+
+        int status = pReal->xRead(pBuff, readCount, offset);
+        if (status != Succeed && status != IOError_ReadShort)
+            return status;
+
+        pthread_mutex_lock(&mutex);
+        for (long pgno = firstPage; pgno <= lastPage && pgno * pageSize < fileSize; pgno++) {
+            auto &stat = pages[pgno];
+            if (stat.pHot || stat.nAccess < pTieredVFS->promoteThreshold)
+                continue;
+            long pageEnd = std::min((pgno + 1) * pageSize, fileSize);
+            if (pgno * pageSize >= offset && pageEnd <= offset + readCount) {
+                if (Fresh(stat, gen))
+                    Promote(stat, &zBuff[pgno * pageSize - offset], pageEnd - pgno * pageSize);
+            } else
+                PromoteLater(pgno);
+        }
+        pthread_mutex_unlock(&mutex);
+        MaybeSweep();
+        return status;
+    }
+
+    int TieredFile::xWrite(const void *pBuff, long writeCount, long offset) {
+        assert(writeCount >= 0);
+        assert(offset >= 0);
+        if (writeCount == 0)
+            return Succeed;
+        int pageSize = pTieredVFS->pageSize;
+        long firstPage = offset / pageSize;
+        long lastPage = (offset + writeCount - 1) / pageSize;
+        auto zBuff = static_cast<const unsigned char *>(pBuff);
+
+        int status = pReal->xWrite(pBuff, writeCount, offset);
+        if (pWrites)
+            pWrites->fetch_add(1);
+
+        pthread_mutex_lock(&mutex);
+        unsigned long gen = ++writeGen;
+        Touch(firstPage, lastPage);
+        if (status == Succeed)
+            fileSize = std::max(fileSize, offset + writeCount);
+        for (long pgno = firstPage; pgno <= lastPage; pgno++) {
+            auto &stat = pages[pgno];
+            stat.lastWrite = gen;
+            long from = std::max(offset, pgno * pageSize);
+            long to = std::min(offset + writeCount, (pgno + 1) * pageSize);
+            if (stat.pHot) {
+                if (status == Succeed)
+                    memcpy(&stat.pHot[from - pgno * pageSize], &zBuff[from - offset], to - from);
+                else {
+                    stat.pHot.reset();
+                    nHot--;
+                }
+            } else if (status == Succeed && stat.nAccess >= pTieredVFS->promoteThreshold &&
+                       from == pgno * pageSize && to == (pgno + 1) * pageSize)
+                Promote(stat, &zBuff[from - offset], pageSize);
+        }
+        pthread_mutex_unlock(&mutex);
+        MaybeSweep();
+        return status;
+    }
+
+    int TieredFile::xTruncate(long size) {
+        int pageSize = pTieredVFS->pageSize;
+        int status = pReal->xTruncate(size);
+        if (pWrites)
+            pWrites->fetch_add(1);
+
+        pthread_mutex_lock(&mutex);
+        unsigned long gen = ++writeGen;
+        for (auto &it: pages) {
+            long pgno = it.first;
+            it.second.lastWrite = gen;
+            if (!it.second.pHot || (pgno + 1) * pageSize <= size)
+                continue;
+            if (status == Succeed && pgno * pageSize < size)
+                memset(&it.second.pHot[size - pgno * pageSize], 0, (pgno + 1) * pageSize - size);
+            else {
+                it.second.pHot.reset();
+                nHot--;
+            }
+        }
+        if (status == Succeed)
+            fileSize = size;
+        pthread_mutex_unlock(&mutex);
+        return status;
+    }
+
+    //another handle or process may have written the file while we held no
+    //lock.the stamp taken when the lock was given up is checked again when
+    //a shared lock is taken from none,any difference in mtime,size or the
+    //writes counted on the inode drops the whole tier
+    int TieredFile::xLock(int eFileLock) {
+        int status = pReal->xLock(eFileLock);
+        if (status != Succeed)
+            return status;
+        bool bFromNone = eLock == Lock_None;
+        eLock = std::max(eLock, eFileLock);
+        if (!bFromNone || eFileLock != Lock_Shared)
+            return status;
+        FileStamp now;
+        bool bStale = Stamp(&now) != Succeed || now.mtime != stamp.mtime || now.size != stamp.size ||
+                      now.nWrite != stamp.nWrite;
+        pthread_mutex_lock(&mutex);
+        if (bStale) {
+            DropAll();
+            if (now.size >= 0)
+                fileSize = now.size;
+        }
+        pthread_mutex_unlock(&mutex);
+        return status;
+    }
+
+    //the stamp is taken while the lock is still held,so no writer can come
+    //in between it and the unlock
+    int TieredFile::xUnlock(int eFileLock) {
+        if (eFileLock == Lock_None && eLock != Lock_None && Stamp(&stamp) != Succeed)
+            stamp = FileStamp();
+        int status = pReal->xUnlock(eFileLock);
+        if (status == Succeed)
+            eLock = std::min(eLock, eFileLock);
+        return status;
+    }
+
+    int TieredFile::xFileControl(int op, void *pArg) {
+        if (op == Fcntl_TierStats) {
+            pthread_mutex_lock(&mutex);
+            *(TierStats *) pArg = stats;
+            ((TierStats *) pArg)->nHotPage = nHot;
+            pthread_mutex_unlock(&mutex);
+            return Succeed;
+        }
+        return ShimFile::xFileControl(op, pArg);
+    }
+
+    TieredFile::TieredFile(TieredVFS *pVFS, tinySQL_file *pReal) :
+            ShimFile(pVFS, pReal), pages(), mutex(), background(), fileSize(0), nHot(0), writeGen(0),
+            dropGen(0), nAccessSinceSweep(0), bSweeping(false), stats(), eLock(Lock_None), stamp(), id(),
+            pWrites(nullptr), pTieredVFS(pVFS) {
+        pthread_mutex_init(&mutex, nullptr);
+        if (pReal->xFileControl(Fcntl_FileId, &id) == Succeed)
+            pWrites = pVFS->AcquireWrites(id);
+        unsigned long size;
+        if (pReal->xFileSize(&size) == Succeed)
+            fileSize = static_cast<long>(size);
+    }
+
+    TieredFile::~TieredFile() {
+        pthread_mutex_destroy(&mutex);
+    }
+}
@@ -0,0 +1,116 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_TIEREDVFS_H
+#define SQLITELIKE_TINYSQL_TIEREDVFS_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include "tinySQL_Shim.h"
+#include "tinySQL_ThreadPool.h"
+
+namespace tinySQL {
+
+    //filled by xFileControl(Fcntl_TierStats)
+    struct TierStats {
+        long nHotPage;
+        long nHit;
+        long nMiss;
+        long nPromote;
+        long nDemote;
+    };
+
+    //keeps the most used pages of each file in memory in front of the file
+    //of pBase.writes go through to the backing file at once,only xSync syncs
+    class TieredVFS final : public ShimVFS {
+    private:
+        //writes through any handle of this vfs to one inode,mtime alone can
+        //miss writes that land in the same clock tick
+        struct InodeWrites {
+            int nRef;
+            std::atomic<unsigned long> nWrite;
+        };
+        std::map<std::pair<unsigned long, unsigned long>, InodeWrites *> inodes;
+        pthread_mutex_t inodeMutex;
+
+        friend class TieredFile;
+        std::atomic<unsigned long> *AcquireWrites(const FileIdentity &id);
+        void ReleaseWrites(const FileIdentity &id);
+    public:
+        const int pageSize;
+        const long maxHotPage;
+        const unsigned promoteThreshold;
+        ThreadPool *const pPool;
+
+        int xOpen(const char *zName, tinySQL_file **ppFile,
+                  int flags, int *pOutFlags) override;
+
+        TieredVFS(std::string name, tinySQL_VFS *pBase, int pageSize = 4096,
+                  long maxHotPage = 1024, unsigned promoteThreshold = 2);
+        ~TieredVFS();
+    };
+
+    class TieredFile : public ShimFile {
+    private:
+        struct PageStat {
+            unsigned nAccess = 0;
+            bool bPending = false;
+            unsigned long lastWrite = 0;
+            std::unique_ptr<unsigned char[]> pHot;
+        };
+        //the file as this handle left it when it last gave up its lock
+        struct FileStamp {
+            long mtime = -1;
+            long size = -1;
+            unsigned long nWrite = 0;
+        };
+
+        std::unordered_map<long, PageStat> pages;
+        pthread_mutex_t mutex;
+        TaskGroup background;
+        long fileSize;
+        long nHot;
+        unsigned long writeGen;
+        unsigned long dropGen;
+        long nAccessSinceSweep;
+        bool bSweeping;
+        TierStats stats;
+        int eLock;
+        FileStamp stamp;
+        FileIdentity id;
+        std::atomic<unsigned long> *pWrites;
+
+        bool AllHot(long firstPage, long lastPage);
+        bool Fresh(const PageStat &stat, unsigned long gen) const;
+        void Promote(PageStat &stat, const unsigned char *pData, long nByte);
+        void PromoteLater(long pgno);
+        void Touch(long firstPage, long lastPage);
+        void MaybeSweep();
+        void Sweep();
+        void DropAll();
+        int Stamp(FileStamp *pStamp);
+    public:
+        TieredVFS *const pTieredVFS;
+
+        int xClose() override;
+
+        int xRead(void *pBuff, long readCount, long offset) override;
+
+        int xWrite(const void *pBuff, long writeCount, long offset) override;
+
+        int xTruncate(long size) override;
+
+        int xLock(int eFileLock) override;
+
+        int xUnlock(int eFileLock) override;
+
+        int xFileControl(int op, void *pArg) override;
+
+        TieredFile(TieredVFS *pVFS, tinySQL_file *pReal);
+        ~TieredFile() override;
+    };
+}
+#endif //SQLITELIKE_TINYSQL_TIEREDVFS_H
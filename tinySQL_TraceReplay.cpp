@@ -0,0 +1,174 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+#include "tinySQL_Clock.h"
+#include "tinySQL_TraceVFS.h"
+
+namespace tinySQL {
+
+    //sequential reader over the trace file
+    struct TraceReader {
+        tinySQL_file *pFile;
+        std::vector<char> buffer;
+        long fileOffset;
+        long begin;
+        long end;
+
+        explicit TraceReader(tinySQL_file *pFile) : pFile(pFile), buffer(1 << 20), fileOffset(0), begin(0), end(0) {
+        }
+
+        bool Read(void *pOut, long n) {
+            auto zOut = static_cast<char *>(pOut);
+            while (n > 0) {
+                if (begin == end) {
+                    int status = pFile->xRead(buffer.data(), static_cast<long>(buffer.size()), fileOffset);
+                    if (status != Succeed && status != IOError_ReadShort)
+                        return false;
+                    unsigned long size;
+                    if (pFile->xFileSize(&size) != Succeed)
+                        return false;
+                    begin = 0;
+                    end = std::min(static_cast<long>(buffer.size()), static_cast<long>(size) - fileOffset);
+                    if (end <= 0)
+                        return false;
+                    fileOffset += end;
+                }
+                long take = std::min(n, end - begin);
+                memcpy(zOut, &buffer[begin], take);
+                begin += take;
+                zOut += take;
+                n -= take;
+            }
+            return true;
+        }
+    };
+
+    static std::string ReplayPath(const std::string &name, const char *zDir) {
+        if (zDir == nullptr)
+            return name;
+        auto slash = name.rfind('/');
+        return std::string(zDir) + "/" + (slash == std::string::npos ? name : name.substr(slash + 1));
+    }
+
+    int TraceReplay(tinySQL_VFS *pTarget, const char *zTrace, const ReplayOptions &options, ReplayStats *pStats) {
+        assert(pTarget && zTrace && pStats);
+        tinySQL_file *pTrace = nullptr;
+        int status = tinySQL_VFS::VFSGet(0)->xOpen(zTrace, &pTrace, Open_ReadOnly, nullptr);
+        if (status != Succeed)
+            return status;
+
+        TraceReader reader(pTrace);
+        TraceFileHeader header{};
+        if (!reader.Read(&header, sizeof(header)) || memcmp(header.magic, TraceMagic, sizeof(TraceMagic)) != 0 ||
+            header.version != TraceVersion || header.recordSize != sizeof(TraceRecord)) {
+            pTrace->xClose();
+            return IOError_Read;
+        }
+
+        std::unordered_map<uint32_t, tinySQL_file *> files;
+        std::vector<char> data;
+        *pStats = ReplayStats();
+        uint64_t start = Clock::Monotonic();
+        TraceRecord record{};
+
+        while (reader.Read(&record, sizeof(record))) {
+            std::string name;
+            if (record.op == Trace_Open || record.op == Trace_Delete) {
+                name.resize(record.length);
+                if (!reader.Read(&name[0], record.length))
+                    break;
+                name = ReplayPath(name, options.zDir);
+            }
+            if (!options.bMaxSpeed) {
+                uint64_t now = Clock::Monotonic() - start;
+                if (record.timestamp > now) {
+                    uint64_t wait = record.timestamp - now;
+                    struct timespec ts{static_cast<time_t>(wait / 1000000000ull),
+                                       static_cast<long>(wait % 1000000000ull)};
+                    nanosleep(&ts, nullptr);
+                }
+            }
+
+            auto it = files.find(record.fileId);
+            tinySQL_file *pFile = it == files.end() ? nullptr : it->second;
+            if (pFile == nullptr && record.op != Trace_Open && record.op != Trace_Delete) {
+                pStats->nSkipped++;
+                continue;
+            }
+            int rc = Succeed;
+            switch (record.op) {
+                case Trace_Open:
+                    rc = pTarget->xOpen(record.length == 0 ? nullptr : name.c_str(), &pFile,
+                                        static_cast<int>(record.offset), nullptr);
+                    if (rc == Succeed)
+                        files[record.fileId] = pFile;
+                    break;
+                case Trace_Delete:
+                    rc = pTarget->xDelete(name.c_str());
+                    break;
+                case Trace_Close:
+                    rc = pFile->xClose();
+                    files.erase(it);
+                    break;
+                case Trace_Read:
+                    data.resize(std::max(data.size(), static_cast<size_t>(record.length)));
+                    rc = pFile->xRead(data.data(), record.length, record.offset);
+                    pStats->nReadByte += record.length;
+                    break;
+                case Trace_Write:
+                    if (data.size() < static_cast<size_t>(record.length))
+                        data.resize(record.length, 0x5a);
+                    rc = pFile->xWrite(data.data(), record.length, record.offset);
+                    pStats->nWriteByte += record.length;
+                    break;
+                case Trace_Truncate:
+                    rc = pFile->xTruncate(record.offset);
+                    break;
+                case Trace_Sync:
+                    rc = pFile->xSync(static_cast<int>(record.offset));
+                    break;
+                case Trace_FileSize: {
+                    unsigned long size;
+                    rc = pFile->xFileSize(&size);
+                    break;
+                }
+                case Trace_Lock:
+                    rc = pFile->xLock(static_cast<int>(record.offset));
+                    break;
+                case Trace_Unlock:
+                    rc = pFile->xUnlock(static_cast<int>(record.offset));
+                    break;
+                case Trace_CheckReservedLock: {
+                    int reserved;
+                    rc = pFile->xCheckReservedLock(&reserved);
+                    break;
+                }
+                case Trace_FileControl:
+                    if (record.offset != Fcntl_SizeHint) {
+                        pStats->nSkipped++;
+                        continue;
+                    } else {
+                        long hint = record.length;
+                        rc = pFile->xFileControl(Fcntl_SizeHint, &hint);
+                    }
+                    break;
+                default:
+                    pStats->nSkipped++;
+                    continue;
+            }
+            pStats->nOp++;
+            if (rc != record.status)
+                pStats->nMismatch++;
+        }
+
+        for (auto &it: files)
+            it.second->xClose();
+        pStats->elapsedNs = Clock::Monotonic() - start;
+        pTrace->xClose();
+        return Succeed;
+    }
+}
@@ -0,0 +1,220 @@
+//
+// Created by user on 26-10-19.
+//
+#include <sched.h>
+#include <sys/syscall.h>
+#include <ctime>
+#include "tinySQL_Clock.h"
+#include "tinySQL_TraceVFS.h"
+
+namespace tinySQL {
+
+    static constexpr long TraceBatchSize = 1 << 16;
+
+    static uint32_t CurrentThreadId() {
+        static thread_local uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+        return tid;
+    }
+
+    uint64_t TraceVFS::Now() const {
+        return Clock::Monotonic() - startNs;
+    }
+
+    //multi producer enqueue,each slot's sequence tells whose turn it is
+    void TraceVFS::Record(const TraceRecord &record, const char *zName) {
+        uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Slot *pSlot;
+        while (true) {
+            pSlot = &ring[pos & ringMask];
+            uint64_t sequence = pSlot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<int64_t>(sequence - pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                //ring is full,wait for the writer rather than lose the record
+                nStall.fetch_add(1, std::memory_order_relaxed);
+                sched_yield();
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            } else
+                pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+        pSlot->record = record;
+        pSlot->zName = nullptr;
+        if (zName) {
+            pSlot->zName = new char[record.length];
+            memcpy(pSlot->zName, zName, record.length);
+        }
+        pSlot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    //single consumer,moves ready records into one batch and appends it to the trace
+    bool TraceVFS::Drain(char *pBatch, long batchSize) {
+        long used = 0;
+        uint64_t nRecord = 0;
+        while (true) {
+            Slot *pSlot = &ring[dequeuePos & ringMask];
+            if (pSlot->sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+                break;
+            long need = sizeof(TraceRecord) + (pSlot->zName ? pSlot->record.length : 0);
+            if (used + need > batchSize)
+                break;
+            memcpy(&pBatch[used], &pSlot->record, sizeof(TraceRecord));
+            if (pSlot->zName) {
+                memcpy(&pBatch[used + sizeof(TraceRecord)], pSlot->zName, pSlot->record.length);
+                delete[] pSlot->zName;
+            }
+            used += need;
+            nRecord++;
+            pSlot->sequence.store(dequeuePos + ringMask + 1, std::memory_order_release);
+            dequeuePos++;
+        }
+        if (used == 0)
+            return false;
+        if (pTrace->xWrite(pBatch, used, traceSize) == Succeed)
+            traceSize += used;
+        else
+            nDropped.fetch_add(nRecord, std::memory_order_relaxed);
+        return true;
+    }
+
+    void *TraceVFS::WriterMain(void *pArg) {
+        auto pVFS = static_cast<TraceVFS *>(pArg);
+        char *pBatch = new char[TraceBatchSize];
+        struct timespec idle{0, 1000000};
+        while (!pVFS->bStop.load(std::memory_order_acquire))
+            if (!pVFS->Drain(pBatch, TraceBatchSize))
+                nanosleep(&idle, nullptr);
+        while (pVFS->Drain(pBatch, TraceBatchSize));
+        delete[] pBatch;
+        return nullptr;
+    }
+
+    int TraceVFS::xOpen(const char *zName, tinySQL_file **ppFile, int flags, int *pOutFlags) {
+        uint64_t start = Now();
+        tinySQL_file *pReal = nullptr;
+        int status = pBase->xOpen(zName, &pReal, flags, pOutFlags);
+        uint32_t fileId = nextFileId.fetch_add(1, std::memory_order_relaxed);
+        //temporary files opened without a name are recorded with an empty one
+        const char *zRecorded = zName ? zName : "";
+        TraceRecord record{start, Now() - start, flags, static_cast<int64_t>(strlen(zRecorded)), fileId,
+                           CurrentThreadId(), Trace_Open, Lock_None, static_cast<int16_t>(status), 0};
+        Record(record, zRecorded);
+        if (status == Succeed)
+            *ppFile = new TraceFile(this, pReal, fileId);
+        return status;
+    }
+
+    int TraceVFS::xDelete(const char *zName) {
+        uint64_t start = Now();
+        int status = pBase->xDelete(zName);
+        TraceRecord record{start, Now() - start, 0, static_cast<int64_t>(strlen(zName)), 0,
+                           CurrentThreadId(), Trace_Delete, Lock_None, static_cast<int16_t>(status), 0};
+        Record(record, zName);
+        return status;
+    }
+
+    TraceVFS::TraceVFS(std::string name, tinySQL_VFS *pBase, const char *zTracePath, int ringSize) :
+            ShimVFS(std::move(name), pBase), ring(nullptr), ringMask(ringSize - 1), enqueuePos(0),
+            dequeuePos(0), bStop(false), writer(), pTrace(nullptr), traceSize(0), startNs(Clock::Monotonic()),
+            nextFileId(1), nStall(0), nDropped(0) {
+        assert(ringSize > 0 && (ringSize & (ringSize - 1)) == 0);
+        if (pBase->xOpen(zTracePath, &pTrace, Open_Create | Open_ReadWrite, nullptr) != Succeed)
+            throw std::runtime_error("can not open the trace file");
+        TraceFileHeader header{};
+        memcpy(header.magic, TraceMagic, sizeof(TraceMagic));
+        header.version = TraceVersion;
+        header.recordSize = sizeof(TraceRecord);
+        pTrace->xTruncate(0);
+        pTrace->xWrite(&header, sizeof(header), 0);
+        traceSize = sizeof(header);
+
+        ring = new Slot[ringSize];
+        for (int i = 0; i < ringSize; i++)
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        if (pthread_create(&writer, nullptr, WriterMain, this))
+            throw std::runtime_error("can not create trace writer thread");
+    }
+
+    TraceVFS::~TraceVFS() {
+        bStop.store(true, std::memory_order_release);
+        pthread_join(writer, nullptr);
+        pTrace->xSync(0);
+        pTrace->xClose();
+        delete[] ring;
+    }
+
+
+    int TraceFile::Log(uint8_t op, uint64_t start, int64_t offset, int64_t length, int status) {
+        TraceRecord record{start, pTraceVFS->Now() - start, offset, length, fileId, CurrentThreadId(),
+                           op, eFileLock, static_cast<int16_t>(status), 0};
+        pTraceVFS->Record(record);
+        return status;
+    }
+
+    int TraceFile::xClose() {
+        uint64_t start = pTraceVFS->Now();
+        int status = pReal->xClose();
+        eFileLock = Lock_None;
+        Log(Trace_Close, start, 0, 0, status);
+        delete this;
+        return status;
+    }
+
+    int TraceFile::xRead(void *pBuff, long readCount, long offset) {
+        uint64_t start = pTraceVFS->Now();
+        return Log(Trace_Read, start, offset, readCount, pReal->xRead(pBuff, readCount, offset));
+    }
+
+    int TraceFile::xWrite(const void *pBuff, long writeCount, long offset) {
+        uint64_t start = pTraceVFS->Now();
+        return Log(Trace_Write, start, offset, writeCount, pReal->xWrite(pBuff, writeCount, offset));
+    }
+
+    int TraceFile::xTruncate(long size) {
+        uint64_t start = pTraceVFS->Now();
+        return Log(Trace_Truncate, start, size, 0, pReal->xTruncate(size));
+    }
+
+    int TraceFile::xSync(int flags) {
+        uint64_t start = pTraceVFS->Now();
+        return Log(Trace_Sync, start, flags, 0, pReal->xSync(flags));
+    }
+
+    int TraceFile::xFileSize(unsigned long *pSize) {
+        uint64_t start = pTraceVFS->Now();
+        int status = pReal->xFileSize(pSize);
+        return Log(Trace_FileSize, start, 0, status == Succeed ? static_cast<int64_t>(*pSize) : 0, status);
+    }
+
+    int TraceFile::xLock(int eLock) {
+        uint64_t start = pTraceVFS->Now();
+        int status = pReal->xLock(eLock);
+        if (status == Succeed && eLock > eFileLock)
+            eFileLock = eLock;
+        return Log(Trace_Lock, start, eLock, 0, status);
+    }
+
+    int TraceFile::xUnlock(int eLock) {
+        uint64_t start = pTraceVFS->Now();
+        int status = pReal->xUnlock(eLock);
+        if (status == Succeed && eLock < eFileLock)
+            eFileLock = eLock;
+        return Log(Trace_Unlock, start, eLock, 0, status);
+    }
+
+    int TraceFile::xCheckReservedLock(int *pResOut) {
+        uint64_t start = pTraceVFS->Now();
+        return Log(Trace_CheckReservedLock, start, 0, 0, pReal->xCheckReservedLock(pResOut));
+    }
+
+    int TraceFile::xFileControl(int op, void *pArg) {
+        uint64_t start = pTraceVFS->Now();
+        int64_t length = op == Fcntl_SizeHint ? *(long *) pArg : 0;
+        return Log(Trace_FileControl, start, op, length, ShimFile::xFileControl(op, pArg));
+    }
+
+    TraceFile::TraceFile(TraceVFS *pVFS, tinySQL_file *pReal, uint32_t fileId) :
+            ShimFile(pVFS, pReal), pTraceVFS(pVFS), fileId(fileId), eFileLock(Lock_None) {
+    }
+}
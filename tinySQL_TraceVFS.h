@@ -0,0 +1,144 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_TRACEVFS_H
+#define SQLITELIKE_TINYSQL_TRACEVFS_H
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include "tinySQL_Shim.h"
+
+namespace tinySQL {
+
+    static constexpr int Trace_Open = 1;
+    static constexpr int Trace_Close = 2;
+    static constexpr int Trace_Read = 3;
+    static constexpr int Trace_Write = 4;
+    static constexpr int Trace_Truncate = 5;
+    static constexpr int Trace_Sync = 6;
+    static constexpr int Trace_FileSize = 7;
+    static constexpr int Trace_Lock = 8;
+    static constexpr int Trace_Unlock = 9;
+    static constexpr int Trace_CheckReservedLock = 10;
+    static constexpr int Trace_FileControl = 11;
+    static constexpr int Trace_Delete = 12;
+
+    static constexpr char TraceMagic[16] = "tinySQL-trace";
+    static constexpr uint32_t TraceVersion = 1;
+
+    //one fixed size record per call.Open and Delete records are followed by
+    //length bytes of file name.offset holds the flags for Open,the requested
+    //level for Lock/Unlock,the new size for Truncate and the op for FileControl
+    struct TraceRecord {
+        uint64_t timestamp;     //ns since the trace started,taken when the call began
+        uint64_t duration;      //ns spent in the call
+        int64_t offset;
+        int64_t length;
+        uint32_t fileId;
+        uint32_t threadId;
+        uint8_t op;
+        uint8_t lockLevel;      //lock held by the file once the call returned
+        int16_t status;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(TraceRecord) == 48, "trace records are written raw");
+
+    struct TraceFileHeader {
+        char magic[16];
+        uint32_t version;
+        uint32_t recordSize;
+    };
+
+    //logs every tinySQL_file call of files opened through it.records go
+    //through a lock free ring to a writer thread that appends them to the trace.
+    //a batch the trace file refuses is lost,its records are counted in nDropped
+    class TraceVFS final : public ShimVFS {
+    private:
+        struct Slot {
+            std::atomic<uint64_t> sequence;
+            TraceRecord record;
+            char *zName;
+        };
+
+        Slot *ring;
+        const uint64_t ringMask;
+        std::atomic<uint64_t> enqueuePos;
+        uint64_t dequeuePos;
+        std::atomic<bool> bStop;
+        pthread_t writer;
+        tinySQL_file *pTrace;
+        long traceSize;
+        uint64_t startNs;
+
+        static void *WriterMain(void *pArg);
+        bool Drain(char *pBatch, long batchSize);
+    public:
+        std::atomic<uint32_t> nextFileId;
+        std::atomic<uint64_t> nStall;
+        std::atomic<uint64_t> nDropped;
+
+        uint64_t Now() const;
+        void Record(const TraceRecord &record, const char *zName = nullptr);
+
+        int xOpen(const char *zName, tinySQL_file **ppFile,
+                  int flags, int *pOutFlags) override;
+
+        int xDelete(const char *zName) override;
+
+        //the trace file itself is created through pBase
+        TraceVFS(std::string name, tinySQL_VFS *pBase, const char *zTracePath, int ringSize = 1 << 16);
+        ~TraceVFS();
+    };
+
+    class TraceFile : public ShimFile {
+    private:
+        int Log(uint8_t op, uint64_t start, int64_t offset, int64_t length, int status);
+    public:
+        TraceVFS *const pTraceVFS;
+        const uint32_t fileId;
+        uint8_t eFileLock;
+
+        int xClose() override;
+
+        int xRead(void *pBuff, long readCount, long offset) override;
+
+        int xWrite(const void *pBuff, long writeCount, long offset) override;
+
+        int xTruncate(long size) override;
+
+        int xSync(int flags) override;
+
+        int xFileSize(unsigned long *pSize) override;
+
+        int xLock(int eFileLock) override;
+
+        int xUnlock(int eFileLock) override;
+
+        int xCheckReservedLock(int *pResOut) override;
+
+        int xFileControl(int op, void *pArg) override;
+
+        TraceFile(TraceVFS *pVFS, tinySQL_file *pReal, uint32_t fileId);
+    };
+
+    struct ReplayOptions {
+        bool bMaxSpeed;         //issue calls back to back instead of at their recorded time
+        const char *zDir;       //when set,files are reopened under this directory
+    };
+
+    struct ReplayStats {
+        long nOp;
+        long nSkipped;          //file controls other than size hints are not replayed
+        long nMismatch;         //calls whose status differs from the recorded one
+        long nReadByte;
+        long nWriteByte;
+        uint64_t elapsedNs;
+    };
+
+    //re-issue every call of the trace at zTrace,read through the first VFS,
+    //against pTarget in recorded order on the calling thread
+    int TraceReplay(tinySQL_VFS *pTarget, const char *zTrace, const ReplayOptions &options, ReplayStats *pStats);
+}
+#endif //SQLITELIKE_TINYSQL_TRACEVFS_H
@@ -5,6 +5,7 @@
 #ifndef SQLITELIKE_TINYSQL_VFS_H
 #define SQLITELIKE_TINYSQL_VFS_H
 
+#include <cstdint>
 #include <string>
 #include <list>
 #include <utility>
@@ -58,15 +59,26 @@ namespace tinySQL {
 
         virtual int xSleep(int microseconds) = 0;
 
+        virtual int xSleepNs(uint64_t ns) = 0;
+
+        //seconds since the epoch
         virtual int xCurrentTime(double *) = 0;
 
         virtual int xGetLastError(int, char *) = 0;
 
 
+        //seconds since the epoch
         virtual int xCurrentTimeInt64(unsigned long *) = 0;
 
+        //nanoseconds since the epoch
+        virtual int xWallTimeNs(uint64_t *pNs) = 0;
+
+        //nanoseconds from an arbitrary point,never going back
+        virtual int xMonotonicTime(uint64_t *pNs) = 0;
+
 
         static tinySQL_VFS * VFSGet(int index);
+        static tinySQL_VFS * VFSFind(const char *zName);
     };
 }
 #endif //SQLITELIKE_TINYSQL_VFS_H
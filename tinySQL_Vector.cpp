@@ -0,0 +1,611 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cassert>
+#include "tinySQL_Vector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TINYSQL_VECTOR_X86 1
+#endif
+
+namespace tinySQL {
+
+    template<int op>
+    static inline bool Test(int64_t a, int64_t b) {
+        switch (op) {
+            case Cmp_Lt:
+                return a < b;
+            case Cmp_Le:
+                return a <= b;
+            case Cmp_Eq:
+                return a == b;
+            case Cmp_Ne:
+                return a != b;
+            case Cmp_Gt:
+                return a > b;
+            default:
+                return a >= b;
+        }
+    }
+
+    template<int op>
+    static inline int64_t Apply(int64_t a, int64_t b) {
+        //unsigned so that overflow wraps instead of being undefined
+        auto x = static_cast<uint64_t>(a), y = static_cast<uint64_t>(b);
+        switch (op) {
+            case Arith_Add:
+                return static_cast<int64_t>(x + y);
+            case Arith_Sub:
+                return static_cast<int64_t>(x - y);
+            default:
+                return static_cast<int64_t>(x * y);
+        }
+    }
+
+    //the predicate is stored unconditionally and the count advanced by it,
+    //so the loop has no branch to mispredict on selective filters
+    template<int op>
+    static int FilterScalar(const int64_t *pColumn, int64_t value, const uint16_t *pSel, int n, uint16_t *pOut,
+                            int i, int nOut) {
+        for (; i < n; i++) {
+            uint16_t row = pSel ? pSel[i] : static_cast<uint16_t>(i);
+            pOut[nOut] = row;
+            nOut += Test<op>(pColumn[row], value);
+        }
+        return nOut;
+    }
+
+    template<int op>
+    static int FilterScalar(const int64_t *pColumn, int64_t value, const uint16_t *pSel, int n, uint16_t *pOut) {
+        return FilterScalar<op>(pColumn, value, pSel, n, pOut, 0, 0);
+    }
+
+    static int64_t SumScalar(const int64_t *pColumn, const uint16_t *pSel, int n, int i) {
+        uint64_t sum = 0;
+        for (; i < n; i++)
+            sum += static_cast<uint64_t>(pColumn[pSel ? pSel[i] : i]);
+        return static_cast<int64_t>(sum);
+    }
+
+    static void MinMaxScalar(const int64_t *pColumn, const uint16_t *pSel, int n, int i, int64_t *pMin,
+                             int64_t *pMax) {
+        for (; i < n; i++) {
+            int64_t x = pColumn[pSel ? pSel[i] : i];
+            *pMin = std::min(*pMin, x);
+            *pMax = std::max(*pMax, x);
+        }
+    }
+
+    template<int op>
+    static void ArithScalar(const int64_t *a, const int64_t *b, int64_t c, int n, int64_t *pOut, int i) {
+        for (; i < n; i++)
+            pOut[i] = Apply<op>(a[i], b ? b[i] : c);
+    }
+
+    template<int op>
+    static void ArithScalar(const int64_t *a, const int64_t *b, int64_t c, int n, int64_t *pOut) {
+        ArithScalar<op>(a, b, c, n, pOut, 0);
+    }
+
+#ifdef TINYSQL_VECTOR_X86
+    //pshufb control packing the 16 bit lanes picked by an 8 bit mask to the
+    //front,and the number of lanes picked
+    struct CompressTable {
+        alignas(16) unsigned char shuffle[256][16];
+        unsigned char count[256];
+
+        CompressTable() : shuffle(), count() {
+            for (int mask = 0; mask < 256; mask++) {
+                int k = 0;
+                for (int lane = 0; lane < 8; lane++)
+                    if (mask & (1 << lane)) {
+                        shuffle[mask][k++] = static_cast<unsigned char>(2 * lane);
+                        shuffle[mask][k++] = static_cast<unsigned char>(2 * lane + 1);
+                    }
+                count[mask] = static_cast<unsigned char>(k / 2);
+                while (k < 16)
+                    shuffle[mask][k++] = 0x80;
+            }
+        }
+    };
+
+    static const CompressTable compressTable;
+
+    //eight row numbers go out with one store,the lanes past the count are
+    //overwritten by the next store.nOut never passes i,so pOut may be pSel
+    __attribute__((target("ssse3"), always_inline))
+    static inline int StoreSelected(__m128i rows, unsigned mask, uint16_t *pOut, int nOut) {
+        __m128i control = _mm_load_si128(reinterpret_cast<const __m128i *>(compressTable.shuffle[mask]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + nOut), _mm_shuffle_epi8(rows, control));
+        return nOut + compressTable.count[mask];
+    }
+
+    //the compare predicate has to be an immediate
+    template<int op>
+    struct Avx512Predicate {
+        static constexpr int value = op == Cmp_Lt ? _MM_CMPINT_LT : op == Cmp_Le ? _MM_CMPINT_LE :
+                                     op == Cmp_Eq ? _MM_CMPINT_EQ : op == Cmp_Ne ? _MM_CMPINT_NE :
+                                     op == Cmp_Gt ? _MM_CMPINT_NLE : _MM_CMPINT_NLT;
+    };
+
+    //the masked gather starts from zeros.the plain one,like the plain
+    //min,max and reduce intrinsics,starts from an undefined register that
+    //gcc warns about
+    __attribute__((target("avx512f"), always_inline))
+    static inline __m512i Gather(__m256i rows, const int64_t *pColumn) {
+        return _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), 0xFF, rows, pColumn, 8);
+    }
+
+    template<int op>
+    __attribute__((target("avx512f,avx512dq,avx2,ssse3")))
+    static int FilterAVX512(const int64_t *pColumn, int64_t value, const uint16_t *pSel, int n, uint16_t *pOut) {
+        const __m512i v = _mm512_set1_epi64(value);
+        const __m128i iota = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+        int i = 0, nOut = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i rows;
+            __m512i x;
+            if (pSel) {
+                rows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSel + i));
+                x = Gather(_mm256_cvtepu16_epi32(rows), pColumn);
+            } else {
+                rows = _mm_add_epi16(_mm_set1_epi16(static_cast<short>(i)), iota);
+                x = _mm512_loadu_si512(pColumn + i);
+            }
+            unsigned mask = _mm512_cmp_epi64_mask(x, v, Avx512Predicate<op>::value);
+            nOut = StoreSelected(rows, mask, pOut, nOut);
+        }
+        return FilterScalar<op>(pColumn, value, pSel, n, pOut, i, nOut);
+    }
+
+    __attribute__((target("avx512f,avx512dq,avx2")))
+    static int64_t SumAVX512(const int64_t *pColumn, const uint16_t *pSel, int n) {
+        __m512i sum0 = _mm512_setzero_si512(), sum1 = _mm512_setzero_si512();
+        int i = 0;
+        if (pSel) {
+            for (; i + 8 <= n; i += 8) {
+                __m256i rows = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSel + i)));
+                sum0 = _mm512_add_epi64(sum0, Gather(rows, pColumn));
+            }
+        } else {
+            for (; i + 16 <= n; i += 16) {
+                sum0 = _mm512_add_epi64(sum0, _mm512_loadu_si512(pColumn + i));
+                sum1 = _mm512_add_epi64(sum1, _mm512_loadu_si512(pColumn + i + 8));
+            }
+        }
+        alignas(64) uint64_t lanes[8];
+        _mm512_store_si512(lanes, _mm512_add_epi64(sum0, sum1));
+        uint64_t sum = 0;
+        for (uint64_t lane: lanes)
+            sum += lane;
+        return static_cast<int64_t>(sum + static_cast<uint64_t>(SumScalar(pColumn, pSel, n, i)));
+    }
+
+    __attribute__((target("avx512f,avx512dq,avx2")))
+    static void MinMaxAVX512(const int64_t *pColumn, const uint16_t *pSel, int n, int64_t *pMin, int64_t *pMax) {
+        __m512i min = _mm512_set1_epi64(INT64_MAX), max = _mm512_set1_epi64(INT64_MIN);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m512i x;
+            if (pSel) {
+                __m256i rows = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSel + i)));
+                x = Gather(rows, pColumn);
+            } else
+                x = _mm512_loadu_si512(pColumn + i);
+            min = _mm512_mask_min_epi64(min, 0xFF, min, x);
+            max = _mm512_mask_max_epi64(max, 0xFF, max, x);
+        }
+        alignas(64) int64_t lanes[2][8];
+        _mm512_store_si512(lanes[0], min);
+        _mm512_store_si512(lanes[1], max);
+        *pMin = *std::min_element(lanes[0], lanes[0] + 8);
+        *pMax = *std::max_element(lanes[1], lanes[1] + 8);
+        MinMaxScalar(pColumn, pSel, n, i, pMin, pMax);
+    }
+
+    template<int op>
+    __attribute__((target("avx512f,avx512dq,avx2")))
+    static void ArithAVX512(const int64_t *a, const int64_t *b, int64_t c, int n, int64_t *pOut) {
+        const __m512i vc = _mm512_set1_epi64(c);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m512i x = _mm512_loadu_si512(a + i);
+            __m512i y = b ? _mm512_loadu_si512(b + i) : vc;
+            __m512i r;
+            switch (op) {
+                case Arith_Add:
+                    r = _mm512_add_epi64(x, y);
+                    break;
+                case Arith_Sub:
+                    r = _mm512_sub_epi64(x, y);
+                    break;
+                default:
+                    r = _mm512_mullo_epi64(x, y);
+            }
+            _mm512_storeu_si512(pOut + i, r);
+        }
+        ArithScalar<op>(a, b, c, n, pOut, i);
+    }
+
+    //avx2 compares 64 bit lanes only for equal and greater,the rest are built from those
+    template<int op>
+    __attribute__((target("avx2"), always_inline))
+    static inline unsigned CompareAVX2(__m256i x, __m256i v) {
+        __m256i r;
+        bool bNot;
+        switch (op) {
+            case Cmp_Lt:
+                r = _mm256_cmpgt_epi64(v, x);
+                bNot = false;
+                break;
+            case Cmp_Le:
+                r = _mm256_cmpgt_epi64(x, v);
+                bNot = true;
+                break;
+            case Cmp_Eq:
+                r = _mm256_cmpeq_epi64(x, v);
+                bNot = false;
+                break;
+            case Cmp_Ne:
+                r = _mm256_cmpeq_epi64(x, v);
+                bNot = true;
+                break;
+            case Cmp_Gt:
+                r = _mm256_cmpgt_epi64(x, v);
+                bNot = false;
+                break;
+            default:
+                r = _mm256_cmpgt_epi64(v, x);
+                bNot = true;
+        }
+        auto mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(r)));
+        return bNot ? mask ^ 0xf : mask;
+    }
+
+    template<int op>
+    __attribute__((target("avx2,ssse3")))
+    static int FilterAVX2(const int64_t *pColumn, int64_t value, const uint16_t *pSel, int n, uint16_t *pOut) {
+        const __m256i v = _mm256_set1_epi64x(value);
+        const __m128i iota = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+        const auto *base = reinterpret_cast<const long long *>(pColumn);
+        int i = 0, nOut = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i rows;
+            __m256i lo, hi;
+            if (pSel) {
+                rows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSel + i));
+                __m256i index = _mm256_cvtepu16_epi32(rows);
+                lo = _mm256_i32gather_epi64(base, _mm256_castsi256_si128(index), 8);
+                hi = _mm256_i32gather_epi64(base, _mm256_extracti128_si256(index, 1), 8);
+            } else {
+                rows = _mm_add_epi16(_mm_set1_epi16(static_cast<short>(i)), iota);
+                lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pColumn + i));
+                hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pColumn + i + 4));
+            }
+            unsigned mask = CompareAVX2<op>(lo, v) | CompareAVX2<op>(hi, v) << 4;
+            nOut = StoreSelected(rows, mask, pOut, nOut);
+        }
+        return FilterScalar<op>(pColumn, value, pSel, n, pOut, i, nOut);
+    }
+
+    __attribute__((target("avx2")))
+    static int64_t SumAVX2(const int64_t *pColumn, const uint16_t *pSel, int n) {
+        const auto *base = reinterpret_cast<const long long *>(pColumn);
+        __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+        int i = 0;
+        if (pSel) {
+            for (; i + 4 <= n; i += 4) {
+                __m128i rows = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pSel + i)));
+                sum0 = _mm256_add_epi64(sum0, _mm256_i32gather_epi64(base, rows, 8));
+            }
+        } else {
+            for (; i + 8 <= n; i += 8) {
+                sum0 = _mm256_add_epi64(sum0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pColumn + i)));
+                sum1 = _mm256_add_epi64(sum1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pColumn + i + 4)));
+            }
+        }
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(sum0, sum1));
+        uint64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        return static_cast<int64_t>(sum + static_cast<uint64_t>(SumScalar(pColumn, pSel, n, i)));
+    }
+
+    __attribute__((target("avx2")))
+    static void MinMaxAVX2(const int64_t *pColumn, const uint16_t *pSel, int n, int64_t *pMin, int64_t *pMax) {
+        const auto *base = reinterpret_cast<const long long *>(pColumn);
+        __m256i min = _mm256_set1_epi64x(INT64_MAX), max = _mm256_set1_epi64x(INT64_MIN);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x;
+            if (pSel) {
+                __m128i rows = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pSel + i)));
+                x = _mm256_i32gather_epi64(base, rows, 8);
+            } else
+                x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pColumn + i));
+            min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+            max = _mm256_blendv_epi8(max, x, _mm256_cmpgt_epi64(x, max));
+        }
+        alignas(32) int64_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), min);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes + 4), max);
+        *pMin = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        *pMax = std::max(std::max(lanes[4], lanes[5]), std::max(lanes[6], lanes[7]));
+        MinMaxScalar(pColumn, pSel, n, i, pMin, pMax);
+    }
+
+    //low 64 bits of the product from three 32x32 multiplies
+    __attribute__((target("avx2"), always_inline))
+    static inline __m256i MulAVX2(__m256i x, __m256i y) {
+        __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), y),
+                                         _mm256_mul_epu32(x, _mm256_srli_epi64(y, 32)));
+        return _mm256_add_epi64(_mm256_mul_epu32(x, y), _mm256_slli_epi64(cross, 32));
+    }
+
+    template<int op>
+    __attribute__((target("avx2")))
+    static void ArithAVX2(const int64_t *a, const int64_t *b, int64_t c, int n, int64_t *pOut) {
+        const __m256i vc = _mm256_set1_epi64x(c);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i y = b ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)) : vc;
+            __m256i r;
+            switch (op) {
+                case Arith_Add:
+                    r = _mm256_add_epi64(x, y);
+                    break;
+                case Arith_Sub:
+                    r = _mm256_sub_epi64(x, y);
+                    break;
+                default:
+                    r = MulAVX2(x, y);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pOut + i), r);
+        }
+        ArithScalar<op>(a, b, c, n, pOut, i);
+    }
+#endif
+
+    typedef int (*FilterKernel)(const int64_t *pColumn, int64_t value, const uint16_t *pSel, int n, uint16_t *pOut);
+    typedef int64_t (*SumKernel)(const int64_t *pColumn, const uint16_t *pSel, int n);
+    typedef void (*MinMaxKernel)(const int64_t *pColumn, const uint16_t *pSel, int n, int64_t *pMin, int64_t *pMax);
+    typedef void (*ArithKernel)(const int64_t *a, const int64_t *b, int64_t c, int n, int64_t *pOut);
+
+    struct VectorKernels {
+        const char *zName;
+        FilterKernel filter[6];
+        SumKernel sum;
+        MinMaxKernel minMax;
+        ArithKernel arith[3];
+    };
+
+    static int64_t SumScalar(const int64_t *pColumn, const uint16_t *pSel, int n) {
+        return SumScalar(pColumn, pSel, n, 0);
+    }
+
+    static void MinMaxScalar(const int64_t *pColumn, const uint16_t *pSel, int n, int64_t *pMin, int64_t *pMax) {
+        *pMin = INT64_MAX;
+        *pMax = INT64_MIN;
+        MinMaxScalar(pColumn, pSel, n, 0, pMin, pMax);
+    }
+
+    static const VectorKernels scalarKernels = {
+            "scalar",
+            {FilterScalar<Cmp_Lt>, FilterScalar<Cmp_Le>, FilterScalar<Cmp_Eq>,
+             FilterScalar<Cmp_Ne>, FilterScalar<Cmp_Gt>, FilterScalar<Cmp_Ge>},
+            SumScalar, MinMaxScalar,
+            {ArithScalar<Arith_Add>, ArithScalar<Arith_Sub>, ArithScalar<Arith_Mul>}
+    };
+
+#ifdef TINYSQL_VECTOR_X86
+    static const VectorKernels avx2Kernels = {
+            "avx2",
+            {FilterAVX2<Cmp_Lt>, FilterAVX2<Cmp_Le>, FilterAVX2<Cmp_Eq>,
+             FilterAVX2<Cmp_Ne>, FilterAVX2<Cmp_Gt>, FilterAVX2<Cmp_Ge>},
+            SumAVX2, MinMaxAVX2,
+            {ArithAVX2<Arith_Add>, ArithAVX2<Arith_Sub>, ArithAVX2<Arith_Mul>}
+    };
+
+    static const VectorKernels avx512Kernels = {
+            "avx512",
+            {FilterAVX512<Cmp_Lt>, FilterAVX512<Cmp_Le>, FilterAVX512<Cmp_Eq>,
+             FilterAVX512<Cmp_Ne>, FilterAVX512<Cmp_Gt>, FilterAVX512<Cmp_Ge>},
+            SumAVX512, MinMaxAVX512,
+            {ArithAVX512<Arith_Add>, ArithAVX512<Arith_Sub>, ArithAVX512<Arith_Mul>}
+    };
+#endif
+
+    static const VectorKernels *DetectKernels() {
+#ifdef TINYSQL_VECTOR_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+            __builtin_cpu_supports("avx2"))
+            return &avx512Kernels;
+        if (__builtin_cpu_supports("avx2"))
+            return &avx2Kernels;
+#endif
+        return &scalarKernels;
+    }
+
+    static std::atomic<const VectorKernels *> &Selected() {
+        static std::atomic<const VectorKernels *> pKernels(DetectKernels());
+        return pKernels;
+    }
+
+    static const VectorKernels &Kernels() {
+        return *Selected().load(std::memory_order_relaxed);
+    }
+
+    int VectorFilter(const ColumnVector &column, int op, int64_t value, const SelectionVector *pSel, int n,
+                     SelectionVector *pOut) {
+        assert(op >= Cmp_Lt && op <= Cmp_Ge && n >= 0 && n <= VectorSize);
+        return Kernels().filter[op](column.v, value, pSel ? pSel->index : nullptr, n, pOut->index);
+    }
+
+    int64_t VectorSum(const ColumnVector &column, const SelectionVector *pSel, int n) {
+        assert(n >= 0 && n <= VectorSize);
+        return Kernels().sum(column.v, pSel ? pSel->index : nullptr, n);
+    }
+
+    void VectorMinMax(const ColumnVector &column, const SelectionVector *pSel, int n, int64_t *pMin, int64_t *pMax) {
+        assert(n > 0 && n <= VectorSize);
+        Kernels().minMax(column.v, pSel ? pSel->index : nullptr, n, pMin, pMax);
+    }
+
+    void VectorArith(int op, const ColumnVector &a, const ColumnVector &b, int n, ColumnVector *pOut) {
+        assert(op >= Arith_Add && op <= Arith_Mul && n >= 0 && n <= VectorSize);
+        Kernels().arith[op](a.v, b.v, 0, n, pOut->v);
+    }
+
+    void VectorArith(int op, const ColumnVector &a, int64_t b, int n, ColumnVector *pOut) {
+        assert(op >= Arith_Add && op <= Arith_Mul && n >= 0 && n <= VectorSize);
+        Kernels().arith[op](a.v, nullptr, b, n, pOut->v);
+    }
+
+    const char *VectorImplementation() {
+        return Kernels().zName;
+    }
+
+    bool SetVectorImplementation(const char *zName) {
+        const VectorKernels *pKernels = nullptr;
+        if (strcmp(zName, "scalar") == 0)
+            pKernels = &scalarKernels;
+#ifdef TINYSQL_VECTOR_X86
+        const VectorKernels *pBest = DetectKernels();
+        if (strcmp(zName, "avx2") == 0 && pBest != &scalarKernels)
+            pKernels = &avx2Kernels;
+        if (strcmp(zName, "avx512") == 0 && pBest == &avx512Kernels)
+            pKernels = &avx512Kernels;
+#endif
+        if (!pKernels)
+            return false;
+        Selected().store(pKernels, std::memory_order_relaxed);
+        return true;
+    }
+
+
+    //where the next batch starts: the leaf after the last row returned,found
+    //again by key when the tree changed since
+    int ColumnScan::Position(unsigned *pPgno, int *pIndex) {
+        *pPgno = 0;
+        int status;
+        if (!bStarted) {
+            status = cursor.First();
+            bStarted = true;
+            if (status == Succeed && cursor.eState == Cursor_Valid) {
+                *pPgno = cursor.pgno;
+                *pIndex = cursor.index;
+            }
+            return status;
+        }
+        if (cursor.eState == Cursor_Valid && cursor.generation == pTree->pPager->generation) {
+            *pPgno = cursor.pgno;
+            *pIndex = cursor.index + 1;
+            return Succeed;
+        }
+        int result;
+        status = cursor.Seek(lastKey.data(), static_cast<int>(lastKey.size()), &result);
+        if (status != Succeed || result < 0)
+            return status;
+        *pPgno = cursor.pgno;
+        *pIndex = result == 0 ? cursor.index + 1 : cursor.index;
+        return Succeed;
+    }
+
+    int ColumnScan::Next(ColumnBatch *pBatch) {
+        pBatch->nRow = 0;
+        pBatch->columns.resize(columns.size());
+        if (bEof)
+            return Succeed;
+        unsigned pgno;
+        int index;
+        int status = Position(&pgno, &index);
+        if (status != Succeed)
+            return status;
+
+        Pager *pPager = pTree->pPager;
+        const int pageSize = pPager->pageSize;
+        int nOut = 0;
+        while (pgno != 0 && nOut < VectorSize) {
+            PgHdr *pPage;
+            status = pPager->Get(pgno, &pPage);
+            if (status != Succeed)
+                return status;
+            BtPage page(pPage->pData, pageSize);
+            if (!page.IsLeaf()) {
+                pPager->Unref(pPage);
+                return Corrupt;
+            }
+            const int nCell = page.CellCount();
+            const int prefixLength = page.PrefixLength();
+            const int first = index;
+            for (; index < nCell && nOut < VectorSize; index++, nOut++) {
+                const unsigned char *pCell = &page.a[page.CellOffset(index)];
+                const int suffixLength = page.SuffixLength(index);
+                const unsigned valueSize = Get4(pCell);
+                const unsigned char *pValue = pCell + 4 + suffixLength;
+                if (BtPage::LocalSize(pageSize, prefixLength + suffixLength, valueSize) < valueSize) {
+                    status = pTree->ReadValue(page, index, &value);
+                    if (status != Succeed) {
+                        pPager->Unref(pPage);
+                        return status;
+                    }
+                    pValue = reinterpret_cast<const unsigned char *>(value.data());
+                }
+                DecodeRow(pValue, valueSize, columns, nOut, pBatch);
+            }
+            if (index > first) {
+                lastKey = page.Key(index - 1);
+                cursor.pgno = pgno;
+                cursor.index = index - 1;
+                cursor.eState = Cursor_Valid;
+                cursor.bSkipNext = false;
+                cursor.generation = pPager->generation;
+            }
+            if (index >= nCell) {
+                pgno = page.Right();
+                index = 0;
+                if (pgno != 0)
+                    cursor.Prefetch(page, pgno);
+            }
+            pPager->Unref(pPage);
+        }
+        pBatch->nRow = nOut;
+        nRow += nOut;
+        bEof = nOut == 0;
+        return Succeed;
+    }
+
+    void ColumnScan::Reset() {
+        cursor.eState = Cursor_Invalid;
+        bStarted = false;
+        bEof = false;
+        lastKey.clear();
+        nRow = 0;
+    }
+
+    ColumnScan::ColumnScan(BTree *pTree, std::vector<int> columns) :
+            cursor(pTree), bStarted(false), bEof(false), lastKey(), value(), pTree(pTree),
+            columns(std::move(columns)), nRow(0) {
+    }
+
+    void DecodeRow(const unsigned char *pRow, unsigned nRow, const std::vector<int> &columns, int iRow,
+                   ColumnBatch *pBatch) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            int64_t x = 0;
+            long offset = columns[c] * 8L;
+            if (columns[c] >= 0 && offset + 8 <= nRow)
+                memcpy(&x, pRow + offset, 8);
+            pBatch->columns[c].v[iRow] = x;
+        }
+    }
+
+    void EncodeRow(const int64_t *pColumns, int nColumn, std::string *pRow) {
+        pRow->resize(nColumn * 8L);
+        memcpy(&(*pRow)[0], pColumns, nColumn * 8L);
+    }
+}
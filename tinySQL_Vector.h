@@ -0,0 +1,96 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_VECTOR_H
+#define SQLITELIKE_TINYSQL_VECTOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tinySQL_BTree.h"
+
+namespace tinySQL {
+
+    static constexpr int VectorSize = 1024;
+
+    static constexpr int Cmp_Lt = 0;
+    static constexpr int Cmp_Le = 1;
+    static constexpr int Cmp_Eq = 2;
+    static constexpr int Cmp_Ne = 3;
+    static constexpr int Cmp_Gt = 4;
+    static constexpr int Cmp_Ge = 5;
+
+    static constexpr int Arith_Add = 0;
+    static constexpr int Arith_Sub = 1;
+    static constexpr int Arith_Mul = 2;
+
+    //values of one column for a batch of rows
+    struct alignas(64) ColumnVector {
+        int64_t v[VectorSize];
+    };
+
+    //ascending row numbers of a batch that are still live.kernels take the
+    //selection and its count apart,a null selection stands for rows 0..n-1
+    struct SelectionVector {
+        uint16_t index[VectorSize];
+    };
+
+    //the selected rows whose column compares op to value go to *pOut,the
+    //count is returned.pOut may be pSel
+    int VectorFilter(const ColumnVector &column, int op, int64_t value, const SelectionVector *pSel, int n,
+                     SelectionVector *pOut);
+
+    //sum wraps around on overflow
+    int64_t VectorSum(const ColumnVector &column, const SelectionVector *pSel, int n);
+
+    //n must not be 0
+    void VectorMinMax(const ColumnVector &column, const SelectionVector *pSel, int n, int64_t *pMin, int64_t *pMax);
+
+    //rows 0..n-1 of pOut = a op b,wrapping around on overflow.projections are
+    //computed for every row,that is cheaper than gathering the selected ones
+    void VectorArith(int op, const ColumnVector &a, const ColumnVector &b, int n, ColumnVector *pOut);
+    void VectorArith(int op, const ColumnVector &a, int64_t b, int n, ColumnVector *pOut);
+
+    //"avx512","avx2" or "scalar",chosen once from cpuid
+    const char *VectorImplementation();
+    //makes the vector functions use the named kernels,false when the cpu lacks them
+    bool SetVectorImplementation(const char *zName);
+
+    //rows of a BTree,up to VectorSize at a time
+    struct ColumnBatch {
+        int nRow;
+        std::vector<ColumnVector> columns;
+    };
+
+    //reads the values of a BTree as rows of 8 byte integers in native order and
+    //hands back the chosen columns a batch at a time,decoded straight off the
+    //leaf pages.a column past the end of a row reads as 0.the scan keeps its
+    //place across transactions by the last key it returned
+    class ColumnScan {
+    private:
+        BtCursor cursor;    //on the last row returned
+        bool bStarted;
+        bool bEof;
+        std::string lastKey;
+        std::string value;
+
+        int Position(unsigned *pPgno, int *pIndex);
+    public:
+        BTree *const pTree;
+        const std::vector<int> columns;
+        long nRow;
+
+        //pBatch->nRow is 0 once the scan is done
+        int Next(ColumnBatch *pBatch);
+        void Reset();
+
+        ColumnScan(BTree *pTree, std::vector<int> columns);
+    };
+
+    //the row format ColumnScan reads
+    void EncodeRow(const int64_t *pColumns, int nColumn, std::string *pRow);
+    void DecodeRow(const unsigned char *pRow, unsigned nRow, const std::vector<int> &columns, int iRow,
+                   ColumnBatch *pBatch);
+}
+#endif //SQLITELIKE_TINYSQL_VECTOR_H
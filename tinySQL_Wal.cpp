@@ -0,0 +1,549 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include "tinySQL_Wal.h"
+#include "tinySQL_Clock.h"
+#include "tinySQL_Pager.h"
+
+namespace tinySQL {
+
+    static constexpr unsigned ScanBatch = 64;       //whole frames worth of bytes read at once while scanning the log
+    static constexpr long AppendBatch = 256 * 1024; //bytes of frames gathered into one xWrite
+    static constexpr int DeltaGap = 8;              //equal bytes carried inside a range rather than starting a new one
+    static constexpr unsigned CheckpointRun = 64;   //pages gathered into one xWrite by a checkpoint
+
+    //n is a multiple of 8
+    static void WalChecksum(const unsigned char *p, long n, unsigned *s) {
+        unsigned s1 = s[0], s2 = s[1];
+        for (long i = 0; i < n; i += 8) {
+            s1 += Get4(&p[i]) + s2;
+            s2 += Get4(&p[i + 4]) + s1;
+        }
+        s[0] = s1;
+        s[1] = s2;
+    }
+
+    //the byte ranges of pNew that differ from pOld,each as 2 bytes of offset,
+    //2 of length and the new bytes.-1 when they come to more than limit
+    static long EncodeDelta(const unsigned char *pOld, const unsigned char *pNew, int pageSize, long limit,
+                            unsigned char *pOut) {
+        long n = 0;
+        int i = 0;
+        while (i < pageSize) {
+            if (pOld[i] == pNew[i]) {
+                i++;
+                continue;
+            }
+            int start = i, end = i + 1;
+            for (int j = i + 1; j < pageSize && j + 1 - start <= 0xFFFF; j++) {
+                if (pOld[j] != pNew[j])
+                    end = j + 1;
+                else if (j + 1 - end > DeltaGap)
+                    break;
+            }
+            if (n + 4 + end - start > limit)
+                return -1;
+            Put2(&pOut[n], start);
+            Put2(&pOut[n + 2], end - start);
+            memcpy(&pOut[n + 4], &pNew[start], end - start);
+            n += 4 + end - start;
+            i = end;
+        }
+        return n;
+    }
+
+    //a range of length 0 ends the delta,the padding reads as one
+    static bool ApplyDelta(const unsigned char *pDelta, long n, int pageSize, unsigned char *pPage) {
+        long i = 0;
+        while (i + 4 <= n) {
+            unsigned offset = Get2(&pDelta[i]);
+            unsigned length = Get2(&pDelta[i + 2]);
+            if (length == 0)
+                break;
+            if (offset + length > static_cast<unsigned>(pageSize) || i + 4 + length > n)
+                return false;
+            memcpy(&pPage[offset], &pDelta[i + 4], length);
+            i += 4 + length;
+        }
+        return true;
+    }
+
+    int Wal::Open(tinySQL_VFS *pVFS, const std::string &path, int pageSize, Wal **ppWal) {
+        assert(pVFS && ppWal);
+        *ppWal = nullptr;
+        tinySQL_file *pFile = nullptr;
+        int status = pVFS->xOpen(path.c_str(), &pFile, Open_Create | Open_ReadWrite | Open_MainWAL, nullptr);
+        if (status != Succeed)
+            return status;
+        *ppWal = new Wal(pFile, pageSize);
+        return Succeed;
+    }
+
+    int Wal::Close() {
+        delete this;
+        return Succeed;
+    }
+
+    int Wal::FrameHeaderSize() const {
+        return version > 1 ? Wal_DeltaHeaderSize : Wal_FrameHeaderSize;
+    }
+
+    long Wal::FrameEnd() const {
+        if (frames.empty())
+            return Wal_HeaderSize;
+        return frames.back().offset + FrameHeaderSize() + frames.back().size;
+    }
+
+    void Wal::Forget() {
+        index.clear();
+        frames.clear();
+        images.clear();
+        backfilled.clear();
+        mxFrame = 0;
+        dbSize = 0;
+    }
+
+    //a commit that cut the page count off leaves frames of the pages past it
+    //in the log.they are forgotten so that once the database grows again
+    //those page numbers never resolve to a frame from before the cut
+    void Wal::DropAbove(unsigned nPage) {
+        for (auto it = index.begin(); it != index.end();)
+            it = it->first > nPage ? index.erase(it) : std::next(it);
+        for (auto it = backfilled.begin(); it != backfilled.end();)
+            it = it->first > nPage ? backfilled.erase(it) : std::next(it);
+        for (auto it = images.begin(); it != images.end();)
+            it = it->first > nPage ? images.erase(it) : std::next(it);
+    }
+
+    //frame header: page number,page count after a commit (0 for the other
+    //frames of a transaction),the two salts,from version 2 the size of what
+    //follows and the frame a delta applies to,and the running checksum.
+    //the header is checksummed without its salts,then the rest of the frame
+    int Wal::Scan(bool bApply, bool *pNewer, bool *pReset, std::vector<unsigned> *pChanged) {
+        *pNewer = false;
+        if (pReset)
+            *pReset = false;
+        unsigned long size;
+        int status = pFile->xFileSize(&size);
+        if (status != Succeed)
+            return status;
+
+        unsigned char header[Wal_HeaderSize];
+        unsigned s[2] = {0, 0};
+        bool bValid = false;
+        if (size >= Wal_HeaderSize) {
+            status = pFile->xRead(header, Wal_HeaderSize, 0);
+            if (status != Succeed)
+                return status;
+            WalChecksum(header, 24, s);
+            bValid = Get4(header) == Wal_Magic && Get4(&header[4]) >= 1 && Get4(&header[4]) <= Wal_Version &&
+                     static_cast<int>(Get4(&header[8])) == pageSize &&
+                     Get4(&header[24]) == s[0] && Get4(&header[28]) == s[1];
+        }
+        if (!bValid) {
+            //truncated away or never written,nothing in it counts
+            if (bHeader) {
+                *pNewer = true;
+                if (bApply) {
+                    *pReset = true;
+                    Forget();
+                    bHeader = false;
+                }
+            }
+            return Succeed;
+        }
+
+        unsigned headerSalt[2] = {Get4(&header[16]), Get4(&header[20])};
+        if (!bHeader || headerSalt[0] != salt[0] || headerSalt[1] != salt[1]) {
+            //started over by a checkpoint since the snapshot was taken
+            *pNewer = true;
+            if (!bApply)
+                return Succeed;
+            *pReset = true;
+            Forget();
+            version = Get4(&header[4]);
+            salt[0] = headerSalt[0];
+            salt[1] = headerSalt[1];
+            checksum[0] = s[0];
+            checksum[1] = s[1];
+            checkpointSeq = Get4(&header[12]);
+            bHeader = true;
+        } else {
+            s[0] = checksum[0];
+            s[1] = checksum[1];
+        }
+
+        const int headerSize = FrameHeaderSize();
+        long offset = FrameEnd();
+        std::vector<WalFrame> pending;      //frames since the last commit
+        std::vector<unsigned char> buf;
+        long bufStart = 0;
+        auto xFill = [&]() {
+            bufStart = offset;
+            buf.resize(std::min(static_cast<long>(size) - offset, static_cast<long>(ScanBatch) * (headerSize + pageSize)));
+            int fillStatus = pFile->xRead(buf.data(), static_cast<long>(buf.size()), offset);
+            return fillStatus == IOError_ReadShort ? Succeed : fillStatus;
+        };
+        while (offset + headerSize <= static_cast<long>(size)) {
+            if (offset < bufStart || offset + headerSize > bufStart + static_cast<long>(buf.size())) {
+                if ((status = xFill()) != Succeed)
+                    return status;
+            }
+            const unsigned char *p = &buf[offset - bufStart];
+            if (Get4(&p[8]) != salt[0] || Get4(&p[12]) != salt[1])
+                return Succeed;
+            WalFrame info{Get4(p), static_cast<unsigned>(pageSize), 0, 0, offset};
+            if (version > 1) {
+                info.size = Get4(&p[16]);
+                info.base = Get4(&p[20]);
+            }
+            if (info.base == 0 ? info.size != static_cast<unsigned>(pageSize) :
+                info.size % 8 || info.size > static_cast<unsigned>(pageSize) || info.base > frames.size() ||
+                frames[info.base - 1].pgno != info.pgno)
+                return Succeed;
+            if (info.base)
+                info.depth = frames[info.base - 1].depth + 1;
+            if (offset + headerSize + info.size > static_cast<long>(size))
+                return Succeed;
+            if (offset + headerSize + info.size > bufStart + static_cast<long>(buf.size())) {
+                if ((status = xFill()) != Succeed)
+                    return status;
+                p = buf.data();
+            }
+            WalChecksum(p, 8, s);
+            if (version > 1)
+                WalChecksum(&p[16], 8, s);
+            WalChecksum(&p[headerSize], info.size, s);
+            if (Get4(&p[headerSize - 8]) != s[0] || Get4(&p[headerSize - 4]) != s[1])
+                return Succeed;
+            offset += headerSize + info.size;
+            pending.push_back(info);
+            if (Get4(&p[4]) == 0)
+                continue;
+
+            *pNewer = true;
+            if (!bApply)
+                return Succeed;
+            for (auto &it: pending) {
+                frames.push_back(it);
+                index[it.pgno] = static_cast<unsigned>(frames.size());
+                if (pChanged && !*pReset)
+                    pChanged->push_back(it.pgno);
+            }
+            pending.clear();
+            mxFrame = static_cast<unsigned>(frames.size());
+            if (Get4(&p[4]) < dbSize)
+                DropAbove(Get4(&p[4]));
+            dbSize = Get4(&p[4]);
+            checksum[0] = s[0];
+            checksum[1] = s[1];
+        }
+        return Succeed;
+    }
+
+    int Wal::Refresh(bool *pReset, std::vector<unsigned> *pChanged) {
+        bool bNewer;
+        return Scan(true, &bNewer, pReset, pChanged);
+    }
+
+    int Wal::HasNewer(bool *pNewer) {
+        return Scan(false, pNewer, nullptr, nullptr);
+    }
+
+    unsigned Wal::Find(unsigned pgno) const {
+        auto it = index.find(pgno);
+        return it == index.end() ? 0 : it->second;
+    }
+
+    void Wal::PagesSince(unsigned frame, std::vector<unsigned> *pPgno) const {
+        pPgno->clear();
+        for (auto &entry : index)
+            if (entry.second > frame && entry.first <= dbSize)
+                pPgno->push_back(entry.first);
+        std::sort(pPgno->begin(), pPgno->end());
+    }
+
+    uint64_t Wal::Salts() const {
+        return (static_cast<uint64_t>(salt[0]) << 32) | salt[1];
+    }
+
+    int Wal::CommitSize(unsigned frame, unsigned *pnPage) {
+        assert(frame > 0 && frame <= mxFrame);
+        unsigned char header[8];
+        int status = pFile->xRead(header, sizeof(header), frames[frame - 1].offset);
+        if (status != Succeed)
+            return status;
+        *pnPage = Get4(&header[4]);
+        return *pnPage ? Succeed : Corrupt;
+    }
+
+    int Wal::ReadFrame(unsigned frame, void *pData, long nByte) {
+        assert(frame > 0 && frame <= mxFrame && nByte <= pageSize);
+        const int headerSize = FrameHeaderSize();
+        if (frames[frame - 1].base == 0)
+            return pFile->xRead(pData, nByte, frames[frame - 1].offset + headerSize);
+        std::vector<unsigned> chain;
+        for (unsigned f = frame; frames[f - 1].base; f = frames[f - 1].base)
+            chain.push_back(f);
+        std::vector<unsigned char> page(pageSize);
+        std::vector<unsigned char> delta;
+        const WalFrame &whole = frames[frames[chain.back() - 1].base - 1];
+        int status = pFile->xRead(page.data(), pageSize, whole.offset + headerSize);
+        for (auto it = chain.rbegin(); status == Succeed && it != chain.rend(); it++) {
+            const WalFrame &info = frames[*it - 1];
+            delta.resize(info.size);
+            status = pFile->xRead(delta.data(), info.size, info.offset + headerSize);
+            if (status == Succeed && !ApplyDelta(delta.data(), info.size, pageSize, page.data()))
+                status = Corrupt;
+        }
+        if (status == Succeed)
+            memcpy(pData, page.data(), nByte);
+        return status;
+    }
+
+    //a page changed since it was last logged in this log is written as a delta
+    //against that frame,unless the chain of deltas is long already or the
+    //delta would be over half a page
+    int Wal::Append(const unsigned *pPgno, const unsigned char *const *ppData, int n, unsigned nPage) {
+        assert(n > 0);
+        int status;
+        if (!bHeader && (status = Restart()) != Succeed)
+            return status;
+
+        const int headerSize = FrameHeaderSize();
+        unsigned s[2] = {checksum[0], checksum[1]};
+        long offset = FrameEnd();
+        if (!open.empty()) {
+            s[0] = openChecksum[0];
+            s[1] = openChecksum[1];
+            offset = open.back().offset + headerSize + open.back().size;
+        }
+        std::vector<WalFrame> added;
+        std::vector<unsigned char> buf;
+        std::vector<unsigned char> old(pageSize);
+        long bufStart = offset;
+        for (int i = 0; i < n; i++) {
+            WalFrame info{pPgno[i], static_cast<unsigned>(pageSize), 0, 0, offset};
+            size_t at = buf.size();
+            buf.resize(at + headerSize + pageSize);
+            unsigned char *p = &buf[at];
+            unsigned base = version > 1 ? Find(pPgno[i]) : 0;
+            if (base && frames[base - 1].depth + 1 < Wal_MaxDeltaChain) {
+                const unsigned char *pOld = old.data();
+                auto it = images.find(pPgno[i]);
+                if (it != images.end() && it->second.frame == base)
+                    pOld = it->second.data.data();
+                else if ((status = ReadFrame(base, old.data(), pageSize)) != Succeed)
+                    return status;
+                long m = EncodeDelta(pOld, ppData[i], pageSize, pageSize / 2, &p[headerSize]);
+                if (m >= 0) {
+                    info.size = static_cast<unsigned>((m + 8) & ~7L);
+                    memset(&p[headerSize + m], 0, info.size - m);
+                    info.base = base;
+                    info.depth = frames[base - 1].depth + 1;
+                }
+            }
+            if (info.base == 0)
+                memcpy(&p[headerSize], ppData[i], pageSize);
+            buf.resize(at + headerSize + info.size);
+            Put4(p, pPgno[i]);
+            Put4(&p[4], i == n - 1 ? nPage : 0);
+            Put4(&p[8], salt[0]);
+            Put4(&p[12], salt[1]);
+            WalChecksum(p, 8, s);
+            if (version > 1) {
+                Put4(&p[16], info.size);
+                Put4(&p[20], info.base);
+                WalChecksum(&p[16], 8, s);
+            }
+            WalChecksum(&p[headerSize], info.size, s);
+            Put4(&p[headerSize - 8], s[0]);
+            Put4(&p[headerSize - 4], s[1]);
+            added.push_back(info);
+            offset += headerSize + info.size;
+            if (static_cast<long>(buf.size()) >= AppendBatch || i == n - 1) {
+                status = pFile->xWrite(buf.data(), static_cast<long>(buf.size()), bufStart);
+                if (status != Succeed)
+                    return status;
+                buf.clear();
+                bufStart = offset;
+            }
+        }
+        if (nPage == 0) {
+            open.insert(open.end(), added.begin(), added.end());
+            openChecksum[0] = s[0];
+            openChecksum[1] = s[1];
+            return Succeed;
+        }
+        status = pFile->xSync(0);
+        if (status != Succeed)
+            return status;
+
+        for (auto &info: open) {
+            frames.push_back(info);
+            index[info.pgno] = static_cast<unsigned>(frames.size());
+        }
+        for (int i = 0; i < n; i++) {
+            frames.push_back(added[i]);
+            index[pPgno[i]] = static_cast<unsigned>(frames.size());
+            if (version > 1) {
+                if (images.size() >= Wal_ImageCache && images.find(pPgno[i]) == images.end())
+                    images.erase(images.begin());
+                LoggedImage &image = images[pPgno[i]];
+                image.frame = static_cast<unsigned>(frames.size());
+                image.data.assign(ppData[i], ppData[i] + pageSize);
+            }
+        }
+        mxFrame = static_cast<unsigned>(frames.size());
+        open.clear();
+        if (nPage < dbSize)
+            DropAbove(nPage);
+        dbSize = nPage;
+        checksum[0] = s[0];
+        checksum[1] = s[1];
+        return Succeed;
+    }
+
+    //the next Append writes over them,a reader stops at the first of them
+    //since no commit frame follows
+    void Wal::Discard() {
+        open.clear();
+    }
+
+    //new salts cut off every frame in the file at once
+    int Wal::Restart() {
+        assert(open.empty());
+        if (bHeader)
+            salt[0]++;
+        else
+            tinySQL_Randomness(sizeof(salt[0]), &salt[0]);
+        tinySQL_Randomness(sizeof(salt[1]), &salt[1]);
+        checkpointSeq++;
+
+        unsigned char header[Wal_HeaderSize];
+        unsigned s[2] = {0, 0};
+        Put4(header, Wal_Magic);
+        Put4(&header[4], Wal_Version);
+        Put4(&header[8], pageSize);
+        Put4(&header[12], checkpointSeq);
+        Put4(&header[16], salt[0]);
+        Put4(&header[20], salt[1]);
+        WalChecksum(header, 24, s);
+        Put4(&header[24], s[0]);
+        Put4(&header[28], s[1]);
+        int status = pFile->xWrite(header, Wal_HeaderSize, 0);
+        if (status == Succeed)
+            status = pFile->xTruncate(Wal_HeaderSize);
+        if (status == Succeed)
+            status = pFile->xSync(0);
+        if (status != Succeed)
+            return status;
+
+        Forget();
+        version = Wal_Version;
+        nRestart++;
+        checksum[0] = s[0];
+        checksum[1] = s[1];
+        bHeader = true;
+        return Succeed;
+    }
+
+    int Wal::CopyRun(tinySQL_file *pDb, const std::pair<unsigned, unsigned> *pPages, size_t n) {
+        std::vector<unsigned char> run(n * pageSize);
+        for (size_t k = 0; k < n; k++) {
+            int status = ReadFrame(pPages[k].second, &run[k * pageSize], pageSize);
+            if (status != Succeed)
+                return status;
+        }
+        return pDb->xWrite(run.data(), static_cast<long>(run.size()), static_cast<long>(pPages[0].first - 1) * pageSize);
+    }
+
+    //frames are only read and the runs do not overlap,so the writers need no
+    //lock.each round is handed to the os to write back while the next is copied,
+    //which leaves little for the final sync
+    int Wal::Backfill(tinySQL_file *pDb, long budgetNs, int nWriter, ThreadPool *pPool, bool *pDone) {
+        *pDone = false;
+        uint64_t start = Clock::Monotonic();
+        std::vector<std::pair<unsigned, unsigned>> pages;
+        for (auto &it: index) {
+            if (it.first > dbSize)
+                continue;
+            auto copied = backfilled.find(it.first);
+            if (copied == backfilled.end() || copied->second != it.second)
+                pages.emplace_back(it);
+        }
+        std::sort(pages.begin(), pages.end());
+
+        nWriter = std::max(nWriter, 1);
+        std::vector<std::pair<size_t, size_t>> runs;
+        size_t i = 0;
+        while (i < pages.size()) {
+            runs.clear();
+            while (i < pages.size() && static_cast<int>(runs.size()) < nWriter) {
+                size_t j = i + 1;
+                while (j < pages.size() && j - i < CheckpointRun && pages[j].first == pages[j - 1].first + 1)
+                    j++;
+                runs.emplace_back(i, j);
+                i = j;
+            }
+            std::vector<int> aStatus(runs.size(), Succeed);
+            TaskGroup group;
+            for (size_t r = 0; r < runs.size(); r++)
+                group.Run(runs.size() > 1 ? pPool : nullptr, [this, pDb, &pages, &runs, &aStatus, r]() {
+                    aStatus[r] = CopyRun(pDb, &pages[runs[r].first], runs[r].second - runs[r].first);
+                });
+            group.Wait();
+            for (int status: aStatus)
+                if (status != Succeed)
+                    return status;
+            for (size_t k = runs.front().first; k < i; k++)
+                backfilled[pages[k].first] = pages[k].second;
+            nPageCopied += static_cast<long>(i - runs.front().first);
+            FileRange range{static_cast<long>(pages[runs.front().first].first - 1) * pageSize,
+                            static_cast<long>(pages[i - 1].first - pages[runs.front().first].first + 1) * pageSize};
+            pDb->xFileControl(Fcntl_SyncRange, &range);
+            if (budgetNs >= 0 && Clock::Monotonic() - start >= static_cast<uint64_t>(budgetNs))
+                break;
+        }
+        nSlice++;
+        nsCopying += Clock::Monotonic() - start;
+        if (i < pages.size())
+            return Succeed;
+
+        //pages the last commit no longer counts
+        unsigned long size;
+        int status = pDb->xFileSize(&size);
+        if (status == Succeed && dbSize > 0 && size > static_cast<unsigned long>(dbSize) * pageSize)
+            status = pDb->xTruncate(static_cast<long>(dbSize) * pageSize);
+        if (status == Succeed)
+            status = pDb->xSync(0);
+        *pDone = status == Succeed;
+        return status;
+    }
+
+    int Wal::Checkpoint(tinySQL_file *pDb) {
+        bool bDone;
+        return Backfill(pDb, -1, 1, nullptr, &bDone);
+    }
+
+    void Wal::Stats(CheckpointStats *pStats) const {
+        unsigned nBacklog = 0;
+        for (auto &it: index) {
+            auto copied = backfilled.find(it.first);
+            if (it.first <= dbSize && (copied == backfilled.end() || copied->second != it.second))
+                nBacklog++;
+        }
+        *pStats = {mxFrame, nBacklog, nSlice, nPageCopied, nRestart, nsCopying};
+    }
+
+    Wal::Wal(tinySQL_file *pFile, int pageSize) :
+            index(), frames(), images(), backfilled(), open(), openChecksum{0, 0}, nSlice(0), nPageCopied(0), nRestart(0), nsCopying(0),
+            salt{0, 0}, checksum{0, 0}, version(Wal_Version), bHeader(false),
+            pFile(pFile), pageSize(pageSize), mxFrame(0), dbSize(0), checkpointSeq(0) {
+    }
+
+    Wal::~Wal() {
+        pFile->xClose();
+    }
+}
@@ -0,0 +1,134 @@
+//
+// Created by user on 26-10-19.
+//
+
+#ifndef SQLITELIKE_TINYSQL_WAL_H
+#define SQLITELIKE_TINYSQL_WAL_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "tinySQL_ThreadPool.h"
+#include "tinySQL_VFS.h"
+#include "tinySQL_def.h"
+
+namespace tinySQL {
+
+    static constexpr unsigned Wal_Magic = 0x74735741;
+    static constexpr unsigned Wal_Version = 2;
+    static constexpr int Wal_HeaderSize = 32;
+    static constexpr int Wal_FrameHeaderSize = 24;      //version 1,every frame holds a whole page
+    static constexpr int Wal_DeltaHeaderSize = 32;      //version 2
+    static constexpr unsigned Wal_MaxDeltaChain = 16;   //deltas in a row before a page is logged whole again
+    static constexpr unsigned Wal_ImageCache = 256;     //pages last logged,kept to diff the next commit against
+    static constexpr unsigned DefaultAutoCheckpoint = 1000;
+    static constexpr int DefaultCheckpointSliceMs = 5;
+    static constexpr int DefaultCheckpointWriters = 4;
+    //"<db>-ship" holds the mark of the log a follower has,see LogShipper
+    static constexpr const char *Wal_ShipSuffix = "-ship";
+    static constexpr unsigned Wal_ShipMagic = 0x74735350;
+    static constexpr int Wal_ShipMarkSize = 16;
+
+    struct WalFrame {
+        unsigned pgno;
+        unsigned size;              //bytes after the frame header
+        unsigned base;              //frame a delta applies to,0 for a whole page
+        unsigned depth;             //deltas since the page was last logged whole
+        long offset;
+    };
+
+    struct CheckpointStats {
+        unsigned nFrame;            //frames in the snapshot
+        unsigned nBacklog;          //pages of the snapshot the database file does not have yet
+        long nSlice;
+        long nPageCopied;
+        long nRestart;
+        uint64_t nsCopying;
+    };
+
+    //write-ahead log next to a database,"<db>-wal".a commit appends a frame per
+    //changed page,the last one carrying the page count of the database,and the
+    //log keeps growing until a checkpoint copies the newest frames back into
+    //the database file and starts the log over with new salts.frames are
+    //chained by a running checksum so a torn append is cut off at the last
+    //commit that made it to disk.
+    //every connection keeps its own index of the frames in its snapshot and
+    //extends it from the file at the start of a read transaction
+    class Wal {
+    private:
+        struct LoggedImage {
+            unsigned frame;
+            std::vector<unsigned char> data;
+        };
+
+        std::unordered_map<unsigned, unsigned> index;   //page number to its newest frame in the snapshot
+        std::vector<WalFrame> frames;                   //of the snapshot,frame i at i - 1
+        std::unordered_map<unsigned, LoggedImage> images;
+        std::unordered_map<unsigned, unsigned> backfilled;  //page number to the frame last copied to the database
+        std::vector<WalFrame> open;                     //written by the transaction not committed yet
+        unsigned openChecksum[2];                       //running checksum after them
+        long nSlice;
+        long nPageCopied;
+        long nRestart;
+        uint64_t nsCopying;
+        unsigned salt[2];
+        unsigned checksum[2];       //running checksum at mxFrame
+        unsigned version;           //of the log in the file,a new log is Wal_Version
+        bool bHeader;               //the file starts with a valid header
+
+        Wal(tinySQL_file *pFile, int pageSize);
+        int FrameHeaderSize() const;
+        long FrameEnd() const;
+        void Forget();
+        void DropAbove(unsigned nPage);
+        int CopyRun(tinySQL_file *pDb, const std::pair<unsigned, unsigned> *pPages, size_t n);
+        int Scan(bool bApply, bool *pNewer, bool *pReset, std::vector<unsigned> *pChanged);
+    public:
+        tinySQL_file *const pFile;
+        const int pageSize;
+        unsigned mxFrame;           //last frame of the snapshot
+        unsigned dbSize;            //page count committed by frame mxFrame
+        unsigned checkpointSeq;
+
+        static int Open(tinySQL_VFS *pVFS, const std::string &path, int pageSize, Wal **ppWal);
+        int Close();
+
+        //brings the snapshot up to the last commit in the file.*pReset is set
+        //when the log was started over,the pages committed since go to pChanged
+        int Refresh(bool *pReset, std::vector<unsigned> *pChanged);
+        int HasNewer(bool *pNewer);
+
+        //0 when the page is not in the snapshot's part of the log
+        unsigned Find(unsigned pgno) const;
+        //pages of the snapshot whose newest frame comes after frame,in page order
+        void PagesSince(unsigned frame, std::vector<unsigned> *pPgno) const;
+        //salt 1 and 2 of the log the snapshot is in,they change whenever it starts over
+        uint64_t Salts() const;
+        //page count the commit at frame left,Corrupt when frame does not end a commit
+        int CommitSize(unsigned frame, unsigned *pnPage);
+        //positional read,safe from any thread
+        int ReadFrame(unsigned frame, void *pData, long nByte);
+
+        //pages go in the order given,the call returns once they are synced.
+        //with nPage 0 the frames belong to a transaction that is still open,
+        //they are not synced and nobody sees them until a later Append
+        //commits them together with its own,or Discard throws them away
+        int Append(const unsigned *pPgno, const unsigned char *const *ppData, int n, unsigned nPage);
+        void Discard();
+
+        //copies the snapshot's pages pDb does not have yet in page order,nWriter
+        //runs of them at a time on pPool,until all are there or budgetNs has
+        //passed (never when it is negative).once all are there pDb is cut to the
+        //snapshot's page count and synced and *pDone set.the caller makes sure
+        //nobody writes meanwhile and that no reader holds an older snapshot
+        int Backfill(tinySQL_file *pDb, long budgetNs, int nWriter, ThreadPool *pPool, bool *pDone);
+        int Checkpoint(tinySQL_file *pDb);
+        void Stats(CheckpointStats *pStats) const;
+        //starts the log over,which needs nobody reading it at all
+        int Restart();
+
+        ~Wal();
+    };
+}
+#endif //SQLITELIKE_TINYSQL_WAL_H
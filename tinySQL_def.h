@@ -8,6 +8,12 @@
 #include <cstring>
 #include <utility>
 #include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <cassert>
 #include <stdexcept>
@@ -59,13 +65,26 @@ namespace tinySQL {
     static constexpr int Fcntl_TempFileName = 7;
     static constexpr int Fcntl_HaveMoved = 8;
     static constexpr int Fcntl_ExternalReader = 9;
+    static constexpr int Fcntl_TierStats = 10;
+    static constexpr int Fcntl_SlowSetConfig = 11;
+    static constexpr int Fcntl_SlowGetConfig = 12;
+    static constexpr int Fcntl_FileId = 13;
+    static constexpr int Fcntl_PunchHole = 14;
+    static constexpr int Fcntl_FileDescriptor = 15;   //int,NotFound from files that change or watch their data
+    static constexpr int Fcntl_Prefetch = 16;         //FileRange the os should start reading into its cache
+    static constexpr int Fcntl_SyncRange = 17;        //FileRange the os should start writing back
+    static constexpr int Fcntl_LockProfile = 18;      //LockReport,the hottest locks of the process
 //    static constexpr int
 
     static constexpr int UnixFile_PersistWal = 0x04;
     static constexpr int UnixFile_PSOW = 0x10;
+    static constexpr int UnixFile_Unlinked = 0x20;
     static constexpr int NotFound = 0x10;
     static constexpr int CanNotOpen = 0x11;
     static constexpr int SpaceFull = 0x12;
+    static constexpr int Corrupt = 0x13;
+    static constexpr int TooBig = 0x14;
+    static constexpr int Misuse = 0x15;
 
     static constexpr int MinFileDescriptor = 3;
 
@@ -77,27 +96,58 @@ namespace tinySQL {
 
 
     static constexpr int LockZone_PendingByte = 0x40000000;
-    static constexpr int LockZone_ReservedByte = Lock_Pending + 1;
-    static constexpr int LockZone_SharedFirst = Lock_Pending + 2;
+    static constexpr int LockZone_ReservedByte = LockZone_PendingByte + 1;
+    static constexpr int LockZone_SharedFirst = LockZone_PendingByte + 2;
     static constexpr int LockZone_SharedSize = 510;
 
     static constexpr int (*OsOpen)(const char * zName,int flag,...) = open;
     static constexpr int (*OsClose)(int) = close;
     static constexpr int (*OsUnlink)(const char * zPath) = unlink;
+    static constexpr int (*OsLink)(const char *,const char *) = link;
+    static constexpr int (*OsMkostemp)(char *,int) = mkostemp;
     static constexpr int (*OsAccess)(const char *,int) = access;
     static constexpr ssize_t (*OsRead)(int,void*,size_t) = read;
     static constexpr ssize_t (*OsWrite)(int,const void*,size_t) = write;
+    static constexpr ssize_t (*OsPread)(int,void*,size_t,off_t) = pread;
+    static constexpr ssize_t (*OsPwrite)(int,const void*,size_t,off_t) = pwrite;
     static constexpr off_t  (*OsLseek)(int,off_t ,int) = lseek;
+    static constexpr int (*OsStat)(const char *,struct stat*) = stat;
     static constexpr int (*OsFstat)(int,struct stat*) = fstat;
     static constexpr int (*OsFchmod)(int,mode_t) = fchmod;
     static constexpr int (*OsFallocate)(int,int,off_t,off_t) = fallocate;
     static constexpr int (*OsFtruncate)(int,off_t) = ftruncate;
     static constexpr int (*OsFsync)(int) = fsync;
+    static constexpr int (*OsFadvise)(int,off_t,off_t,int) = posix_fadvise;
+    static constexpr int (*OsSyncFileRange)(int,off_t,off_t,unsigned int) = sync_file_range;
+    static constexpr ssize_t (*OsGetrandom)(void *,size_t,unsigned int) = getrandom;
+    static constexpr int (*OsFlock)(int,int) = flock;
+    static constexpr ssize_t (*OsSend)(int,const void*,size_t,int) = send;
+    static constexpr int (*OsPoll)(struct pollfd *,nfds_t,int) = poll;
+    static constexpr ssize_t (*OsSendfile)(int,int,off_t*,size_t) = sendfile;
+    static constexpr void *(*OsMmap)(void *,size_t,int,int,int,off_t) = mmap;
+    static constexpr int (*OsMunmap)(void *,size_t) = munmap;
+
+    //filled by xFileControl(Fcntl_FileId),mtime in nanoseconds
+    struct FileIdentity {
+        unsigned long dev;
+        unsigned long ino;
+        long mtime;
+    };
+
+    //passed to xFileControl(Fcntl_PunchHole),the range reads as zeros after
+    //and its blocks go back to the file system.NotFound when that is not supported
+    struct FileRange {
+        long offset;
+        long length;
+    };
 
     void tinySQL_Randomness(int nByte,void *pBuf);
     int inline OsSetAdvisoryLock(int fd,struct flock *pLock){
         return fcntl(fd,F_SETLK,pLock);
     }
+    int inline OsGetAdvisoryLock(int fd,struct flock *pLock){
+        return fcntl(fd,F_GETLK,pLock);
+    }
 
 }
 #endif //SQLITELIKE_TINYSQL_DEF_H
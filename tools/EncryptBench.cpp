@@ -0,0 +1,93 @@
+//
+// Created by user on 26-10-19.
+//
+#include <sched.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../tinySQL_Clock.h"
+#include "../tinySQL_EncryptVFS.h"
+
+//the portable cipher is slow enough that it gets a smaller file
+static constexpr long PortableMaxMB = 16;
+static constexpr long ChunkSize = 1 << 20;
+
+static double GBPerSecond(long nByte, uint64_t ns) {
+    return ns ? static_cast<double>(nByte) / static_cast<double>(ns) : 0.0;
+}
+
+//usage: EncryptBench [-mb size] [-dir directory]
+//times EncryptFile xWrite and xRead,and the cipher alone,on one core for
+//every implementation the cpu has.the file goes to /dev/shm by default so
+//the disk stays out of the numbers
+int main(int argc, char **argv) {
+    using namespace tinySQL;
+    long nMB = 256;
+    const char *zDir = "/dev/shm";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-mb") == 0 && i + 1 < argc)
+            nMB = atol(argv[++i]);
+        else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+            zDir = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [-mb size] [-dir directory]\n", argv[0]);
+            return 1;
+        }
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    unsigned char key[XTS_KeySize];
+    tinySQL_Randomness(sizeof(key), key);
+    EncryptVFS vfs("encryptBench", tinySQL_VFS::VFSGet(0), key);
+    std::string path = std::string(zDir) + "/tinySQL-encrypt-bench";
+    std::vector<unsigned char> chunk(ChunkSize);
+    tinySQL_Randomness(ChunkSize, chunk.data());
+
+    //"plain" is the base vfs with no cipher,what the file system alone costs
+    for (const char *zImpl : {"plain", "vaes", "aesni", "portable"}) {
+        bool bPlain = strcmp(zImpl, "plain") == 0;
+        if (!bPlain && !XTSCipher::SetImplementation(zImpl)) {
+            printf("%-8s not supported\n", zImpl);
+            continue;
+        }
+        tinySQL_VFS *pVFS = bPlain ? vfs.pBase : &vfs;
+        long nByte = (strcmp(zImpl, "portable") == 0 ? std::min(nMB, PortableMaxMB) : nMB) * ChunkSize;
+
+        uint64_t start = Clock::Monotonic();
+        for (long done = 0; done < nByte && !bPlain; done += ChunkSize)
+            vfs.cipher.Encrypt(chunk.data(), ChunkSize, static_cast<unsigned long>(done / vfs.pageSize));
+        uint64_t cipherNs = Clock::Monotonic() - start;
+
+        pVFS->xDelete(path.c_str());
+        tinySQL_file *pFile;
+        int status = pVFS->xOpen(path.c_str(), &pFile, Open_Create | Open_ReadWrite, nullptr);
+        if (status != Succeed) {
+            fprintf(stderr, "can not open %s: %d\n", path.c_str(), status);
+            return 1;
+        }
+        start = Clock::Monotonic();
+        for (long done = 0; done < nByte && status == Succeed; done += ChunkSize)
+            status = pFile->xWrite(chunk.data(), ChunkSize, done);
+        uint64_t writeNs = Clock::Monotonic() - start;
+        start = Clock::Monotonic();
+        for (long done = 0; done < nByte && status == Succeed; done += ChunkSize)
+            status = pFile->xRead(chunk.data(), ChunkSize, done);
+        uint64_t readNs = Clock::Monotonic() - start;
+        pFile->xClose();
+        pVFS->xDelete(path.c_str());
+        if (status != Succeed) {
+            fprintf(stderr, "i/o failed on %s: %d\n", zImpl, status);
+            return 1;
+        }
+        printf("%-8s %4ld MB  cipher %7.3f GB/s  xWrite %7.3f GB/s  xRead %7.3f GB/s\n", zImpl,
+               nByte / ChunkSize, bPlain ? 0.0 : GBPerSecond(nByte, cipherNs), GBPerSecond(nByte, writeNs),
+               GBPerSecond(nByte, readNs));
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+//
+// Created by user on 26-10-19.
+//
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../tinySQL_Clock.h"
+#include "../tinySQL_BTree.h"
+#include "../tinySQL_SlowVFS.h"
+
+struct Connection {
+    std::vector<uint64_t> latencies;    //of the commits that went through,in ns
+    long nFailed = 0;
+    int status = tinySQL::Succeed;
+};
+
+static void Run(tinySQL::tinySQL_VFS *pVFS, const char *zPath, bool bWal, int busyMs, unsigned root,
+                int iThread, long nTxn, Connection *pConn) {
+    using namespace tinySQL;
+    Pager *pPager;
+    if ((pConn->status = Pager::Open(pVFS, zPath, 4096, &pPager)) != Succeed)
+        return;
+    pPager->busyTimeoutMs = busyMs;
+    if (bWal && (pConn->status = pPager->SetWalMode(true)) != Succeed) {
+        pPager->Close();
+        return;
+    }
+    BTree tree(pPager, root);
+    std::string value(100, 'v');
+    for (long i = 0; i < nTxn; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "%04d-%012ld", iThread, i);
+        uint64_t start = tinySQL::Clock::Monotonic();
+        int status = pPager->BeginWrite();
+        if (status == Succeed)
+            status = tree.Insert(key, static_cast<int>(strlen(key)), value.data(), static_cast<long>(value.size()));
+        if (status == Succeed)
+            status = pPager->Commit();
+        if (status != Succeed) {
+            pPager->Rollback();
+            pConn->nFailed++;
+            continue;
+        }
+        pConn->latencies.push_back(tinySQL::Clock::Monotonic() - start);
+    }
+    pPager->Close();
+}
+
+static double Percentile(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty())
+        return 0.0;
+    auto index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted[index]) / 1e3;
+}
+
+//usage: SlowCommitBench [-threads n] [-txn n] [-wal] [-dir directory] [-busy-ms n]
+//                       [-sync-us mean] [-stall-permille n] [-stall-us n] [-busy-permille n]
+//every thread opens its own connection and commits one small row per
+//transaction through a SlowVFS whose fsync takes an exponential time with the
+//given mean,and sometimes stalls.prints commits per second and the latency
+//percentiles,to compare commit and backoff changes under a slow device.a
+//transaction still busy after -busy-ms is rolled back and counted as failed
+int main(int argc, char **argv) {
+    using namespace tinySQL;
+    int nThread = 4;
+    long nTxn = 200;
+    bool bWal = false;
+    int busyMs = 1000;
+    const char *zDir = "/tmp";
+    SlowConfig config{};
+    config.sync = {Latency_Exponential, 100, 1000, 0, 0};
+    config.syncStallPermille = 5;
+    config.syncStallUs = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            nThread = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-txn") == 0 && i + 1 < argc)
+            nTxn = atol(argv[++i]);
+        else if (strcmp(argv[i], "-wal") == 0)
+            bWal = true;
+        else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+            zDir = argv[++i];
+        else if (strcmp(argv[i], "-busy-ms") == 0 && i + 1 < argc)
+            busyMs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-sync-us") == 0 && i + 1 < argc)
+            config.sync.meanUs = atol(argv[++i]);
+        else if (strcmp(argv[i], "-stall-permille") == 0 && i + 1 < argc)
+            config.syncStallPermille = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-stall-us") == 0 && i + 1 < argc)
+            config.syncStallUs = atol(argv[++i]);
+        else if (strcmp(argv[i], "-busy-permille") == 0 && i + 1 < argc)
+            config.busyPermille = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-threads n] [-txn n] [-wal] [-dir directory] [-busy-ms n] "
+                            "[-sync-us mean] [-stall-permille n] [-stall-us n] [-busy-permille n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SlowVFS vfs("slowCommitBench", tinySQL_VFS::VFSGet(0), config);
+    std::string path = std::string(zDir) + "/tinySQL-slow-commit-bench";
+    vfs.xDelete(path.c_str());
+    vfs.xDelete((path + "-wal").c_str());
+    Pager *pPager;
+    int status = Pager::Open(&vfs, path.c_str(), 4096, &pPager);
+    if (status != Succeed) {
+        fprintf(stderr, "can not open %s: %d\n", path.c_str(), status);
+        return 1;
+    }
+    unsigned root = 0;
+    if (bWal)
+        status = pPager->SetWalMode(true);
+    if (status == Succeed)
+        status = pPager->BeginWrite();
+    if (status == Succeed)
+        status = BTree::Create(pPager, &root);
+    if (status == Succeed)
+        status = pPager->Commit();
+    pPager->Close();
+    if (status != Succeed) {
+        fprintf(stderr, "can not create the table: %d\n", status);
+        return 1;
+    }
+
+    std::vector<Connection> connections(nThread);
+    std::vector<std::thread> threads;
+    uint64_t start = Clock::Monotonic();
+    for (int i = 0; i < nThread; i++)
+        threads.emplace_back(Run, &vfs, path.c_str(), bWal, busyMs, root, i, nTxn, &connections[i]);
+    for (auto &thread: threads)
+        thread.join();
+    uint64_t elapsed = Clock::Monotonic() - start;
+
+    std::vector<uint64_t> all;
+    long nFailed = 0;
+    for (auto &conn: connections) {
+        if (conn.status != Succeed) {
+            fprintf(stderr, "a connection failed to open: %d\n", conn.status);
+            return 1;
+        }
+        all.insert(all.end(), conn.latencies.begin(), conn.latencies.end());
+        nFailed += conn.nFailed;
+    }
+    std::sort(all.begin(), all.end());
+    printf("%s, %d threads, %zu commits, %ld failed, %.0f commits/s\n", bWal ? "wal" : "rollback", nThread,
+           all.size(), nFailed, static_cast<double>(all.size()) * 1e9 / static_cast<double>(elapsed));
+    printf("latency us  p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %.0f\n", Percentile(all, 0.5),
+           Percentile(all, 0.9), Percentile(all, 0.99), Percentile(all, 0.999), Percentile(all, 1.0));
+    vfs.xDelete(path.c_str());
+    vfs.xDelete((path + "-wal").c_str());
+    return 0;
+}
@@ -0,0 +1,44 @@
+//
+// Created by user on 26-10-19.
+//
+#include <cstdio>
+#include "../tinySQL_TraceVFS.h"
+
+//usage: TraceReplay <trace file> [-vfs name] [-dir directory] [-max]
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file> [-vfs name] [-dir directory] [-max]\n", argv[0]);
+        return 1;
+    }
+    const char *zVFS = "unixVFS";
+    tinySQL::ReplayOptions options{false, nullptr};
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-vfs") == 0 && i + 1 < argc)
+            zVFS = argv[++i];
+        else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+            options.zDir = argv[++i];
+        else if (strcmp(argv[i], "-max") == 0)
+            options.bMaxSpeed = true;
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    auto pVFS = tinySQL::tinySQL_VFS::VFSFind(zVFS);
+    if (pVFS == nullptr) {
+        fprintf(stderr, "no VFS named %s\n", zVFS);
+        return 1;
+    }
+    tinySQL::ReplayStats stats{};
+    int status = tinySQL::TraceReplay(pVFS, argv[1], options, &stats);
+    if (status != tinySQL::Succeed) {
+        fprintf(stderr, "can not replay %s: %d\n", argv[1], status);
+        return 1;
+    }
+    double seconds = static_cast<double>(stats.elapsedNs) / 1e9;
+    printf("ops %ld skipped %ld mismatched %ld\n", stats.nOp, stats.nSkipped, stats.nMismatch);
+    printf("read %ld bytes write %ld bytes in %.3f s (%.0f ops/s)\n", stats.nReadByte, stats.nWriteByte,
+           seconds, seconds > 0 ? static_cast<double>(stats.nOp) / seconds : 0.0);
+    return 0;
+}
@@ -0,0 +1,136 @@
+//
+// Created by user on 26-10-19.
+//
+#include <sched.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../tinySQL_Clock.h"
+#include "../tinySQL_Pager.h"
+#include "../tinySQL_Vector.h"
+
+//the query run on every batch: sum(c2) where c1 < 10,about a tenth of the rows pass
+static constexpr int64_t FilterBound = 10;
+
+static double MRowsPerSecond(long nRow, uint64_t ns) {
+    return ns ? static_cast<double>(nRow) * 1e3 / static_cast<double>(ns) : 0.0;
+}
+
+static int64_t Query(const tinySQL::ColumnBatch &batch) {
+    tinySQL::SelectionVector sel;
+    int n = tinySQL::VectorFilter(batch.columns[0], tinySQL::Cmp_Lt, FilterBound, nullptr, batch.nRow, &sel);
+    return tinySQL::VectorSum(batch.columns[1], &sel, n);
+}
+
+//usage: VectorBench [-rows n] [-dir directory] [-repeat n]
+//builds a table of four integer columns,then for every kernel set the cpu
+//has times the query over batches already in memory,and over a ColumnScan
+//of the table,on one core.the database goes to /dev/shm by default
+int main(int argc, char **argv) {
+    using namespace tinySQL;
+    long nRow = 2000000;
+    int nRepeat = 5;
+    const char *zDir = "/dev/shm";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-rows") == 0 && i + 1 < argc)
+            nRow = atol(argv[++i]);
+        else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+            zDir = argv[++i];
+        else if (strcmp(argv[i], "-repeat") == 0 && i + 1 < argc)
+            nRepeat = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-rows n] [-dir directory] [-repeat n]\n", argv[0]);
+            return 1;
+        }
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    tinySQL_VFS *pVFS = tinySQL_VFS::VFSGet(0);
+    std::string path = std::string(zDir) + "/tinySQL-vector-bench";
+    pVFS->xDelete(path.c_str());
+    Pager *pPager;
+    int status = Pager::Open(pVFS, path.c_str(), 4096, &pPager);
+    if (status != Succeed) {
+        fprintf(stderr, "can not open %s: %d\n", path.c_str(), status);
+        return 1;
+    }
+    unsigned root;
+    status = pPager->BeginWrite();
+    if (status == Succeed)
+        status = BTree::Create(pPager, &root);
+    BTree tree(pPager, root);
+    std::string row;
+    uint64_t seed = 88172645463325252ull;
+    for (long i = 0; i < nRow && status == Succeed; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        int64_t columns[4] = {i, static_cast<int64_t>(seed % 100), static_cast<int64_t>(seed >> 40), i * 3};
+        EncodeRow(columns, 4, &row);
+        char key[24];
+        snprintf(key, sizeof(key), "%012ld", i);
+        status = tree.Insert(key, 12, row.data(), static_cast<long>(row.size()));
+    }
+    if (status == Succeed)
+        status = pPager->Commit();
+    if (status != Succeed) {
+        fprintf(stderr, "can not build the table: %d\n", status);
+        return 1;
+    }
+
+    //the batches the in-memory runs go over
+    std::vector<ColumnBatch> batches;
+    ColumnScan load(&tree, {1, 2});
+    pPager->BeginRead();
+    for (;;) {
+        ColumnBatch batch;
+        if ((status = load.Next(&batch)) != Succeed || batch.nRow == 0)
+            break;
+        batches.push_back(std::move(batch));
+    }
+    pPager->EndRead();
+    if (status != Succeed) {
+        fprintf(stderr, "scan failed: %d\n", status);
+        return 1;
+    }
+
+    printf("%ld rows, %zu batches\n", nRow, batches.size());
+    for (const char *zImpl : {"avx512", "avx2", "scalar"}) {
+        if (!SetVectorImplementation(zImpl)) {
+            printf("%-7s not supported\n", zImpl);
+            continue;
+        }
+        int64_t memorySum = 0, scanSum = 0;
+        uint64_t start = Clock::Monotonic();
+        for (int r = 0; r < nRepeat; r++)
+            for (const ColumnBatch &batch: batches)
+                memorySum += Query(batch);
+        uint64_t memoryNs = Clock::Monotonic() - start;
+
+        start = Clock::Monotonic();
+        for (int r = 0; r < nRepeat && status == Succeed; r++) {
+            ColumnScan scan(&tree, {1, 2});
+            ColumnBatch batch;
+            pPager->BeginRead();
+            while ((status = scan.Next(&batch)) == Succeed && batch.nRow)
+                scanSum += Query(batch);
+            pPager->EndRead();
+        }
+        uint64_t scanNs = Clock::Monotonic() - start;
+        if (status != Succeed) {
+            fprintf(stderr, "scan failed: %d\n", status);
+            return 1;
+        }
+        printf("%-7s kernels %8.1f Mrows/s  scan+kernels %7.1f Mrows/s  sum %lld %s\n", zImpl,
+               MRowsPerSecond(nRow * nRepeat, memoryNs), MRowsPerSecond(nRow * nRepeat, scanNs),
+               static_cast<long long>(memorySum), memorySum == scanSum ? "" : "MISMATCH");
+    }
+    pPager->Close();
+    pVFS->xDelete(path.c_str());
+    return 0;
+}